@@ -132,6 +132,10 @@ struct luacwrap_Type
 {
   unsigned int              typeclass;  // type class
   const char*               name;       // name of type
+  unsigned int              align;      // required alignment of boxed objects
+                                        // in [bytes] (0 = default), added in
+                                        // C interface version 4 (changes the
+                                        // layout of all type descriptors)
 };
 
 //
@@ -220,11 +224,25 @@ typedef struct luacwrap_EmbeddedObject  luacwrap_EmbeddedObject;
 
 */////////////////////////////////////////////////////////////////////////
 #define LUACWRAP_DEFINESTRUCT(name)                     \
+        LUACWRAP_DEFINESTRUCT_ALIGNED(name, 0)
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  LUACWRAP_DEFINESTRUCT_ALIGNED
+
+  helper macro to create struct descriptors for types which boxed
+  objects require an alignment of the given number of bytes 
+  (power of two, e.g. 32 for AVX vectors)
+
+*/////////////////////////////////////////////////////////////////////////
+#define LUACWRAP_DEFINESTRUCT_ALIGNED(name, alignment)  \
 luacwrap_RecordType regType_##name =                    \
 {                                                       \
   {                                                     \
     LUACWRAP_TC_RECORD,                                 \
-    #name                                               \
+    #name,                                              \
+    alignment                                           \
   },                                                    \
   sizeof(name),                                         \
   s_member##name                                        \
@@ -239,11 +257,24 @@ luacwrap_RecordType regType_##name =                    \
 
 */////////////////////////////////////////////////////////////////////////
 #define LUACWRAP_DEFINEARRAY(elemtype, nelems)          \
+        LUACWRAP_DEFINEARRAY_ALIGNED(elemtype, nelems, 0)
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  LUACWRAP_DEFINEARRAY_ALIGNED
+
+  helper macro to create array descriptors for types which boxed
+  objects require an alignment of the given number of bytes
+
+*/////////////////////////////////////////////////////////////////////////
+#define LUACWRAP_DEFINEARRAY_ALIGNED(elemtype, nelems, alignment) \
 luacwrap_ArrayType regType_##elemtype##_##nelems =      \
 {                                                       \
   {                                                     \
     LUACWRAP_TC_ARRAY,                                  \
-    #elemtype"_"#nelems                                 \
+    #elemtype"_"#nelems,                                \
+    alignment                                           \
   },                                                    \
   nelems,                                               \
   sizeof(elemtype),                                     \
@@ -335,7 +366,10 @@ typedef void* (*luacwrap_checktype_t        )( lua_State*            L
 
 //
 // create a boxed object on the top of the Lua stack, use initval to fill memory
+// (LUACWRAP_NOINIT leaves the memory uninitialized)
 //
+#define LUACWRAP_NOINIT  (-0x7fffffff - 1)
+
 typedef void* (*luacwrap_pushboxedobj_t     )( lua_State*            L
                                              , luacwrap_Type*        desc
                                              , int                   initval);
@@ -381,8 +415,73 @@ typedef int (*luacwrap_mobj_copy_references_t   )(lua_State* L);
 //
 typedef void* (*luacwrap_mobj_getbaseptr_t      )(lua_State* L, int ud);
 
+//
+// create a boxed object which memory is allocated from the allocator at
+// stack index allocidx (luacwrap.arena or luacwrap.external) on the top 
+// of the Lua stack
+//
+typedef void* (*luacwrap_pushallocobj_t     )( lua_State*            L
+                                             , luacwrap_Type*        desc
+                                             , int                   initval
+                                             , int                   allocidx);
+
+//
+// allocator hooks used for external object memory (luacwrap.external),
+// the returned memory has to be aligned to align bytes (power of two)
+//
+typedef void* (*luacwrap_alloc_t            )( void*                 ud
+                                             , size_t                size
+                                             , size_t                align);
+typedef void  (*luacwrap_free_t             )( void*                 ud
+                                             , void*                 ptr
+                                             , size_t                size
+                                             , size_t                align);
+
+//
+// set allocator hooks of luacwrap.external (replaces luacwrap.external,
+// objects keep the allocator they have been allocated from)
+//
+typedef void (*luacwrap_setallocator_t      )( lua_State*            L
+                                             , luacwrap_alloc_t      allocfn
+                                             , luacwrap_free_t       freefn
+                                             , void*                 ud);
 
-#define LUACWARP_CINTERFACE_VERSION  2
+//
+// per type statistics (only collected if luacwrap is compiled 
+// with LUACWRAP_STATS defined)
+//
+typedef struct luacwrap_TypeStats
+{
+  size_t created;       // number of boxed objects created
+  size_t alive;         // number of boxed objects not yet collected
+  size_t bytes;         // object memory of alive boxed objects in [bytes]
+  size_t embedded;      // number of embedded object proxies created
+  size_t envtables;     // number of environment tables created
+  size_t refs;          // registry references taken by embedded proxies
+  size_t unrefs;        // registry references released by embedded proxies
+  size_t references;    // pointer references stored via mobj_set_reference
+} luacwrap_TypeStats;
+
+//
+// get statistics of a type (returns 0 if statistics are not available)
+//
+typedef int (*luacwrap_getstats_t           )( luacwrap_Type*        desc
+                                             , luacwrap_TypeStats*   stats);
+
+//
+// access to weak reference table (weak references do not keep 
+// the referenced value alive, getweakreference pushes nil and 
+// returns 0 if the value has been collected)
+//
+typedef int  (*luacwrap_createweakreference_t )(lua_State* L, int index);
+typedef int  (*luacwrap_getweakreference_t    )(lua_State* L, int handle);
+typedef void (*luacwrap_releaseweakreference_t)(lua_State* L, int handle);
+
+//
+// version 4 changed the layout of type descriptors (luacwrap_Type.align),
+// modules built against older versions have to be rebuilt
+//
+#define LUACWARP_CINTERFACE_VERSION  4
 
 #define LUACWARP_CINTERFACE_NAME     "c_interface"
 
@@ -426,5 +525,15 @@ typedef struct
   luacwrap_mobj_copy_references_t   mobjcopyreferences;
 
   luacwrap_mobj_getbaseptr_t        mobjgetbaseptr;
+
+  // v3
+  luacwrap_pushallocobj_t           pushallocobj;
+  luacwrap_setallocator_t           setallocator;
+  luacwrap_getstats_t               getstats;
+  luacwrap_createweakreference_t    createweakreference;
+  luacwrap_getweakreference_t       getweakreference;
+  luacwrap_releaseweakreference_t   releaseweakreference;
+
+  // v4 (no new functions, type descriptor header has the align member)
 } luacwrap_cinterface;
 
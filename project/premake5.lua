@@ -67,10 +67,31 @@ solution "luacwrap"
     { 
       "../include/*.h", 
       basepath .. "luacwrap.def", 
+      basepath .. "archive.h",
+      basepath .. "archive.c",
+      basepath .. "arena.h",
+      basepath .. "arena.c",
+      basepath .. "external.h",
+      basepath .. "external.c",
+      basepath .. "json.h",
+      basepath .. "json.c",
+      basepath .. "msgpack.h",
+      basepath .. "msgpack.c",
+      basepath .. "arrayindex.c",
+      basepath .. "arrayops.h",
+      basepath .. "arrayops.c",
       basepath .. "defconstants.c", 
       basepath .. "luacwrap.c",
       basepath .. "luaaux.h",
       basepath .. "luaaux.c", 
+      basepath .. "mapfile.h",
+      basepath .. "mapfile.c",
+      basepath .. "serialize.h",
+      basepath .. "serialize.c",
+      basepath .. "stats.h",
+      basepath .. "stats.c",
+      basepath .. "stream.h",
+      basepath .. "stream.c",
       basepath .. "wrapnumeric.h",
       basepath .. "wrapnumeric.c", 
       basepath .. "wrappointer.h",
@@ -0,0 +1,1175 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Self-describing record archives.
+
+  An archive stores an array of records together with the descriptors
+  of their type (names, sizes, member offsets and member types):
+
+      +---------------------+
+      | header              |   magic, byte order, record size/count, ...
+      +---------------------+
+      | type description    |   serialized type descriptors
+      +---------------------+
+      | checksums           |   CRC-32 of each block of records (optional)
+      +---------------------+
+      | padding             |   records start at an aligned file offset
+      +---------------------+
+      | records             |
+      +---------------------+
+
+  On load the stored description is compared with the registered type.
+  If both layouts are identical the records are mapped into memory
+  without copying. Otherwise they are read and converted member by
+  member: members are matched by name, basic types of a different kind
+  are converted through their get/set wrappers, arrays and buffers are
+  truncated to the smaller size and members missing in the archive are
+  left zero.
+
+  Archives are written in native byte order, loading an archive written
+  on a platform of the other byte order raises an error.
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "luaaux.h"
+#include "archive.h"
+#include "mapfile.h"
+#include "serialize.h"
+
+// file identification
+#define ARCHIVE_MAGIC           "LCWARCH1"
+
+// written in native byte order to detect foreign archives
+#define ARCHIVE_BYTEORDER       0x01020304
+
+// current format version
+#define ARCHIVE_VERSION         1
+
+// default number of records per checksum block
+#define ARCHIVE_DEFAULT_BLOCK   4096
+
+// minimal alignment of the records within the file
+#define ARCHIVE_DATA_ALIGN      64
+
+// maximal nesting depth of stored type descriptions
+#define ARCHIVE_MAX_DEPTH       32
+
+// access modes of loaded archives (same as luacwrap.mmap())
+static const char* const s_archiveModes[] = { "r", "w", "c", NULL };
+
+//
+// archive file header (native byte order)
+//
+typedef struct archive_Header
+{
+  char    magic[8];         // ARCHIVE_MAGIC
+  UINT32  byteorder;        // ARCHIVE_BYTEORDER
+  UINT32  version;          // ARCHIVE_VERSION
+  UINT32  desclen;          // size of the type description
+  UINT32  nblocks;          // number of checksums (0 = no checksums)
+  UINT32  blockrecords;     // number of records per checksum block
+  UINT32  count;            // number of records
+  UINT32  recsize;          // size of a record
+  UINT32  dataoffset;       // file offset of the first record
+} archive_Header;
+
+//
+// file handle, closed when collected (so errors do not leak it)
+//
+typedef struct archive_File
+{
+  FILE*   f;
+} archive_File;
+
+//
+// conversion step from a stored record into a registered record
+//
+typedef struct archive_Op
+{
+  size_t              srcoffset;  // offset within the stored record
+  size_t              dstoffset;  // offset within the registered record
+  size_t              size;       // number of bytes to copy/read
+  luacwrap_BasicType* srctype;    // stored basic type (NULL = plain copy)
+  luacwrap_BasicType* dsttype;    // registered basic type
+} archive_Op;
+
+//
+// list of conversion steps
+//
+typedef struct archive_Plan
+{
+  int                 idx;        // stack index of the userdata holding ops
+  archive_Op*         ops;        // conversion steps
+  int                 nops;       // number of conversion steps
+  int                 maxops;     // capacity of ops
+  size_t              srcsize;    // size of a stored record
+  archive_Op          pending;    // last step, extended by adjacent copies
+} archive_Plan;
+
+//
+// read position within a stored type description
+//
+typedef struct archive_Cursor
+{
+  const BYTE*         p;          // next byte
+  const BYTE*         end;        // end of the type description
+  const char*         path;       // archive file name (for error messages)
+} archive_Cursor;
+
+// CRC-32 lookup table (built on first use)
+static UINT32 s_crcTable[256];
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Computes the CRC-32 (IEEE 802.3) of a memory block.
+
+  @param[in]  crc   CRC of the preceding data (0 for the first block)
+  @param[in]  p     data
+  @param[in]  len   number of bytes
+
+*/////////////////////////////////////////////////////////////////////////
+static UINT32 archive_crc32(UINT32 crc, const BYTE* p, size_t len)
+{
+  if (0 == s_crcTable[1])
+  {
+    UINT32 n;
+    for (n = 0; n < 256; n++)
+    {
+      UINT32 c = n;
+      int k;
+      for (k = 0; k < 8; k++)
+      {
+        c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+      }
+      s_crcTable[n] = c;
+    }
+  }
+
+  crc = ~crc;
+  while (len--)
+  {
+    crc = s_crcTable[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements __gc of archive file handles.
+
+*/////////////////////////////////////////////////////////////////////////
+static int archive_gcfile(lua_State* L)
+{
+  archive_File* af = (archive_File*)lua_touserdata(L, 1);
+  if (NULL != af->f)
+  {
+    fclose(af->f);
+    af->f = NULL;
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Opens a file and pushes its handle onto the stack. The file is closed
+  by archive_close() or when the handle is collected.
+
+*/////////////////////////////////////////////////////////////////////////
+static FILE* archive_open(lua_State* L, const char* path, const char* mode)
+{
+  archive_File* af;
+
+  af = (archive_File*)lua_newuserdata(L, sizeof(archive_File));
+  af->f = NULL;
+  lua_pushlightuserdata(L, (void*)g_mtArchiveFile);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  lua_setmetatable(L, -2);
+
+  af->f = fopen(path, mode);
+  if (NULL == af->f)
+  {
+    luaL_error(L, "luacwrap: could not open archive <%s>: %s", path, strerror(errno));
+  }
+  return af->f;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Closes the file of a handle pushed by archive_open().
+
+  @return 1 on success, 0 if closing failed (e.g. buffered data could
+          not be written)
+
+*/////////////////////////////////////////////////////////////////////////
+static int archive_close(lua_State* L, int idx)
+{
+  archive_File* af = (archive_File*)lua_touserdata(L, idx);
+  int result = 1;
+
+  if (NULL != af->f)
+  {
+    result = (0 == fclose(af->f));
+    af->f = NULL;
+  }
+  return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends an unsigned 32 bit value to a type description.
+
+*/////////////////////////////////////////////////////////////////////////
+static void archive_putu32(luaL_Buffer* b, UINT32 value)
+{
+  luaL_addlstring(b, (const char*)&value, sizeof(value));
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a length prefixed string to a type description.
+
+*/////////////////////////////////////////////////////////////////////////
+static void archive_putstr(luaL_Buffer* b, const char* s)
+{
+  size_t len = s ? strlen(s) : 0;
+
+  archive_putu32(b, (UINT32)len);
+  if (len > 0)
+  {
+    luaL_addlstring(b, s, len);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends the description of a type to a type description.
+
+    - typeclass   (byte)
+    - name        (string)
+    - size        (u32)
+    - records:    member count (u32), then name (string),
+                  offset (u32) and type description of each member
+    - arrays:     element count (u32), element size (u32) and
+                  type description of the elements
+
+*/////////////////////////////////////////////////////////////////////////
+static void archive_putdesc(lua_State* L, luaL_Buffer* b, luacwrap_Type* desc)
+{
+  luaL_addchar(b, (char)desc->typeclass);
+  archive_putstr(b, desc->name);
+  archive_putu32(b, (UINT32)luacwrap_type_size(desc));
+
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_RECORD:
+    {
+      luacwrap_RecordMember* member = ((luacwrap_RecordType*)desc)->members;
+      UINT32 nmembers = 0;
+
+      while (member[nmembers].membername)
+      {
+        nmembers++;
+      }
+      archive_putu32(b, nmembers);
+
+      for (; member->membername; member++)
+      {
+        archive_putstr(b, member->membername);
+        archive_putu32(b, member->memberoffset);
+        archive_putdesc(L, b, luacwrap_getmembertype(L, member));
+      }
+      break;
+    }
+    case LUACWRAP_TC_ARRAY:
+    {
+      luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+
+      archive_putu32(b, arrdesc->elemcount);
+      archive_putu32(b, arrdesc->elemsize);
+      archive_putdesc(L, b, luacwrap_getelemtype(L, arrdesc));
+      break;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Reads raw bytes from a stored type description.
+
+*/////////////////////////////////////////////////////////////////////////
+static const BYTE* archive_getbytes(lua_State* L, archive_Cursor* c, size_t len)
+{
+  const BYTE* result = c->p;
+
+  if ((size_t)(c->end - c->p) < len)
+  {
+    luaL_error(L, "luacwrap: archive <%s> has a corrupt type description", c->path);
+  }
+  c->p += len;
+  return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Reads an unsigned 32 bit value from a stored type description.
+
+*/////////////////////////////////////////////////////////////////////////
+static UINT32 archive_getu32(lua_State* L, archive_Cursor* c)
+{
+  UINT32 value;
+
+  memcpy(&value, archive_getbytes(L, c, sizeof(value)), sizeof(value));
+  return value;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Reads a string from a stored type description and pushes it.
+
+*/////////////////////////////////////////////////////////////////////////
+static void archive_getstr(lua_State* L, archive_Cursor* c)
+{
+  UINT32 len = archive_getu32(L, c);
+
+  lua_pushlstring(L, (const char*)archive_getbytes(L, c, len), len);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Reads a stored type description and pushes it as a table
+  { class, name, size, members = { { name, offset, type }, ... } }
+  or { class, name, size, count, elemsize, elem } for arrays.
+
+*/////////////////////////////////////////////////////////////////////////
+static void archive_getdesc(lua_State* L, archive_Cursor* c, int depth)
+{
+  int typeclass;
+
+  if (depth > ARCHIVE_MAX_DEPTH)
+  {
+    luaL_error(L, "luacwrap: archive <%s> has a corrupt type description", c->path);
+  }
+  luaL_checkstack(L, 4, "type description nested too deep");
+
+  lua_createtable(L, 0, 6);
+
+  typeclass = *archive_getbytes(L, c, 1);
+  lua_pushinteger(L, typeclass);
+  lua_setfield(L, -2, "class");
+  archive_getstr(L, c);
+  lua_setfield(L, -2, "name");
+  lua_pushinteger(L, archive_getu32(L, c));
+  lua_setfield(L, -2, "size");
+
+  switch (typeclass)
+  {
+    case LUACWRAP_TC_BASIC:
+    case LUACWRAP_TC_BUFFER:
+      break;
+
+    case LUACWRAP_TC_RECORD:
+    {
+      UINT32 nmembers = archive_getu32(L, c);
+      UINT32 n;
+
+      // each member takes at least 13 bytes
+      if (nmembers > (size_t)(c->end - c->p) / 13)
+      {
+        luaL_error(L, "luacwrap: archive <%s> has a corrupt type description", c->path);
+      }
+
+      lua_createtable(L, (int)nmembers, 0);
+      for (n = 1; n <= nmembers; n++)
+      {
+        lua_createtable(L, 0, 3);
+        archive_getstr(L, c);
+        lua_setfield(L, -2, "name");
+        lua_pushinteger(L, archive_getu32(L, c));
+        lua_setfield(L, -2, "offset");
+        archive_getdesc(L, c, depth + 1);
+        lua_setfield(L, -2, "type");
+        lua_rawseti(L, -2, n);
+      }
+      lua_setfield(L, -2, "members");
+      break;
+    }
+
+    case LUACWRAP_TC_ARRAY:
+      lua_pushinteger(L, archive_getu32(L, c));
+      lua_setfield(L, -2, "count");
+      lua_pushinteger(L, archive_getu32(L, c));
+      lua_setfield(L, -2, "elemsize");
+      archive_getdesc(L, c, depth + 1);
+      lua_setfield(L, -2, "elem");
+      break;
+
+    default:
+      luaL_error(L, "luacwrap: archive <%s> has a corrupt type description", c->path);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Gets an integer field of a stored type description.
+
+*/////////////////////////////////////////////////////////////////////////
+static size_t archive_getsize(lua_State* L, int node, const char* field)
+{
+  size_t result;
+
+  lua_getfield(L, node, field);
+  result = (size_t)lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Looks up a registered basic type by name (NULL if there is none).
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_BasicType* archive_findbasictype(lua_State* L, const char* name)
+{
+  luacwrap_Type* desc = NULL;
+
+  LUASTACK_SET(L);
+
+  getmoduletable(L);
+  lua_getfield(L, -1, "types");
+  lua_getfield(L, -1, name);
+  if (lua_isuserdata(L, -1))
+  {
+    desc = (luacwrap_Type*)lua_touserdata(L, -1);
+  }
+  lua_pop(L, 3);
+
+  LUASTACK_CLEAN(L, 0);
+  return (desc && (LUACWRAP_TC_BASIC == desc->typeclass)) ? (luacwrap_BasicType*)desc : NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Stores the pending conversion step of a plan.
+
+*/////////////////////////////////////////////////////////////////////////
+static void archive_flushop(lua_State* L, archive_Plan* plan)
+{
+  if (0 == plan->pending.size)
+  {
+    return;
+  }
+
+  if (plan->nops == plan->maxops)
+  {
+    // grow step list (replaces the userdata holding the steps)
+    int maxops = plan->maxops * 2;
+    archive_Op* ops = (archive_Op*)lua_newuserdata(L, maxops * sizeof(archive_Op));
+    memcpy(ops, plan->ops, plan->nops * sizeof(archive_Op));
+    lua_replace(L, plan->idx);
+    plan->ops    = ops;
+    plan->maxops = maxops;
+  }
+  plan->ops[plan->nops++] = plan->pending;
+  plan->pending.size = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Adds a conversion step to a plan. Plain copies of adjacent memory
+  are merged into one step.
+
+*/////////////////////////////////////////////////////////////////////////
+static void archive_addop( lua_State*           L
+                         , archive_Plan*        plan
+                         , size_t               srcoffset
+                         , size_t               dstoffset
+                         , size_t               size
+                         , luacwrap_BasicType*  srctype
+                         , luacwrap_BasicType*  dsttype)
+{
+  archive_Op* last = &plan->pending;
+
+  if ((srcoffset > plan->srcsize) || (size > plan->srcsize - srcoffset))
+  {
+    luaL_error(L, "luacwrap: archive has a corrupt type description (member outside of record)");
+  }
+
+  if (  (0 != last->size) && (NULL == last->srctype) && (NULL == srctype)
+     && (last->srcoffset + last->size == srcoffset)
+     && (last->dstoffset + last->size == dstoffset))
+  {
+    last->size += size;
+    return;
+  }
+
+  archive_flushop(L, plan);
+  last->srcoffset = srcoffset;
+  last->dstoffset = dstoffset;
+  last->size      = size;
+  last->srctype   = srctype;
+  last->dsttype   = dsttype;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Adds the conversion steps from a stored type description to a
+  registered type. Parts which do not match are skipped (left zero).
+
+  @param[in]  node      stack index of the stored type description
+  @param[in]  desc      registered type
+  @param[in]  srcoffset offset of the stored object within the record
+  @param[in]  dstoffset offset of the registered object within the record
+
+*/////////////////////////////////////////////////////////////////////////
+static void archive_plan( lua_State*        L
+                        , archive_Plan*     plan
+                        , int               node
+                        , luacwrap_Type*    desc
+                        , size_t            srcoffset
+                        , size_t            dstoffset)
+{
+  size_t srcsize;
+  size_t dstsize;
+
+  LUASTACK_SET(L);
+
+  node = abs_index(L, node);
+  if (archive_getsize(L, node, "class") != desc->typeclass)
+  {
+    return;
+  }
+  srcsize = archive_getsize(L, node, "size");
+  dstsize = luacwrap_type_size(desc);
+
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC:
+    {
+      luacwrap_BasicType* srctype;
+      const char* name;
+
+      // pointers and references are meaningless within a file
+      if (luacwrap_type_hasrefs(L, desc))
+      {
+        break;
+      }
+
+      lua_getfield(L, node, "name");
+      name = lua_tostring(L, -1);
+      if ((0 == strcmp(name, desc->name)) && (srcsize == dstsize))
+      {
+        archive_addop(L, plan, srcoffset, dstoffset, dstsize, NULL, NULL);
+      }
+      else
+      {
+        // convert through the wrappers of the stored type
+        srctype = archive_findbasictype(L, name);
+        if (  srctype && (srctype->size == srcsize)
+           && !luacwrap_type_hasrefs(L, (luacwrap_Type*)srctype))
+        {
+          archive_addop(L, plan, srcoffset, dstoffset, srcsize, srctype, (luacwrap_BasicType*)desc);
+        }
+      }
+      lua_pop(L, 1);
+      break;
+    }
+
+    case LUACWRAP_TC_BUFFER:
+      archive_addop(L, plan, srcoffset, dstoffset, (srcsize < dstsize) ? srcsize : dstsize, NULL, NULL);
+      break;
+
+    case LUACWRAP_TC_RECORD:
+    {
+      luacwrap_RecordMember* member = ((luacwrap_RecordType*)desc)->members;
+      int nmembers;
+      int n;
+
+      lua_getfield(L, node, "members");
+#if (LUA_VERSION_NUM > 501)
+      nmembers = (int)lua_rawlen(L, -1);
+#else
+      nmembers = (int)lua_objlen(L, -1);
+#endif
+
+      // match members by name
+      for (; member->membername; member++)
+      {
+        for (n = 1; n <= nmembers; n++)
+        {
+          lua_rawgeti(L, -1, n);
+          lua_getfield(L, -1, "name");
+          if (0 == strcmp(lua_tostring(L, -1), member->membername))
+          {
+            size_t offset = archive_getsize(L, -2, "offset");
+
+            lua_getfield(L, -2, "type");
+            archive_plan(L, plan, -1, luacwrap_getmembertype(L, member)
+              , srcoffset + offset, dstoffset + member->memberoffset);
+            lua_pop(L, 3);
+            break;
+          }
+          lua_pop(L, 2);
+        }
+      }
+      lua_pop(L, 1);
+      break;
+    }
+
+    case LUACWRAP_TC_ARRAY:
+    {
+      luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+      luacwrap_Type* elemdesc = luacwrap_getelemtype(L, arrdesc);
+      size_t count    = archive_getsize(L, node, "count");
+      size_t elemsize = archive_getsize(L, node, "elemsize");
+      size_t n;
+
+      if (count > arrdesc->elemcount)
+      {
+        count = arrdesc->elemcount;
+      }
+
+      lua_getfield(L, node, "elem");
+      for (n = 0; n < count; n++)
+      {
+        archive_plan(L, plan, -1, elemdesc, srcoffset + n * elemsize, dstoffset + n * arrdesc->elemsize);
+      }
+      lua_pop(L, 1);
+      break;
+    }
+  }
+
+  LUASTACK_CLEAN(L, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Converts a stored record into a registered record.
+
+*/////////////////////////////////////////////////////////////////////////
+static void archive_convert(lua_State* L, archive_Plan* plan, PBYTE src, PBYTE dst)
+{
+  archive_Op* op  = plan->ops;
+  archive_Op* end = plan->ops + plan->nops;
+
+  for (; op < end; op++)
+  {
+    if (NULL == op->srctype)
+    {
+      memcpy(dst + op->dstoffset, src + op->srcoffset, op->size);
+    }
+    else
+    {
+      op->srctype->getWrapper(op->srctype, L, src + op->srcoffset, (int)op->srcoffset);
+      op->dsttype->setWrapper(op->dsttype, L, dst + op->dstoffset, (int)op->dstoffset);
+      lua_pop(L, 1);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Gets the type descriptor from a type table argument.
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_Type* archive_checktype(lua_State* L, int idx)
+{
+  luacwrap_Type* desc;
+
+  luaL_checktype(L, idx, LUA_TTABLE);
+  lua_getfield(L, idx, "$desc");
+  if (lua_isnil(L, -1))
+  {
+    luaL_argerror(L, idx, "type expected");
+  }
+  desc = (luacwrap_Type*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  luaL_argcheck(L, luacwrap_type_size(desc) > 0, idx, "type without size");
+  return desc;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Writes records together with the description of their type into
+  an archive file. Pointer and reference members are written as zero.
+
+  Parameters on lua stack:
+    - path    (file name)
+    - TYPE    (type table of the records)
+    - objs    (table of TYPE objects or array object of TYPE elements)
+    - opts    (optional table:
+                checksum      = false to omit block checksums,
+                blockrecords  = number of records per checksum block
+                                (default 4096))
+
+  Return values on lua stack
+    - number of written records
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_savearchive(lua_State* L)
+{
+  static const BYTE s_zero[ARCHIVE_DATA_ALIGN] = { 0 };
+
+  const char* path;
+  luacwrap_Type* desc;
+  luacwrap_Type* objdesc;
+  archive_Header hdr;
+  const char* desctext;
+  size_t desclen;
+  size_t recsize;
+  size_t align;
+  size_t count;
+  size_t blockrecords;
+  size_t nblocks;
+  size_t pad;
+  size_t first;
+  size_t n;
+  size_t i;
+  PBYTE base = NULL;
+  PBYTE* ptrs = NULL;
+  PBYTE temp = NULL;
+  UINT32* crcs;
+  int checksums = 1;
+  int hasrefs;
+  int fidx;
+  int ok;
+  FILE* f;
+
+  path    = luaL_checkstring(L, 1);
+  desc    = archive_checktype(L, 2);
+  recsize = luacwrap_type_size(desc);
+
+  // options
+  blockrecords = ARCHIVE_DEFAULT_BLOCK;
+  if (lua_istable(L, 4))
+  {
+    lua_getfield(L, 4, "checksum");
+    if (!lua_isnil(L, -1))
+    {
+      checksums = lua_toboolean(L, -1);
+    }
+    lua_getfield(L, 4, "blockrecords");
+    if (!lua_isnil(L, -1))
+    {
+      lua_Integer value = luaL_checkinteger(L, -1);
+      luaL_argcheck(L, (value > 0) && (value <= INT_MAX), 4, "blockrecords out of range");
+      blockrecords = (size_t)value;
+    }
+    lua_pop(L, 2);
+  }
+
+  // collect records
+  if (lua_istable(L, 3))
+  {
+#if (LUA_VERSION_NUM > 501)
+    count = lua_rawlen(L, 3);
+#else
+    count = lua_objlen(L, 3);
+#endif
+    ptrs  = (PBYTE*)lua_newuserdata(L, (count ? count : 1) * sizeof(PBYTE));
+    for (i = 0; i < count; i++)
+    {
+      lua_rawgeti(L, 3, (int)(i + 1));
+      if (desc != luacwrap_getdescriptor(L, -1))
+      {
+        luaL_error(L, "luacwrap: element %d of objs is not of type <%s>", (int)(i + 1), desc->name);
+      }
+      ptrs[i] = (PBYTE)luacwrap_mobj_getbaseptr(L, -1);
+      lua_pop(L, 1);
+    }
+  }
+  else
+  {
+    objdesc = luacwrap_getdescriptor(L, 3);
+    if (  (NULL == objdesc) || (LUACWRAP_TC_ARRAY != objdesc->typeclass)
+       || (desc != luacwrap_getelemtype(L, (luacwrap_ArrayType*)objdesc)))
+    {
+      luaL_argerror(L, 3, "table or array of TYPE expected");
+    }
+    count = ((luacwrap_ArrayType*)objdesc)->elemcount;
+    base  = (PBYTE)luacwrap_mobj_getbaseptr(L, 3);
+  }
+  luaL_argcheck(L, count <= (INT_MAX / recsize), 3, "too many records");
+
+  hasrefs = luacwrap_type_hasrefs(L, desc);
+  if (hasrefs)
+  {
+    temp = (PBYTE)lua_newuserdata(L, recsize);
+  }
+
+  if (!checksums)
+  {
+    blockrecords = count ? count : 1;
+  }
+  nblocks = checksums ? (count + blockrecords - 1) / blockrecords : 0;
+  crcs    = (UINT32*)lua_newuserdata(L, (nblocks ? nblocks : 1) * sizeof(UINT32));
+
+  // type description
+  {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    archive_putdesc(L, &b, desc);
+    luaL_pushresult(&b);
+  }
+  desctext = lua_tolstring(L, -1, &desclen);
+
+  // records start behind the checksums at an aligned offset
+  align = luacwrap_type_align(L, desc);
+  if (align < ARCHIVE_DATA_ALIGN)
+  {
+    align = ARCHIVE_DATA_ALIGN;
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, ARCHIVE_MAGIC, sizeof(hdr.magic));
+  hdr.byteorder     = ARCHIVE_BYTEORDER;
+  hdr.version       = ARCHIVE_VERSION;
+  hdr.desclen       = (UINT32)desclen;
+  hdr.nblocks       = (UINT32)nblocks;
+  hdr.blockrecords  = (UINT32)blockrecords;
+  hdr.count         = (UINT32)count;
+  hdr.recsize       = (UINT32)recsize;
+  hdr.dataoffset    = (UINT32)((sizeof(hdr) + desclen + nblocks * sizeof(UINT32) + align - 1) & ~(align - 1));
+
+  f = archive_open(L, path, "wb");
+  fidx = lua_gettop(L);
+
+  // checksums are written after the records are known
+  ok =  (1 == fwrite(&hdr, sizeof(hdr), 1, f))
+     && (1 == fwrite(desctext, desclen, 1, f))
+     && (0 == fseek(f, hdr.dataoffset, SEEK_SET));
+
+  for (first = 0; ok && (first < count); first += n)
+  {
+    UINT32 crc = 0;
+
+    n = count - first;
+    if (n > blockrecords)
+    {
+      n = blockrecords;
+    }
+
+    if (base && !hasrefs)
+    {
+      // contiguous records without references are written at once
+      PBYTE p = base + first * recsize;
+      ok = (n == fwrite(p, recsize, n, f));
+      crc = archive_crc32(crc, p, n * recsize);
+    }
+    else
+    {
+      for (i = first; ok && (i < first + n); i++)
+      {
+        PBYTE p = ptrs ? ptrs[i] : base + i * recsize;
+        if (hasrefs)
+        {
+          memcpy(temp, p, recsize);
+          luacwrap_applyrefpolicy(L, desc, temp, LUACWRAP_REFS_ZERO);
+          p = temp;
+        }
+        ok = (1 == fwrite(p, recsize, 1, f));
+        crc = archive_crc32(crc, p, recsize);
+      }
+    }
+    if (checksums)
+    {
+      crcs[first / blockrecords] = crc;
+    }
+  }
+
+  if (ok && nblocks)
+  {
+    ok =  (0 == fseek(f, (long)(sizeof(hdr) + desclen), SEEK_SET))
+       && (nblocks == fwrite(crcs, sizeof(UINT32), nblocks, f));
+  }
+
+  // zero padding (fseek may leave a hole)
+  pad = hdr.dataoffset - (sizeof(hdr) + desclen + nblocks * sizeof(UINT32));
+  if (ok && pad)
+  {
+    ok = (0 == fseek(f, (long)(hdr.dataoffset - pad), SEEK_SET));
+    while (ok && pad)
+    {
+      n = (pad < sizeof(s_zero)) ? pad : sizeof(s_zero);
+      ok = (1 == fwrite(s_zero, n, 1, f));
+      pad -= n;
+    }
+  }
+
+  ok = archive_close(L, fidx) && ok;
+  if (!ok)
+  {
+    luaL_error(L, "luacwrap: could not write archive <%s>", path);
+  }
+
+  lua_pushinteger(L, (lua_Integer)count);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Loads the records of an archive file as an array of the registered
+  type. If the stored layout equals the registered one the file is
+  mapped into memory (zero copy), otherwise the records are converted
+  into a new boxed array.
+
+  Parameters on lua stack:
+    - path    (file name)
+    - TYPE    (type table of the records)
+    - opts    (optional table:
+                verify  = false to skip checking the block checksums,
+                mode    = access mode of mapped arrays ("r" = read-only
+                          (default), "w" = read-write shared,
+                          "c" = copy-on-write),
+                copy    = true to always read into a boxed array)
+
+  Return values on lua stack
+    - array of records
+    - true if the array maps the file, false if it holds a copy
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_loadarchive(lua_State* L)
+{
+  const char* path;
+  luacwrap_Type* desc;
+  archive_Header hdr;
+  archive_Cursor cursor;
+  archive_Plan plan;
+  PBYTE desctext;
+  PBYTE buffer;
+  PBYTE dst;
+  UINT32* crcs = NULL;
+  size_t dstsize;
+  size_t count;
+  size_t chunk;
+  size_t first;
+  size_t n;
+  size_t i;
+  int verify = 1;
+  int copy = 0;
+  int mode = LUACWRAP_MAP_READ;
+  int identical;
+  int fidx;
+  int nodeidx;
+  FILE* f;
+
+  path    = luaL_checkstring(L, 1);
+  desc    = archive_checktype(L, 2);
+  dstsize = luacwrap_type_size(desc);
+
+  // options
+  if (lua_istable(L, 3))
+  {
+    lua_getfield(L, 3, "verify");
+    if (!lua_isnil(L, -1))
+    {
+      verify = lua_toboolean(L, -1);
+    }
+    lua_getfield(L, 3, "copy");
+    copy = lua_toboolean(L, -1);
+    lua_getfield(L, 3, "mode");
+    if (!lua_isnil(L, -1))
+    {
+      const char* name = lua_tostring(L, -1);
+      for (mode = 0; s_archiveModes[mode]; mode++)
+      {
+        if (name && (0 == strcmp(name, s_archiveModes[mode])))
+        {
+          break;
+        }
+      }
+      if (NULL == s_archiveModes[mode])
+      {
+        luaL_argerror(L, 3, "invalid mode (\"r\", \"w\" or \"c\" expected)");
+      }
+    }
+    lua_pop(L, 3);
+  }
+
+  f = archive_open(L, path, "rb");
+  fidx = lua_gettop(L);
+
+  // header
+  if (  (1 != fread(&hdr, sizeof(hdr), 1, f))
+     || (0 != memcmp(hdr.magic, ARCHIVE_MAGIC, sizeof(hdr.magic))))
+  {
+    luaL_error(L, "luacwrap: <%s> is not a luacwrap archive", path);
+  }
+  if (ARCHIVE_BYTEORDER != hdr.byteorder)
+  {
+    luaL_error(L, "luacwrap: archive <%s> was written with a different byte order", path);
+  }
+  if (ARCHIVE_VERSION != hdr.version)
+  {
+    luaL_error(L, "luacwrap: archive <%s> has unsupported version %d", path, (int)hdr.version);
+  }
+  if (  (0 == hdr.recsize) || (0 == hdr.blockrecords)
+     || (hdr.count > INT_MAX / hdr.recsize)
+     || ((0 != hdr.nblocks) && (hdr.nblocks != (hdr.count + hdr.blockrecords - 1) / hdr.blockrecords))
+     || (hdr.dataoffset < sizeof(hdr) + (size_t)hdr.desclen + hdr.nblocks * sizeof(UINT32)))
+  {
+    luaL_error(L, "luacwrap: archive <%s> has a corrupt header", path);
+  }
+  count = hdr.count;
+  if (count > INT_MAX / dstsize)
+  {
+    luaL_error(L, "luacwrap: archive <%s> holds too many records for type <%s>", path, desc->name);
+  }
+
+  // type description
+  desctext = (PBYTE)lua_newuserdata(L, hdr.desclen ? hdr.desclen : 1);
+  if (1 != fread(desctext, hdr.desclen, 1, f))
+  {
+    luaL_error(L, "luacwrap: archive <%s> is truncated", path);
+  }
+  cursor.p    = desctext;
+  cursor.end  = desctext + hdr.desclen;
+  cursor.path = path;
+  archive_getdesc(L, &cursor, 0);
+  nodeidx = lua_gettop(L);
+  if (archive_getsize(L, nodeidx, "size") != hdr.recsize)
+  {
+    luaL_error(L, "luacwrap: archive <%s> has a corrupt type description", path);
+  }
+
+  // checksums
+  if (hdr.nblocks)
+  {
+    crcs = (UINT32*)lua_newuserdata(L, hdr.nblocks * sizeof(UINT32));
+    if (hdr.nblocks != fread(crcs, sizeof(UINT32), hdr.nblocks, f))
+    {
+      luaL_error(L, "luacwrap: archive <%s> is truncated", path);
+    }
+  }
+  verify = verify && crcs;
+
+  // compare stored with registered layout
+  memset(&plan, 0, sizeof(plan));
+  plan.maxops  = 16;
+  plan.ops     = (archive_Op*)lua_newuserdata(L, plan.maxops * sizeof(archive_Op));
+  plan.idx     = lua_gettop(L);
+  plan.srcsize = hdr.recsize;
+  archive_plan(L, &plan, nodeidx, desc, 0, 0);
+  archive_flushop(L, &plan);
+
+  // layouts are identical if the descriptions are, also with padding
+  // or pointer members which are not covered by the plan
+  {
+    luaL_Buffer b;
+    const char* text;
+    size_t len;
+
+    luaL_buffinit(L, &b);
+    archive_putdesc(L, &b, desc);
+    luaL_pushresult(&b);
+    text = lua_tolstring(L, -1, &len);
+    identical =  (hdr.recsize == dstsize) && (hdr.desclen == len)
+              && (0 == memcmp(desctext, text, len));
+    lua_pop(L, 1);
+  }
+
+  if (identical && !copy && (count > 0))
+  {
+    // zero copy
+    archive_close(L, fidx);
+    dst = (PBYTE)luacwrap_pushmappedarray(L, path, desc, count, mode, hdr.dataoffset);
+
+    for (first = 0; verify && (first < count); first += n)
+    {
+      n = count - first;
+      if (n > hdr.blockrecords)
+      {
+        n = hdr.blockrecords;
+      }
+      if (crcs[first / hdr.blockrecords] != archive_crc32(0, dst + first * dstsize, n * dstsize))
+      {
+        luaL_error(L, "luacwrap: checksum mismatch in block %d of archive <%s>", (int)(first / hdr.blockrecords), path);
+      }
+    }
+    lua_pushboolean(L, 1);
+    return 2;
+  }
+
+  // read and convert blocks of records
+  chunk = crcs ? hdr.blockrecords : ARCHIVE_DEFAULT_BLOCK;
+  if (chunk > count)
+  {
+    chunk = count;
+  }
+  buffer = (PBYTE)lua_newuserdata(L, chunk ? chunk * hdr.recsize : 1);
+  dst    = (PBYTE)luacwrap_pushnewarray(L, desc, (int)count);
+
+  if (0 != fseek(f, (long)hdr.dataoffset, SEEK_SET))
+  {
+    luaL_error(L, "luacwrap: archive <%s> is truncated", path);
+  }
+
+  for (first = 0; first < count; first += n)
+  {
+    n = count - first;
+    if (n > chunk)
+    {
+      n = chunk;
+    }
+    if (n != fread(buffer, hdr.recsize, n, f))
+    {
+      luaL_error(L, "luacwrap: archive <%s> is truncated", path);
+    }
+    if (verify && (crcs[first / chunk] != archive_crc32(0, buffer, n * hdr.recsize)))
+    {
+      luaL_error(L, "luacwrap: checksum mismatch in block %d of archive <%s>", (int)(first / chunk), path);
+    }
+
+    if (identical)
+    {
+      memcpy(dst + first * dstsize, buffer, n * dstsize);
+    }
+    else
+    {
+      for (i = 0; i < n; i++)
+      {
+        archive_convert(L, &plan, buffer + i * hdr.recsize, dst + (first + i) * dstsize);
+      }
+    }
+  }
+  archive_close(L, fidx);
+
+  lua_pushboolean(L, 0);
+  return 2;
+}
+
+// metatable of file handles used while reading/writing archives
+luaL_Reg g_mtArchiveFile[ ] = {
+  { "__gc"    , archive_gcfile  },
+  { NULL, NULL }
+};
@@ -0,0 +1,28 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Self-describing record archives
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+//
+// implements luacwrap.savearchive(path, TYPE, objs [, opts])
+//
+int luacwrap_savearchive          ( lua_State*        L);
+
+//
+// implements luacwrap.loadarchive(path, TYPE [, opts])
+//
+int luacwrap_loadarchive          ( lua_State*        L);
+
+// metatable of file handles used while reading/writing archives
+extern luaL_Reg g_mtArchiveFile[];
@@ -0,0 +1,222 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Arena allocator for boxed objects with bulk release.
+
+  An arena is a single userdata block from which objects are
+  allocated by bumping a pointer. Objects allocated from an arena
+  are indirect objects: a small userdata which points into the
+  arena memory and references the arena within its environment.
+  Resetting the arena releases all objects at once. Each reset
+  increments the arena generation, so accessing a stale object
+  raises an error instead of touching reused memory.
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "luaaux.h"
+#include "arena.h"
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Get arena at the given stack index.
+
+  @param[in]  L         lua state
+  @param[in]  idx       stack index
+
+  @return arena or NULL if the value is not an arena
+
+*/////////////////////////////////////////////////////////////////////////
+luacwrap_Arena* luacwrap_toarena(lua_State* L, int idx)
+{
+  return (luacwrap_Arena*)luacwrap_toudata(L, idx, (void*)g_mtArena);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Check for an arena at the given stack index.
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_Arena* arena_check(lua_State* L, int idx)
+{
+  luacwrap_Arena* arena = luacwrap_toarena(L, idx);
+  if (NULL == arena)
+  {
+    luaL_argerror(L, idx, "arena expected");
+  }
+  return arena;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Allocate memory from an arena. Raises an error if the arena is
+  exhausted.
+
+  @param[in]  L         lua state
+  @param[in]  arena     arena to allocate from
+  @param[in]  size      number of bytes
+  @param[in]  align     required alignment (power of two, at least 
+                        LUACWRAP_ARENA_ALIGN is used)
+
+  @return pointer to (uninitialized) memory
+
+*/////////////////////////////////////////////////////////////////////////
+void* luacwrap_arena_alloc(lua_State* L, luacwrap_Arena* arena, size_t size, size_t align)
+{
+  size_t start;
+
+  if (align < LUACWRAP_ARENA_ALIGN)
+  {
+    align = LUACWRAP_ARENA_ALIGN;
+  }
+
+  // align the address (arena memory is only aligned to LUACWRAP_ARENA_ALIGN)
+  start = ((((size_t)arena->mem + arena->used) + align - 1) & ~(align - 1)) - (size_t)arena->mem;
+
+  if ((start > arena->size) || (size > arena->size - start))
+  {
+    luaL_error(L, "arena exhausted (%d of %d bytes used, %d requested)", (int)arena->used, (int)arena->size, (int)size);
+  }
+
+  arena->used = start + size;
+  return arena->mem + start;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements luacwrap.arena(size).
+
+  Parameters on lua stack:
+    - size of arena in [bytes]
+
+  Return values on lua stack
+    - arena object
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_arena_new(lua_State* L)
+{
+  luacwrap_Arena* arena;
+  lua_Integer     size;
+
+  LUASTACK_SET(L);
+
+  size = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, size > 0, 1, "arena size must be positive");
+
+  arena = (luacwrap_Arena*)lua_newuserdata(L, sizeof(luacwrap_Arena) + (size_t)size + LUACWRAP_ARENA_ALIGN - 1);
+
+  arena->mem        = (PBYTE)(((size_t)(arena + 1) + LUACWRAP_ARENA_ALIGN - 1) & ~(size_t)(LUACWRAP_ARENA_ALIGN - 1));
+  arena->size       = (size_t)size;
+  arena->used       = 0;
+  arena->generation = 0;
+
+  // get/attach metatable
+  lua_pushlightuserdata(L, (void*)g_mtArena);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  assert(lua_istable(L, -1));
+  lua_setmetatable(L, -2);
+
+  // cache of the environments shared by the arena objects of a type
+  lua_newtable(L);
+  luacwrap_setenvironment(L, -2);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Allocate memory from an arena and create an indirect object header
+  for it on the top of the lua stack.
+
+  @param[in]  L         lua state
+  @param[in]  arena     arena to allocate from
+  @param[in]  size      number of bytes
+  @param[in]  align     required alignment
+
+  @return pointer to (uninitialized) memory
+
+*/////////////////////////////////////////////////////////////////////////
+void* luacwrap_arena_pushobj(lua_State* L, luacwrap_Arena* arena, size_t size, size_t align)
+{
+  void* ptr = luacwrap_arena_alloc(L, arena, size, align);
+  luacwrap_pushindirectobj(L, ptr, size, align, &arena->generation, NULL, NULL);
+  return ptr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arena:new(TYPE [, init]).
+  Same as TYPE:new(init, arena).
+
+*/////////////////////////////////////////////////////////////////////////
+static int arena_newobj(lua_State* L)
+{
+  arena_check(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_settop(L, 3);
+
+  // call TYPE:new(init, arena)
+  lua_getfield(L, 2, "new");
+  lua_pushvalue(L, 2);
+  lua_pushvalue(L, 3);
+  lua_pushvalue(L, 1);
+  lua_call(L, 3, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arena:reset().
+  Releases all objects allocated from the arena. Objects which are
+  still referenced raise an error when accessed.
+
+*/////////////////////////////////////////////////////////////////////////
+static int arena_reset(lua_State* L)
+{
+  luacwrap_Arena* arena = arena_check(L, 1);
+
+  arena->used = 0;
+  ++arena->generation;
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arena:usage().
+
+  Return values on lua stack
+    - number of allocated bytes
+    - size of arena in [bytes]
+
+*/////////////////////////////////////////////////////////////////////////
+static int arena_usage(lua_State* L)
+{
+  luacwrap_Arena* arena = arena_check(L, 1);
+
+  lua_pushinteger(L, (lua_Integer)arena->used);
+  lua_pushinteger(L, (lua_Integer)arena->size);
+  return 2;
+}
+
+// metatable of arena objects
+luaL_Reg g_mtArena[ ] = {
+  { "new"   , arena_newobj  },
+  { "reset" , arena_reset   },
+  { "usage" , arena_usage   },
+  { NULL, NULL }
+};
@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Arena allocator for boxed objects with bulk release
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+// alignment of objects allocated from an arena
+#define LUACWRAP_ARENA_ALIGN    16
+
+//
+// arena (memory follows the header within the same userdata)
+//
+typedef struct luacwrap_Arena
+{
+  PBYTE         mem;          // aligned arena memory
+  size_t        size;         // size of arena memory
+  size_t        used;         // number of allocated bytes
+  unsigned int  generation;   // incremented on each reset
+} luacwrap_Arena;
+
+//
+// get arena at the given stack index (or NULL)
+//
+luacwrap_Arena* luacwrap_toarena  ( lua_State*        L
+                                  , int               idx);
+
+//
+// allocate memory from an arena
+//
+void* luacwrap_arena_alloc        ( lua_State*        L
+                                  , luacwrap_Arena*   arena
+                                  , size_t            size
+                                  , size_t            align);
+
+//
+// allocate memory from an arena and create an indirect object header for it
+//
+void* luacwrap_arena_pushobj      ( lua_State*        L
+                                  , luacwrap_Arena*   arena
+                                  , size_t            size
+                                  , size_t            align);
+
+//
+// implements luacwrap.arena(size)
+//
+int luacwrap_arena_new            ( lua_State*        L);
+
+// metatable of arena objects
+extern luaL_Reg g_mtArena[];
@@ -0,0 +1,746 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Hash index and hash based aggregation over the elements of
+  wrapped arrays.
+
+  The index is an open addressing hash table (linear probing) which
+  maps the value of a key member to the index of an array element.
+  Slots only store element indices, keys are always compared against
+  the array memory, so a stale index never returns a wrong element.
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "luaaux.h"
+#include "arrayops.h"
+#include "wrapnumeric.h"
+
+// minimal number of slots of an index
+#define ARRAYINDEX_MINSLOTS   8
+
+//
+// hash index object
+//
+typedef struct luacwrap_ArrayIndex
+{
+  luacwrap_FieldKey   key;        // key member within element
+  size_t              capacity;   // number of slots (power of 2)
+  size_t              count;      // number of used slots
+  unsigned int*       slots;      // element index + 1, 0 marks an empty slot
+} luacwrap_ArrayIndex;
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Mix the bits of a 64 bit integer (finalizer of splitmix64).
+
+*/////////////////////////////////////////////////////////////////////////
+static size_t hash_integer(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return (size_t)x;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  FNV-1a hash of a zero padded byte key. Trailing zeros are ignored,
+  so that keys which compare equal have the same hash.
+
+*/////////////////////////////////////////////////////////////////////////
+static size_t hash_bytes(const BYTE* data, size_t len)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  size_t i;
+
+  while ((len > 0) && (0 == data[len-1]))
+    --len;
+
+  for (i = 0; i < len; ++i)
+  {
+    h ^= data[i];
+    h *= 0x100000001b3ULL;
+  }
+  return hash_integer(h);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Check that a key could be used for hashing (integers, char arrays
+  and buffers).
+
+*/////////////////////////////////////////////////////////////////////////
+void luacwrap_field_checkhashable( lua_State*                L
+                                 , const char*               path
+                                 , const luacwrap_FieldKey*  key)
+{
+  if ((LUACWRAP_NK_FLT == key->kind) || (LUACWRAP_NK_DBL == key->kind))
+  {
+    luaL_error(L, "member path <%s>: floating point members could not be used as hash key", path);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Calculate the hash of the key member of an element.
+
+  @param[in]  key       key descriptor (integer or byte key)
+  @param[in]  a         pointer to key member of element
+
+*/////////////////////////////////////////////////////////////////////////
+size_t luacwrap_field_hash( const luacwrap_FieldKey*  key
+                          , const BYTE*               a)
+{
+  switch (key->kind)
+  {
+    case LUACWRAP_NK_I8   : return hash_integer((uint64_t)(int64_t)*(const int8_t*  )a);
+    case LUACWRAP_NK_U8   : return hash_integer((uint64_t)         *(const uint8_t* )a);
+    case LUACWRAP_NK_I16  : return hash_integer((uint64_t)(int64_t)*(const int16_t* )a);
+    case LUACWRAP_NK_U16  : return hash_integer((uint64_t)         *(const uint16_t*)a);
+    case LUACWRAP_NK_I32  : return hash_integer((uint64_t)(int64_t)*(const int32_t* )a);
+    case LUACWRAP_NK_U32  : return hash_integer((uint64_t)         *(const uint32_t*)a);
+    case LUACWRAP_NK_I64  : return hash_integer((uint64_t)         *(const int64_t* )a);
+    case LUACWRAP_NK_U64  : return hash_integer(                   *(const uint64_t*)a);
+    case LUACWRAP_NK_BYTES: return hash_bytes(a, key->size);
+    default:
+      {
+        assert(0);
+      }
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Calculate the hash of a key value.
+
+  @param[in]  key       key descriptor (integer or byte key)
+  @param[in]  value     key value
+  @param[out] hash      hash of value
+
+  @return 0 if the value could not match any member value
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_field_hashvalue( const luacwrap_FieldKey*    key
+                            , const luacwrap_FieldValue*  value
+                            , size_t*                     hash)
+{
+  if (LUACWRAP_NK_BYTES == key->kind)
+  {
+    const BYTE* data = (const BYTE*)value->str;
+    size_t len = value->len;
+
+    while ((len > 0) && (0 == data[len-1]))
+      --len;
+    if (len > key->size)
+      return 0;
+
+    *hash = hash_bytes(data, len);
+  }
+  else
+  {
+    if (!value->isint)
+      return 0;
+
+    *hash = hash_integer((uint64_t)value->i);
+  }
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Check for an index object.
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_ArrayIndex* arrayindex_toindex(lua_State* L, int idx)
+{
+  luacwrap_ArrayIndex* index = (luacwrap_ArrayIndex*)luacwrap_toudata(L, idx, (void*)g_mtArrayIndex);
+  if (NULL == index)
+  {
+    luaL_argerror(L, idx, "array index expected");
+  }
+  return index;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Check for an index object and push its array.
+
+  @return pointer to first array element
+
+*/////////////////////////////////////////////////////////////////////////
+static PBYTE arrayindex_check( lua_State*             L
+                             , int                    idx
+                             , luacwrap_ArrayIndex**  pindex
+                             , luacwrap_ArrayType**   arrdesc)
+{
+  luacwrap_Type* elemdesc;
+
+  *pindex = arrayindex_toindex(L, idx);
+
+  // get indexed array from environment
+  luacwrap_getenvironment(L, idx);
+  lua_rawgeti(L, -1, 1);
+  lua_remove(L, -2);
+
+  return luacwrap_checkarray(L, lua_gettop(L), arrdesc, &elemdesc);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Put an element into the index. An existing slot for the same key
+  is overwritten if replace is set.
+
+*/////////////////////////////////////////////////////////////////////////
+static void arrayindex_put( luacwrap_ArrayIndex*  index
+                          , const PBYTE           base
+                          , size_t                elemsize
+                          , unsigned int          elemidx
+                          , int                   replace)
+{
+  const luacwrap_FieldKey* key = &index->key;
+  const BYTE* pelem = base + (size_t)elemidx * elemsize + key->offset;
+  size_t mask = index->capacity - 1;
+  size_t pos  = luacwrap_field_hash(key, pelem) & mask;
+
+  while (index->slots[pos])
+  {
+    const BYTE* pslot = base + (size_t)(index->slots[pos] - 1) * elemsize + key->offset;
+    if (0 == luacwrap_field_compare(key, pslot, pelem))
+    {
+      if (replace)
+        index->slots[pos] = elemidx + 1;
+      return;
+    }
+    pos = (pos + 1) & mask;
+  }
+
+  index->slots[pos] = elemidx + 1;
+  ++index->count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  (Re)build the index with at least the given number of slots.
+  For duplicate keys the first element is indexed.
+
+*/////////////////////////////////////////////////////////////////////////
+static void arrayindex_build( lua_State*            L
+                            , luacwrap_ArrayIndex*  index
+                            , const PBYTE           base
+                            , luacwrap_ArrayType*   arrdesc
+                            , size_t                minslots)
+{
+  size_t capacity = ARRAYINDEX_MINSLOTS;
+  unsigned int i;
+
+  // keep load factor below 0.5
+  while (capacity < minslots)
+    capacity <<= 1;
+
+  if (capacity != index->capacity)
+  {
+    unsigned int* slots = (unsigned int*)realloc(index->slots, capacity * sizeof(unsigned int));
+    if (NULL == slots)
+    {
+      luaL_error(L, "not enough memory for array index");
+    }
+    index->slots    = slots;
+    index->capacity = capacity;
+  }
+
+  memset(index->slots, 0, index->capacity * sizeof(unsigned int));
+  index->count = 0;
+
+  for (i = 0; i < arrdesc->elemcount; ++i)
+  {
+    arrayindex_put(index, base, arrdesc->elemsize, i, 0);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Grow the index to at least the given number of slots. The indexed
+  element of each key is kept (insert() may have replaced the first
+  one of duplicate keys), stale entries are dropped and elements which
+  keys are not indexed yet are added.
+
+*/////////////////////////////////////////////////////////////////////////
+static void arrayindex_grow( lua_State*            L
+                           , luacwrap_ArrayIndex*  index
+                           , const PBYTE           base
+                           , luacwrap_ArrayType*   arrdesc
+                           , size_t                minslots)
+{
+  unsigned int* oldslots    = index->slots;
+  size_t        oldcapacity = index->capacity;
+  size_t        capacity    = ARRAYINDEX_MINSLOTS;
+  size_t        pos;
+  unsigned int  i;
+
+  while (capacity < minslots)
+    capacity <<= 1;
+
+  index->slots = (unsigned int*)calloc(capacity, sizeof(unsigned int));
+  if (NULL == index->slots)
+  {
+    index->slots = oldslots;
+    luaL_error(L, "not enough memory for array index");
+  }
+  index->capacity = capacity;
+  index->count    = 0;
+
+  // entries are put with the current key of their element
+  for (pos = 0; pos < oldcapacity; ++pos)
+  {
+    if (oldslots[pos])
+    {
+      arrayindex_put(index, base, arrdesc->elemsize, oldslots[pos] - 1, 0);
+    }
+  }
+  free(oldslots);
+
+  for (i = 0; i < arrdesc->elemcount; ++i)
+  {
+    arrayindex_put(index, base, arrdesc->elemsize, i, 0);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arr:index([key]) for wrapped arrays.
+  Creates a hash index which maps the value of the key member
+  to the element index. Supported keys are integer members, char
+  arrays and buffers. If no key is given the element value itself
+  is used.
+
+  Parameters on lua stack:
+    - self  (wrapped array)
+    - key   (string, optional for arrays of basic types)
+
+  Return values on lua stack
+    - index object
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_arrayindex_new(lua_State* L)
+{
+  luacwrap_ArrayIndex*  index;
+  luacwrap_ArrayType*   arrdesc;
+  luacwrap_Type*        elemdesc;
+  PBYTE                 base;
+  const char*           path;
+
+  LUASTACK_SET(L);
+
+  base = luacwrap_checkarray(L, 1, &arrdesc, &elemdesc);
+  path = luaL_optstring(L, 2, "");
+
+  index = (luacwrap_ArrayIndex*)lua_newuserdata(L, sizeof(luacwrap_ArrayIndex));
+  memset(index, 0, sizeof(luacwrap_ArrayIndex));
+
+  luacwrap_field_resolve(L, elemdesc, path, &index->key);
+  luacwrap_field_checkhashable(L, path, &index->key);
+
+  // set metatable
+  lua_pushlightuserdata(L, (void*)&g_mtArrayIndex);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  assert(!lua_isnil(L, -1));
+  lua_setmetatable(L, -2);
+
+  // keep indexed array within environment
+  lua_createtable(L, 1, 0);
+  lua_pushvalue(L, 1);
+  lua_rawseti(L, -2, 1);
+  luacwrap_setenvironment(L, -2);
+
+  arrayindex_build(L, index, base, arrdesc, 2 * (size_t)arrdesc->elemcount);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements index:lookup(value).
+  Returns the 1-based index of the element which key equals value
+  or nil if there is no such element.
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayindex_lookup(lua_State* L)
+{
+  luacwrap_ArrayIndex*  index;
+  luacwrap_ArrayType*   arrdesc;
+  luacwrap_FieldValue   value;
+  PBYTE                 base;
+  size_t                hash;
+
+  LUASTACK_SET(L);
+
+  base = arrayindex_check(L, 1, &index, &arrdesc);
+  lua_pop(L, 1);
+
+  luacwrap_field_tovalue(L, 2, &index->key, &value);
+
+  if (luacwrap_field_hashvalue(&index->key, &value, &hash))
+  {
+    size_t mask = index->capacity - 1;
+    size_t pos  = hash & mask;
+
+    while (index->slots[pos])
+    {
+      unsigned int elemidx = index->slots[pos] - 1;
+      const BYTE* pslot = base + (size_t)elemidx * arrdesc->elemsize + index->key.offset;
+      if (0 == luacwrap_field_comparevalue(&index->key, pslot, &value))
+      {
+        lua_pushinteger(L, elemidx + 1);
+
+        LUASTACK_CLEAN(L, 1);
+        return 1;
+      }
+      pos = (pos + 1) & mask;
+    }
+  }
+
+  lua_pushnil(L);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements index:insert(i).
+  Adds the element with the given 1-based index to the index (after
+  setting its key member). An existing entry with the same key is
+  replaced, also when the index grows later on.
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayindex_insert(lua_State* L)
+{
+  luacwrap_ArrayIndex*  index;
+  luacwrap_ArrayType*   arrdesc;
+  PBYTE                 base;
+  lua_Integer           elemidx;
+
+  LUASTACK_SET(L);
+
+  base = arrayindex_check(L, 1, &index, &arrdesc);
+  lua_pop(L, 1);
+
+  elemidx = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, (elemidx >= 1) && (elemidx <= (lua_Integer)arrdesc->elemcount), 2, "index out of bounds");
+
+  // grow index (this also drops stale entries)
+  if (4 * (index->count + 1) > 3 * index->capacity)
+  {
+    arrayindex_grow(L, index, base, arrdesc, 2 * index->capacity);
+  }
+
+  arrayindex_put(index, base, arrdesc->elemsize, (unsigned int)(elemidx - 1), 1);
+
+  LUASTACK_CLEAN(L, 0);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements index:rebuild().
+  Rebuilds the index from the current array content.
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayindex_rebuild(lua_State* L)
+{
+  luacwrap_ArrayIndex*  index;
+  luacwrap_ArrayType*   arrdesc;
+  PBYTE                 base;
+
+  LUASTACK_SET(L);
+
+  base = arrayindex_check(L, 1, &index, &arrdesc);
+  lua_pop(L, 1);
+
+  arrayindex_build(L, index, base, arrdesc, 2 * (size_t)arrdesc->elemcount);
+
+  LUASTACK_CLEAN(L, 0);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements index:memory().
+
+  Return values on lua stack
+    - memory used by the index in [bytes]
+    - number of used slots
+    - number of slots
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayindex_memory(lua_State* L)
+{
+  luacwrap_ArrayIndex* index = arrayindex_toindex(L, 1);
+
+  lua_pushinteger(L, (lua_Integer)(sizeof(luacwrap_ArrayIndex) + index->capacity * sizeof(unsigned int)));
+  lua_pushinteger(L, (lua_Integer)index->count);
+  lua_pushinteger(L, (lua_Integer)index->capacity);
+  return 3;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements __gc metamethod for index objects.
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayindex_gc(lua_State* L)
+{
+  luacwrap_ArrayIndex* index = (luacwrap_ArrayIndex*)lua_touserdata(L, 1);
+
+  free(index->slots);
+  index->slots    = NULL;
+  index->capacity = 0;
+  index->count    = 0;
+  return 0;
+}
+
+// aggregate functions of arr:aggregate()
+enum { AGGREGATE_COUNT, AGGREGATE_SUM, AGGREGATE_MIN, AGGREGATE_MAX, AGGREGATE_AVG, AGGREGATE_NUM };
+
+static const char* g_aggregateFuncs[] = { "count", "sum", "min", "max", "avg", NULL };
+
+//
+// accumulated values of a group
+//
+typedef struct AggregateGroup
+{
+  unsigned int  first;      // first element of group (holds the key)
+  unsigned int  count;      // number of elements
+  unsigned int  minelem;    // element with minimal value
+  unsigned int  maxelem;    // element with maximal value
+  lua_Number    sum;        // sum of values
+  lua_Number    avgsum;     // sum of values for average
+} AggregateGroup;
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arr:aggregate(key, functions) for wrapped arrays.
+
+  Groups the array elements by the value of the key member and
+  calculates aggregate functions per group. Functions are given
+  as table with the function names as keys and the member paths
+  as values (count = true), e.g.
+    { count = true, sum = "bytes", max = "latency" }
+  Supported functions are count, sum, min, max and avg.
+
+  Parameters on lua stack:
+    - self  (wrapped array)
+    - key   (string, hashable member)
+    - functions (table)
+
+  Return values on lua stack
+    - table which maps key values to tables with the results
+      of the aggregate functions
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_arrayindex_aggregate(lua_State* L)
+{
+  luacwrap_FieldKey   funckeys[AGGREGATE_NUM];
+  int                 used[AGGREGATE_NUM];
+  luacwrap_FieldKey   key;
+  luacwrap_ArrayType* arrdesc;
+  luacwrap_Type*      elemdesc;
+  AggregateGroup*     groups;
+  unsigned int*       slots;
+  PBYTE               base;
+  const char*         path;
+  size_t              n, i, capacity, mask, ngroups;
+  int                 f;
+
+  LUASTACK_SET(L);
+
+  base = luacwrap_checkarray(L, 1, &arrdesc, &elemdesc);
+  path = luaL_checkstring(L, 2);
+  luaL_checktype(L, 3, LUA_TTABLE);
+
+  luacwrap_field_resolve(L, elemdesc, path, &key);
+  luacwrap_field_checkhashable(L, path, &key);
+
+  // resolve members of aggregate functions
+  memset(used, 0, sizeof(used));
+  lua_pushnil(L);
+  while (lua_next(L, 3))
+  {
+    const char* name = lua_tostring(L, -2);
+
+    for (f = 0; name && g_aggregateFuncs[f] && strcmp(g_aggregateFuncs[f], name); ++f)
+      ;
+    if ((NULL == name) || (NULL == g_aggregateFuncs[f]))
+    {
+      luaL_error(L, "unknown aggregate function <%s>", name ? name : "?");
+    }
+
+    if (AGGREGATE_COUNT != f)
+    {
+      const char* funcpath = lua_tostring(L, -1);
+      if (NULL == funcpath)
+      {
+        luaL_error(L, "aggregate function <%s>: member path expected", name);
+      }
+      luacwrap_field_resolve(L, elemdesc, funcpath, &funckeys[f]);
+      if (LUACWRAP_NK_BYTES == funckeys[f].kind)
+      {
+        luaL_error(L, "aggregate function <%s>: member <%s> is not numeric", name, funcpath);
+      }
+    }
+    used[f] = lua_toboolean(L, -1);
+
+    lua_pop(L, 1);
+  }
+
+  // scratch memory for hash slots and groups is maintained by lua
+  n = arrdesc->elemcount;
+  capacity = ARRAYINDEX_MINSLOTS;
+  while (capacity < 2 * n)
+    capacity <<= 1;
+  mask = capacity - 1;
+
+  groups = (AggregateGroup*)lua_newuserdata(L, (n ? n : 1) * sizeof(AggregateGroup) + capacity * sizeof(unsigned int));
+  slots  = (unsigned int*)(groups + (n ? n : 1));
+  memset(slots, 0, capacity * sizeof(unsigned int));
+  ngroups = 0;
+
+  for (i = 0; i < n; ++i)
+  {
+    const BYTE* pelem = base + i * arrdesc->elemsize;
+    size_t pos = luacwrap_field_hash(&key, pelem + key.offset) & mask;
+    AggregateGroup* group = NULL;
+
+    // find group of element
+    while (slots[pos])
+    {
+      AggregateGroup* g = &groups[slots[pos] - 1];
+      const BYTE* pfirst = base + (size_t)g->first * arrdesc->elemsize;
+      if (0 == luacwrap_field_compare(&key, pfirst + key.offset, pelem + key.offset))
+      {
+        group = g;
+        break;
+      }
+      pos = (pos + 1) & mask;
+    }
+
+    // create new group
+    if (NULL == group)
+    {
+      group = &groups[ngroups++];
+      memset(group, 0, sizeof(AggregateGroup));
+      group->first   = (unsigned int)i;
+      group->minelem = (unsigned int)i;
+      group->maxelem = (unsigned int)i;
+      slots[pos] = (unsigned int)ngroups;
+    }
+
+    // accumulate
+    ++group->count;
+    if (used[AGGREGATE_SUM])
+    {
+      group->sum += luacwrap_field_tonumber(&funckeys[AGGREGATE_SUM], pelem + funckeys[AGGREGATE_SUM].offset);
+    }
+    if (used[AGGREGATE_AVG])
+    {
+      group->avgsum += luacwrap_field_tonumber(&funckeys[AGGREGATE_AVG], pelem + funckeys[AGGREGATE_AVG].offset);
+    }
+    if (used[AGGREGATE_MIN])
+    {
+      const luacwrap_FieldKey* fk = &funckeys[AGGREGATE_MIN];
+      if (luacwrap_field_compare(fk, pelem + fk->offset, base + (size_t)group->minelem * arrdesc->elemsize + fk->offset) < 0)
+        group->minelem = (unsigned int)i;
+    }
+    if (used[AGGREGATE_MAX])
+    {
+      const luacwrap_FieldKey* fk = &funckeys[AGGREGATE_MAX];
+      if (luacwrap_field_compare(fk, pelem + fk->offset, base + (size_t)group->maxelem * arrdesc->elemsize + fk->offset) > 0)
+        group->maxelem = (unsigned int)i;
+    }
+  }
+
+  // create result table
+  lua_createtable(L, 0, (int)ngroups);
+  for (i = 0; i < ngroups; ++i)
+  {
+    const AggregateGroup* group = &groups[i];
+
+    luacwrap_field_push(L, &key, base + (size_t)group->first * arrdesc->elemsize + key.offset);
+    lua_createtable(L, 0, AGGREGATE_NUM);
+
+    if (used[AGGREGATE_COUNT])
+    {
+      lua_pushinteger(L, group->count);
+      lua_setfield(L, -2, g_aggregateFuncs[AGGREGATE_COUNT]);
+    }
+    if (used[AGGREGATE_SUM])
+    {
+      lua_pushnumber(L, group->sum);
+      lua_setfield(L, -2, g_aggregateFuncs[AGGREGATE_SUM]);
+    }
+    if (used[AGGREGATE_MIN])
+    {
+      const luacwrap_FieldKey* fk = &funckeys[AGGREGATE_MIN];
+      luacwrap_field_push(L, fk, base + (size_t)group->minelem * arrdesc->elemsize + fk->offset);
+      lua_setfield(L, -2, g_aggregateFuncs[AGGREGATE_MIN]);
+    }
+    if (used[AGGREGATE_MAX])
+    {
+      const luacwrap_FieldKey* fk = &funckeys[AGGREGATE_MAX];
+      luacwrap_field_push(L, fk, base + (size_t)group->maxelem * arrdesc->elemsize + fk->offset);
+      lua_setfield(L, -2, g_aggregateFuncs[AGGREGATE_MAX]);
+    }
+    if (used[AGGREGATE_AVG])
+    {
+      lua_pushnumber(L, group->avgsum / group->count);
+      lua_setfield(L, -2, g_aggregateFuncs[AGGREGATE_AVG]);
+    }
+
+    lua_rawset(L, -3);
+  }
+
+  // drop scratch memory
+  lua_remove(L, -2);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+// metatable of index objects
+luaL_Reg g_mtArrayIndex[ ] = {
+  { "lookup"  , arrayindex_lookup   },
+  { "insert"  , arrayindex_insert   },
+  { "rebuild" , arrayindex_rebuild  },
+  { "memory"  , arrayindex_memory   },
+  { "__gc"    , arrayindex_gc       },
+  { NULL, NULL }
+};
@@ -0,0 +1,1032 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Bulk operations on wrapped arrays (sort, search, ...) which work
+  directly on the raw array memory.
+
+  Key members are resolved once to (offset, numeric kind) and all
+  comparisons are done in C without creating proxy objects.
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "luaaux.h"
+#include "arrayops.h"
+#include "json.h"
+#include "msgpack.h"
+#include "serialize.h"
+#include "wrapnumeric.h"
+
+// maximum number of sort keys
+#define ARRAYOPS_MAXKEYS      16
+
+// below this number of elements insertion sort is used
+#define ARRAYOPS_INSERTION    16
+
+// three way comparison
+#define CMP3(a, b)            (((a) > (b)) - ((a) < (b)))
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Resolve a (dotted) member path of an element type to a key.
+  An empty path denotes the element itself.
+
+  @param[in]  L         lua state
+  @param[in]  elemdesc  element type descriptor
+  @param[in]  path      member path (e.g. "inner.id")
+  @param[out] key       resolved key
+
+*/////////////////////////////////////////////////////////////////////////
+void luacwrap_field_resolve( lua_State*          L
+                           , luacwrap_Type*      elemdesc
+                           , const char*         path
+                           , luacwrap_FieldKey*  key)
+{
+  luacwrap_Type* desc = elemdesc;
+  const char* seg = path;
+  unsigned int offset = 0;
+
+  while (*seg)
+  {
+    luacwrap_RecordMember* member;
+    const char* end = strchr(seg, '.');
+    size_t seglen = end ? (size_t)(end - seg) : strlen(seg);
+
+    if (LUACWRAP_TC_RECORD != desc->typeclass)
+    {
+      luaL_error(L, "member path <%s>: type <%s> is not a record", path, desc->name);
+    }
+
+    member = luacwrap_findmember(((luacwrap_RecordType*)desc)->members, seg, seglen);
+    if (NULL == member)
+    {
+      luaL_error(L, "member path <%s>: unknown member in type <%s>", path, desc->name);
+    }
+
+    offset += member->memberoffset;
+    desc = luacwrap_getmembertype(L, member);
+
+    seg += seglen;
+    if ('.' == *seg)
+      ++seg;
+  }
+
+  key->offset = offset;
+  key->dir    = 1;
+
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC:
+      {
+        key->kind = luacwrap_numerickind(desc);
+        key->size = ((luacwrap_BasicType*)desc)->size;
+      }
+      break;
+    case LUACWRAP_TC_ARRAY:
+      {
+        luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+
+        // char arrays are compared as zero padded strings
+        key->kind = (1 == arrdesc->elemsize) ? LUACWRAP_NK_BYTES : LUACWRAP_NK_NONE;
+        key->size = arrdesc->elemcount;
+      }
+      break;
+    case LUACWRAP_TC_BUFFER:
+      {
+        key->kind = LUACWRAP_NK_BYTES;
+        key->size = ((luacwrap_BufferType*)desc)->size;
+      }
+      break;
+    default:
+      {
+        key->kind = LUACWRAP_NK_NONE;
+        key->size = 0;
+      }
+      break;
+  }
+
+  if (LUACWRAP_NK_NONE == key->kind)
+  {
+    luaL_error(L, "member path <%s>: type <%s> could not be used as key", path, desc->name);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Convert the lua value at the given stack index to a key value.
+
+  @param[in]  L         lua state
+  @param[in]  idx       stack index of value
+  @param[in]  key       key to compare against
+  @param[out] value     converted value
+
+*/////////////////////////////////////////////////////////////////////////
+void luacwrap_field_tovalue( lua_State*                L
+                           , int                       idx
+                           , const luacwrap_FieldKey*  key
+                           , luacwrap_FieldValue*      value)
+{
+  memset(value, 0, sizeof(luacwrap_FieldValue));
+
+  if (LUACWRAP_NK_BYTES == key->kind)
+  {
+    value->str = luaL_checklstring(L, idx, &value->len);
+  }
+  else
+  {
+    value->num = luaL_checknumber(L, idx);
+
+    // integral values are compared exactly against integer members
+    if ((value->num >= -9223372036854775808.0) && (value->num < 9223372036854775808.0))
+    {
+      value->i = (int64_t)value->num;
+      value->isint = ((lua_Number)value->i == value->num);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Compare two fixed size zero padded byte keys.
+
+*/////////////////////////////////////////////////////////////////////////
+static int compare_bytes(const BYTE* a, size_t alen, const BYTE* b, size_t blen)
+{
+  size_t n = (alen < blen) ? alen : blen;
+  int result = memcmp(a, b, n);
+  if (result)
+    return (result < 0) ? -1 : 1;
+
+  // the longer key is greater if its remainder contains non zero bytes
+  for (; n < alen; ++n)
+    if (a[n]) return 1;
+  for (; n < blen; ++n)
+    if (b[n]) return -1;
+
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Compare the key members of two elements.
+
+  @param[in]  key       key descriptor
+  @param[in]  a         pointer to key member of first element
+  @param[in]  b         pointer to key member of second element
+
+  @return -1, 0 or 1
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_field_compare( const luacwrap_FieldKey*  key
+                          , const BYTE*               a
+                          , const BYTE*               b)
+{
+  switch (key->kind)
+  {
+    case LUACWRAP_NK_I8   : return CMP3(*(const int8_t*  )a, *(const int8_t*  )b);
+    case LUACWRAP_NK_U8   : return CMP3(*(const uint8_t* )a, *(const uint8_t* )b);
+    case LUACWRAP_NK_I16  : return CMP3(*(const int16_t* )a, *(const int16_t* )b);
+    case LUACWRAP_NK_U16  : return CMP3(*(const uint16_t*)a, *(const uint16_t*)b);
+    case LUACWRAP_NK_I32  : return CMP3(*(const int32_t* )a, *(const int32_t* )b);
+    case LUACWRAP_NK_U32  : return CMP3(*(const uint32_t*)a, *(const uint32_t*)b);
+    case LUACWRAP_NK_I64  : return CMP3(*(const int64_t* )a, *(const int64_t* )b);
+    case LUACWRAP_NK_U64  : return CMP3(*(const uint64_t*)a, *(const uint64_t*)b);
+    case LUACWRAP_NK_FLT  : return CMP3(*(const float*   )a, *(const float*   )b);
+    case LUACWRAP_NK_DBL  : return CMP3(*(const double*  )a, *(const double*  )b);
+    case LUACWRAP_NK_BYTES: return compare_bytes(a, key->size, b, key->size);
+    default:
+      {
+        assert(0);
+      }
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Compare the key member of an element with a key value.
+
+  @param[in]  key       key descriptor
+  @param[in]  a         pointer to key member of element
+  @param[in]  value     value to compare with
+
+  @return -1, 0 or 1
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_field_comparevalue( const luacwrap_FieldKey*    key
+                               , const BYTE*                 a
+                               , const luacwrap_FieldValue*  value)
+{
+  int64_t  ival;
+  uint64_t uval;
+
+  switch (key->kind)
+  {
+    case LUACWRAP_NK_I8   : ival = *(const int8_t*  )a; break;
+    case LUACWRAP_NK_I16  : ival = *(const int16_t* )a; break;
+    case LUACWRAP_NK_I32  : ival = *(const int32_t* )a; break;
+    case LUACWRAP_NK_I64  : ival = *(const int64_t* )a; break;
+    case LUACWRAP_NK_U8   : uval = *(const uint8_t* )a; goto unsignedcmp;
+    case LUACWRAP_NK_U16  : uval = *(const uint16_t*)a; goto unsignedcmp;
+    case LUACWRAP_NK_U32  : uval = *(const uint32_t*)a; goto unsignedcmp;
+    case LUACWRAP_NK_U64  : uval = *(const uint64_t*)a; goto unsignedcmp;
+    case LUACWRAP_NK_FLT  : return CMP3((lua_Number)*(const float*)a, value->num);
+    case LUACWRAP_NK_DBL  : return CMP3((lua_Number)*(const double*)a, value->num);
+    case LUACWRAP_NK_BYTES: return compare_bytes(a, key->size, (const BYTE*)value->str, value->len);
+    default:
+      {
+        assert(0);
+        return 0;
+      }
+  }
+
+  // signed members
+  if (value->isint)
+    return CMP3(ival, value->i);
+  return CMP3((lua_Number)ival, value->num);
+
+unsignedcmp:
+  if (value->isint)
+    return (value->i < 0) ? 1 : CMP3(uval, (uint64_t)value->i);
+  return CMP3((lua_Number)uval, value->num);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Get the value of a numeric key member.
+
+  @param[in]  key       key descriptor (numeric key)
+  @param[in]  a         pointer to key member of element
+
+*/////////////////////////////////////////////////////////////////////////
+lua_Number luacwrap_field_tonumber( const luacwrap_FieldKey*  key
+                                  , const BYTE*               a)
+{
+  switch (key->kind)
+  {
+    case LUACWRAP_NK_I8   : return (lua_Number)*(const int8_t*  )a;
+    case LUACWRAP_NK_U8   : return (lua_Number)*(const uint8_t* )a;
+    case LUACWRAP_NK_I16  : return (lua_Number)*(const int16_t* )a;
+    case LUACWRAP_NK_U16  : return (lua_Number)*(const uint16_t*)a;
+    case LUACWRAP_NK_I32  : return (lua_Number)*(const int32_t* )a;
+    case LUACWRAP_NK_U32  : return (lua_Number)*(const uint32_t*)a;
+    case LUACWRAP_NK_I64  : return (lua_Number)*(const int64_t* )a;
+    case LUACWRAP_NK_U64  : return (lua_Number)*(const uint64_t*)a;
+    case LUACWRAP_NK_FLT  : return (lua_Number)*(const float*   )a;
+    case LUACWRAP_NK_DBL  : return (lua_Number)*(const double*  )a;
+    default:
+      {
+        assert(0);
+      }
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Push the value of a key member on the lua stack. Byte keys are
+  pushed as strings without trailing zeros.
+
+  @param[in]  L         lua state
+  @param[in]  key       key descriptor
+  @param[in]  a         pointer to key member of element
+
+*/////////////////////////////////////////////////////////////////////////
+void luacwrap_field_push( lua_State*                L
+                        , const luacwrap_FieldKey*  key
+                        , const BYTE*               a)
+{
+  if (LUACWRAP_NK_BYTES == key->kind)
+  {
+    size_t len = key->size;
+    while ((len > 0) && (0 == a[len-1]))
+      --len;
+    lua_pushlstring(L, (const char*)a, len);
+  }
+  else
+  {
+    lua_pushnumber(L, luacwrap_field_tonumber(key, a));
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Check for a wrapped array object and return its base pointer.
+
+  @param[in]  L         lua state
+  @param[in]  idx       stack index of array object
+  @param[out] arrdesc   array type descriptor
+  @param[out] elemdesc  element type descriptor
+
+  @return pointer to first array element
+
+*/////////////////////////////////////////////////////////////////////////
+PBYTE luacwrap_checkarray( lua_State*            L
+                         , int                   idx
+                         , luacwrap_ArrayType**  arrdesc
+                         , luacwrap_Type**       elemdesc)
+{
+  luacwrap_Type* desc = luacwrap_getdescriptor(L, idx);
+  if ((NULL == desc) || (LUACWRAP_TC_ARRAY != desc->typeclass))
+  {
+    luaL_argerror(L, idx, "wrapped array expected");
+  }
+
+  *arrdesc  = (luacwrap_ArrayType*)desc;
+  *elemdesc = luacwrap_getelemtype(L, *arrdesc);
+
+  return (PBYTE)luacwrap_mobj_getbaseptr(L, idx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Resolve a key given as string on the lua stack. The key could be
+  prefixed by '-' for descending or '+' for ascending order.
+
+*/////////////////////////////////////////////////////////////////////////
+static void arrayops_checkkey(lua_State* L, int idx, luacwrap_Type* elemdesc, luacwrap_FieldKey* key)
+{
+  const char* path = luaL_checkstring(L, idx);
+  int dir = 1;
+
+  if ('-' == *path)
+  {
+    dir = -1;
+    ++path;
+  }
+  else if ('+' == *path)
+  {
+    ++path;
+  }
+
+  luacwrap_field_resolve(L, elemdesc, path, key);
+  key->dir = dir;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  sort context
+
+*/////////////////////////////////////////////////////////////////////////
+typedef struct SortContext
+{
+  PBYTE               base;
+  unsigned int        elemsize;
+  int                 nkeys;
+  luacwrap_FieldKey   keys[ARRAYOPS_MAXKEYS];
+} SortContext;
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  compare two elements given by index according to all sort keys
+
+*/////////////////////////////////////////////////////////////////////////
+static int sort_compare(const SortContext* ctx, unsigned int ia, unsigned int ib)
+{
+  int k;
+  const BYTE* pa = ctx->base + (size_t)ia * ctx->elemsize;
+  const BYTE* pb = ctx->base + (size_t)ib * ctx->elemsize;
+
+  for (k = 0; k < ctx->nkeys; ++k)
+  {
+    const luacwrap_FieldKey* key = &ctx->keys[k];
+    int result = luacwrap_field_compare(key, pa + key->offset, pb + key->offset);
+    if (result)
+    {
+      return result * key->dir;
+    }
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  stable insertion sort of an index range
+
+*/////////////////////////////////////////////////////////////////////////
+static void sort_insertion(const SortContext* ctx, unsigned int* idx, size_t n)
+{
+  size_t i, j;
+  for (i = 1; i < n; ++i)
+  {
+    unsigned int v = idx[i];
+    for (j = i; (j > 0) && (sort_compare(ctx, idx[j-1], v) > 0); --j)
+    {
+      idx[j] = idx[j-1];
+    }
+    idx[j] = v;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  stable merge sort of an index range (tmp has to hold n indices)
+
+*/////////////////////////////////////////////////////////////////////////
+static void sort_merge(const SortContext* ctx, unsigned int* idx, unsigned int* tmp, size_t n)
+{
+  size_t mid, i, j, k;
+
+  if (n <= ARRAYOPS_INSERTION)
+  {
+    sort_insertion(ctx, idx, n);
+    return;
+  }
+
+  mid = n / 2;
+  sort_merge(ctx, idx, tmp, mid);
+  sort_merge(ctx, idx + mid, tmp, n - mid);
+
+  // already in order
+  if (sort_compare(ctx, idx[mid-1], idx[mid]) <= 0)
+    return;
+
+  memcpy(tmp, idx, mid * sizeof(unsigned int));
+
+  i = 0; j = mid; k = 0;
+  while ((i < mid) && (j < n))
+  {
+    // take from left run on ties to keep sort stable
+    if (sort_compare(ctx, idx[j], tmp[i]) < 0)
+      idx[k++] = idx[j++];
+    else
+      idx[k++] = tmp[i++];
+  }
+  while (i < mid)
+  {
+    idx[k++] = tmp[i++];
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  unstable quick sort of an index range
+
+*/////////////////////////////////////////////////////////////////////////
+static void sort_quick(const SortContext* ctx, unsigned int* idx, size_t n)
+{
+  while (n > ARRAYOPS_INSERTION)
+  {
+    size_t i, j;
+    unsigned int pivot, t;
+    size_t mid = n / 2;
+
+    // median of three
+    if (sort_compare(ctx, idx[mid], idx[0]) < 0)      { t = idx[mid]; idx[mid] = idx[0];   idx[0] = t;   }
+    if (sort_compare(ctx, idx[n-1], idx[mid]) < 0)    { t = idx[n-1]; idx[n-1] = idx[mid]; idx[mid] = t;
+      if (sort_compare(ctx, idx[mid], idx[0]) < 0)    { t = idx[mid]; idx[mid] = idx[0];   idx[0] = t;   }
+    }
+    pivot = idx[mid];
+
+    // hoare partition
+    i = 0; j = n - 1;
+    for (;;)
+    {
+      while (sort_compare(ctx, idx[i], pivot) < 0) ++i;
+      while (sort_compare(ctx, pivot, idx[j]) < 0) --j;
+      if (i >= j)
+        break;
+      t = idx[i]; idx[i] = idx[j]; idx[j] = t;
+      ++i; --j;
+    }
+
+    // recurse into smaller part, loop on larger part
+    if ((j + 1) < (n - j - 1))
+    {
+      sort_quick(ctx, idx, j + 1);
+      idx += j + 1;
+      n   -= j + 1;
+    }
+    else
+    {
+      sort_quick(ctx, idx + j + 1, n - j - 1);
+      n = j + 1;
+    }
+  }
+  sort_insertion(ctx, idx, n);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arr:sort(key1, key2, ... [, options]) for wrapped arrays.
+
+  Each key is a (dotted) member path of the element type, prefixed by
+  '-' for descending or '+' for ascending order. An empty key
+  (or no key at all) sorts by the element value itself.
+  The optional options table supports
+    - stable    (boolean) use a stable sort algorithm
+
+  Pointer references held by the outer object are moved along
+  with their elements.
+
+  Parameters on lua stack:
+    - self  (wrapped array)
+    - keys  (strings)
+    - options (table, optional)
+
+  Return values on lua stack
+    - self
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayops_sort(lua_State* L)
+{
+  SortContext         ctx;
+  luacwrap_ArrayType* arrdesc;
+  luacwrap_Type*      elemdesc;
+  unsigned int*       perm;
+  unsigned int*       newpos;
+  PBYTE               tmp;
+  size_t              n, i;
+  int                 stable = 0;
+  int                 nargs, arg;
+  int                 outeroffset;
+
+  LUASTACK_SET(L);
+
+  ctx.base     = luacwrap_checkarray(L, 1, &arrdesc, &elemdesc);
+  ctx.elemsize = arrdesc->elemsize;
+  ctx.nkeys    = 0;
+
+  luacwrap_checkwritable(L, 1);
+
+  // get options
+  nargs = lua_gettop(L);
+  if ((nargs > 1) && lua_istable(L, nargs))
+  {
+    lua_getfield(L, nargs, "stable");
+    stable = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    --nargs;
+  }
+
+  // resolve sort keys
+  for (arg = 2; arg <= nargs; ++arg)
+  {
+    if (ARRAYOPS_MAXKEYS == ctx.nkeys)
+    {
+      luaL_error(L, "too many sort keys (maximum is %d)", ARRAYOPS_MAXKEYS);
+    }
+
+    arrayops_checkkey(L, arg, elemdesc, &ctx.keys[ctx.nkeys++]);
+  }
+
+  // sort by element value
+  if (0 == ctx.nkeys)
+  {
+    luacwrap_field_resolve(L, elemdesc, "", &ctx.keys[ctx.nkeys++]);
+  }
+
+  n = arrdesc->elemcount;
+  if (n > 1)
+  {
+    // scratch memory is maintained by lua to be safe on errors
+    perm   = (unsigned int*)lua_newuserdata(L, 2 * n * sizeof(unsigned int));
+    newpos = perm + n;
+    tmp    = (PBYTE)lua_newuserdata(L, n * ctx.elemsize);
+
+    for (i = 0; i < n; ++i)
+    {
+      perm[i] = (unsigned int)i;
+    }
+
+    // sort indices
+    if (stable)
+    {
+      sort_merge(&ctx, perm, newpos, n);
+    }
+    else
+    {
+      sort_quick(&ctx, perm, n);
+    }
+
+    // reorder raw memory
+    for (i = 0; i < n; ++i)
+    {
+      memcpy(tmp + i * ctx.elemsize, ctx.base + (size_t)perm[i] * ctx.elemsize, ctx.elemsize);
+      newpos[perm[i]] = (unsigned int)i;
+    }
+    memcpy(ctx.base, tmp, n * ctx.elemsize);
+
+    // move pointer references stored within the outer object
+    if (luacwrap_getouter(L, 1, &outeroffset))
+    {
+      luacwrap_mobj_permute_references(L, -1, outeroffset, ctx.elemsize, (int)n, newpos);
+      lua_pop(L, 1);
+    }
+
+    // pop scratch memory
+    lua_pop(L, 2);
+  }
+
+  // return self
+  lua_pushvalue(L, 1);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Binary search on a sorted array. Returns the 0-based index of the
+  first element which key is not less than (upper = 0) or
+  greater than (upper = 1) the given value.
+
+*/////////////////////////////////////////////////////////////////////////
+static size_t arrayops_bound( const PBYTE                 base
+                            , size_t                      elemsize
+                            , size_t                      n
+                            , const luacwrap_FieldKey*    key
+                            , const luacwrap_FieldValue*  value
+                            , int                         upper)
+{
+  size_t lo = 0;
+  size_t hi = n;
+
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    int result = luacwrap_field_comparevalue(key, base + mid * elemsize + key->offset, value) * key->dir;
+
+    if ((result < 0) || (upper && (0 == result)))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Gets key and value parameters of the search functions.
+
+  Parameters on lua stack:
+    - self  (wrapped array)
+    - key   (string, optional for arrays of basic types)
+    - value
+
+  @return stack index of value
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayops_searchparams( lua_State*            L
+                                , PBYTE*                base
+                                , luacwrap_ArrayType**  arrdesc
+                                , luacwrap_FieldKey*    key
+                                , luacwrap_FieldValue*  value)
+{
+  luacwrap_Type* elemdesc;
+  int validx = 3;
+
+  *base = luacwrap_checkarray(L, 1, arrdesc, &elemdesc);
+
+  if (lua_gettop(L) < 3)
+  {
+    // search by element value
+    luacwrap_field_resolve(L, elemdesc, "", key);
+    validx = 2;
+  }
+  else
+  {
+    arrayops_checkkey(L, 2, elemdesc, key);
+  }
+
+  luacwrap_field_tovalue(L, validx, key, value);
+  return validx;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arr:lowerbound([key,] value) on sorted arrays.
+  Returns the 1-based index of the first element which key is not
+  less than value or #arr+1 if there is no such element.
+  Use a key prefixed with '-' for arrays sorted in descending order.
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayops_lowerbound(lua_State* L)
+{
+  PBYTE               base;
+  luacwrap_ArrayType* arrdesc;
+  luacwrap_FieldKey   key;
+  luacwrap_FieldValue value;
+
+  LUASTACK_SET(L);
+
+  arrayops_searchparams(L, &base, &arrdesc, &key, &value);
+
+  lua_pushinteger(L, 1 + arrayops_bound(base, arrdesc->elemsize, arrdesc->elemcount, &key, &value, 0));
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arr:upperbound([key,] value) on sorted arrays.
+  Returns the 1-based index of the first element which key is
+  greater than value or #arr+1 if there is no such element.
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayops_upperbound(lua_State* L)
+{
+  PBYTE               base;
+  luacwrap_ArrayType* arrdesc;
+  luacwrap_FieldKey   key;
+  luacwrap_FieldValue value;
+
+  LUASTACK_SET(L);
+
+  arrayops_searchparams(L, &base, &arrdesc, &key, &value);
+
+  lua_pushinteger(L, 1 + arrayops_bound(base, arrdesc->elemsize, arrdesc->elemcount, &key, &value, 1));
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arr:find([key,] value) on sorted arrays.
+  Returns the 1-based index of the first element which key equals
+  value or nil if there is no such element.
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayops_find(lua_State* L)
+{
+  PBYTE               base;
+  luacwrap_ArrayType* arrdesc;
+  luacwrap_FieldKey   key;
+  luacwrap_FieldValue value;
+  size_t              pos;
+
+  LUASTACK_SET(L);
+
+  arrayops_searchparams(L, &base, &arrdesc, &key, &value);
+
+  pos = arrayops_bound(base, arrdesc->elemsize, arrdesc->elemcount, &key, &value, 0);
+  if ( (pos < arrdesc->elemcount) 
+    && (0 == luacwrap_field_comparevalue(&key, base + pos * arrdesc->elemsize + key.offset, &value)))
+  {
+    lua_pushinteger(L, 1 + pos);
+  }
+  else
+  {
+    lua_pushnil(L);
+  }
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  compiled predicate of arr:select()
+
+*/////////////////////////////////////////////////////////////////////////
+typedef struct SelectPredicate
+{
+  luacwrap_FieldKey   key;
+  luacwrap_FieldValue value;
+  int                 op;
+} SelectPredicate;
+
+// comparison operators of predicates
+enum { SELECT_EQ, SELECT_NE, SELECT_LT, SELECT_LE, SELECT_GT, SELECT_GE, SELECT_NE2 };
+
+static const char* g_selectOps[] = { "==", "~=", "<", "<=", ">", ">=", "!=", NULL };
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Returns true if the key member or the value of a predicate is NaN.
+  Like in lua, unordered values only satisfy ~=.
+
+*/////////////////////////////////////////////////////////////////////////
+static int select_unordered(const SelectPredicate* pred, const BYTE* pfield)
+{
+  switch (pred->key.kind)
+  {
+    case LUACWRAP_NK_BYTES:
+      return 0;
+    case LUACWRAP_NK_FLT:
+      if (*(const float*)pfield != *(const float*)pfield)
+        return 1;
+      break;
+    case LUACWRAP_NK_DBL:
+      if (*(const double*)pfield != *(const double*)pfield)
+        return 1;
+      break;
+  }
+  return !pred->value.isint && (pred->value.num != pred->value.num);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Evaluate the conjunction of all predicates on an element.
+
+*/////////////////////////////////////////////////////////////////////////
+static int select_match(const SelectPredicate* preds, int npreds, const BYTE* pelem)
+{
+  int k;
+
+  for (k = 0; k < npreds; ++k)
+  {
+    const SelectPredicate* pred = &preds[k];
+    int result;
+
+    if (select_unordered(pred, pelem + pred->key.offset))
+    {
+      if (SELECT_NE != pred->op)
+        return 0;
+      continue;
+    }
+
+    result = luacwrap_field_comparevalue(&pred->key, pelem + pred->key.offset, &pred->value);
+
+    switch (pred->op)
+    {
+      case SELECT_EQ: if (0 != result) return 0; break;
+      case SELECT_NE: if (0 == result) return 0; break;
+      case SELECT_LT: if (result >= 0) return 0; break;
+      case SELECT_LE: if (result >  0) return 0; break;
+      case SELECT_GT: if (result <= 0) return 0; break;
+      case SELECT_GE: if (result <  0) return 0; break;
+    }
+  }
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements arr:select(predicates [, options]) for wrapped arrays.
+
+  Each predicate is a table {key, op, value} with a (dotted) member
+  path, one of the operators ==, ~=, !=, <, <=, >, >= and a value.
+  The predicates are resolved once and their conjunction is
+  evaluated on the raw array memory.
+  The optional options table supports
+    - astable   (boolean) return a lua table instead of a $u32 array
+
+  Parameters on lua stack:
+    - self  (wrapped array)
+    - predicates (table)
+    - options (table, optional)
+
+  Return values on lua stack
+    - 1-based indices of matching elements ($u32 array or table)
+
+*/////////////////////////////////////////////////////////////////////////
+static int arrayops_select(lua_State* L)
+{
+  SelectPredicate     preds[ARRAYOPS_MAXKEYS];
+  luacwrap_ArrayType* arrdesc;
+  luacwrap_Type*      elemdesc;
+  PBYTE               base;
+  unsigned int*       matches;
+  size_t              n, i, count;
+  int                 npreds, k;
+  int                 astable = 0;
+  const char*         path;
+  const char*         op;
+
+  LUASTACK_SET(L);
+
+  base = luacwrap_checkarray(L, 1, &arrdesc, &elemdesc);
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  // get options
+  if (lua_istable(L, 3))
+  {
+    lua_getfield(L, 3, "astable");
+    astable = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
+
+  // compile predicates
+#if (LUA_VERSION_NUM > 501)
+  npreds = (int)lua_rawlen(L, 2);
+#else
+  npreds = (int)lua_objlen(L, 2);
+#endif
+  if (npreds > ARRAYOPS_MAXKEYS)
+  {
+    luaL_error(L, "too many predicates (maximum is %d)", ARRAYOPS_MAXKEYS);
+  }
+
+  for (k = 0; k < npreds; ++k)
+  {
+    SelectPredicate* pred = &preds[k];
+
+    lua_rawgeti(L, 2, k + 1);
+    if (!lua_istable(L, -1))
+    {
+      luaL_error(L, "predicate #%d: table {key, op, value} expected", k + 1);
+    }
+    lua_rawgeti(L, -1, 1);
+    lua_rawgeti(L, -2, 2);
+    lua_rawgeti(L, -3, 3);
+
+    path = lua_tostring(L, -3);
+    op   = lua_tostring(L, -2);
+    if ((NULL == path) || (NULL == op))
+    {
+      luaL_error(L, "predicate #%d: table {key, op, value} expected", k + 1);
+    }
+
+    luacwrap_field_resolve(L, elemdesc, path, &pred->key);
+
+    for (pred->op = 0; g_selectOps[pred->op] && strcmp(g_selectOps[pred->op], op); ++pred->op)
+      ;
+    if (NULL == g_selectOps[pred->op])
+    {
+      luaL_error(L, "predicate #%d: unknown operator <%s>", k + 1, op);
+    }
+    else if (SELECT_NE2 == pred->op)
+    {
+      pred->op = SELECT_NE;
+    }
+
+    // string values stay referenced by the predicate table
+    luacwrap_field_tovalue(L, lua_gettop(L), &pred->key, &pred->value);
+
+    lua_pop(L, 4);
+  }
+
+  // evaluate predicates
+  n = arrdesc->elemcount;
+  matches = (unsigned int*)lua_newuserdata(L, (n ? n : 1) * sizeof(unsigned int));
+  count = 0;
+  for (i = 0; i < n; ++i)
+  {
+    if (select_match(preds, npreds, base + i * arrdesc->elemsize))
+    {
+      matches[count++] = (unsigned int)(i + 1);
+    }
+  }
+
+  // create result
+  if (astable)
+  {
+    lua_createtable(L, (int)count, 0);
+    for (i = 0; i < count; ++i)
+    {
+      lua_pushinteger(L, matches[i]);
+      lua_rawseti(L, -2, (int)(i + 1));
+    }
+  }
+  else
+  {
+    luacwrap_Type* u32desc = luacwrap_getdescriptor_byname(L, "$u32", -1);
+    void* result = luacwrap_pushnewarray(L, u32desc, (int)count);
+    memcpy(result, matches, count * sizeof(unsigned int));
+  }
+
+  // drop scratch memory
+  lua_remove(L, -2);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+// builtin methods of array objects
+luaL_Reg g_ArrayMethods[ ] = {
+  { "sort"      , arrayops_sort       },
+  { "lowerbound", arrayops_lowerbound },
+  { "upperbound", arrayops_upperbound },
+  { "find"      , arrayops_find       },
+  { "index"     , luacwrap_arrayindex_new },
+  { "select"    , arrayops_select     },
+  { "aggregate" , luacwrap_arrayindex_aggregate },
+  { "tobytes"   , luacwrap_tobytes    },
+  { "setjson"   , luacwrap_setjson    },
+  { "setmsgpack", luacwrap_setmsgpack },
+  { NULL, NULL }
+};
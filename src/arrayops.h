@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Bulk operations on wrapped arrays (sort, search, ...) which work
+  directly on the raw array memory
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+#include "stdint.h"
+
+// key kind for fixed size byte keys (char arrays, buffers)
+#define LUACWRAP_NK_BYTES   32
+
+//
+// describes a key member within an array element
+//
+typedef struct luacwrap_FieldKey
+{
+  unsigned int  offset;     // offset of key within element
+  unsigned int  size;       // size of key in bytes
+  int           kind;       // LUACWRAP_NK_xxx
+  int           dir;        // sort direction (1 = ascending, -1 = descending)
+} luacwrap_FieldKey;
+
+//
+// a lua value converted to be compared against a key member
+//
+typedef struct luacwrap_FieldValue
+{
+  lua_Number    num;        // numeric value
+  int64_t       i;          // numeric value as integer (if isint)
+  int           isint;      // 1 if value is integral and fits into 64 bits
+  const char*   str;        // string value (for LUACWRAP_NK_BYTES)
+  size_t        len;        // length of string value
+} luacwrap_FieldValue;
+
+//
+// resolve a (dotted) member path of an element type to a key
+//
+void luacwrap_field_resolve       ( lua_State*          L
+                                  , luacwrap_Type*      elemdesc
+                                  , const char*         path
+                                  , luacwrap_FieldKey*  key);
+
+//
+// convert the lua value at the given stack index to a key value
+//
+void luacwrap_field_tovalue       ( lua_State*                L
+                                  , int                       idx
+                                  , const luacwrap_FieldKey*  key
+                                  , luacwrap_FieldValue*      value);
+
+//
+// compare the key members of two elements
+//
+int luacwrap_field_compare        ( const luacwrap_FieldKey*  key
+                                  , const BYTE*               a
+                                  , const BYTE*               b);
+
+//
+// compare the key member of an element with a key value
+//
+int luacwrap_field_comparevalue   ( const luacwrap_FieldKey*    key
+                                  , const BYTE*                 a
+                                  , const luacwrap_FieldValue*  value);
+
+//
+// get the value of a numeric key member
+//
+lua_Number luacwrap_field_tonumber  ( const luacwrap_FieldKey*  key
+                                    , const BYTE*               a);
+
+//
+// push the value of a key member on the lua stack
+//
+void luacwrap_field_push          ( lua_State*                L
+                                  , const luacwrap_FieldKey*  key
+                                  , const BYTE*               a);
+
+//
+// check for a wrapped array and return its base pointer
+//
+PBYTE luacwrap_checkarray         ( lua_State*            L
+                                  , int                   idx
+                                  , luacwrap_ArrayType**  arrdesc
+                                  , luacwrap_Type**       elemdesc);
+
+//
+// hashing of key members (integers, char arrays and buffers)
+//
+void luacwrap_field_checkhashable ( lua_State*                  L
+                                  , const char*                 path
+                                  , const luacwrap_FieldKey*    key);
+
+size_t luacwrap_field_hash        ( const luacwrap_FieldKey*    key
+                                  , const BYTE*                 a);
+
+int luacwrap_field_hashvalue      ( const luacwrap_FieldKey*    key
+                                  , const luacwrap_FieldValue*  value
+                                  , size_t*                     hash);
+
+//
+// implements arr:index(key)
+//
+int luacwrap_arrayindex_new       ( lua_State*                  L);
+
+//
+// implements arr:aggregate(key, functions)
+//
+int luacwrap_arrayindex_aggregate ( lua_State*                  L);
+
+// builtin methods of array objects
+extern luaL_Reg g_ArrayMethods[];
+
+// metatable of array index objects
+extern luaL_Reg g_mtArrayIndex[];
@@ -0,0 +1,244 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  External (not lua managed) memory for boxed objects.
+
+  Objects created with TYPE:new(init, luacwrap.external) are indirect
+  objects which memory is allocated via allocator hooks. The hooks
+  could be replaced through the C interface (e.g. to use a slab
+  allocator or a huge page pool). The memory is released when the 
+  object is collected or explicitly via obj:free().
+
+  Lua has no API to account external memory, so allocations perform
+  an incremental GC step proportional to the allocated size to keep
+  the collection pacing close to the one of lua managed memory.
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+
+#include "luaaux.h"
+#include "external.h"
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  default allocator hooks. Blocks with an alignment above the one 
+  guaranteed by malloc are over-allocated, the pointer to the 
+  allocated block is stored in front of the aligned memory.
+
+*/////////////////////////////////////////////////////////////////////////
+static void* external_malloc(void* ud, size_t size, size_t align)
+{
+  PBYTE block;
+  PBYTE ptr;
+
+  if (align <= LUACWRAP_USERDATA_ALIGN)
+  {
+    return malloc(size);
+  }
+
+  block = (PBYTE)malloc(size + align + sizeof(void*));
+  if (NULL == block)
+  {
+    return NULL;
+  }
+  ptr = (PBYTE)(((size_t)(block + sizeof(void*)) + align - 1) & ~(align - 1));
+  ((void**)ptr)[-1] = block;
+  return ptr;
+}
+
+static void external_free(void* ud, void* ptr, size_t size, size_t align)
+{
+  if (align <= LUACWRAP_USERDATA_ALIGN)
+  {
+    free(ptr);
+  }
+  else
+  {
+    free(((void**)ptr)[-1]);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Get allocator at the given stack index.
+
+  @return allocator or NULL if the value is not an allocator
+
+*/////////////////////////////////////////////////////////////////////////
+luacwrap_Allocator* luacwrap_toallocator(lua_State* L, int idx)
+{
+  return (luacwrap_Allocator*)luacwrap_toudata(L, idx, (void*)g_mtAllocator);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Releases the external memory of an indirect object.
+
+*/////////////////////////////////////////////////////////////////////////
+static void external_release(lua_State* L, luacwrap_IndirectObject* pobj)
+{
+  luacwrap_Allocator* allocator = (luacwrap_Allocator*)pobj->releasedata;
+
+  allocator->freefn(allocator->ud, pobj->ptr, pobj->size, pobj->align);
+  allocator->used -= pobj->size;
+  --allocator->count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Allocate external memory and create an indirect object header for
+  it on the top of the lua stack.
+
+  @param[in]  L           lua state
+  @param[in]  allocator   allocator to use
+  @param[in]  size        number of bytes
+  @param[in]  align       required alignment (power of two)
+
+  @return pointer to (uninitialized) memory
+
+*/////////////////////////////////////////////////////////////////////////
+void* luacwrap_allocator_pushobj(lua_State* L, luacwrap_Allocator* allocator, size_t size, size_t align)
+{
+  void* ptr;
+
+  LUASTACK_SET(L);
+
+  // create header first, so that a failing allocation does not leak
+  luacwrap_pushindirectobj(L, NULL, size, align, NULL, external_release, allocator);
+
+  ptr = allocator->allocfn(allocator->ud, size ? size : 1, align);
+  if (NULL == ptr)
+  {
+    luaL_error(L, "allocation of %d bytes of external memory failed", (int)size);
+  }
+  ((luacwrap_IndirectObject*)lua_touserdata(L, -1))->ptr = (PBYTE)ptr;
+
+  allocator->used += size;
+  ++allocator->count;
+
+  // let the collector do the work it would do for lua managed memory
+  if (size >= 1024)
+  {
+    lua_gc(L, LUA_GCSTEP, (int)(size >> 10));
+  }
+
+  LUASTACK_CLEAN(L, 1);
+  return ptr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Set allocator hooks. Creates a new allocator and stores it as 
+  luacwrap.external. Objects keep the allocator they have been
+  allocated from.
+
+  @param[in]  L         lua state
+  @param[in]  allocfn   allocation hook (NULL = malloc)
+  @param[in]  freefn    release hook (NULL = free)
+  @param[in]  ud        user data passed to hooks
+
+  Both hooks have to be given (or both NULL), the default release 
+  hook could not release memory of another allocation hook.
+
+*/////////////////////////////////////////////////////////////////////////
+void luacwrap_setallocator( lua_State*        L
+                          , luacwrap_alloc_t  allocfn
+                          , luacwrap_free_t   freefn
+                          , void*             ud)
+{
+  luacwrap_Allocator* allocator;
+
+  LUASTACK_SET(L);
+
+  if ((NULL == allocfn) != (NULL == freefn))
+  {
+    luaL_error(L, "luacwrap: bad argument to setallocator (allocation and release hooks have to be given together)");
+  }
+
+  allocator = (luacwrap_Allocator*)lua_newuserdata(L, sizeof(luacwrap_Allocator));
+  allocator->allocfn = allocfn ? allocfn : external_malloc;
+  allocator->freefn  = freefn  ? freefn  : external_free;
+  allocator->ud      = ud;
+  allocator->used    = 0;
+  allocator->count   = 0;
+
+  // get/attach metatable
+  lua_pushlightuserdata(L, (void*)g_mtAllocator);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  assert(lua_istable(L, -1));
+  lua_setmetatable(L, -2);
+
+  // store as _M.external
+  getmoduletable(L);
+  lua_insert(L, -2);
+  lua_setfield(L, -2, "external");
+  lua_pop(L, 1);
+
+  LUASTACK_CLEAN(L, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements allocator:new(TYPE [, init]).
+  Same as TYPE:new(init, allocator).
+
+*/////////////////////////////////////////////////////////////////////////
+static int allocator_newobj(lua_State* L)
+{
+  if (NULL == luacwrap_toallocator(L, 1))
+  {
+    luaL_argerror(L, 1, "allocator expected");
+  }
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_settop(L, 3);
+
+  // call TYPE:new(init, allocator)
+  lua_getfield(L, 2, "new");
+  lua_pushvalue(L, 2);
+  lua_pushvalue(L, 3);
+  lua_pushvalue(L, 1);
+  lua_call(L, 3, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements allocator:usage().
+
+  Return values on lua stack
+    - number of currently allocated bytes
+    - number of currently allocated objects
+
+*/////////////////////////////////////////////////////////////////////////
+static int allocator_usage(lua_State* L)
+{
+  luacwrap_Allocator* allocator = luacwrap_toallocator(L, 1);
+  if (NULL == allocator)
+  {
+    luaL_argerror(L, 1, "allocator expected");
+  }
+
+  lua_pushinteger(L, (lua_Integer)allocator->used);
+  lua_pushinteger(L, (lua_Integer)allocator->count);
+  return 2;
+}
+
+// metatable of allocator objects
+luaL_Reg g_mtAllocator[ ] = {
+  { "new"   , allocator_newobj  },
+  { "usage" , allocator_usage   },
+  { NULL, NULL }
+};
@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  External (not lua managed) memory for boxed objects
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+//
+// allocator for external object memory
+//
+typedef struct luacwrap_Allocator
+{
+  luacwrap_alloc_t  allocfn;    // allocation hook
+  luacwrap_free_t   freefn;     // release hook
+  void*             ud;         // user data passed to hooks
+  size_t            used;       // number of currently allocated bytes
+  size_t            count;      // number of currently allocated objects
+} luacwrap_Allocator;
+
+//
+// get allocator at the given stack index (or NULL)
+//
+luacwrap_Allocator* luacwrap_toallocator  ( lua_State*          L
+                                          , int                 idx);
+
+//
+// allocate external memory and create an indirect object header for it
+//
+void* luacwrap_allocator_pushobj          ( lua_State*          L
+                                          , luacwrap_Allocator* allocator
+                                          , size_t              size
+                                          , size_t              align);
+
+//
+// set allocator hooks (creates a new luacwrap.external)
+//
+void luacwrap_setallocator                ( lua_State*          L
+                                          , luacwrap_alloc_t    allocfn
+                                          , luacwrap_free_t     freefn
+                                          , void*               ud);
+
+// metatable of allocator objects
+extern luaL_Reg g_mtAllocator[];
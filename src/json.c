@@ -0,0 +1,1328 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  JSON encoding and decoding of wrapped objects.
+
+  The encoder walks the type descriptors and formats the object memory
+  directly into a luaL_Buffer (or a file), without creating Lua values
+  for the members:
+
+    - records are written as objects with the member names as keys
+    - arrays are written as JSON arrays, arrays of $char as strings
+      (up to the first NUL character)
+    - buffers are written as strings (up to the first NUL character)
+    - numeric members are formatted from memory, NaN and infinity
+      are written as null
+    - other basic types (pointers, references, custom types) are
+      written through their get wrappers, values which are neither
+      nil, booleans, numbers nor strings are written as null
+
+  The decoder is guided by the type descriptors as well and writes the
+  values directly into the object memory:
+
+    - object keys are matched with the member names of records,
+      unknown keys are skipped without creating Lua values
+    - numbers (and true/false) are stored into numeric members,
+      null leaves a member unchanged
+    - strings are stored into arrays of 1 byte elements and buffers
+      (truncated to their size, the rest is filled with zeros)
+    - JSON arrays are stored into array elements
+    - other basic types (pointers, references) are set through their
+      set wrappers with the decoded string, number or boolean
+
+  Errors report the JSON path of the value, e.g. $.inner.items[3].
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "luaaux.h"
+#include "json.h"
+#include "wrapnumeric.h"
+
+// size of the output buffer used when writing to files
+#define JSON_FILEBUFSIZE  8192
+
+// maximal nesting depth of parsed JSON values
+#define JSON_MAX_DEPTH    128
+
+//
+// output of the encoder
+//
+typedef struct json_Out
+{
+  luaL_Buffer*      b;          // string buffer (NULL when writing to a file)
+  FILE*             f;          // file (NULL when writing to a string)
+  int               failed;     // writing to the file failed
+  int               indent;     // number of spaces per level (0 = compact)
+  int               chararrays; // write arrays of $char as strings
+  int               keep;       // stack index of table keeping strings alive
+  size_t            len;        // number of bytes within buf
+  char              buf[JSON_FILEBUFSIZE];
+} json_Out;
+
+//
+// element of the path to the currently parsed value
+//
+typedef struct json_PathElem
+{
+  const char*       key;        // object key (NULL for array elements)
+  size_t            keylen;     // length of key
+  int               index;      // zero based array index
+} json_PathElem;
+
+//
+// state of the decoder
+//
+typedef struct json_Parser
+{
+  lua_State*        L;
+  const char*       start;      // start of the input
+  const char*       p;          // next character
+  const char*       end;        // end of the input
+  int               depth;      // number of path elements
+  json_PathElem     path[JSON_MAX_DEPTH];
+} json_Parser;
+
+//
+// destination of decoded strings
+//
+typedef struct json_Sink
+{
+  luaL_Buffer*      b;          // string buffer (or NULL)
+  char*             dst;        // memory (if b is NULL)
+  size_t            cap;        // size of dst
+  size_t            len;        // number of decoded bytes
+} json_Sink;
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Writes the buffered output to the file.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_flush(json_Out* out)
+{
+  if (out->len > 0)
+  {
+    if (out->len != fwrite(out->buf, 1, out->len, out->f))
+    {
+      out->failed = 1;
+    }
+    out->len = 0;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends bytes to the output.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_write(json_Out* out, const char* s, size_t len)
+{
+  if (out->b)
+  {
+    luaL_addlstring(out->b, s, len);
+  }
+  else
+  {
+    if (len > sizeof(out->buf) - out->len)
+    {
+      json_flush(out);
+    }
+    if (len >= sizeof(out->buf))
+    {
+      if (len != fwrite(s, 1, len, out->f))
+      {
+        out->failed = 1;
+      }
+    }
+    else
+    {
+      memcpy(out->buf + out->len, s, len);
+      out->len += len;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a single character to the output.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_putc(json_Out* out, char c)
+{
+  if (out->b)
+  {
+    luaL_addchar(out->b, c);
+  }
+  else
+  {
+    if (out->len == sizeof(out->buf))
+    {
+      json_flush(out);
+    }
+    out->buf[out->len++] = c;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Starts a new line of the given nesting depth (if indenting).
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_newline(json_Out* out, int depth)
+{
+  int n;
+
+  if (out->indent > 0)
+  {
+    json_putc(out, '\n');
+    for (n = depth * out->indent; n > 0; n--)
+    {
+      json_putc(out, ' ');
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a quoted and escaped string to the output.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_string(json_Out* out, const char* s, size_t len)
+{
+  static const char s_hex[] = "0123456789abcdef";
+  const char* run = s;
+  const char* end = s + len;
+
+  json_putc(out, '"');
+  for (; s < end; s++)
+  {
+    unsigned char c = (unsigned char)*s;
+    char esc[6];
+    size_t esclen = 2;
+
+    if ((c >= 0x20) && (c != '"') && (c != '\\'))
+    {
+      continue;
+    }
+
+    // write unescaped characters at once
+    json_write(out, run, s - run);
+    run = s + 1;
+
+    esc[0] = '\\';
+    switch (c)
+    {
+      case '"' : esc[1] = '"';  break;
+      case '\\': esc[1] = '\\'; break;
+      case '\b': esc[1] = 'b';  break;
+      case '\f': esc[1] = 'f';  break;
+      case '\n': esc[1] = 'n';  break;
+      case '\r': esc[1] = 'r';  break;
+      case '\t': esc[1] = 't';  break;
+      default:
+        esc[1] = 'u';
+        esc[2] = '0';
+        esc[3] = '0';
+        esc[4] = s_hex[c >> 4];
+        esc[5] = s_hex[c & 0xF];
+        esclen = 6;
+    }
+    json_write(out, esc, esclen);
+  }
+  json_write(out, run, s - run);
+  json_putc(out, '"');
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a NUL terminated string of a fixed size memory block.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_cstring(json_Out* out, const char* s, size_t size)
+{
+  const char* end = (const char*)memchr(s, 0, size);
+
+  json_string(out, s, end ? (size_t)(end - s) : size);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a floating point number (null for NaN and infinity).
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_double(json_Out* out, double value, const char* fmt)
+{
+  char num[64];
+
+  if ((value != value) || (value - value != 0))
+  {
+    json_write(out, "null", 4);
+  }
+  else
+  {
+    json_write(out, num, sprintf(num, fmt, value));
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a numeric member formatted directly from memory.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_number(json_Out* out, int kind, PBYTE p)
+{
+  char num[32];
+  int len = 0;
+
+  switch (kind)
+  {
+    case LUACWRAP_NK_I8 : len = sprintf(num, "%d", (int)*(const int8_t*  )p); break;
+    case LUACWRAP_NK_U8 : len = sprintf(num, "%u", (unsigned int)*(const uint8_t* )p); break;
+    case LUACWRAP_NK_I16: len = sprintf(num, "%d", (int)*(const int16_t* )p); break;
+    case LUACWRAP_NK_U16: len = sprintf(num, "%u", (unsigned int)*(const uint16_t*)p); break;
+    case LUACWRAP_NK_I32: len = sprintf(num, "%ld", (long)*(const int32_t* )p); break;
+    case LUACWRAP_NK_U32: len = sprintf(num, "%lu", (unsigned long)*(const uint32_t*)p); break;
+    case LUACWRAP_NK_I64: len = sprintf(num, "%lld", (long long)*(const int64_t* )p); break;
+    case LUACWRAP_NK_U64: len = sprintf(num, "%llu", (unsigned long long)*(const uint64_t*)p); break;
+    case LUACWRAP_NK_FLT: json_double(out, *(const float* )p, "%.9g");  return;
+    case LUACWRAP_NK_DBL: json_double(out, *(const double*)p, "%.17g"); return;
+  }
+  json_write(out, num, len);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends the value of a basic type returned by its get wrapper.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_luavalue( lua_State*          L
+                         , json_Out*           out
+                         , luacwrap_BasicType* desc
+                         , PBYTE               base
+                         , int                 offset)
+{
+  luacwrap_BasicValue value;
+
+  luacwrap_getbasicvalue(L, desc, base, offset, out->keep, &value);
+  switch (value.type)
+  {
+    case LUA_TBOOLEAN:
+      if (value.number)
+        json_write(out, "true", 4);
+      else
+        json_write(out, "false", 5);
+      break;
+    case LUA_TNUMBER:
+      json_double(out, value.number, "%.17g");
+      break;
+    case LUA_TSTRING:
+      json_string(out, value.s, value.len);
+      break;
+    default:
+      json_write(out, "null", 4);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends the JSON representation of an object.
+
+  @param[in]  base    memory of the outer object (at stack index 1)
+  @param[in]  offset  offset of the object within the outer object
+  @param[in]  desc    type of the object
+  @param[in]  depth   nesting depth (for indentation)
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_value( lua_State*      L
+                      , json_Out*       out
+                      , PBYTE           base
+                      , int             offset
+                      , luacwrap_Type*  desc
+                      , int             depth)
+{
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC:
+      {
+        int kind = luacwrap_numerickind(desc);
+        if (LUACWRAP_NK_NONE != kind)
+        {
+          json_number(out, kind, base + offset);
+        }
+        else
+        {
+          json_luavalue(L, out, (luacwrap_BasicType*)desc, base, offset);
+        }
+      }
+      break;
+
+    case LUACWRAP_TC_RECORD:
+      {
+        luacwrap_RecordMember* member = ((luacwrap_RecordType*)desc)->members;
+
+        json_putc(out, '{');
+        for (; member->membername; member++)
+        {
+          if (member != ((luacwrap_RecordType*)desc)->members)
+          {
+            json_putc(out, ',');
+          }
+          json_newline(out, depth + 1);
+          json_string(out, member->membername, strlen(member->membername));
+          json_putc(out, ':');
+          if (out->indent > 0)
+          {
+            json_putc(out, ' ');
+          }
+          json_value(L, out, base, offset + member->memberoffset, luacwrap_getmembertype(L, member), depth + 1);
+        }
+        if (member != ((luacwrap_RecordType*)desc)->members)
+        {
+          json_newline(out, depth);
+        }
+        json_putc(out, '}');
+      }
+      break;
+
+    case LUACWRAP_TC_ARRAY:
+      {
+        luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+        luacwrap_Type* elemdesc = luacwrap_getelemtype(L, arrdesc);
+        unsigned int n;
+
+        if (out->chararrays && (0 == strcmp(elemdesc->name, "$char")))
+        {
+          json_cstring(out, (const char*)base + offset, arrdesc->elemcount);
+          break;
+        }
+
+        json_putc(out, '[');
+        for (n = 0; n < arrdesc->elemcount; n++)
+        {
+          if (n > 0)
+          {
+            json_putc(out, ',');
+          }
+          json_newline(out, depth + 1);
+          json_value(L, out, base, offset + n * arrdesc->elemsize, elemdesc, depth + 1);
+        }
+        if (n > 0)
+        {
+          json_newline(out, depth);
+        }
+        json_putc(out, ']');
+      }
+      break;
+
+    case LUACWRAP_TC_BUFFER:
+      json_cstring(out, (const char*)base + offset, ((luacwrap_BufferType*)desc)->size);
+      break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Prepares encoding of the wrapped object at stack index obj with the
+  options at stack index opts. Replaces stack index 1 with the outer
+  object (get wrappers of pointer members expect it there) and pushes
+  a table to keep strings alive.
+
+  @return type of the object
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_Type* json_begin( lua_State*  L
+                                , json_Out*   out
+                                , int         obj
+                                , int         opts
+                                , PBYTE*      base
+                                , int*        offset)
+{
+  luacwrap_Type* desc = luacwrap_checkobject(L, obj);
+
+  // options
+  out->indent     = 0;
+  out->chararrays = 1;
+  if (lua_istable(L, opts))
+  {
+    lua_getfield(L, opts, "indent");
+    out->indent = (int)luaL_optinteger(L, -1, 0);
+    lua_getfield(L, opts, "chararrays");
+    if (!lua_isnil(L, -1))
+    {
+      out->chararrays = lua_toboolean(L, -1);
+    }
+    lua_pop(L, 2);
+    luaL_argcheck(L, (out->indent >= 0) && (out->indent <= 16), opts, "indent out of range");
+  }
+
+  *base = (PBYTE)luacwrap_replaceouter(L, obj, offset);
+
+  lua_createtable(L, 1, 0);
+  out->keep = lua_gettop(L);
+  return desc;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Encodes a wrapped object as JSON string.
+
+  Parameters on lua stack:
+    - obj     (boxed or embedded object)
+    - opts    (optional table:
+                indent      = number of spaces per nesting level
+                              (default 0 = single line),
+                chararrays  = false to write arrays of $char as
+                              arrays of numbers)
+
+  Return values on lua stack
+    - JSON string
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_tojson(lua_State* L)
+{
+  luaL_Buffer b;
+  luacwrap_Type* desc;
+  json_Out* out;
+  PBYTE base;
+  int offset;
+
+  lua_settop(L, 2);
+
+  // only the options are used, no file buffer needed
+  out = (json_Out*)lua_newuserdata(L, offsetof(json_Out, buf));
+  memset(out, 0, offsetof(json_Out, buf));
+  desc = json_begin(L, out, 1, 2, &base, &offset);
+
+  luaL_buffinit(L, &b);
+  out->b = &b;
+  json_value(L, out, base, offset, desc, 0);
+  luaL_pushresult(&b);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Writes the JSON representation of a wrapped object to a file
+  without building it as string first (for large arrays).
+
+  Parameters on lua stack:
+    - file    (file handle of the io library)
+    - obj     (boxed or embedded object)
+    - opts    (optional table, see luacwrap.tojson())
+
+  Return values on lua stack
+    - file
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_writejson(lua_State* L)
+{
+  luacwrap_Type* desc;
+  json_Out* out;
+  PBYTE base;
+  int offset;
+  FILE* f;
+
+#if (LUA_VERSION_NUM > 501)
+  luaL_Stream* stream = (luaL_Stream*)luaL_checkudata(L, 1, LUA_FILEHANDLE);
+  f = stream->closef ? stream->f : NULL;
+#else
+  f = *(FILE**)luaL_checkudata(L, 1, LUA_FILEHANDLE);
+#endif
+  if (NULL == f)
+  {
+    luaL_argerror(L, 1, "attempt to use a closed file");
+  }
+  lua_settop(L, 3);
+
+  // keep file handle, stack index 1 is replaced by the outer object
+  lua_pushvalue(L, 1);
+
+  out = (json_Out*)lua_newuserdata(L, sizeof(json_Out));
+  memset(out, 0, offsetof(json_Out, buf));
+  out->f = f;
+  desc = json_begin(L, out, 2, 3, &base, &offset);
+
+  json_value(L, out, base, offset, desc, 0);
+  json_flush(out);
+  if (out->failed)
+  {
+    luaL_error(L, "luacwrap: could not write JSON: %s", strerror(errno));
+  }
+
+  lua_pushvalue(L, 4);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Raises an error with the JSON path of the current value.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_error(json_Parser* P, const char* msg)
+{
+  lua_State* L = P->L;
+  luaL_Buffer b;
+  int n;
+
+  luaL_buffinit(L, &b);
+  luaL_addchar(&b, '$');
+  for (n = 0; n < P->depth; n++)
+  {
+    if (P->path[n].key)
+    {
+      luaL_addchar(&b, '.');
+      luaL_addlstring(&b, P->path[n].key, P->path[n].keylen);
+    }
+    else
+    {
+      char idx[16];
+      luaL_addlstring(&b, idx, sprintf(idx, "[%d]", P->path[n].index));
+    }
+  }
+  luaL_pushresult(&b);
+
+  luaL_error(L, "luacwrap: JSON error at %s (offset %d): %s"
+    , lua_tostring(L, -1), (int)(P->p - P->start), msg);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Enters a nested value (object member or array element).
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_push(json_Parser* P, const char* key, size_t keylen, int index)
+{
+  if (P->depth >= JSON_MAX_DEPTH)
+  {
+    json_error(P, "nested too deep");
+  }
+  P->path[P->depth].key    = key;
+  P->path[P->depth].keylen = keylen;
+  P->path[P->depth].index  = index;
+  P->depth++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Skips whitespace and returns the next character (0 at the end).
+
+*/////////////////////////////////////////////////////////////////////////
+static char json_peek(json_Parser* P)
+{
+  while ((P->p < P->end) && ((' ' == *P->p) || ('\t' == *P->p) || ('\n' == *P->p) || ('\r' == *P->p)))
+  {
+    P->p++;
+  }
+  return (P->p < P->end) ? *P->p : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Consumes the expected character.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_expect(json_Parser* P, char c, const char* msg)
+{
+  if (c != json_peek(P))
+  {
+    json_error(P, msg);
+  }
+  P->p++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Consumes a literal (true, false or null) if present.
+
+*/////////////////////////////////////////////////////////////////////////
+static int json_literal(json_Parser* P, const char* lit, size_t len)
+{
+  if (((size_t)(P->end - P->p) >= len) && (0 == memcmp(P->p, lit, len)))
+  {
+    P->p += len;
+    return 1;
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a decoded byte to a string sink.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_sinkput(json_Sink* sink, char c)
+{
+  if (sink->b)
+  {
+    luaL_addchar(sink->b, c);
+  }
+  else if (sink->len < sink->cap)
+  {
+    sink->dst[sink->len] = c;
+  }
+  sink->len++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Reads four hex digits of an \u escape sequence.
+
+*/////////////////////////////////////////////////////////////////////////
+static unsigned int json_hex4(json_Parser* P)
+{
+  unsigned int value = 0;
+  int n;
+
+  if (P->end - P->p < 4)
+  {
+    json_error(P, "invalid escape sequence");
+  }
+  for (n = 0; n < 4; n++)
+  {
+    char c = *P->p++;
+    value <<= 4;
+    if ((c >= '0') && (c <= '9'))       value |= c - '0';
+    else if ((c >= 'a') && (c <= 'f'))  value |= c - 'a' + 10;
+    else if ((c >= 'A') && (c <= 'F'))  value |= c - 'A' + 10;
+    else json_error(P, "invalid escape sequence");
+  }
+  return value;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Decodes a string (behind the opening quote) into a sink. Pass a NULL
+  sink to skip the string.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_string_decode(json_Parser* P, json_Sink* sink)
+{
+  while (P->p < P->end)
+  {
+    unsigned char c = (unsigned char)*P->p++;
+
+    if ('"' == c)
+    {
+      return;
+    }
+    if (c < 0x20)
+    {
+      P->p--;
+      json_error(P, "control character within string");
+    }
+    if ('\\' == c)
+    {
+      unsigned int cp;
+
+      if (P->p >= P->end)
+      {
+        break;
+      }
+      switch (*P->p++)
+      {
+        case '"' : c = '"';  break;
+        case '\\': c = '\\'; break;
+        case '/' : c = '/';  break;
+        case 'b' : c = '\b'; break;
+        case 'f' : c = '\f'; break;
+        case 'n' : c = '\n'; break;
+        case 'r' : c = '\r'; break;
+        case 't' : c = '\t'; break;
+        case 'u' :
+          cp = json_hex4(P);
+          if ((cp >= 0xD800) && (cp < 0xDC00) && (P->end - P->p >= 6) && ('\\' == P->p[0]) && ('u' == P->p[1]))
+          {
+            // surrogate pair
+            unsigned int lo;
+            P->p += 2;
+            lo = json_hex4(P);
+            if ((lo < 0xDC00) || (lo > 0xDFFF))
+            {
+              json_error(P, "invalid surrogate pair");
+            }
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+          }
+          if (sink)
+          {
+            // encode as UTF-8
+            if (cp < 0x80)
+            {
+              json_sinkput(sink, (char)cp);
+            }
+            else if (cp < 0x800)
+            {
+              json_sinkput(sink, (char)(0xC0 | (cp >> 6)));
+              json_sinkput(sink, (char)(0x80 | (cp & 0x3F)));
+            }
+            else if (cp < 0x10000)
+            {
+              json_sinkput(sink, (char)(0xE0 | (cp >> 12)));
+              json_sinkput(sink, (char)(0x80 | ((cp >> 6) & 0x3F)));
+              json_sinkput(sink, (char)(0x80 | (cp & 0x3F)));
+            }
+            else
+            {
+              json_sinkput(sink, (char)(0xF0 | (cp >> 18)));
+              json_sinkput(sink, (char)(0x80 | ((cp >> 12) & 0x3F)));
+              json_sinkput(sink, (char)(0x80 | ((cp >> 6) & 0x3F)));
+              json_sinkput(sink, (char)(0x80 | (cp & 0x3F)));
+            }
+          }
+          continue;
+        default:
+          P->p--;
+          json_error(P, "invalid escape sequence");
+      }
+    }
+    if (sink)
+    {
+      json_sinkput(sink, (char)c);
+    }
+  }
+  json_error(P, "unterminated string");
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Decodes a string into fixed size memory. The rest of the memory is
+  filled with zeros, longer strings are truncated.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_string_tomem(json_Parser* P, PBYTE dst, size_t size)
+{
+  json_Sink sink;
+
+  sink.b   = NULL;
+  sink.dst = (char*)dst;
+  sink.cap = size;
+  sink.len = 0;
+
+  P->p++;
+  json_string_decode(P, &sink);
+  if (sink.len < size)
+  {
+    memset(dst + sink.len, 0, size - sink.len);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Scans a number and returns its end. Sets *integral if the number has
+  neither fraction nor exponent.
+
+*/////////////////////////////////////////////////////////////////////////
+static const char* json_scannumber(json_Parser* P, int* integral)
+{
+  const char* s = P->p;
+  const char* digits;
+
+  *integral = 1;
+  if ((s < P->end) && ('-' == *s))
+  {
+    s++;
+  }
+  digits = s;
+  while ((s < P->end) && (*s >= '0') && (*s <= '9'))
+  {
+    s++;
+  }
+  if ((s == digits) || (('0' == *digits) && (s - digits > 1)))
+  {
+    json_error(P, "invalid number");
+  }
+  if ((s < P->end) && ('.' == *s))
+  {
+    *integral = 0;
+    digits = ++s;
+    while ((s < P->end) && (*s >= '0') && (*s <= '9'))
+    {
+      s++;
+    }
+    if (s == digits)
+    {
+      json_error(P, "invalid number");
+    }
+  }
+  if ((s < P->end) && (('e' == *s) || ('E' == *s)))
+  {
+    *integral = 0;
+    s++;
+    if ((s < P->end) && (('+' == *s) || ('-' == *s)))
+    {
+      s++;
+    }
+    digits = s;
+    while ((s < P->end) && (*s >= '0') && (*s <= '9'))
+    {
+      s++;
+    }
+    if (s == digits)
+    {
+      json_error(P, "invalid number");
+    }
+  }
+  return s;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Parses a number (or true/false) into a numeric member.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_number_tomem(json_Parser* P, int kind, PBYTE p)
+{
+  long long           ival;
+  unsigned long long  uval;
+  double              dval;
+  int                 integral = 0;
+
+  if (json_literal(P, "true", 4))
+  {
+    ival = 1; uval = 1; dval = 1;
+  }
+  else if (json_literal(P, "false", 5))
+  {
+    ival = 0; uval = 0; dval = 0;
+  }
+  else
+  {
+    const char* end;
+
+    if (('-' != *P->p) && ((*P->p < '0') || (*P->p > '9')))
+    {
+      json_error(P, "number expected");
+    }
+    end = json_scannumber(P, &integral);
+
+    // the input is a NUL terminated Lua string
+    dval = strtod(P->p, NULL);
+    if (integral && ('-' == *P->p))
+    {
+      ival = strtoll(P->p, NULL, 10);
+      uval = (unsigned long long)ival;
+    }
+    else if (integral)
+    {
+      uval = strtoull(P->p, NULL, 10);
+      ival = (long long)uval;
+    }
+    else if ((LUACWRAP_NK_FLT == kind) || (LUACWRAP_NK_DBL == kind))
+    {
+      ival = 0;
+      uval = 0;
+    }
+    else
+    {
+      // converting doubles out of the 64 bit range is undefined
+      if (!((dval >= -9223372036854775808.0) && (dval < 18446744073709551616.0)))
+      {
+        json_error(P, "number out of range");
+      }
+      if (dval < 0)
+      {
+        ival = (long long)dval;
+        uval = (unsigned long long)ival;
+      }
+      else
+      {
+        uval = (unsigned long long)dval;
+        ival = (long long)uval;
+      }
+    }
+    P->p = end;
+  }
+
+  switch (kind)
+  {
+    case LUACWRAP_NK_I8 : *(int8_t*  )p = (int8_t  )ival; break;
+    case LUACWRAP_NK_U8 : *(uint8_t* )p = (uint8_t )uval; break;
+    case LUACWRAP_NK_I16: *(int16_t* )p = (int16_t )ival; break;
+    case LUACWRAP_NK_U16: *(uint16_t*)p = (uint16_t)uval; break;
+    case LUACWRAP_NK_I32: *(int32_t* )p = (int32_t )ival; break;
+    case LUACWRAP_NK_U32: *(uint32_t*)p = (uint32_t)uval; break;
+    case LUACWRAP_NK_I64: *(int64_t* )p = (int64_t )ival; break;
+    case LUACWRAP_NK_U64: *(uint64_t*)p = (uint64_t)uval; break;
+    case LUACWRAP_NK_FLT: *(float*   )p = (float   )dval; break;
+    case LUACWRAP_NK_DBL: *(double*  )p = (double  )dval; break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Skips a value without creating Lua values.
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_skip(json_Parser* P, int depth)
+{
+  char c = json_peek(P);
+
+  if (depth > JSON_MAX_DEPTH)
+  {
+    json_error(P, "nested too deep");
+  }
+
+  switch (c)
+  {
+    case '"':
+      P->p++;
+      json_string_decode(P, NULL);
+      break;
+    case '{':
+      P->p++;
+      if ('}' == json_peek(P))
+      {
+        P->p++;
+        break;
+      }
+      do
+      {
+        json_expect(P, '"', "object key expected");
+        json_string_decode(P, NULL);
+        json_expect(P, ':', "':' expected");
+        json_skip(P, depth + 1);
+      } while (',' == json_peek(P) && P->p++);
+      json_expect(P, '}', "'}' expected");
+      break;
+    case '[':
+      P->p++;
+      if (']' == json_peek(P))
+      {
+        P->p++;
+        break;
+      }
+      do
+      {
+        json_skip(P, depth + 1);
+      } while (',' == json_peek(P) && P->p++);
+      json_expect(P, ']', "']' expected");
+      break;
+    default:
+      if (!json_literal(P, "true", 4) && !json_literal(P, "false", 5) && !json_literal(P, "null", 4))
+      {
+        int integral;
+        if (('-' != c) && ((c < '0') || (c > '9')))
+        {
+          json_error(P, "value expected");
+        }
+        P->p = json_scannumber(P, &integral);
+      }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Parses a scalar value as Lua value and stores it through the set
+  wrapper of a basic type (e.g. pointers).
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_luavalue_tomem( json_Parser*         P
+                               , luacwrap_BasicType*  desc
+                               , PBYTE                base
+                               , int                  offset)
+{
+  lua_State* L = P->L;
+  char c = json_peek(P);
+
+  LUASTACK_SET(L);
+
+  if ('"' == c)
+  {
+    luaL_Buffer b;
+    json_Sink sink;
+
+    luaL_buffinit(L, &b);
+    sink.b   = &b;
+    sink.dst = NULL;
+    sink.cap = 0;
+    sink.len = 0;
+    P->p++;
+    json_string_decode(P, &sink);
+    luaL_pushresult(&b);
+  }
+  else if (json_literal(P, "true", 4))
+  {
+    lua_pushboolean(L, 1);
+  }
+  else if (json_literal(P, "false", 5))
+  {
+    lua_pushboolean(L, 0);
+  }
+  else if (('-' == c) || ((c >= '0') && (c <= '9')))
+  {
+    int integral;
+    const char* end = json_scannumber(P, &integral);
+    lua_pushnumber(L, (lua_Number)strtod(P->p, NULL));
+    P->p = end;
+  }
+  else
+  {
+    json_error(P, "string, number or boolean expected");
+  }
+
+  desc->setWrapper(desc, L, base + offset, offset);
+  lua_pop(L, 1);
+
+  LUASTACK_CLEAN(L, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Parses a value into an object of the given type.
+
+  @param[in]  base    memory of the outer object (at stack index 1)
+  @param[in]  offset  offset of the object within the outer object
+  @param[in]  desc    type of the object
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_parse( json_Parser*    P
+                      , PBYTE           base
+                      , int             offset
+                      , luacwrap_Type*  desc)
+{
+  lua_State* L = P->L;
+  char c = json_peek(P);
+
+  // null leaves the object unchanged
+  if (('n' == c) && json_literal(P, "null", 4))
+  {
+    return;
+  }
+
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC:
+      {
+        int kind = luacwrap_numerickind(desc);
+        if (LUACWRAP_NK_NONE != kind)
+        {
+          json_number_tomem(P, kind, base + offset);
+        }
+        else
+        {
+          json_luavalue_tomem(P, (luacwrap_BasicType*)desc, base, offset);
+        }
+      }
+      break;
+
+    case LUACWRAP_TC_RECORD:
+      {
+        luacwrap_RecordMember* members = ((luacwrap_RecordType*)desc)->members;
+
+        json_expect(P, '{', "object expected");
+        if ('}' == json_peek(P))
+        {
+          P->p++;
+          break;
+        }
+        do
+        {
+          luacwrap_RecordMember* member = NULL;
+          const char* key;
+          size_t keylen;
+          char name[256];
+          json_Sink sink;
+
+          json_expect(P, '"', "object key expected");
+          key = P->p;
+
+          // decode key into a local buffer (longer keys are unknown)
+          sink.b   = NULL;
+          sink.dst = name;
+          sink.cap = sizeof(name);
+          sink.len = 0;
+          json_string_decode(P, &sink);
+          keylen = P->p - key - 1;
+          if ((sink.len <= sizeof(name)) && (NULL == memchr(name, 0, sink.len)))
+          {
+            member = luacwrap_findmember(members, name, sink.len);
+          }
+
+          json_expect(P, ':', "':' expected");
+          json_push(P, key, keylen, 0);
+          if (member)
+          {
+            json_parse(P, base, offset + member->memberoffset, luacwrap_getmembertype(L, member));
+          }
+          else
+          {
+            json_skip(P, P->depth);
+          }
+          P->depth--;
+        } while (',' == json_peek(P) && P->p++);
+        json_expect(P, '}', "'}' expected");
+      }
+      break;
+
+    case LUACWRAP_TC_ARRAY:
+      {
+        luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+        luacwrap_Type* elemdesc = luacwrap_getelemtype(L, arrdesc);
+        unsigned int n = 0;
+
+        // strings are stored into byte arrays
+        if (('"' == c) && (1 == arrdesc->elemsize))
+        {
+          json_string_tomem(P, base + offset, arrdesc->elemcount);
+          break;
+        }
+
+        json_expect(P, '[', "array expected");
+        if (']' == json_peek(P))
+        {
+          P->p++;
+          break;
+        }
+        do
+        {
+          json_push(P, NULL, 0, n);
+          if ((n >= arrdesc->elemcount) && json_peek(P))
+          {
+            json_error(P, "too many array elements");
+          }
+          json_parse(P, base, offset + n * arrdesc->elemsize, elemdesc);
+          P->depth--;
+          n++;
+        } while (',' == json_peek(P) && P->p++);
+        json_expect(P, ']', "']' expected");
+      }
+      break;
+
+    case LUACWRAP_TC_BUFFER:
+      if ('"' != c)
+      {
+        json_error(P, "string expected");
+      }
+      json_string_tomem(P, base + offset, ((luacwrap_BufferType*)desc)->size);
+      break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Parses a JSON string into the object at stack index 1 (outer object).
+
+*/////////////////////////////////////////////////////////////////////////
+static void json_decode( lua_State*      L
+                       , const char*     s
+                       , size_t          len
+                       , int             offset
+                       , luacwrap_Type*  desc)
+{
+  json_Parser* P;
+
+  // parser state is too large for the C stack of deep recursions
+  P = (json_Parser*)lua_newuserdata(L, sizeof(json_Parser));
+  P->L     = L;
+  P->start = s;
+  P->p     = s;
+  P->end   = s + len;
+  P->depth = 0;
+
+  json_parse(P, (PBYTE)luacwrap_getobjptr(L, 1), offset, desc);
+  if (0 != json_peek(P))
+  {
+    json_error(P, "unexpected data behind value");
+  }
+  lua_pop(L, 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements TYPE:fromjson(s). Creates a new boxed object from a JSON
+  string, values absent in the string are zero.
+
+  Parameters on lua stack:
+    - self    (type descriptor)
+    - JSON string
+
+  Return values on lua stack
+    - new object
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_type_fromjson(lua_State* L)
+{
+  luacwrap_Type* desc;
+  const char* s;
+  size_t len;
+
+  s = luaL_checklstring(L, 2, &len);
+  lua_settop(L, 2);
+
+  // set wrappers of pointer members expect the object at index 1
+  desc = luacwrap_beginnew(L, "fromjson");
+
+  json_decode(L, s, len, 0, desc);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements obj:setjson(s). Sets the members given in a JSON string,
+  other members are unchanged.
+
+  Parameters on lua stack:
+    - self    (boxed or embedded object)
+    - JSON string
+
+  Return values on lua stack
+    - self
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_setjson(lua_State* L)
+{
+  luacwrap_Type* desc;
+  const char* s;
+  size_t len;
+  int offset = 0;
+
+  s = luaL_checklstring(L, 2, &len);
+  lua_settop(L, 2);
+
+  // set wrappers of pointer members expect the outer object at index 1
+  desc = luacwrap_beginset(L, &offset);
+
+  json_decode(L, s, len, offset, desc);
+  return 1;
+}
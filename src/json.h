@@ -0,0 +1,35 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  JSON encoding and decoding of wrapped objects
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+//
+// implements luacwrap.tojson(obj [, opts])
+//
+int luacwrap_tojson               ( lua_State*        L);
+
+//
+// implements luacwrap.writejson(file, obj [, opts])
+//
+int luacwrap_writejson            ( lua_State*        L);
+
+//
+// implements TYPE:fromjson(s)
+//
+int luacwrap_type_fromjson        ( lua_State*        L);
+
+//
+// implements obj:setjson(s)
+//
+int luacwrap_setjson              ( lua_State*        L);
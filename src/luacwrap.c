@@ -10,11 +10,23 @@
 
 */////////////////////////////////////////////////////////////////////////
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "luaaux.h"
 #include "luacwrap.h"
+#include "arena.h"
+#include "archive.h"
+#include "external.h"
+#include "json.h"
+#include "msgpack.h"
+#include "mapfile.h"
+#include "serialize.h"
+#include "stream.h"
+#include "stats.h"
+#include "arrayops.h"
 #include "wrapnumeric.h"
 #include "wrappointer.h"
 #include "wrapreference.h"
@@ -48,12 +60,8 @@ static int pushEmbedded(lua_State* L, int ud, int offset, luacwrap_Type* desc);
 static int luacwrap_type_set(lua_State* L);
 static int luacwrap_type_dup(lua_State* L);
 
-static int luacwrap_type_size(luacwrap_Type* desc);
-
-static int luacwrap_getouter(lua_State* L, int ud, int* offset);
-
-static luacwrap_Type* luacwrap_getdescriptor(lua_State* L, int ud);
-static luacwrap_Type* luacwrap_getdescriptor_byname(lua_State* L, const char* name, int namelen);
+extern luaL_Reg g_mtTypeCtors[];
+extern luaL_Reg g_mtExternal[];
 
 // function prototype for getting the outer object
 // and the offset within the outer object
@@ -62,6 +70,21 @@ typedef int (*GET_OBJECTOUTER)(lua_State* L, int ud, int* offset);
 // key under which the getouter function is stored
 const char* g_keyGetOuter = "getouter";
 
+// function prototype for getting the memory pointer of objects
+// which do not hold their memory within their userdata
+typedef void* (*GET_OBJECTPTR)(lua_State* L, int ud);
+
+// index within the metatable under which the getptr function is stored
+#define LUACWRAP_MT_GETPTR  1
+
+// metatable of boxed objects of the lua state which opened luacwrap last, 
+// plain boxed objects are detected by comparing with it (reset when the 
+// state is closed, objects of other states use the getptr lookup)
+static const void* s_mtBoxedPtr = NULL;
+
+// type name of anonymous array types
+const char* g_nameAnonArray = "$array";
+
 //////////////////////////////////////////////////////////////////////////
 /**
 
@@ -99,6 +122,61 @@ static luacwrap_RecordMember* findMember(luacwrap_RecordMember* members, const c
   return NULL;
 }
 
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Find a member within a members array by a name which is not
+  necessarily zero terminated (e.g. a part of a dotted member path).
+
+*////////////////////////////////////////////////////////////////////////
+luacwrap_RecordMember* luacwrap_findmember(luacwrap_RecordMember* members, const char* name, size_t namelen)
+{
+  luacwrap_RecordMember* result = members;
+  while (result->membername)
+  {
+    if ((0 == strncmp(result->membername, name, namelen)) && (0 == result->membername[namelen]))
+    {
+      return result;
+    }
+    ++result;
+  };
+  return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Get the type descriptor of a record member and cache it within
+  the member descriptor.
+
+*////////////////////////////////////////////////////////////////////////
+luacwrap_Type* luacwrap_getmembertype(lua_State* L, luacwrap_RecordMember* member)
+{
+  if (NULL == member->membertypedesc)
+  {
+    // get descriptor from type name and cache it
+    member->membertypedesc = luacwrap_getdescriptor_byname(L, member->membertypename, -1);
+  }
+  return member->membertypedesc;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Get the element type descriptor of an array type and cache it within
+  the array descriptor.
+
+*////////////////////////////////////////////////////////////////////////
+luacwrap_Type* luacwrap_getelemtype(lua_State* L, luacwrap_ArrayType* arrdesc)
+{
+  if (NULL == arrdesc->elemtypedesc)
+  {
+    // get descriptor from type name and cache it
+    arrdesc->elemtypedesc = luacwrap_getdescriptor_byname(L, arrdesc->elemtypename, -1);
+  }
+  return arrdesc->elemtypedesc;
+}
+
 //////////////////////////////////////////////////////////////////////////
 /**
 
@@ -150,268 +228,707 @@ int luacwrap_setenvironment(lua_State *L, int ud)
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Get reference from environment of managed object to get a
-  pointer referenced value.
-  The offset of the pointer is used as index in the reference table.
+  Reference store of managed objects.
+
+  The values referenced by pointer members of a managed object are kept
+  in a compact store at env[LUACWRAP_ENV_REFS]. The store is a plain
+  array: store[1] holds the number of references n followed by n
+  (offset, value) pairs sorted by offset, i.e. store[2k] is the offset 
+  of the k-th reference and store[2k+1] its value.
+  Objects without references do not have a store at all, so the 
+  common case is decided by a single lookup.
 
 *////////////////////////////////////////////////////////////////////////
-int luacwrap_mobj_get_reference(lua_State *L, int ud, int offset)
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  entry used to reorder references in luacwrap_mobj_permute_references
+
+*////////////////////////////////////////////////////////////////////////
+typedef struct
 {
-  LUASTACK_SET(L);
+  int offset;                         // new offset of the reference
+  int slot;                           // index of the value in scratch table
+} refstore_Entry;
 
-  if (luacwrap_getenvironment(L, ud))
-  {
-    // result = env[offset]
-    lua_rawgeti(L, -1, offset);
+//////////////////////////////////////////////////////////////////////////
+/**
 
-    // check if reference is present
-    if (!lua_isnil(L, -1))
+  Push reference store of managed object ud (which has to be an 
+  absolute index). If create is set a missing environment and store
+  are created.
+
+  @return 1 if a store has been pushed, 0 if nil has been pushed
+
+*////////////////////////////////////////////////////////////////////////
+static int refstore_push(lua_State* L, int ud, int create)
+{
+  if (!luacwrap_getenvironment(L, ud))
+  {
+    if (!create)
     {
-      // remove environment table
-      lua_remove(L, -2);
+      return 0;
+    }
 
-      LUASTACK_CLEAN(L, 1);
-      return 1;
+    // create environment
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    luacwrap_setenvironment(L, ud);
+    LUACWRAP_STAT_INC(luacwrap_getdescriptor(L, ud), envtables);
+  }
+  else if (create)
+  {
+    lua_rawgeti(L, -1, LUACWRAP_ENV_SHARED);
+    if (lua_toboolean(L, -1))
+    {
+      // copy shared environment before the store is added
+      lua_pop(L, 1);
+      lua_createtable(L, 1, 3);
+      lua_pushnil(L);
+      while (lua_next(L, -3))
+      {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, -4);
+      }
+      lua_pushnil(L);
+      lua_rawseti(L, -2, LUACWRAP_ENV_SHARED);
+      lua_replace(L, -2);
+      lua_pushvalue(L, -1);
+      luacwrap_setenvironment(L, ud);
+      LUACWRAP_STAT_INC(luacwrap_getdescriptor(L, ud), envtables);
     }
     else
     {
-      // no reference stored -> return 0
+      lua_pop(L, 1);
     }
+  }
 
-    lua_pop(L, 2);
+  lua_rawgeti(L, -1, LUACWRAP_ENV_REFS);
+  if (lua_isnil(L, -1) && create)
+  {
+    // create empty store
+    lua_pop(L, 1);
+    lua_createtable(L, 3, 0);
+    lua_pushinteger(L, 0);
+    lua_rawseti(L, -2, 1);
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, -3, LUACWRAP_ENV_REFS);
   }
 
-  LUASTACK_CLEAN(L, 0);
-  return 0;
+  // remove environment
+  lua_remove(L, -2);
+
+  return !lua_isnil(L, -1);
 }
 
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Set reference within environment of managed object to a
-  pointer referenced value.
-  The offset of the pointer is used as index in the reference table.
+  get number of references within store
 
 *////////////////////////////////////////////////////////////////////////
-int luacwrap_mobj_set_reference(lua_State *L, int ud, int value, int offset)
+static int refstore_count(lua_State* L, int store)
 {
-  LUASTACK_SET(L);
+  int n;
+  lua_rawgeti(L, store, 1);
+  n = (int)lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  return n;
+}
 
-  // create environment if not already present
-  if (!luacwrap_getenvironment(L, ud))
-  {
-    lua_pop(L, 1);
-    lua_newtable(L);
-    lua_pushvalue(L, -1);
-    luacwrap_setenvironment(L, ud);
-  }
+//////////////////////////////////////////////////////////////////////////
+/**
 
-  // env[offset] = value
-  lua_pushvalue(L, value);
-  lua_rawseti(L, -2, offset);
+  get offset of k-th reference within store
 
-  // pop environment table
+*////////////////////////////////////////////////////////////////////////
+static int refstore_offset(lua_State* L, int store, int k)
+{
+  int offset;
+  lua_rawgeti(L, store, 2*k);
+  offset = (int)lua_tointeger(L, -1);
   lua_pop(L, 1);
+  return offset;
+}
 
-  LUASTACK_CLEAN(L, 0);
+//////////////////////////////////////////////////////////////////////////
+/**
 
-  return 0;
+  Binary search for the first reference with an offset not less
+  than the given one.
+
+  @return position within 1..n+1
+
+*////////////////////////////////////////////////////////////////////////
+static int refstore_lowerbound(lua_State* L, int store, int n, int offset)
+{
+  int lo = 1;
+  int hi = n + 1;
+
+  while (lo < hi)
+  {
+    int mid = lo + (hi - lo) / 2;
+    if (refstore_offset(L, store, mid) < offset)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return lo;
 }
 
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Remove a reference within environment of managed object to a
-  pointer referenced value.
+  Set reference at offset to the value at (absolute) index value.
+  An existing reference for the same offset is replaced.
+
+  @return 1 if a new reference has been inserted
 
 *////////////////////////////////////////////////////////////////////////
-int luacwrap_mobj_remove_reference(lua_State *L, int ud, int offset)
+static int refstore_put(lua_State* L, int store, int offset, int value)
 {
-  LUASTACK_SET(L);
-  
-  // get environment
-  if (luacwrap_getenvironment(L, ud))
+  int n = refstore_count(L, store);
+  int k = refstore_lowerbound(L, store, n, offset);
+  int i;
+
+  if ((k <= n) && (refstore_offset(L, store, k) == offset))
   {
-    // env[offset] = nil
-    lua_pushnil(L);
-    lua_rawseti(L, -2, offset);
+    // replace value
+    lua_pushvalue(L, value);
+    lua_rawseti(L, store, 2*k+1);
+    return 0;
+  }
 
-    // pop environment table
-    lua_pop(L, 1);
+  // move following entries up by one pair
+  for (i = 2*n+1; i >= 2*k; --i)
+  {
+    lua_rawgeti(L, store, i);
+    lua_rawseti(L, store, i+2);
   }
 
-  LUASTACK_CLEAN(L, 0);
-  return 0;
+  lua_pushinteger(L, offset);
+  lua_rawseti(L, store, 2*k);
+  lua_pushvalue(L, value);
+  lua_rawseti(L, store, 2*k+1);
+  lua_pushinteger(L, n+1);
+  lua_rawseti(L, store, 1);
+
+  return 1;
 }
 
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  copy reference table from source object to destination object
+  Replace the references at positions lo..hi-1 of the store by k 
+  (offset, value) pairs taken from the array at stack index pairs.
+  Following references are moved once by the size difference.
 
 *////////////////////////////////////////////////////////////////////////
-int luacwrap_mobj_copy_references(lua_State* L)
+static void refstore_splice( lua_State*  L
+                           , int         store
+                           , int         n
+                           , int         lo
+                           , int         hi
+                           , int         pairs
+                           , int         k)
 {
-  LUASTACK_SET(L);
+  int delta = k - (hi - lo);
+  int i;
 
-  luacwrap_Type* srcdesc = luacwrap_getdescriptor(L, -1);
-  if (NULL == srcdesc)
+  if (delta > 0)
   {
-    // todo: 
+    // move following entries up
+    for (i = 2*n+1; i >= 2*hi; --i)
+    {
+      lua_rawgeti(L, store, i);
+      lua_rawseti(L, store, i + 2*delta);
+    }
   }
-
-  int srcsize = luacwrap_type_size(srcdesc);
-
-  // get environment from (outer) source
-  if (luacwrap_getenvironment(L, -1))
+  else if (delta < 0)
   {
-    // create destination environment if not already present
-    if (!luacwrap_getenvironment(L, -3))
+    // move following entries down and clear the tail
+    for (i = 2*hi; i <= 2*n+1; ++i)
     {
-      lua_pop(L, 1);
-      lua_newtable(L);
-      lua_pushvalue(L, -1);
-      luacwrap_setenvironment(L, -4);
+      lua_rawgeti(L, store, i);
+      lua_rawseti(L, store, i + 2*delta);
     }
-
-    // copy source content to destination
-    lua_pushnil(L);                    // first key
-    while (0 != lua_next(L, -3))
+    for (i = 2*(n+delta)+2; i <= 2*n+1; ++i)
     {
-      // stack holds key and value
-      if (lua_type(L, -2) == LUA_TNUMBER) 
-      {
-        // check if index is within range of source object
-        lua_Number v = lua_tonumber(L, -2);
-        // v -= srcbase;
-        if ((v >= 0) && (v <= srcsize))
-        {
-          // transfer key into range of destination object
-          // lua_pushnumber(L, v + destoffset);
-          lua_pushnumber(L, v);
-          lua_pushvalue(L, -2);
-          lua_rawset(L, -5);
-        }
-      }
-
-      // removes 'value'; keeps 'key' for next iteration
-      lua_pop(L, 1);
+      lua_pushnil(L);
+      lua_rawseti(L, store, i);
     }
-
-    // pop environment table
-    lua_pop(L, 1);
   }
 
-  // pop environment table
-  lua_pop(L, 1);
-
-  LUASTACK_CLEAN(L, 0);
+  // write new entries
+  for (i = 0; i < 2*k; ++i)
+  {
+    lua_rawgeti(L, pairs, i+1);
+    lua_rawseti(L, store, 2*lo + i);
+  }
 
-  return 0;
+  lua_pushinteger(L, n + delta);
+  lua_rawseti(L, store, 1);
 }
 
-
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Determine the size of a type in [bytes].
+  remove empty reference store from environment of ud
 
 *////////////////////////////////////////////////////////////////////////
-static int luacwrap_type_size(luacwrap_Type* desc)
+static void refstore_drop(lua_State* L, int ud)
 {
-  int size = 0;
-  switch(desc->typeclass)
+  if (luacwrap_getenvironment(L, ud))
   {
-    case LUACWRAP_TC_BASIC : size = ((luacwrap_BasicType*)desc)->size;  break;
-    case LUACWRAP_TC_RECORD: size = ((luacwrap_RecordType*)desc)->size;  break;
-    case LUACWRAP_TC_ARRAY :
-      {
-        luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
-        size = arrdesc->elemcount * arrdesc->elemsize;
-      }
-      break;
-    case LUACWRAP_TC_BUFFER: size = ((luacwrap_BufferType*)desc)->size; break;
-    default:
-      {
-        assert(0);
-      }
+    lua_pushnil(L);
+    lua_rawseti(L, -2, LUACWRAP_ENV_REFS);
   }
-  return size;
+  lua_pop(L, 1);
 }
 
-
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Returns the type dependant length (for the # operator).
+  compare function for sorting refstore_Entry by offset
 
 *////////////////////////////////////////////////////////////////////////
-static int luacwrap_type_len(luacwrap_Type* desc)
+static int refstore_cmpentry(const void* a, const void* b)
 {
-  int size = 0;
-  switch(desc->typeclass)
-  {
-    case LUACWRAP_TC_BASIC : size = ((luacwrap_BasicType*)desc)->size;  break;
-    case LUACWRAP_TC_RECORD: size = ((luacwrap_RecordType*)desc)->size;  break;
-    case LUACWRAP_TC_ARRAY :
-      {
-        luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
-        size = arrdesc->elemcount;
-      }
-      break;
-    case LUACWRAP_TC_BUFFER: size = ((luacwrap_BufferType*)desc)->size; break;
-    default:
-      {
-        assert(0);
-      }
-  }
-  return size;
+  int oa = ((const refstore_Entry*)a)->offset;
+  int ob = ((const refstore_Entry*)b)->offset;
+  return (oa > ob) - (oa < ob);
 }
 
-
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Closure to implement get() on buffers and basic types
+  Get reference from environment of managed object to get a
+  pointer referenced value.
+  The offset of the pointer is used as key in the reference store.
 
 *////////////////////////////////////////////////////////////////////////
-static int luacwrap_get_closure(lua_State* L)
+int luacwrap_mobj_get_reference(lua_State *L, int ud, int offset)
 {
-  int offset;
-  const char* typname;
-  luacwrap_Type* desc;
-  size_t len;
+  LUASTACK_SET(L);
 
-  offset = lua_tointeger(L, lua_upvalueindex(1));
-  typname = lua_tolstring(L, lua_upvalueindex(2), &len);
+  ud = abs_index(L, ud);
 
-  // get descriptor from type name
-  desc = luacwrap_getdescriptor_byname(L, typname, len);
+  // objects without store do not hold any references
+  if (refstore_push(L, ud, 0))
+  {
+    int store = lua_gettop(L);
+    int n     = refstore_count(L, store);
+    int k     = refstore_lowerbound(L, store, n, offset);
 
-  return getEmbedded(L, 1, offset, desc);
+    if ((k <= n) && (refstore_offset(L, store, k) == offset))
+    {
+      // replace store by value
+      lua_rawgeti(L, store, 2*k+1);
+      lua_replace(L, store);
+
+      LUASTACK_CLEAN(L, 1);
+      return 1;
+    }
+  }
+
+  // pop store
+  lua_pop(L, 1);
+
+  LUASTACK_CLEAN(L, 0);
+  return 0;
 }
 
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Closure to implement set() on buffers and basic types
+  Set reference within environment of managed object to a
+  pointer referenced value.
+  The offset of the pointer is used as key in the reference store.
 
 *////////////////////////////////////////////////////////////////////////
-static int luacwrap_set_closure(lua_State* L)
+int luacwrap_mobj_set_reference(lua_State *L, int ud, int value, int offset)
 {
-  int offset;
-  const char* typname;
-  luacwrap_Type* desc;
-  size_t len;
-
-  offset = lua_tointeger(L, lua_upvalueindex(1));
-  typname = lua_tolstring(L, lua_upvalueindex(2), &len);
+  LUASTACK_SET(L);
 
-  // get descriptor from type name
-  desc = luacwrap_getdescriptor_byname(L, typname, len);
+  ud    = abs_index(L, ud);
+  value = abs_index(L, value);
 
-  return setEmbedded(L, offset, desc);
-}
+  // create environment and store if not already present
+  refstore_push(L, ud, 1);
+
+  if (refstore_put(L, lua_gettop(L), offset, value))
+  {
+    LUACWRAP_STAT_INC(luacwrap_getdescriptor(L, ud), references);
+  }
+
+  // pop store
+  lua_pop(L, 1);
+
+  LUASTACK_CLEAN(L, 0);
+
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Remove a reference within environment of managed object to a
+  pointer referenced value. The store is dropped together with its
+  last reference.
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_mobj_remove_reference(lua_State *L, int ud, int offset)
+{
+  LUASTACK_SET(L);
+
+  ud = abs_index(L, ud);
+
+  if (refstore_push(L, ud, 0))
+  {
+    int store = lua_gettop(L);
+    int n     = refstore_count(L, store);
+    int k     = refstore_lowerbound(L, store, n, offset);
+
+    if ((k <= n) && (refstore_offset(L, store, k) == offset))
+    {
+      if (1 == n)
+      {
+        refstore_drop(L, ud);
+      }
+      else
+      {
+        refstore_splice(L, store, n, k, k+1, 0, 0);
+      }
+    }
+  }
+
+  // pop store
+  lua_pop(L, 1);
+
+  LUASTACK_CLEAN(L, 0);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Copy references from source object to destination object of the 
+  same type (after their memory has been copied).
+  
+  Both objects may be embedded into outer objects. The references 
+  within the byte range of the source are rebased to the range of the
+  destination and replace all references held in that range before.
+
+  Parameters on lua stack:
+    - destination object (at -2)
+    - source object (at -1)
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_mobj_copy_references(lua_State* L)
+{
+  luacwrap_Type* desc;
+  int dest;
+  int src;
+  int size;
+  int srcoffset;
+  int destoffset;
+  int srcouter;
+  int destouter;
+  int pairs;
+  int k = 0;
+
+  LUASTACK_SET(L);
+
+  dest = abs_index(L, -2);
+  src  = abs_index(L, -1);
+
+  desc = luacwrap_getdescriptor(L, src);
+  if (NULL == desc)
+  {
+    // not a managed object -> no references
+    return 0;
+  }
+  size = luacwrap_type_size(desc);
+
+  // get outer objects and offsets
+  if (!luacwrap_getouter(L, src, &srcoffset))
+  {
+    lua_pushvalue(L, src);
+    srcoffset = 0;
+  }
+  srcouter = lua_gettop(L);
+
+  if (!luacwrap_getouter(L, dest, &destoffset))
+  {
+    lua_pushvalue(L, dest);
+    destoffset = 0;
+  }
+  destouter = lua_gettop(L);
+
+  // collect rebased references within range of source
+  if (refstore_push(L, srcouter, 0))
+  {
+    int store = lua_gettop(L);
+    int n     = refstore_count(L, store);
+    int lo    = refstore_lowerbound(L, store, n, srcoffset);
+    int hi    = refstore_lowerbound(L, store, n, srcoffset + size);
+    int i;
+
+    k = hi - lo;
+    lua_createtable(L, 2*k, 0);
+    for (i = 0; i < k; ++i)
+    {
+      lua_pushinteger(L, refstore_offset(L, store, lo + i) - srcoffset + destoffset);
+      lua_rawseti(L, -2, 2*i+1);
+      lua_rawgeti(L, store, 2*(lo + i)+1);
+      lua_rawseti(L, -2, 2*i+2);
+    }
+    lua_replace(L, store);
+  }
+  pairs = lua_gettop(L);
+
+  // only full userdata are able to hold references
+  if (LUA_TUSERDATA == lua_type(L, destouter))
+  {
+    if (refstore_push(L, destouter, k > 0))
+    {
+      int store = lua_gettop(L);
+      int n     = refstore_count(L, store);
+      int lo    = refstore_lowerbound(L, store, n, destoffset);
+      int hi    = refstore_lowerbound(L, store, n, destoffset + size);
+
+      if (n - (hi - lo) + k > 0)
+      {
+        refstore_splice(L, store, n, lo, hi, pairs, k);
+      }
+      else
+      {
+        refstore_drop(L, destouter);
+      }
+    }
+
+    // pop destination store
+    lua_pop(L, 1);
+  }
+
+  // pop pairs and outer objects
+  lua_pop(L, 3);
+
+  LUASTACK_CLEAN(L, 0);
+
+  return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Moves the references of an array of elements after the elements
+  have been reordered (e.g. by sort()).
+
+  @param[in]  L         lua state
+  @param[in]  ud        outer object which holds the references
+  @param[in]  offset    offset of the first element within the outer object
+  @param[in]  elemsize  size of one element
+  @param[in]  elemcount number of elements
+  @param[in]  newpos    new element index for each old element index
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_mobj_permute_references( lua_State*          L
+                                    , int                 ud
+                                    , int                 offset
+                                    , int                 elemsize
+                                    , int                 elemcount
+                                    , const unsigned int* newpos)
+{
+  int moved = 0;
+
+  LUASTACK_SET(L);
+
+  ud = abs_index(L, ud);
+
+  if (refstore_push(L, ud, 0))
+  {
+    // references of the array form a contiguous run within the store
+    int store = lua_gettop(L);
+    int n     = refstore_count(L, store);
+    int lo    = refstore_lowerbound(L, store, n, offset);
+    int hi    = refstore_lowerbound(L, store, n, offset + elemsize * elemcount);
+    int k;
+
+    moved = hi - lo;
+    if (moved > 0)
+    {
+      refstore_Entry* entries = (refstore_Entry*)lua_newuserdata(L, moved * sizeof(refstore_Entry));
+
+      // compute new offsets and save values into a scratch table
+      lua_createtable(L, moved, 0);
+      for (k = lo; k < hi; ++k)
+      {
+        int relofs = refstore_offset(L, store, k) - offset;
+
+        entries[k - lo].offset = offset + newpos[relofs / elemsize] * elemsize + (relofs % elemsize);
+        entries[k - lo].slot   = k - lo + 1;
+
+        lua_rawgeti(L, store, 2*k+1);
+        lua_rawseti(L, -2, k - lo + 1);
+      }
+
+      qsort(entries, moved, sizeof(refstore_Entry), refstore_cmpentry);
+
+      // write back run in new order
+      for (k = lo; k < hi; ++k)
+      {
+        lua_pushinteger(L, entries[k - lo].offset);
+        lua_rawseti(L, store, 2*k);
+        lua_rawgeti(L, -1, entries[k - lo].slot);
+        lua_rawseti(L, store, 2*k+1);
+      }
+
+      // pop scratch table and entries
+      lua_pop(L, 2);
+    }
+  }
+
+  // pop store
+  lua_pop(L, 1);
+
+  LUASTACK_CLEAN(L, 0);
+  return moved;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Determine the size of a type in [bytes].
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_type_size(luacwrap_Type* desc)
+{
+  int size = 0;
+  switch(desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC : size = ((luacwrap_BasicType*)desc)->size;  break;
+    case LUACWRAP_TC_RECORD: size = ((luacwrap_RecordType*)desc)->size;  break;
+    case LUACWRAP_TC_ARRAY :
+      {
+        luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+        size = arrdesc->elemcount * arrdesc->elemsize;
+      }
+      break;
+    case LUACWRAP_TC_BUFFER: size = ((luacwrap_BufferType*)desc)->size; break;
+    default:
+      {
+        assert(0);
+      }
+  }
+  return size;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Determine the required alignment of boxed objects of a type 
+  in [bytes]. Arrays without explicit alignment use the alignment 
+  of their element type. Returns 0 if the type has no requirements.
+
+*////////////////////////////////////////////////////////////////////////
+size_t luacwrap_type_align(lua_State* L, luacwrap_Type* desc)
+{
+  if ((0 == desc->align) && (LUACWRAP_TC_ARRAY == desc->typeclass))
+  {
+    // element types of static array descriptors are resolved on first use
+    luacwrap_Type* elemdesc = luacwrap_getelemtype(L, (luacwrap_ArrayType*)desc);
+    if (NULL != elemdesc)
+    {
+      return luacwrap_type_align(L, elemdesc);
+    }
+  }
+  return desc->align;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Returns the type dependant length (for the # operator).
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_type_len(luacwrap_Type* desc)
+{
+  int size = 0;
+  switch(desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC : size = ((luacwrap_BasicType*)desc)->size;  break;
+    case LUACWRAP_TC_RECORD: size = ((luacwrap_RecordType*)desc)->size;  break;
+    case LUACWRAP_TC_ARRAY :
+      {
+        luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+        size = arrdesc->elemcount;
+      }
+      break;
+    case LUACWRAP_TC_BUFFER: size = ((luacwrap_BufferType*)desc)->size; break;
+    default:
+      {
+        assert(0);
+      }
+  }
+  return size;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Closure to implement get() on buffers and basic types
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_get_closure(lua_State* L)
+{
+  int offset;
+  const char* typname;
+  luacwrap_Type* desc;
+  size_t len;
+
+  offset = lua_tointeger(L, lua_upvalueindex(1));
+  typname = lua_tolstring(L, lua_upvalueindex(2), &len);
+
+  // get descriptor from type name
+  desc = luacwrap_getdescriptor_byname(L, typname, len);
+
+  return getEmbedded(L, 1, offset, desc);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Closure to implement set() on buffers and basic types
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_set_closure(lua_State* L)
+{
+  int offset;
+  const char* typname;
+  luacwrap_Type* desc;
+  size_t len;
+
+  offset = lua_tointeger(L, lua_upvalueindex(1));
+  typname = lua_tolstring(L, lua_upvalueindex(2), &len);
+
+  // get descriptor from type name
+  desc = luacwrap_getdescriptor_byname(L, typname, len);
+
+  luacwrap_checkwritable(L, 1);
+
+  return setEmbedded(L, offset, desc);
+}
 
 //////////////////////////////////////////////////////////////////////////
 /**
@@ -477,6 +994,26 @@ static int luacwrap_type_index(lua_State* L, int ud, int offset, luacwrap_Type*
             }
           }
           lua_pop(L, 1);
+
+          // builtin methods not overridden by the method table
+          if (0 == strcmp(stridx, "tobytes"))
+          {
+            lua_pushcfunction(L, luacwrap_tobytes);
+            LUASTACK_CLEAN(L, 1);
+            return 1;
+          }
+          else if (0 == strcmp(stridx, "setjson"))
+          {
+            lua_pushcfunction(L, luacwrap_setjson);
+            LUASTACK_CLEAN(L, 1);
+            return 1;
+          }
+          else if (0 == strcmp(stridx, "setmsgpack"))
+          {
+            lua_pushcfunction(L, luacwrap_setmsgpack);
+            LUASTACK_CLEAN(L, 1);
+            return 1;
+          }
         }
       }
       break;
@@ -484,7 +1021,25 @@ static int luacwrap_type_index(lua_State* L, int ud, int offset, luacwrap_Type*
       {
         // determine offset and return inner wrapper
         luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
-        int idx = lua_tointeger(L, 2);
+        int idx;
+
+        if (LUA_TSTRING == lua_type(L, 2))
+        {
+          // try to return builtin array methods
+          lua_pushlightuserdata(L, (void*)g_ArrayMethods);
+          lua_rawget(L, LUA_REGISTRYINDEX);
+          lua_pushvalue(L, 2);
+          lua_rawget(L, -2);
+          lua_remove(L, -2);
+          if (!lua_isnil(L, -1))
+          {
+            LUASTACK_CLEAN(L, 1);
+            return 1;
+          }
+          lua_pop(L, 1);
+        }
+
+        idx = lua_tointeger(L, 2);
 
         if (NULL == arrdesc->elemtypedesc)
         {
@@ -529,13 +1084,34 @@ static int luacwrap_type_index(lua_State* L, int ud, int offset, luacwrap_Type*
           LUASTACK_CLEAN(L, 1);
           return 1;
         }
-      }
-      break;
-    default:
-      {
-        assert(0);
-      }
-  }
+        else if (0 == strcmp("tobytes", stridx))
+        {
+          lua_pushcfunction(L, luacwrap_tobytes);
+
+          LUASTACK_CLEAN(L, 1);
+          return 1;
+        }
+        else if (0 == strcmp("setjson", stridx))
+        {
+          lua_pushcfunction(L, luacwrap_setjson);
+
+          LUASTACK_CLEAN(L, 1);
+          return 1;
+        }
+        else if (0 == strcmp("setmsgpack", stridx))
+        {
+          lua_pushcfunction(L, luacwrap_setmsgpack);
+
+          LUASTACK_CLEAN(L, 1);
+          return 1;
+        }
+      }
+      break;
+    default:
+      {
+        assert(0);
+      }
+  }
 
 #ifdef LUACWRAP_DEBUG_PTR
   // special handling for __ptr
@@ -543,7 +1119,7 @@ static int luacwrap_type_index(lua_State* L, int ud, int offset, luacwrap_Type*
   if (0 == strcmp("__ptr", stridx))
   {
     PBYTE pobj;
-    pobj = (PBYTE)lua_touserdata(L, ud) + offset;
+    pobj = (PBYTE)luacwrap_getobjptr(L, ud) + offset;
     lua_pushlightuserdata(L, pobj);
     LUASTACK_CLEAN(L, 1);
     return 1;
@@ -651,147 +1227,326 @@ static int luacwrap_type_newindex(lua_State* L, int offset, luacwrap_Type* desc)
   return 0;
 }
 
+//
+// state of the tostring conversion
+//
+typedef struct tostring_State
+{
+  luaL_Buffer*  b;            // output
+  int           ud;           // stack index of the outer object
+  PBYTE         base;         // memory of the outer object
+  int           keep;         // stack index of table keeping strings alive
+  int           compact;      // single line output
+  lua_Integer   maxelements;  // maximal number of array elements written (0 = all)
+  int           escape;       // write NUL characters as \0 (within records)
+} tostring_State;
+
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Implements type dependant __tostring method.
-  The object pointer is determined from the pointer to
-  the outer object and the given offset.
+  Appends a number formatted like the lua tostring function.
 
 *////////////////////////////////////////////////////////////////////////
-static int luacwrap_type_tostring(lua_State* L, int ud, int offset, luacwrap_Type* desc)
+static void tostring_addnumber(luaL_Buffer* b, lua_Number value)
 {
-  LUASTACK_SET(L);
+  char num[64];
+  int len = sprintf(num, LUA_NUMBER_FMT, (LUAI_UACNUMBER)value);
 
-  switch(desc->typeclass)
+#if (LUA_VERSION_NUM > 502)
+  // floats which look like integers get a ".0" suffix
+  if ('\0' == num[strspn(num, "-0123456789")])
   {
-    case LUACWRAP_TC_BASIC :
-      {
-        // call getter
-        // return ((luacwrap_BasicType*)desc)->getWrapper((luacwrap_BasicType*)desc, L, p, 0);
-      }
-      break;
-    case LUACWRAP_TC_RECORD:
-      {
-        // structtostring
-        luacwrap_RecordMember* member;
-        luacwrap_RecordType* recdesc = (luacwrap_RecordType*)desc;
-        int idx = 1;
+    num[len++] = '.';
+    num[len++] = '0';
+  }
+#endif
 
-        lua_getglobal(L, "tostring");
+  luaL_addlstring(b, num, len);
+}
 
-        lua_getglobal(L, "table");
-        lua_getfield(L, -1, "concat");
-        // remove "table"
-        lua_remove(L, -2);
+//////////////////////////////////////////////////////////////////////////
+/**
 
-        lua_newtable(L);
-        lua_pushfstring(L, "{ __ptr = %p,\n", ((PBYTE)lua_touserdata(L, ud)) +  offset);
-        lua_rawseti(L, -2, idx++);
+  Appends a numeric member (converted to lua_Number like the get
+  wrappers of the numeric types).
 
-        member = recdesc->members;
-        while (member->membername)
-        {
-          if (NULL == member->membertypedesc)
-          {
-            luacwrap_Type* desc;
+*////////////////////////////////////////////////////////////////////////
+static void tostring_addnumeric(luaL_Buffer* b, int kind, PBYTE p)
+{
+  lua_Number value = 0;
 
-            // get descriptor from type name
-            desc = luacwrap_getdescriptor_byname(L, member->membertypename, -1);
+  switch (kind)
+  {
+    case LUACWRAP_NK_I8 : value = (lua_Number)*(const int8_t*  )p; break;
+    case LUACWRAP_NK_U8 : value = (lua_Number)*(const uint8_t* )p; break;
+    case LUACWRAP_NK_I16: value = (lua_Number)*(const int16_t* )p; break;
+    case LUACWRAP_NK_U16: value = (lua_Number)*(const uint16_t*)p; break;
+    case LUACWRAP_NK_I32: value = (lua_Number)*(const int32_t* )p; break;
+    case LUACWRAP_NK_U32: value = (lua_Number)*(const uint32_t*)p; break;
+    case LUACWRAP_NK_I64: value = (lua_Number)*(const int64_t* )p; break;
+    case LUACWRAP_NK_U64: value = (lua_Number)*(const uint64_t*)p; break;
+    case LUACWRAP_NK_FLT: value = (lua_Number)*(const float*   )p; break;
+    case LUACWRAP_NK_DBL: value = (lua_Number)*(const double*  )p; break;
+  }
 
-            // cache type descriptor
-            member->membertypedesc = desc;
-          }
+  tostring_addnumber(b, value);
+}
 
-          lua_pushstring(L, member->membername);
-          lua_rawseti(L, -2, idx++);
+//////////////////////////////////////////////////////////////////////////
+/**
 
-          lua_pushstring(L, " = ");
-          lua_rawseti(L, -2, idx++);
+  Appends raw bytes, NUL characters are written as \0 within records.
 
-          lua_pushvalue(L, -3);                                           // function to be called (tostring)
-          getEmbedded(L, ud, offset + member->memberoffset, member->membertypedesc);   // value to convert
-          if (lua_isnumber(L, -1))
-          {
-            lua_call(L, 1, 1);                                            // call tostring
-            lua_rawseti(L, -2, idx++);
-          }
-          else
-          {
-            lua_call(L, 1, 1);                                            // call tostring
-            lua_pushstring(L, "[[");
-            lua_rawseti(L, -3, idx++);
-            lua_rawseti(L, -2, idx++);
-            lua_pushstring(L, "]]");
-            lua_rawseti(L, -2, idx++);
-          }
-          
-          lua_pushstring(L, ",\n");
-          lua_rawseti(L, -2, idx++);
+*////////////////////////////////////////////////////////////////////////
+static void tostring_addbytes(tostring_State* S, const char* p, size_t len)
+{
+  const char* nul;
 
-          ++member;
-        }
+  if (!S->escape)
+  {
+    luaL_addlstring(S->b, p, len);
+    return;
+  }
 
-        lua_pushstring(L, "}");
-        lua_rawseti(L, -2, idx++);
+  while (NULL != (nul = (const char*)memchr(p, 0, len)))
+  {
+    luaL_addlstring(S->b, p, nul - p);
+    luaL_addlstring(S->b, "\\0", 2);
+    len -= (nul - p) + 1;
+    p    = nul + 1;
+  }
+  luaL_addlstring(S->b, p, len);
+}
 
-        lua_call(L, 1, 1);                                                // call concat
+static void tostring_value(lua_State* L, tostring_State* S, int offset, luacwrap_Type* desc, int member);
 
-        // remove "tostring"
-        lua_remove(L, -2);
+//////////////////////////////////////////////////////////////////////////
+/**
 
-        // string.gsub(res, "%z", "\\0")
-        lua_getglobal(L, "string");
-        lua_getfield(L, -1, "gsub");
-        lua_remove(L, -2);
+  Appends a record as "{ __ptr = 0x..., name = value, ... }".
 
-        lua_pushvalue(L, -2);
-        lua_pushstring(L, "%z");
-        lua_pushstring(L, "\\0");
-        lua_call(L, 3, 1);
+*////////////////////////////////////////////////////////////////////////
+static void tostring_record(lua_State* L, tostring_State* S, int offset, luacwrap_RecordType* recdesc)
+{
+  luacwrap_RecordMember* member;
+  int escape = S->escape;
+  char ptr[64];
 
-        // remove original string
-        lua_remove(L, -2);
+  S->escape = 1;
 
-        LUASTACK_CLEAN(L, 1);
-        return 1;
+  luaL_addlstring(S->b, ptr, sprintf(ptr, "{ __ptr = %p", (void*)(S->base + offset)));
+  luaL_addstring(S->b, S->compact ? "" : ",\n");
+
+  for (member = recdesc->members; member->membername; member++)
+  {
+    if (S->compact)
+    {
+      luaL_addlstring(S->b, ", ", 2);
+    }
+    luaL_addstring(S->b, member->membername);
+    luaL_addlstring(S->b, " = ", 3);
+    tostring_value(L, S, offset + member->memberoffset, luacwrap_getmembertype(L, member), 1);
+    if (!S->compact)
+    {
+      luaL_addlstring(S->b, ",\n", 2);
+    }
+  }
+
+  luaL_addstring(S->b, S->compact ? " }" : "}");
+
+  S->escape = escape;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends the elements of an array as " = {\n  1 = value,\n ... }"
+  (or "{ value, ... }" in compact form).
+
+*////////////////////////////////////////////////////////////////////////
+static void tostring_array(lua_State* L, tostring_State* S, int offset, luacwrap_ArrayType* arrdesc)
+{
+  luacwrap_Type* elemdesc = luacwrap_getelemtype(L, arrdesc);
+  unsigned int count = arrdesc->elemcount;
+  unsigned int n;
+  char idx[32];
+
+  if ((S->maxelements > 0) && ((lua_Integer)count > S->maxelements))
+  {
+    count = (unsigned int)S->maxelements;
+  }
+
+  luaL_addstring(S->b, S->compact ? "{" : " = {");
+  for (n = 0; n < count; n++)
+  {
+    if (S->compact)
+    {
+      luaL_addstring(S->b, (0 == n) ? " " : ", ");
+    }
+    else
+    {
+      luaL_addlstring(S->b, idx, sprintf(idx, "\n  %u = ", n + 1));
+    }
+    tostring_value(L, S, offset + n * arrdesc->elemsize, elemdesc, 0);
+    if (!S->compact)
+    {
+      luaL_addchar(S->b, ',');
+    }
+  }
+
+  // elements left out
+  if (count < arrdesc->elemcount)
+  {
+    luaL_addstring(S->b, S->compact ? ((0 == count) ? " ..." : ", ...") : "\n  ...");
+  }
+
+  luaL_addstring(S->b, S->compact ? " }" : "\n}");
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends the string representation of a value. Non numeric members of
+  records are enclosed in [[ ]].
+
+*////////////////////////////////////////////////////////////////////////
+static void tostring_value(lua_State* L, tostring_State* S, int offset, luacwrap_Type* desc, int member)
+{
+  const char* open  = member ? "[[" : "";
+  const char* close = member ? "]]" : "";
+
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC :
+      {
+        int kind = luacwrap_numerickind(desc);
+        size_t len;
+        const char* s;
+        int isnumber;
+
+        if (LUACWRAP_NK_NONE != kind)
+        {
+          tostring_addnumeric(S->b, kind, S->base + offset);
+          break;
+        }
+
+        // other basic types are converted through their get wrappers
+        getEmbedded(L, S->ud, offset, desc);
+        isnumber = lua_isnumber(L, -1);
+        if (!isnumber && !lua_isstring(L, -1))
+        {
+          lua_getglobal(L, "tostring");
+          lua_insert(L, -2);
+          lua_call(L, 1, 1);
+        }
+        s = lua_tolstring(L, -1, &len);
+
+        // keep string alive while it is appended
+        lua_rawseti(L, S->keep, 1);
+
+        luaL_addstring(S->b, isnumber ? "" : open);
+        tostring_addbytes(S, s, len);
+        luaL_addstring(S->b, isnumber ? "" : close);
       }
       break;
+    case LUACWRAP_TC_RECORD:
+      luaL_addstring(S->b, open);
+      tostring_record(L, S, offset, (luacwrap_RecordType*)desc);
+      luaL_addstring(S->b, close);
+      break;
     case LUACWRAP_TC_ARRAY :
       {
         luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
-        
-        if (NULL == arrdesc->elemtypedesc)
+
+        luaL_addstring(S->b, open);
+        if (1 == arrdesc->elemsize)
         {
-          luacwrap_Type* desc;
+          // arrays with 1 byte elements are written as string
+          tostring_addbytes(S, (const char*)S->base + offset, arrdesc->elemcount);
+        }
+        else
+        {
+          tostring_array(L, S, offset, arrdesc);
+        }
+        luaL_addstring(S->b, close);
+      }
+      break;
+    case LUACWRAP_TC_BUFFER:
+      luaL_addstring(S->b, open);
+      tostring_addbytes(S, (const char*)S->base + offset, ((luacwrap_BufferType*)desc)->size);
+      luaL_addstring(S->b, close);
+      break;
+  }
+}
 
-          // get descriptor from type name
-          desc = luacwrap_getdescriptor_byname(L, arrdesc->elemtypename, -1);
+//////////////////////////////////////////////////////////////////////////
+/**
 
-          // cache type descriptor
-          arrdesc->elemtypedesc = desc;
-        }
+  Implements type dependant __tostring method.
+  The object pointer is determined from the pointer to
+  the outer object and the given offset.
 
-        // maybe better use:
-        //  if (&regType_char.hdr == arrdesc->elemtypedesc)
-        if (1 == arrdesc->elemsize)
+  Records and arrays are formatted in a single pass into a string
+  buffer.
+
+  @param[in]  compact      single line output
+  @param[in]  maxelements  maximal number of array elements (0 = all)
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_type_tostring(lua_State* L, int ud, int offset, luacwrap_Type* desc, int compact, lua_Integer maxelements)
+{
+  LUASTACK_SET(L);
+
+  switch(desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC :
+      {
+        // call getter
+        // return ((luacwrap_BasicType*)desc)->getWrapper((luacwrap_BasicType*)desc, L, p, 0);
+      }
+      break;
+    case LUACWRAP_TC_RECORD:
+    case LUACWRAP_TC_ARRAY :
+      {
+        luaL_Buffer b;
+        tostring_State S;
+
+        if ((LUACWRAP_TC_ARRAY == desc->typeclass) && (1 == ((luacwrap_ArrayType*)desc)->elemsize))
         {
           // if element type is 1 byte long convert directly to string
           const char* pobj;
-          pobj = (const char*)lua_touserdata(L, ud) + offset;
-        
-          lua_pushlstring(L, pobj , arrdesc->elemsize * arrdesc->elemcount);
+          pobj = (const char*)luacwrap_getobjptr(L, ud) + offset;
+
+          lua_pushlstring(L, pobj, ((luacwrap_ArrayType*)desc)->elemsize * ((luacwrap_ArrayType*)desc)->elemcount);
+
+          LUASTACK_CLEAN(L, 1);
+          return 1;
+        }
+
+        // table keeping strings of get wrappers alive while they are appended
+        lua_createtable(L, 1, 0);
+
+        S.b           = &b;
+        S.ud          = ud;
+        S.base        = (PBYTE)luacwrap_getobjptr(L, ud);
+        S.keep        = lua_gettop(L);
+        S.compact     = compact;
+        S.maxelements = maxelements;
+        S.escape      = 0;
+
+        luaL_buffinit(L, &b);
+        if (LUACWRAP_TC_RECORD == desc->typeclass)
+        {
+          tostring_record(L, &S, offset, (luacwrap_RecordType*)desc);
         }
         else
         {
-          // call tabletostring
-          getmoduletable(L);
-          lua_getfield(L, -1, "tabletostring");
-          lua_remove(L, -2);
-          
-          getEmbedded(L, ud, offset, desc);   // value to convert
-          lua_call(L, 1, 1);
+          tostring_array(L, &S, offset, (luacwrap_ArrayType*)desc);
         }
+        luaL_pushresult(&b);
+
+        // remove keep table
+        lua_remove(L, -2);
 
         LUASTACK_CLEAN(L, 1);
         return 1;
@@ -802,7 +1557,7 @@ static int luacwrap_type_tostring(lua_State* L, int ud, int offset, luacwrap_Typ
         const char* pobj;
         luacwrap_BufferType* bufdesc = (luacwrap_BufferType*)desc;
 
-        pobj = (const char*)lua_touserdata(L, ud) + offset;
+        pobj = (const char*)luacwrap_getobjptr(L, ud) + offset;
 
         // get buffer as string
         lua_pushlstring(L, pobj, bufdesc->size);
@@ -828,7 +1583,7 @@ static int luacwrap_type_tostring(lua_State* L, int ud, int offset, luacwrap_Typ
   Gets type descriptor from ud._ENV["$desc"]
 
 *////////////////////////////////////////////////////////////////////////
-static luacwrap_Type* luacwrap_getdescriptor(lua_State* L, int ud)
+luacwrap_Type* luacwrap_getdescriptor(lua_State* L, int ud)
 {
   luacwrap_Type* desc = 0;
 
@@ -894,7 +1649,7 @@ static int luacwrap_getmethodtable_byname(lua_State* L, const char* name)
     - then tries a lookup in _G
 
 *////////////////////////////////////////////////////////////////////////
-static luacwrap_Type* luacwrap_getdescriptor_byname(lua_State* L, const char* name, int namelen)
+luacwrap_Type* luacwrap_getdescriptor_byname(lua_State* L, const char* name, int namelen)
 {
   luacwrap_Type* result = NULL;
 
@@ -949,22 +1704,18 @@ static luacwrap_Type* luacwrap_getdescriptor_byname(lua_State* L, const char* na
 *////////////////////////////////////////////////////////////////////////
 static int Embedded_index(lua_State* L)
 {
-  int result;
   luacwrap_Type* desc;
   luacwrap_EmbeddedObject* pobj;
 
-  LUASTACK_SET(L);
-
   desc = luacwrap_getdescriptor(L, 1);
   pobj = (luacwrap_EmbeddedObject*)lua_touserdata(L, 1);
 
+  // replace self by outer object, so that getters (e.g. of pointer
+  // members) find the references stored within the outer object
   lua_rawgeti(L, LUA_REGISTRYINDEX, pobj->outer);
-  result = luacwrap_type_index(L, -1, pobj->offset, desc);
-
-  lua_remove(L, -2);
+  lua_replace(L, 1);
 
-  LUASTACK_CLEAN(L, result);
-  return result;
+  return luacwrap_type_index(L, 1, pobj->offset, desc);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -988,6 +1739,7 @@ static int Embedded_newindex(lua_State* L)
 
   lua_rawgeti(L, LUA_REGISTRYINDEX, pobj->outer);
   lua_replace(L, 1);
+  luacwrap_checkwritable(L, 1);
 
   return luacwrap_type_newindex(L, pobj->offset, desc);
 }
@@ -1028,18 +1780,15 @@ static int Embedded_tostring(lua_State* L)
   luacwrap_Type* desc;
   luacwrap_EmbeddedObject* pobj;
 
-  LUASTACK_SET(L);
-
   desc = luacwrap_getdescriptor(L, 1);
   pobj = (luacwrap_EmbeddedObject*)lua_touserdata(L, 1);
 
+  // replace self by outer object (userdata or string of a view), so
+  // that getters (e.g. of pointer members) find their references
   lua_rawgeti(L, LUA_REGISTRYINDEX, pobj->outer);
-  assert(lua_isuserdata(L, -1));
-  luacwrap_type_tostring(L, abs_index(L, -1), pobj->offset, desc);
-  lua_remove(L, -2);
+  lua_replace(L, 1);
 
-  LUASTACK_CLEAN(L, 1);
-  return 1;
+  return luacwrap_type_tostring(L, 1, pobj->offset, desc, 0, 0);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -1062,6 +1811,7 @@ static int Embedded_gc(lua_State* L)
 
   luaL_unref(L, LUA_REGISTRYINDEX, pobj->outer);
   pobj->outer = LUA_REFNIL;
+  LUACWRAP_STAT_INC(luacwrap_getdescriptor(L, 1), unrefs);
 
   LUASTACK_CLEAN(L, 0);
   return 0;
@@ -1158,10 +1908,32 @@ static int pushEmbedded(lua_State* L, int ud, int offset, luacwrap_Type* desc)
   lua_setfield(L, -2, "$desc");
   luacwrap_setenvironment(L, -2);
 
+  LUACWRAP_STAT_INC(desc, embedded);
+  LUACWRAP_STAT_INC(desc, envtables);
+  LUACWRAP_STAT_INC(desc, refs);
+
   LUASTACK_CLEAN(L, 1);
   return 1;
 }
 
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Creates an embedded object of the given type at the given offset 
+  within an outer object. The offset of the embedded object may be 
+  changed later on to re-point it (e.g. cursors of stream readers).
+
+  @param[in]  L           lua state
+  @param[in]  ud          stack index of outer object
+  @param[in]  offset      offset within outer object
+  @param[in]  desc        type descriptor of the embedded object
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_pushembedded(lua_State* L, int ud, int offset, luacwrap_Type* desc)
+{
+  return pushEmbedded(L, abs_index(L, ud), offset, desc);
+}
+
 //////////////////////////////////////////////////////////////////////////
 /**
 
@@ -1182,7 +1954,7 @@ static int getEmbedded(lua_State* L, int ud, int offset, luacwrap_Type* desc)
         PBYTE pobj;
         luacwrap_BasicType* basdesc = (luacwrap_BasicType*)desc;
 
-        pobj = (PBYTE)lua_touserdata(L, ud) + offset;
+        pobj = (PBYTE)luacwrap_getobjptr(L, ud) + offset;
 
         return basdesc->getWrapper(basdesc, L, pobj, offset);
       }
@@ -1192,7 +1964,7 @@ static int getEmbedded(lua_State* L, int ud, int offset, luacwrap_Type* desc)
         const char* pobj;
         luacwrap_BufferType* bufdesc = (luacwrap_BufferType*)desc;
 
-        pobj = (const char*)lua_touserdata(L, ud) + offset;
+        pobj = (const char*)luacwrap_getobjptr(L, ud) + offset;
 
         // get buffer as string
         lua_pushlstring(L, pobj, bufdesc->size);
@@ -1241,7 +2013,7 @@ static int setEmbedded(lua_State* L, int offset, luacwrap_Type* desc)
         PBYTE pobj;
         luacwrap_BasicType* basdesc = (luacwrap_BasicType*)desc;
 
-        pobj = (PBYTE)lua_touserdata(L, -3) + offset;
+        pobj = (PBYTE)luacwrap_getobjptr(L, -3) + offset;
 
         lua_pushvalue(L, -1);
         basdesc->setWrapper(basdesc, L, pobj, offset);
@@ -1257,7 +2029,7 @@ static int setEmbedded(lua_State* L, int offset, luacwrap_Type* desc)
         // check for string
         const char* strval = lua_tolstring(L, -1, &length);
 
-        pobj = (PBYTE)lua_touserdata(L, -3) + offset;
+        pobj = (PBYTE)luacwrap_getobjptr(L, -3) + offset;
 
         // limit length to maximum buffer size
         length = (bufdesc->size < length) ? bufdesc->size : length;
@@ -1364,7 +2136,62 @@ static int Boxed_tostring(lua_State* L)
 
   desc = luacwrap_getdescriptor(L, 1);
 
-  return luacwrap_type_tostring(L, abs_index(L, 1), 0, desc);
+  return luacwrap_type_tostring(L, abs_index(L, 1), 0, desc, 0, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements luacwrap.tostring(obj [, opts]), the string conversion of
+  __tostring with options.
+
+  Parameters on lua stack:
+    - obj     (boxed or embedded object)
+    - opts    (optional table:
+                compact     = true for single line output,
+                maxelements = maximal number of array elements written)
+
+  Return values on lua stack
+    - string representation of the object
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_tostring(lua_State* L)
+{
+  luacwrap_Type* desc;
+  int offset = 0;
+  int compact = 0;
+  lua_Integer maxelements = 0;
+
+  lua_settop(L, 2);
+
+  desc = luacwrap_getdescriptor(L, 1);
+  if (NULL == desc)
+  {
+    luaL_argerror(L, 1, "wrapped object expected");
+  }
+
+  // options
+  if (lua_istable(L, 2))
+  {
+    lua_getfield(L, 2, "compact");
+    compact = lua_toboolean(L, -1);
+    lua_getfield(L, 2, "maxelements");
+    maxelements = luaL_optinteger(L, -1, 0);
+    lua_pop(L, 2);
+  }
+
+  // get wrappers of pointer members expect the outer object at index 1
+  if (!luacwrap_getouter(L, 1, &offset))
+  {
+    luaL_argerror(L, 1, "wrapped object expected");
+  }
+  lua_replace(L, 1);
+
+  if (0 == luacwrap_type_tostring(L, 1, offset, desc, compact, maxelements))
+  {
+    luaL_argerror(L, 1, "tostring not supported for this type");
+  }
+  return 1;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -1380,207 +2207,1349 @@ static int Boxed_getouter(lua_State* L, int ud, int* offset)
   return 1;
 }
 
+#ifdef LUACWRAP_STATS
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the __gc metamethod for boxed objects (only used to 
+  update statistics). Note that finalizers delay freeing the memory 
+  of boxed objects by one garbage collection cycle.
+
+  Parameters on lua stack:
+    - self  (userdata, boxed object)
+
+*////////////////////////////////////////////////////////////////////////
+static int Boxed_gc(lua_State* L)
+{
+  luacwrap_Type* desc;
+
+  desc = luacwrap_getdescriptor(L, 1);
+  if (desc)
+  {
+    LUACWRAP_STAT_DEC(desc, alive);
+#if (LUA_VERSION_NUM > 501)
+    LUACWRAP_STAT_SUB(desc, bytes, lua_rawlen(L, 1));
+#else
+    LUACWRAP_STAT_SUB(desc, bytes, lua_objlen(L, 1));
+#endif
+  }
+  return 0;
+}
+#endif
+
 luaL_Reg g_mtBoxed[ ] = {
   { "__index"   , Boxed_index     },
   { "__newindex", Boxed_newindex  },
   { "__len"     , Boxed_len},
   { "__tostring", Boxed_tostring},
+#ifdef LUACWRAP_STATS
+  { "__gc"      , Boxed_gc},
+#endif
   { NULL, NULL }
 };
 
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Pushes a boxed object on the lua stack 
-  (C-API equivalent to TYPE:new function)
+  Gets the memory pointer of an indirect object. Raises an error if
+  the owner of the memory (e.g. an arena) has released it.
 
-  @param[in]  L       lua state
-  @param[in]  desc    basic type descriptor
-  @param[in]  initval value used to initialize object memory with
+*////////////////////////////////////////////////////////////////////////
+static void* Indirect_getptr(lua_State* L, int ud)
+{
+  luacwrap_IndirectObject* pobj = (luacwrap_IndirectObject*)lua_touserdata(L, ud);
+
+  if ((NULL != pobj->pgeneration) && (*pobj->pgeneration != pobj->generation))
+  {
+    luaL_error(L, "access to released object (memory owner has been reset)");
+  }
+  if (NULL == pobj->ptr)
+  {
+    luaL_error(L, "access to released object (memory has been freed)");
+  }
+  return pobj->ptr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Releases the memory of an indirect object via its release hook.
+  Further accesses to the object raise an error.
+
+*////////////////////////////////////////////////////////////////////////
+static void Indirect_release(lua_State* L, luacwrap_IndirectObject* pobj)
+{
+  if ((NULL != pobj->release) && (NULL != pobj->ptr))
+  {
+    pobj->release(L, pobj);
+    pobj->ptr = NULL;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the __gc metamethod for indirect objects with external 
+  memory.
+
+  Parameters on lua stack:
+    - self  (userdata, indirect object)
+
+*////////////////////////////////////////////////////////////////////////
+static int Indirect_gc(lua_State* L)
+{
+  luacwrap_IndirectObject* pobj = (luacwrap_IndirectObject*)lua_touserdata(L, 1);
+
+#ifdef LUACWRAP_STATS
+  luacwrap_Type* desc = luacwrap_getdescriptor(L, 1);
+  if (desc)
+  {
+    LUACWRAP_STAT_DEC(desc, alive);
+    LUACWRAP_STAT_SUB(desc, bytes, pobj->size);
+  }
+#endif
+
+  Indirect_release(L, pobj);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements obj:free() for objects with external memory. Releases 
+  the memory before the object is collected.
+
+  Parameters on lua stack:
+    - self  (userdata, indirect object)
+
+*////////////////////////////////////////////////////////////////////////
+static int External_free(lua_State* L)
+{
+  luacwrap_IndirectObject* pobj;
   
-  @return pointer to raw object memory
+  pobj = (luacwrap_IndirectObject*)luacwrap_toudata(L, 1, (void*)g_mtExternal);
+  if (NULL == pobj)
+  {
+    luaL_argerror(L, 1, "object with external memory expected");
+  }
+  Indirect_release(L, pobj);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the __index metamethod for objects with external memory.
+  Same as for boxed objects, additionally provides the free() method.
+
+  Parameters on lua stack:
+    - self  (userdata, indirect object)
+    - index
 
 *////////////////////////////////////////////////////////////////////////
-void* luacwrap_pushboxedobj( lua_State*            L
-                           , luacwrap_Type*        desc
-                           , int                   initval)
+static int External_index(lua_State* L)
 {
-  size_t udsize;
-  void* ud;
+  int res;
+  const char* stridx;
+
+  res = Boxed_index(L);
+  if ((0 == res) || lua_isnil(L, -1))
+  {
+    stridx = lua_tostring(L, 2);
+    if (stridx && (0 == strcmp(stridx, "free")))
+    {
+      lua_pushcfunction(L, External_free);
+      return 1;
+    }
+  }
+  return res;
+}
+
+// indirect objects behave like boxed objects
+luaL_Reg g_mtIndirect[ ] = {
+  { "__index"   , Boxed_index     },
+  { "__newindex", Boxed_newindex  },
+  { "__len"     , Boxed_len},
+  { "__tostring", Boxed_tostring},
+#ifdef LUACWRAP_STATS
+  { "__gc"      , Indirect_gc},
+#endif
+  { NULL, NULL }
+};
+
+// objects with external memory additionally release it on collection
+luaL_Reg g_mtExternal[ ] = {
+  { "__index"   , External_index  },
+  { "__newindex", Boxed_newindex  },
+  { "__len"     , Boxed_len},
+  { "__tostring", Boxed_tostring},
+  { "__gc"      , Indirect_gc},
+  { NULL, NULL }
+};
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the __index metamethod for memory mapped arrays.
+  Same as for boxed objects, additionally provides the methods of
+  mapped arrays (close(), sync(), advise()).
+
+  Parameters on lua stack:
+    - self  (userdata, indirect object)
+    - index
+
+*////////////////////////////////////////////////////////////////////////
+static int Mapped_index(lua_State* L)
+{
+  int res;
+
+  res = Boxed_index(L);
+  if (((0 == res) || lua_isnil(L, -1)) && (LUA_TSTRING == lua_type(L, 2)))
+  {
+    lua_pushlightuserdata(L, (void*)g_MappedMethods);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    return 1;
+  }
+  return res;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the __newindex metamethod for memory mapped arrays.
+  Raises an error for read-only mappings.
+
+  Parameters on lua stack:
+    - self  (userdata, indirect object)
+    - index
+    - value
+
+*////////////////////////////////////////////////////////////////////////
+static int Mapped_newindex(lua_State* L)
+{
+  luacwrap_checkwritable(L, 1);
+
+  return Boxed_newindex(L);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the __gc metamethod for memory mapped arrays (unmaps
+  the file).
+
+  Parameters on lua stack:
+    - self  (userdata, indirect object)
+
+*////////////////////////////////////////////////////////////////////////
+static int Mapped_gc(lua_State* L)
+{
+  Indirect_release(L, (luacwrap_IndirectObject*)lua_touserdata(L, 1));
+  return 0;
+}
+
+// memory mapped arrays behave like objects with external memory
+luaL_Reg g_mtMapped[ ] = {
+  { "__index"   , Mapped_index    },
+  { "__newindex", Mapped_newindex },
+  { "__len"     , Boxed_len},
+  { "__tostring", Boxed_tostring},
+  { "__gc"      , Mapped_gc},
+  { NULL, NULL }
+};
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Creates the header of an indirect object on the top of the lua 
+  stack and attaches the metatable for indirect objects.
+
+  @param[in]  L           lua state
+  @param[in]  ptr         pointer to object memory
+  @param[in]  size        size of object memory
+  @param[in]  align       alignment of object memory
+  @param[in]  pgeneration pointer to generation counter of memory
+                          owner (or NULL)
+  @param[in]  release     hook to release memory on collection or
+                          obj:free() (or NULL if owned elsewhere)
+  @param[in]  releasedata user data for release hook
+
+*////////////////////////////////////////////////////////////////////////
+luacwrap_IndirectObject* luacwrap_pushindirectobj ( lua_State*          L
+                                                  , void*               ptr
+                                                  , size_t              size
+                                                  , size_t              align
+                                                  , const unsigned int* pgeneration
+                                                  , LUACWRAP_RELEASEMEM release
+                                                  , void*               releasedata)
+{
+  luacwrap_IndirectObject* pobj;
 
   LUASTACK_SET(L);
-  
-  // determine size
-  udsize = luacwrap_type_size(desc);
 
-  // create userdata which holds type instance
-  ud = lua_newuserdata(L, udsize);
+  pobj = (luacwrap_IndirectObject*)lua_newuserdata(L, sizeof(luacwrap_IndirectObject));
+  pobj->ptr         = (PBYTE)ptr;
+  pobj->size        = size;
+  pobj->align       = align;
+  pobj->pgeneration = pgeneration;
+  pobj->generation  = pgeneration ? *pgeneration : 0;
+  pobj->release     = release;
+  pobj->releasedata = releasedata;
+  pobj->readonly    = 0;
 
-  // by clear memory with given value
-  memset(ud, initval, udsize);
-  
   // get/attach metatable
-  lua_pushlightuserdata(L, (void*)&g_mtBoxed);
+  lua_pushlightuserdata(L, release ? (void*)&g_mtExternal : (void*)&g_mtIndirect);
   lua_rawget(L, LUA_REGISTRYINDEX);
   assert(!lua_isnil(L, -1));
   lua_setmetatable(L, -2);
 
+  LUASTACK_CLEAN(L, 1);
+  return pobj;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Pushes a new environment table for a boxed object holding its
+  type descriptor, method table and the owner of its memory.
+
+  @param[in]  L           lua state
+  @param[in]  desc        type descriptor
+  @param[in]  methodsidx  stack index of method table 
+                          (0 = lookup method table by type name)
+  @param[in]  allocidx    stack index of arena or allocator (or 0)
+
+*////////////////////////////////////////////////////////////////////////
+static void luacwrap_pushobjenv( lua_State*            L
+                               , luacwrap_Type*        desc
+                               , int                   methodsidx
+                               , int                   allocidx)
+{
   // set _ENV[$desc] and _ENV[$methods]
-  lua_newtable(L);
-  if (luacwrap_getmethodtable_byname(L, desc->name))
+  lua_createtable(L, 0, 2);
+  if (methodsidx)
+  {
+    lua_pushvalue(L, methodsidx);
+    lua_setfield(L, -2, "$methods");
+  }
+  else if (luacwrap_getmethodtable_byname(L, desc->name))
   {
     lua_setfield(L, -2, "$methods");
   }
   lua_pushlightuserdata(L, desc);
   lua_setfield(L, -2, "$desc");
-  luacwrap_setenvironment(L, -2);
-
-  LUASTACK_CLEAN(L, 1);
 
-  return ud;
+  // keep arena/allocator alive as long as the object exists
+  if (allocidx)
+  {
+    lua_pushvalue(L, allocidx);
+    lua_setfield(L, -2, "$owner");
+  }
 }
 
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Implements the new() constructor method for boxed types. It
-    - creates udata with size determined from type descriptor
-    - attaches the metatable for boxed objects
-    - adds a type descriptor to environment[$desc]
+  Creates a boxed object on the top of the lua stack.
 
-  Parameters on lua stack:
-    - self  (type descriptor)
-    - init parameter (optional)
+  @param[in]  L           lua state
+  @param[in]  desc        type descriptor
+  @param[in]  initval     value used to initialize object memory with
+  @param[in]  methodsidx  stack index of method table 
+                          (0 = lookup method table by type name)
+  @param[in]  allocidx    stack index of arena or allocator to 
+                          allocate object memory from
+                          (0 = allocate within userdata)
+  @param[in]  mtidx       stack index of the metatable for boxed objects
+                          (0 = lookup in registry)
+
+  @return pointer to raw object memory
 
 *////////////////////////////////////////////////////////////////////////
-static int luacwrap_type_new(lua_State* L)
+static void* luacwrap_newboxedobj( lua_State*            L
+                                 , luacwrap_Type*        desc
+                                 , int                   initval
+                                 , int                   methodsidx
+                                 , int                   allocidx
+                                 , int                   mtidx)
 {
-  size_t         udsize;
-  void*          ud;
-  int            initval;
-  luacwrap_Type* desc;
+  size_t udsize;
+  size_t align;
+  void* ud;
+  luacwrap_Arena* arena = NULL;
+  luacwrap_Allocator* allocator;
 
   LUASTACK_SET(L);
 
-  /*
-    method table
-    +-----------------+                     +-----------------+
-    | $desc           |-------------------->| TypeDescriptor  |
-    | + additional    |                     +-----------------+
-    |   methods       |
-    +-----------------+
-      metatable
-        [new]         -> Type_new
-        [attach]      -> Type_attach
-  */
-  luaL_checktype(L, 1, LUA_TTABLE);
+  methodsidx = methodsidx ? abs_index(L, methodsidx) : 0;
+  allocidx   = allocidx   ? abs_index(L, allocidx)   : 0;
+  mtidx      = mtidx      ? abs_index(L, mtidx)      : 0;
 
-  // get descriptor
-  lua_getfield(L, 1, "$desc");
-  if (lua_isnil(L, -1))
+  // determine size and alignment
+  udsize = luacwrap_type_size(desc);
+  align  = luacwrap_type_align(L, desc);
+
+  if (allocidx)
   {
-    luaL_error(L, "No descriptor found. Don't call new() on instances.");
+    // create indirect object which references arena or external memory
+    if (NULL != (arena = luacwrap_toarena(L, allocidx)))
+    {
+      ud = luacwrap_arena_pushobj(L, arena, udsize, align);
+    }
+    else if (NULL != (allocator = luacwrap_toallocator(L, allocidx)))
+    {
+      ud = luacwrap_allocator_pushobj(L, allocator, udsize, align);
+    }
+    else
+    {
+      luaL_argerror(L, allocidx, "arena or allocator expected");
+      ud = NULL;
+    }
   }
-  desc = lua_touserdata(L, -1);
-  lua_pop(L, 1);
+  else if (align > LUACWRAP_USERDATA_ALIGN)
+  {
+    luacwrap_IndirectObject* pobj;
+
+    // userdata memory is not sufficiently aligned, so create an 
+    // indirect object which points to aligned memory behind its
+    // header within the same userdata
+    pobj = (luacwrap_IndirectObject*)lua_newuserdata(L, sizeof(luacwrap_IndirectObject) + udsize + align - 1);
+    ud = (void*)(((size_t)(pobj + 1) + align - 1) & ~(align - 1));
+
+    pobj->ptr         = (PBYTE)ud;
+    pobj->size        = udsize;
+    pobj->align       = align;
+    pobj->pgeneration = NULL;
+    pobj->generation  = 0;
+    pobj->release     = NULL;
+    pobj->releasedata = NULL;
+    pobj->readonly    = 0;
+
+    // get/attach metatable
+    lua_pushlightuserdata(L, (void*)&g_mtIndirect);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    assert(!lua_isnil(L, -1));
+    lua_setmetatable(L, -2);
+  }
+  else
+  {
+    // create userdata which holds type instance
+    ud = lua_newuserdata(L, udsize);
+
+    // get/attach metatable
+    if (mtidx)
+    {
+      lua_pushvalue(L, mtidx);
+    }
+    else
+    {
+      lua_pushlightuserdata(L, (void*)&g_mtBoxed);
+      lua_rawget(L, LUA_REGISTRYINDEX);
+    }
+    assert(!lua_isnil(L, -1));
+    lua_setmetatable(L, -2);
+  }
+
+  // by clear memory with given value
+  if (LUACWRAP_NOINIT != initval)
+  {
+    memset(ud, initval, udsize);
+  }
+
+  if (arena && !methodsidx)
+  {
+    // arena objects of a type share one environment, which is cached
+    // within the environment of the arena
+    luacwrap_getenvironment(L, allocidx);
+    lua_pushlightuserdata(L, desc);
+    lua_rawget(L, -2);
+    if (lua_isnil(L, -1))
+    {
+      lua_pop(L, 1);
+      luacwrap_pushobjenv(L, desc, 0, allocidx);
+      lua_pushboolean(L, 1);
+      lua_rawseti(L, -2, LUACWRAP_ENV_SHARED);
+      lua_pushlightuserdata(L, desc);
+      lua_pushvalue(L, -2);
+      lua_rawset(L, -4);
+      LUACWRAP_STAT_INC(desc, envtables);
+    }
+    lua_remove(L, -2);
+  }
+  else
+  {
+    luacwrap_pushobjenv(L, desc, methodsidx, allocidx);
+    LUACWRAP_STAT_INC(desc, envtables);
+  }
+  luacwrap_setenvironment(L, -2);
+
+  LUACWRAP_STAT_INC(desc, created);
+  LUACWRAP_STAT_INC(desc, alive);
+  LUACWRAP_STAT_ADD(desc, bytes, udsize);
+
+  LUASTACK_CLEAN(L, 1);
+
+  return ud;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Pushes a boxed object on the lua stack 
+  (C-API equivalent to TYPE:new function)
+
+  @param[in]  L       lua state
+  @param[in]  desc    basic type descriptor
+  @param[in]  initval value used to initialize object memory with
+  
+  @return pointer to raw object memory
+
+*////////////////////////////////////////////////////////////////////////
+void* luacwrap_pushboxedobj( lua_State*            L
+                           , luacwrap_Type*        desc
+                           , int                   initval)
+{
+  return luacwrap_newboxedobj(L, desc, initval, 0, 0, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Pushes a boxed object which memory is allocated from an arena
+  or an allocator (e.g. luacwrap.external) on the lua stack 
+  (C-API equivalent to TYPE:new(initval, allocator))
+
+  @param[in]  L         lua state
+  @param[in]  desc      basic type descriptor
+  @param[in]  initval   value used to initialize object memory with
+  @param[in]  allocidx  stack index of arena or allocator
+                        (0 = allocate within userdata)
+  
+  @return pointer to raw object memory
+
+*////////////////////////////////////////////////////////////////////////
+void* luacwrap_pushallocobj( lua_State*            L
+                           , luacwrap_Type*        desc
+                           , int                   initval
+                           , int                   allocidx)
+{
+  return luacwrap_newboxedobj(L, desc, initval, 0, allocidx, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Copies memory and references of an object into another object
+  of the same type.
+
+  @param[in]  L       lua state
+  @param[in]  dest    stack index of destination object
+  @param[in]  src     stack index of source object
+  @param[in]  desc    type descriptor of both objects
+
+*////////////////////////////////////////////////////////////////////////
+static void luacwrap_copyobj(lua_State* L, int dest, int src, luacwrap_Type* desc)
+{
+  LUASTACK_SET(L);
+
+  dest = abs_index(L, dest);
+  src  = abs_index(L, src);
+
+  // copy binary content
+  memcpy( luacwrap_mobj_getbaseptr(L, dest)
+        , luacwrap_mobj_getbaseptr(L, src)
+        , luacwrap_type_size(desc));
+
+  // copy object references
+  lua_pushvalue(L, dest);
+  lua_pushvalue(L, src);
+  luacwrap_mobj_copy_references(L);
+  lua_pop(L, 2);
+
+  LUASTACK_CLEAN(L, 0);
+}
+
+//
+// range of object memory which is completely written by set()
+//
+typedef struct luacwrap_InitRange
+{
+  int first;
+  int last;
+} luacwrap_InitRange;
+
+static int luacwrap_compare_initrange(const void* a, const void* b)
+{
+  return ((const luacwrap_InitRange*)a)->first - ((const luacwrap_InitRange*)b)->first;
+}
+
+//
+// objects below this size are cleared completely before set() is called
+// (cheaper than determining the gaps)
+//
+#define LUACWRAP_CLEARGAPS_MINSIZE  256
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Clears the memory of a new object which is not written when set() 
+  is called with the given init table. Basic and buffer members 
+  which have a value within the init table are written completely 
+  by set(), so only the gaps between them have to be cleared.
+
+  @param[in]  L       lua state
+  @param[in]  ud      stack index of the (uninitialized) object
+  @param[in]  init    stack index of init table
+  @param[in]  desc    type descriptor of the object
+
+*////////////////////////////////////////////////////////////////////////
+static void luacwrap_cleargaps(lua_State* L, int ud, int init, luacwrap_Type* desc)
+{
+  PBYTE               base;
+  int                 size;
+  luacwrap_InitRange* ranges = NULL;
+  int                 nranges = 0;
+  int                 pos;
+  int                 idx;
+
+  LUASTACK_SET(L);
+
+  ud   = abs_index(L, ud);
+  base = (PBYTE)luacwrap_mobj_getbaseptr(L, ud);
+  size = luacwrap_type_size(desc);
+
+  if (size >= LUACWRAP_CLEARGAPS_MINSIZE)
+  {
+    if (LUACWRAP_TC_RECORD == desc->typeclass)
+    {
+      luacwrap_RecordMember* member = ((luacwrap_RecordType*)desc)->members;
+      int nmembers = 0;
+
+      while (member[nmembers].membername)
+      {
+        ++nmembers;
+      }
+      ranges = (luacwrap_InitRange*)lua_newuserdata(L, (nmembers + 1) * sizeof(luacwrap_InitRange));
+
+      for (; member->membername; ++member)
+      {
+        luacwrap_Type* membertype;
+
+        lua_pushstring(L, member->membername);
+        lua_rawget(L, init);
+        if (!lua_isnil(L, -1))
+        {
+          membertype = luacwrap_getmembertype(L, member);
+          if ((LUACWRAP_TC_BASIC == membertype->typeclass) || (LUACWRAP_TC_BUFFER == membertype->typeclass))
+          {
+            ranges[nranges].first = member->memberoffset;
+            ranges[nranges].last  = member->memberoffset + luacwrap_type_size(membertype);
+            ++nranges;
+          }
+        }
+        lua_pop(L, 1);
+      }
+    }
+    else if (LUACWRAP_TC_ARRAY == desc->typeclass)
+    {
+      luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+      luacwrap_Type* elemtype = luacwrap_getelemtype(L, arrdesc);
+
+      if ((LUACWRAP_TC_BASIC == elemtype->typeclass) || (LUACWRAP_TC_BUFFER == elemtype->typeclass))
+      {
+        // set() writes consecutive elements starting at index 1
+        idx = 0;
+        while (idx < (int)arrdesc->elemcount)
+        {
+          lua_rawgeti(L, init, idx + 1);
+          if (lua_isnil(L, -1))
+          {
+            lua_pop(L, 1);
+            break;
+          }
+          lua_pop(L, 1);
+          ++idx;
+        }
+
+        ranges = (luacwrap_InitRange*)lua_newuserdata(L, sizeof(luacwrap_InitRange));
+        ranges[0].first = 0;
+        ranges[0].last  = idx * arrdesc->elemsize;
+        nranges = 1;
+      }
+    }
+  }
+
+  // clear gaps
+  if (nranges > 1)
+  {
+    qsort(ranges, nranges, sizeof(luacwrap_InitRange), luacwrap_compare_initrange);
+  }
+  pos = 0;
+  for (idx = 0; idx < nranges; ++idx)
+  {
+    int first = min(ranges[idx].first, size);
+
+    if (first > pos)
+    {
+      memset(base + pos, 0, first - pos);
+    }
+    if (ranges[idx].last > pos)
+    {
+      pos = ranges[idx].last;
+    }
+  }
+  if (size > pos)
+  {
+    memset(base + pos, 0, size - pos);
+  }
+
+  // drop ranges
+  if (ranges)
+  {
+    lua_pop(L, 1);
+  }
+
+  LUASTACK_CLEAN(L, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Creates a boxed object and initializes it from an init parameter. 
+  Each byte of the object memory is written only once.
+
+  @param[in]  L           lua state
+  @param[in]  desc        type descriptor
+  @param[in]  initidx     stack index of init parameter (0 = none) which 
+                          could be
+                            - a number used to fill the memory
+                            - an object of the same type to copy
+                            - a table or string passed to set()
+  @param[in]  methodsidx  stack index of method table
+  @param[in]  allocidx    stack index of arena or allocator (or 0)
+  @param[in]  mtidx       stack index of metatable for boxed objects (or 0)
+
+  @return pointer to raw object memory
+
+*////////////////////////////////////////////////////////////////////////
+static void* luacwrap_initnewobj( lua_State*            L
+                                , luacwrap_Type*        desc
+                                , int                   initidx
+                                , int                   methodsidx
+                                , int                   allocidx
+                                , int                   mtidx)
+{
+  void* ud;
+
+  LUASTACK_SET(L);
+
+  initidx = initidx ? abs_index(L, initidx) : 0;
+
+  if ((0 == initidx) || lua_isnoneornil(L, initidx))
+  {
+    ud = luacwrap_newboxedobj(L, desc, 0, methodsidx, allocidx, mtidx);
+  }
+  else if (lua_isnumber(L, initidx))
+  {
+    // if optional init parameter is a number use it to fill memory block
+    ud = luacwrap_newboxedobj(L, desc, lua_tointeger(L, initidx), methodsidx, allocidx, mtidx);
+  }
+  else if (lua_isuserdata(L, initidx) && (desc == luacwrap_getdescriptor(L, initidx)))
+  {
+    // copy construction
+    ud = luacwrap_newboxedobj(L, desc, LUACWRAP_NOINIT, methodsidx, allocidx, mtidx);
+    luacwrap_copyobj(L, -1, initidx, desc);
+  }
+  else
+  {
+    if (lua_istable(L, initidx))
+    {
+      // only clear the memory not written by set()
+      ud = luacwrap_newboxedobj(L, desc, LUACWRAP_NOINIT, methodsidx, allocidx, mtidx);
+      luacwrap_cleargaps(L, -1, initidx, desc);
+    }
+    else
+    {
+      ud = luacwrap_newboxedobj(L, desc, 0, methodsidx, allocidx, mtidx);
+    }
+
+    // call set() with init parameter
+    lua_pushcfunction(L, luacwrap_type_set);
+    lua_pushvalue(L, -2);         // push userdata
+    lua_pushvalue(L, initidx);    // push value
+    lua_call(L, 2, 0);            // call set()
+  }
+
+  LUASTACK_CLEAN(L, 1);
+  return ud;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the new() constructor method for boxed types. It
+    - creates udata with size determined from type descriptor
+    - attaches the metatable for boxed objects
+    - adds a type descriptor to environment[$desc]
+
+  Parameters on lua stack:
+    - self  (type descriptor)
+    - init parameter (optional)
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_type_new(lua_State* L)
+{
+  luacwrap_Type* desc;
+
+  LUASTACK_SET(L);
+
+  /*
+    method table
+    +-----------------+                     +-----------------+
+    | $desc           |-------------------->| TypeDescriptor  |
+    | + additional    |                     +-----------------+
+    |   methods       |
+    +-----------------+
+      metatable
+        [new]         -> Type_new
+        [attach]      -> Type_attach
+  */
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  // get descriptor
+  lua_getfield(L, 1, "$desc");
+  if (lua_isnil(L, -1))
+  {
+    luaL_error(L, "No descriptor found. Don't call new() on instances.");
+  }
+  desc = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  // create object, optionally allocated from arena or allocator 
+  // given as 3rd parameter
+  luacwrap_initnewobj(L, desc, 2, 1, lua_isnoneornil(L, 3) ? 0 : 3, 0);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the newmany() constructor method. Creates n boxed objects
+  at once and returns them within a table.
+
+  Parameters on lua stack:
+    - self  (type descriptor)
+    - number of objects
+    - array of init parameters (optional, see new())
+    - arena or allocator (optional)
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_type_newmany(lua_State* L)
+{
+  luacwrap_Type* desc;
+  lua_Integer    count;
+  lua_Integer    idx;
+  int            hasinits;
+  int            allocidx;
+  int            resultidx;
+  int            mtidx;
+
+  LUASTACK_SET(L);
+
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  // get descriptor
+  lua_getfield(L, 1, "$desc");
+  if (lua_isnil(L, -1))
+  {
+    luaL_error(L, "No descriptor found. Don't call newmany() on instances.");
+  }
+  desc = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  count = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, count >= 0, 2, "number of objects must not be negative");
+
+  hasinits = !lua_isnoneornil(L, 3);
+  if (hasinits)
+  {
+    luaL_checktype(L, 3, LUA_TTABLE);
+  }
+  allocidx = lua_isnoneornil(L, 4) ? 0 : 4;
+
+  // create result table
+  lua_createtable(L, (int)count, 0);
+  resultidx = lua_gettop(L);
+
+  // get metatable of boxed objects only once
+  lua_pushlightuserdata(L, (void*)&g_mtBoxed);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  mtidx = lua_gettop(L);
+
+  for (idx = 1; idx <= count; ++idx)
+  {
+    if (hasinits)
+    {
+      lua_rawgeti(L, 3, (int)idx);
+      luacwrap_initnewobj(L, desc, -1, 1, allocidx, mtidx);
+      lua_remove(L, -2);
+    }
+    else
+    {
+      luacwrap_initnewobj(L, desc, 0, 1, allocidx, mtidx);
+    }
+    lua_rawseti(L, resultidx, (int)idx);
+  }
+
+  // pop metatable
+  lua_pop(L, 1);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the new_uninit() constructor method. Same as new() but 
+  leaves the object memory uninitialized. Use it for objects which 
+  content is overwritten immediately.
+
+  Parameters on lua stack:
+    - self  (type descriptor)
+    - arena or allocator (optional)
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_type_new_uninit(lua_State* L)
+{
+  luacwrap_Type* desc;
+
+  LUASTACK_SET(L);
+
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  // get descriptor
+  lua_getfield(L, 1, "$desc");
+  if (lua_isnil(L, -1))
+  {
+    luaL_error(L, "No descriptor found. Don't call new_uninit() on instances.");
+  }
+  desc = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  luacwrap_newboxedobj(L, desc, LUACWRAP_NOINIT, 1, lua_isnoneornil(L, 2) ? 0 : 2, 0);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the __dup() copy constructor method. It creates a boxed
+  object of the same type and copies memory and references.
+
+  Parameters on lua stack:
+    - self  (object to duplicates)
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_type_dup(lua_State* L)
+{
+  luacwrap_Type* desc;
+
+  LUASTACK_SET(L);
+
+  desc = luacwrap_getdescriptor(L, 1);
+  if (!desc)
+  {
+     return luaL_argerror(L, 1, "Failed to get descriptor");
+  }
+
+  // reuse method table of the source object
+  luacwrap_getenvironment(L, 1);
+  lua_getfield(L, -1, "$methods");
+  lua_remove(L, -2);
+  if (lua_isnil(L, -1))
+  {
+    lua_pop(L, 1);
+    if (!luacwrap_getmethodtable_byname(L, desc->name))
+    {
+      luaL_error(L, "Could not get method table for type %s", desc->name);
+    }
+  }
+
+  luacwrap_newboxedobj(L, desc, LUACWRAP_NOINIT, -1, 0, 0);
+
+  // drop method table
+  lua_remove(L, -2);
+
+  luacwrap_copyobj(L, -1, 1, desc);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Creates the type table of an anonymous array type with the given 
+  element type and pushes it on the lua stack. The memory of the 
+  array type descriptor is held by the type table, so objects of the
+  type have to reference it (via $methods).
+
+  @param[in]  L           lua state
+  @param[in]  elemdesc    element type descriptor
+  @param[in]  elemcount   number of elements
+
+  @return array type descriptor
+
+*////////////////////////////////////////////////////////////////////////
+luacwrap_ArrayType* luacwrap_pushanonarraytype(lua_State* L, luacwrap_Type* elemdesc, int elemcount)
+{
+  luacwrap_ArrayType* arrdesc;
+
+  LUASTACK_SET(L);
+
+  // create method table
+  lua_newtable(L);
+
+  // create array type descriptor
+  arrdesc = (luacwrap_ArrayType*)lua_newuserdata(L, sizeof(luacwrap_ArrayType));
+  arrdesc->hdr.typeclass = LUACWRAP_TC_ARRAY;
+  arrdesc->hdr.name      = g_nameAnonArray;
+  arrdesc->hdr.align     = 0;
+  arrdesc->elemcount     = elemcount;
+  arrdesc->elemsize      = luacwrap_type_size(elemdesc);
+  arrdesc->elemtypename  = elemdesc->name;
+  arrdesc->elemtypedesc  = elemdesc;
+  lua_setfield(L, -2, "$descmem");
+
+  // store descriptor in methods["$desc"]
+  lua_pushlightuserdata(L, arrdesc);
+  lua_setfield(L, -2, "$desc");
+
+  // metatable = ctor table
+  lua_pushlightuserdata(L, (void*)&g_mtTypeCtors);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  assert(lua_istable(L, -1));
+  lua_setmetatable(L, -2);
+
+  LUASTACK_CLEAN(L, 1);
+  return arrdesc;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Creates a boxed array object of an anonymous array type with the
+  given element type and pushes it on the lua stack. The memory of
+  the array type descriptor is held by the type table which in turn
+  is referenced by the boxed object (via $methods).
+
+  @param[in]  L           lua state
+  @param[in]  elemdesc    element type descriptor
+  @param[in]  elemcount   number of elements
+
+  @return pointer to the first array element
+
+*////////////////////////////////////////////////////////////////////////
+void* luacwrap_pushnewarray(lua_State* L, luacwrap_Type* elemdesc, int elemcount)
+{
+  void* result;
+
+  LUASTACK_SET(L);
+
+  luacwrap_pushanonarraytype(L, elemdesc, elemcount);
+
+  // create instance
+  lua_pushcfunction(L, luacwrap_type_new);
+  lua_insert(L, -2);
+  lua_call(L, 1, 1);
+
+  result = luacwrap_mobj_getbaseptr(L, -1);
+
+  LUASTACK_CLEAN(L, 1);
+  return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  get memory descriptor (baseptr, offset, size) of given object
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_getouter(lua_State* L, int ud, int* offset)
+{
+  if (luaL_getmetafield(L, ud, g_keyGetOuter))
+  {
+    GET_OBJECTOUTER getouter = (GET_OBJECTOUTER)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    return getouter(L, ud, offset);
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Raises an error if the object at the given stack index is 
+  read-only, i.e. its outer object is a lua string (view) or a 
+  read-only memory mapping.
+
+*////////////////////////////////////////////////////////////////////////
+void luacwrap_checkwritable(lua_State* L, int ud)
+{
+  int offset;
+  int readonly = (LUA_TSTRING == lua_type(L, ud));
+
+  if (!readonly && luacwrap_getouter(L, ud, &offset))
+  {
+    luacwrap_IndirectObject* pobj = (luacwrap_IndirectObject*)luacwrap_toudata(L, -1, (void*)g_mtMapped);
+
+    readonly = (LUA_TSTRING == lua_type(L, -1)) || ((NULL != pobj) && pobj->readonly);
+    lua_pop(L, 1);
+  }
+
+  if (readonly)
+  {
+    luaL_error(L, "luacwrap: object memory is read-only");
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Gets the type descriptor of the wrapped object at the given stack 
+  index. Raises an argument error if it is no wrapped object.
+
+*/////////////////////////////////////////////////////////////////////////
+luacwrap_Type* luacwrap_checkobject(lua_State* L, int ud)
+{
+  luacwrap_Type* desc = luacwrap_getdescriptor(L, ud);
+  if (NULL == desc)
+  {
+    luaL_argerror(L, ud, "wrapped object expected");
+  }
+  return desc;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Replaces stack index 1 with the outer object of the wrapped object
+  at the given stack index (get/set wrappers of pointer members expect
+  the outer object there).
+
+  @param[in]  L       lua state
+  @param[in]  ud      stack index of the wrapped object
+  @param[out] offset  offset of the object within the outer object
+
+  @return memory of the outer object
+
+*/////////////////////////////////////////////////////////////////////////
+void* luacwrap_replaceouter(lua_State* L, int ud, int* offset)
+{
+  *offset = 0;
+  if (!luacwrap_getouter(L, ud, offset))
+  {
+    luaL_argerror(L, ud, "wrapped object expected");
+  }
+  lua_replace(L, 1);
+  return luacwrap_getobjptr(L, 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Prepares creating an object from encoded data (e.g. fromjson()). 
+  Replaces the type table at stack index 1 with a new boxed object 
+  and pushes the object.
+
+  @return type of the object
+
+*/////////////////////////////////////////////////////////////////////////
+luacwrap_Type* luacwrap_beginnew(lua_State* L, const char* fname)
+{
+  luacwrap_Type* desc;
+
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  lua_getfield(L, 1, "$desc");
+  if (lua_isnil(L, -1))
+  {
+    luaL_error(L, "No descriptor found. Don't call %s() on instances.", fname);
+  }
+  desc = (luacwrap_Type*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  luacwrap_pushallocobj(L, desc, 0, 0);
+  lua_pushvalue(L, -1);
+  lua_replace(L, 1);
+  return desc;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Prepares setting members of the wrapped object at stack index 1 from
+  encoded data (e.g. setjson()). Checks that the object is writable 
+  and replaces it with its outer object.
+
+  @param[in]  L       lua state
+  @param[out] offset  offset of the object within the outer object
+
+  @return type of the object
 
-  // push default init parameter
-  int hassetparam = !lua_isnoneornil(L, 2);
+*/////////////////////////////////////////////////////////////////////////
+luacwrap_Type* luacwrap_beginset(lua_State* L, int* offset)
+{
+  luacwrap_Type* desc = luacwrap_checkobject(L, 1);
 
-  // if optional init parameter is a number use it to fill memory block
-  initval = 0;
-  if (lua_isnumber(L, 2))
-  {
-    // init memory with a given value
-    initval = lua_tointeger(L, 2);
-    hassetparam = 0;
-  }
+  luacwrap_checkwritable(L, 1);
 
-  // determine size
-  udsize = luacwrap_type_size(desc);
+  // keep the object itself on the top of the stack
+  lua_pushvalue(L, 1);
+  luacwrap_replaceouter(L, 1, offset);
+  return desc;
+}
 
-  // create userdata which holds type instance
-  ud = lua_newuserdata(L, udsize);
+//////////////////////////////////////////////////////////////////////////
+/**
 
-  // by clear memory with given value
-  memset(ud, initval, udsize);
-  
-  // get/attach metatable
-  lua_pushlightuserdata(L, (void*)&g_mtBoxed);
-  lua_rawget(L, LUA_REGISTRYINDEX);
-  lua_setmetatable(L, -2);
+  Gets the value of a basic type returned by its get wrapper. The 
+  value is popped, strings are kept alive in the table at stack index 
+  keep. Values of other types are returned as nil.
 
-  // set _ENV[$desc] and _ENV[$methods]
-  lua_newtable(L);
-  lua_pushvalue(L, 1);
-  lua_setfield(L, -2, "$methods");
-  lua_pushlightuserdata(L, desc);
-  lua_setfield(L, -2, "$desc");
-  luacwrap_setenvironment(L, -2);
+  @param[in]  base    memory of the outer object (at stack index 1)
+  @param[in]  offset  offset of the value within the outer object
+
+*/////////////////////////////////////////////////////////////////////////
+void luacwrap_getbasicvalue( lua_State*           L
+                           , luacwrap_BasicType*  desc
+                           , PBYTE                base
+                           , int                  offset
+                           , int                  keep
+                           , luacwrap_BasicValue* value)
+{
+  LUASTACK_SET(L);
 
-  // if optional init table parameter present then call set()
-  if (hassetparam)
+  desc->getWrapper(desc, L, base + offset, offset);
+
+  value->type   = lua_type(L, -1);
+  value->number = 0;
+  value->s      = NULL;
+  value->len    = 0;
+  switch (value->type)
   {
-    lua_pushcfunction(L, luacwrap_type_set);
-    lua_pushvalue(L, -2);         // push userdata
-    lua_pushvalue(L,  2);         // push value
-    lua_call(L, 2, 0);            // call set()
+    case LUA_TBOOLEAN:
+      value->number = lua_toboolean(L, -1);
+      lua_pop(L, 1);
+      break;
+    case LUA_TNUMBER:
+      value->number = (double)lua_tonumber(L, -1);
+      lua_pop(L, 1);
+      break;
+    case LUA_TSTRING:
+      value->s = lua_tolstring(L, -1, &value->len);
+      lua_rawseti(L, keep, 1);
+      break;
+    default:
+      value->type = LUA_TNIL;
+      lua_pop(L, 1);
+      break;
   }
 
-  LUASTACK_CLEAN(L, 1);
-  return 1;
+  LUASTACK_CLEAN(L, 0);
 }
 
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  Implements the __dup() copy constructor method. It determines the
-  type descriptor and calls new()
-
-  Parameters on lua stack:
-    - self  (object to duplicates)
+  get userdata at the given stack index if its metatable is stored
+  in the registry under the given key, otherwise return NULL
 
 *////////////////////////////////////////////////////////////////////////
-static int luacwrap_type_dup(lua_State* L)
+void* luacwrap_toudata(lua_State* L, int idx, void* mtkey)
 {
-  luacwrap_Type* desc;
+  void* p = lua_touserdata(L, idx);
+  if ((NULL != p) && lua_getmetatable(L, idx))
+  {
+    int equal;
 
-  LUASTACK_SET(L);
+    lua_pushlightuserdata(L, mtkey);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    equal = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2);
 
-  desc = luacwrap_getdescriptor(L, 1);
-  if (!desc)
-  {
-     return luaL_argerror(L, 1, "Failed to get descriptor");
+    if (equal)
+    {
+      return p;
+    }
   }
+  return NULL;
+}
 
-  lua_pushcfunction(L, luacwrap_type_new);
-  if (!luacwrap_getmethodtable_byname(L, desc->name))
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the __gc metamethod of the sentinel which forgets the 
+  metatable of boxed objects when the lua state is closed.
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_boxedsentinel_gc(lua_State* L)
+{
+  if (s_mtBoxedPtr == *(const void**)lua_touserdata(L, 1))
   {
-    luaL_error(L, "Could not get method table for type %s", desc->name);
+    s_mtBoxedPtr = NULL;
   }
-  lua_pushvalue(L,  1);         // push value
-  lua_call(L, 2, 1);            // call set()
-
-  LUASTACK_CLEAN(L, 1);
-  return 1;
+  return 0;
 }
 
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  get memory descriptor (baseptr, offset, size) of given object
+  get the memory pointer of an outer (boxed) object or of a light 
+  userdata. Objects which do not hold their memory within their 
+  userdata provide a getptr function within their metatable.
 
 *////////////////////////////////////////////////////////////////////////
-static int luacwrap_getouter(lua_State* L, int ud, int* offset)
+void* luacwrap_getobjptr(lua_State* L, int ud)
 {
-  if (luaL_getmetafield(L, ud, g_keyGetOuter))
+  void* ptr = lua_touserdata(L, ud);
+
+  if (NULL == ptr)
   {
-    GET_OBJECTOUTER getouter = (GET_OBJECTOUTER)lua_touserdata(L, -1);
-    lua_pop(L, 1);
+    // outer object of a view
+    return (LUA_TSTRING == lua_type(L, ud)) ? (void*)lua_tostring(L, ud) : NULL;
+  }
 
-    return getouter(L, ud, offset);
+  if (lua_getmetatable(L, ud))
+  {
+    GET_OBJECTPTR getptr;
+
+    // plain boxed objects hold their memory within their userdata
+    if (lua_topointer(L, -1) == s_mtBoxedPtr)
+    {
+      lua_pop(L, 1);
+      return ptr;
+    }
+
+    // indirect objects (arena, external, aligned, mapped) provide getptr
+    lua_rawgeti(L, -1, LUACWRAP_MT_GETPTR);
+    getptr = (GET_OBJECTPTR)lua_touserdata(L, -1);
+    lua_pop(L, 2);
+
+    if (getptr)
+    {
+      return getptr(L, abs_index(L, ud));
+    }
   }
-  return 0;
+  return ptr;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -1594,13 +3563,13 @@ void* luacwrap_mobj_getbaseptr(lua_State* L, int ud)
   int offset;
   if (luacwrap_getouter(L, ud, &offset))
   {
-    PBYTE baseptr = lua_touserdata(L, -1);
+    PBYTE baseptr = luacwrap_getobjptr(L, -1);
     lua_pop(L, 1);
     return (baseptr + offset);
   }
   else
   {
-    PBYTE baseptr = lua_touserdata(L, -1);
+    PBYTE baseptr = lua_touserdata(L, ud);
     return baseptr;
   }
 }
@@ -1710,6 +3679,56 @@ static int luacwrap_type_attach(lua_State* L)
   return result;
 }
 
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  creates a read-only view onto the bytes of a lua string without
+  copying them. The string is kept alive as outer object of the view.
+
+  Parameters on lua stack:
+    - self    (type table)
+    - string  (string with raw bytes)
+    - offset  (optional zero based byte offset, defaults to 0)
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_type_view(lua_State* L)
+{
+  luacwrap_Type* desc;
+  size_t len;
+  size_t size;
+  lua_Integer offset;
+  int result = 0;
+
+  LUASTACK_SET(L);
+
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  // get descriptor
+  lua_getfield(L, 1, "$desc");
+  if (lua_isnil(L, -1))
+  {
+    luaL_error(L, "No descriptor found. Don't call view() on instances.");
+  }
+  desc = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  luaL_checklstring(L, 2, &len);
+  offset = luaL_optinteger(L, 3, 0);
+  luaL_argcheck(L, (offset >= 0) && ((size_t)offset <= len), 3, "offset out of range");
+
+  size = luacwrap_type_size(desc);
+  if ((len - (size_t)offset) < size)
+  {
+    luaL_error(L, "luacwrap: string too short (%d bytes needed at offset %d, got %d)",
+      (int)size, (int)offset, (int)len);
+  }
+
+  result = pushEmbedded(L, 2, (int)offset, desc);
+
+  LUASTACK_CLEAN(L, result);
+  return result;
+}
+
 //////////////////////////////////////////////////////////////////////////
 /**
 
@@ -1736,6 +3755,8 @@ static int luacwrap_type_set(lua_State* L)
      return luaL_argerror(L, 1, "Failed to get descriptor");
   }
 
+  luacwrap_checkwritable(L, 1);
+
   // init from table with init values
   if (lua_istable(L, 2))
   {
@@ -1928,8 +3949,16 @@ static int luacwrap_type_set(lua_State* L)
 // used for static type descriptors
 luaL_Reg g_mtTypeCtors[ ] = {
   { "new"   , luacwrap_type_new     },
+  { "new_uninit", luacwrap_type_new_uninit },
+  { "newmany", luacwrap_type_newmany },
+  { "frombytes", luacwrap_type_frombytes },
+  { "frombytesmany", luacwrap_type_frombytesmany },
+  { "tobytesmany", luacwrap_type_tobytesmany },
+  { "fromjson", luacwrap_type_fromjson },
+  { "frommsgpack", luacwrap_type_frommsgpack },
   { "set"   , luacwrap_type_set     },
   { "attach", luacwrap_type_attach  },
+  { "view"  , luacwrap_type_view    },
   { NULL, NULL }
 };
 
@@ -1962,7 +3991,15 @@ static int luacwrap_malloc_gc(lua_State* L)
 // used for dynamically alloced type descriptors
 luaL_Reg g_mtDynTypeCtors[ ] = {
   { "new"   , luacwrap_type_new     },
+  { "new_uninit", luacwrap_type_new_uninit },
+  { "newmany", luacwrap_type_newmany },
+  { "frombytes", luacwrap_type_frombytes },
+  { "frombytesmany", luacwrap_type_frombytesmany },
+  { "tobytesmany", luacwrap_type_tobytesmany },
+  { "fromjson", luacwrap_type_fromjson },
+  { "frommsgpack", luacwrap_type_frommsgpack },
   { "attach", luacwrap_type_attach  },
+  { "view"  , luacwrap_type_view    },
   { "__gc",   luacwrap_malloc_gc  },
   { NULL, NULL }
 };
@@ -2217,6 +4254,33 @@ static int luacwrap_create_dyntype( lua_State*       L
   return 1;
 }
 
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Checks the optional alignment parameter of register functions.
+
+  @param[in]  L             lua state
+  @param[in]  idx           stack index of alignment parameter
+
+  @return alignment in [bytes] (nil or 0 = default alignment)
+
+*/////////////////////////////////////////////////////////////////////////
+static unsigned int luacwrap_checkalign(lua_State* L, int idx)
+{
+  lua_Integer align;
+
+  if (lua_isnoneornil(L, idx))
+  {
+    return 0;
+  }
+  align = luaL_checkinteger(L, idx);
+  if ((align < 0) || (align > LUACWRAP_MAX_ALIGN) || (0 != (align & (align - 1))))
+  {
+    luaL_argerror(L, idx, "alignment must be a power of two up to 4096");
+  }
+  return (unsigned int)align;
+}
+
 //////////////////////////////////////////////////////////////////////////
 /**
 
@@ -2227,6 +4291,7 @@ static int luacwrap_create_dyntype( lua_State*       L
   Parameters on lua stack:
     - name ("buffer")
     - size in bytes (8)
+    - alignment in bytes (optional)
 
 */////////////////////////////////////////////////////////////////////////
 static int luacwrap_registerbuffer(lua_State*       L)
@@ -2234,10 +4299,12 @@ static int luacwrap_registerbuffer(lua_State*       L)
   luacwrap_BufferType* bufdesc;
   const char* name;
   int bufsize;
+  unsigned int align;
 
   // get parameters
   name = luacwrap_storestring(L, 1, "non empty string expected on parameter #%d", 1);
   bufsize = lua_tointeger(L, 2);
+  align = luacwrap_checkalign(L, 3);
 
   // create record type descriptor
   bufdesc = malloc(sizeof(luacwrap_BufferType));
@@ -2248,6 +4315,7 @@ static int luacwrap_registerbuffer(lua_State*       L)
 
   bufdesc->hdr.typeclass = LUACWRAP_TC_BUFFER;
   bufdesc->hdr.name = name;
+  bufdesc->hdr.align = align;
   bufdesc->size = bufsize;
 
   return luacwrap_create_dyntype(L, &bufdesc->hdr);
@@ -2266,6 +4334,7 @@ static int luacwrap_registerbuffer(lua_State*       L)
     - array of members (name, offset, type)
         { "member1", 0, "$i32" },
         { "member1", 4, "$i32" }
+    - alignment in bytes (optional)
 
 */////////////////////////////////////////////////////////////////////////
 static int luacwrap_registerstruct( lua_State*       L)
@@ -2277,11 +4346,20 @@ static int luacwrap_registerstruct( lua_State*       L)
   int nmembers;
   int allocsize;
   int idx;
+  unsigned int align;
 
   // get parameters
   name = luacwrap_storestring(L, 1, "non empty string expected on parameter #%d", 1);
   recsize = lua_tointeger(L, 2);
   luaL_checktype(L, 3, LUA_TTABLE);
+  align = luacwrap_checkalign(L, 4);
+
+  // as in C the size of an aligned struct is a multiple of its alignment,
+  // otherwise elements of arrays would not be aligned
+  if ((align > 0) && (0 != (recsize % align)))
+  {
+    luaL_argerror(L, 2, "size must be a multiple of the alignment");
+  }
 
   // get number of members
 #if (LUA_VERSION_NUM > 501)
@@ -2303,6 +4381,7 @@ static int luacwrap_registerstruct( lua_State*       L)
 
   recdesc->hdr.typeclass = LUACWRAP_TC_RECORD;
   recdesc->hdr.name = name;
+  recdesc->hdr.align = align;
   recdesc->size = recsize;
   recdesc->members = member;
 
@@ -2353,6 +4432,7 @@ static int luacwrap_registerstruct( lua_State*       L)
     - name ("INT32_8")
     - numelems (8)
     - elementtxpe ("$i32")
+    - alignment in bytes (optional, default is alignment of element type)
 
 */////////////////////////////////////////////////////////////////////////
 static int luacwrap_registerarray( lua_State*       L)
@@ -2363,6 +4443,7 @@ static int luacwrap_registerarray( lua_State*       L)
   const char* elemtypename;
   luacwrap_Type* elemtype;
   size_t len;
+  unsigned int align;
 
   // get parameters
   name = lua_tolstring(L, 1, &len);
@@ -2382,6 +4463,7 @@ static int luacwrap_registerarray( lua_State*       L)
   {
     luaL_error(L, "specified unknown type <%s> in parameter #3", elemtypename);
   }
+  align = luacwrap_checkalign(L, 4);
 
   // create array type descriptor
   arrdesc = malloc(sizeof(luacwrap_ArrayType));
@@ -2392,6 +4474,7 @@ static int luacwrap_registerarray( lua_State*       L)
 
   arrdesc->hdr.typeclass = LUACWRAP_TC_ARRAY;
   arrdesc->hdr.name = name;
+  arrdesc->hdr.align = align;
   arrdesc->elemcount = elemcount;
   arrdesc->elemsize = luacwrap_type_size(elemtype);
   arrdesc->elemtypename = elemtype->name;
@@ -2409,15 +4492,18 @@ static int luacwrap_registerarray( lua_State*       L)
 
   Parameters on lua stack:
     - size (16)
+    - alignment in bytes (optional)
 
 */////////////////////////////////////////////////////////////////////////
 static int luacwrap_createbuffer(lua_State*       L)
 {
   int bufsize;
+  unsigned int align;
 
   LUASTACK_SET(L);
 
   bufsize = lua_tointeger(L, 1);
+  align = luacwrap_checkalign(L, 2);
 
   // get/create buffer type indexed by size under _M.$buftypes
   getmoduletable(L);
@@ -2427,9 +4513,17 @@ static int luacwrap_createbuffer(lua_State*       L)
   // drop module table
   lua_remove(L, -2);
 
-  // lookup buffer type descriptor by buffer size
-  lua_pushinteger(L, bufsize);
-  lua_rawget(L, -2);
+  // lookup buffer type descriptor by buffer size (and alignment)
+  if (align)
+  {
+    lua_pushfstring(L, "$buf%d_%d", bufsize, (int)align);
+  }
+  else
+  {
+    lua_pushinteger(L, bufsize);
+  }
+  lua_pushvalue(L, -1);
+  lua_rawget(L, -3);
   if (lua_isnil(L, -1))
   {
     // pop nil
@@ -2437,14 +4531,25 @@ static int luacwrap_createbuffer(lua_State*       L)
 
     // create new buffer type
     lua_pushcfunction(L, luacwrap_registerbuffer);
-    lua_pushfstring(L, "$buf%d", bufsize);
+    if (align)
+    {
+      lua_pushvalue(L, -2);
+    }
+    else
+    {
+      lua_pushfstring(L, "$buf%d", bufsize);
+    }
     lua_pushinteger(L, bufsize);
-    lua_call(L, 2, 1);
+    lua_pushinteger(L, align);
+    lua_call(L, 3, 1);
 
     // store in cache
-    lua_pushvalue(L, -1);
-    lua_rawseti(L, -3, bufsize);
+    lua_pushvalue(L, -2);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -5);
   }
+  // drop cache key
+  lua_remove(L, -2);
   // _M.$buftypes table
   lua_remove(L, -2);
 
@@ -2463,14 +4568,6 @@ static int luacwrap_createbuffer(lua_State*       L)
 
 char* create_moduletable =
 "  local _M = { types = {} }\n"
-"  function _M.tabletostring(self)\n"
-"    local res = { \" = {\" }\n"
-"    for k = 1, #self do\n"
-"      res[#res+1] = \"  \" .. k .. \" = \" .. tostring(self[k]) .. \",\"\n"
-"    end\n"
-"    res[#res+1] = \"}\"\n"
-"    return table.concat(res, \"\\n\")\n"
-"  end\n"
 "  function _M.getfield(t, f)\n"
 "    local v = t\n"
 "    for w in string.gmatch(f, \"[^%.]+\") do\n"
@@ -2515,13 +4612,21 @@ static luacwrap_cinterface g_cinterface =
   luacwrap_mobj_copy_references,
 
   luacwrap_mobj_getbaseptr,
+
+  // v3
+  luacwrap_pushallocobj,
+  luacwrap_setallocator,
+  luacwrap_getstats,
+  luacwrap_createweakreference,
+  luacwrap_getweakreference,
+  luacwrap_releaseweakreference,
 };
   
 //////////////////////////////////////////////////////////////////////////
 /**
 
   Initializes the luacwrap module.
-    - creates the moduletable _M with the _M.tabletostring function
+    - creates the moduletable _M with the _M.getfield/setfield functions
     - creates metatables for boxed, embedded objects
     - creates metatable for type wrappers
     - registers basic typed for different numeric types
@@ -2555,10 +4660,34 @@ LUACWRAP_API int luaopen_luacwrap(lua_State *L)
     lua_setfield(L, -2, "createbuffer");
     lua_pushcfunction(L, luacwrap_release_reference);
     lua_setfield(L, -2, "releasereference");
+    lua_pushcfunction(L, luacwrap_arena_new);
+    lua_setfield(L, -2, "arena");
+    lua_pushcfunction(L, luacwrap_mapfile);
+    lua_setfield(L, -2, "mmap");
+    lua_pushcfunction(L, luacwrap_reader_new);
+    lua_setfield(L, -2, "reader");
+    lua_pushcfunction(L, luacwrap_writer_new);
+    lua_setfield(L, -2, "writer");
+    lua_pushcfunction(L, luacwrap_savearchive);
+    lua_setfield(L, -2, "savearchive");
+    lua_pushcfunction(L, luacwrap_loadarchive);
+    lua_setfield(L, -2, "loadarchive");
+    lua_pushcfunction(L, luacwrap_tojson);
+    lua_setfield(L, -2, "tojson");
+    lua_pushcfunction(L, luacwrap_writejson);
+    lua_setfield(L, -2, "writejson");
+    lua_pushcfunction(L, luacwrap_tomsgpack);
+    lua_setfield(L, -2, "tomsgpack");
+    lua_pushcfunction(L, luacwrap_tostring);
+    lua_setfield(L, -2, "tostring");
+    lua_pushcfunction(L, luacwrap_stats);
+    lua_setfield(L, -2, "stats");
 
     // add reftable and string table to module table
-    lua_newtable(L);
+    luacwrap_reftable_create(L, 0);
     lua_setfield(L, -2, g_keyRefTable);
+    luacwrap_reftable_create(L, 1);
+    lua_pop(L, 1);
     lua_newtable(L);
     lua_setfield(L, -2, g_keyStringTable);
 
@@ -2593,6 +4722,17 @@ LUACWRAP_API int luaopen_luacwrap(lua_State *L)
     // register getouter in metatable
     lua_pushlightuserdata(L, Boxed_getouter);
     lua_setfield(L, -2, g_keyGetOuter);
+
+    // remember the metatable for the boxed object check of luacwrap_getobjptr(),
+    // the sentinel forgets it when the state is closed
+    s_mtBoxedPtr = lua_topointer(L, -1);
+    lua_pushlightuserdata(L, (void*)&s_mtBoxedPtr);
+    *(const void**)lua_newuserdata(L, sizeof(void*)) = s_mtBoxedPtr;
+    lua_newtable(L);
+    lua_pushcfunction(L, luacwrap_boxedsentinel_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_rawset(L, LUA_REGISTRYINDEX);
     lua_rawset(L, LUA_REGISTRYINDEX);
 
     // create metatable for embedded objects and store it in registry
@@ -2609,6 +4749,149 @@ LUACWRAP_API int luaopen_luacwrap(lua_State *L)
     lua_setfield(L, -2, g_keyGetOuter);
     lua_rawset(L, LUA_REGISTRYINDEX);
 
+    // create metatable for indirect objects and store it in registry
+    lua_pushlightuserdata(L, g_mtIndirect);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_mtIndirect, 0);
+#else
+    luaL_openlib(L, NULL, g_mtIndirect, 0);
+#endif
+
+    // register getouter and getptr in metatable
+    lua_pushlightuserdata(L, Boxed_getouter);
+    lua_setfield(L, -2, g_keyGetOuter);
+    lua_pushlightuserdata(L, Indirect_getptr);
+    lua_rawseti(L, -2, LUACWRAP_MT_GETPTR);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create metatable for objects with external memory and store it in registry
+    lua_pushlightuserdata(L, g_mtExternal);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_mtExternal, 0);
+#else
+    luaL_openlib(L, NULL, g_mtExternal, 0);
+#endif
+
+    // register getouter and getptr in metatable
+    lua_pushlightuserdata(L, Boxed_getouter);
+    lua_setfield(L, -2, g_keyGetOuter);
+    lua_pushlightuserdata(L, Indirect_getptr);
+    lua_rawseti(L, -2, LUACWRAP_MT_GETPTR);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create metatable for memory mapped arrays and store it in registry
+    lua_pushlightuserdata(L, g_mtMapped);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_mtMapped, 0);
+#else
+    luaL_openlib(L, NULL, g_mtMapped, 0);
+#endif
+
+    // register getouter and getptr in metatable
+    lua_pushlightuserdata(L, Boxed_getouter);
+    lua_setfield(L, -2, g_keyGetOuter);
+    lua_pushlightuserdata(L, Indirect_getptr);
+    lua_rawseti(L, -2, LUACWRAP_MT_GETPTR);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create table of memory mapped array methods and store it in registry
+    lua_pushlightuserdata(L, g_MappedMethods);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_MappedMethods, 0);
+#else
+    luaL_openlib(L, NULL, g_MappedMethods, 0);
+#endif
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create metatable for reader objects and store it in registry
+    lua_pushlightuserdata(L, g_mtReader);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_mtReader, 0);
+#else
+    luaL_openlib(L, NULL, g_mtReader, 0);
+#endif
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -1, "__index");
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create metatable for writer objects and store it in registry
+    lua_pushlightuserdata(L, g_mtWriter);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_mtWriter, 0);
+#else
+    luaL_openlib(L, NULL, g_mtWriter, 0);
+#endif
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -1, "__index");
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create metatable for archive file handles and store it in registry
+    lua_pushlightuserdata(L, g_mtArchiveFile);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_mtArchiveFile, 0);
+#else
+    luaL_openlib(L, NULL, g_mtArchiveFile, 0);
+#endif
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create metatable for allocator objects and store it in registry
+    lua_pushlightuserdata(L, g_mtAllocator);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_mtAllocator, 0);
+#else
+    luaL_openlib(L, NULL, g_mtAllocator, 0);
+#endif
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -1, "__index");
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create metatable for arena objects and store it in registry
+    lua_pushlightuserdata(L, g_mtArena);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_mtArena, 0);
+#else
+    luaL_openlib(L, NULL, g_mtArena, 0);
+#endif
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -1, "__index");
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create table of builtin array methods and store it in registry
+    lua_pushlightuserdata(L, g_ArrayMethods);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_ArrayMethods, 0);
+#else
+    luaL_openlib(L, NULL, g_ArrayMethods, 0);
+#endif
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
+    // create metatable for array index objects and store it in registry
+    lua_pushlightuserdata(L, g_mtArrayIndex);
+    lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+    luaL_setfuncs(L, g_mtArrayIndex, 0);
+#else
+    luaL_openlib(L, NULL, g_mtArrayIndex, 0);
+#endif
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -1, "__index");
+    lua_rawset(L, LUA_REGISTRYINDEX);
+
     // create metatable for type wrappers and store it in registry
     lua_pushlightuserdata(L, g_mtTypeCtors);
     lua_newtable(L);
@@ -2644,7 +4927,11 @@ LUACWRAP_API int luaopen_luacwrap(lua_State *L)
 
     // register reference type
     luacwrap_registerbasictype(L, &regType_Reference);
+    luacwrap_registerbasictype(L, &regType_WeakReference);
     
+    // create default allocator for external memory (luacwrap.external)
+    luacwrap_setallocator(L, NULL, NULL, NULL);
+
     // register c interface
     lua_pushlightuserdata(L, &g_cinterface);
     lua_setfield(L, -2, LUACWARP_CINTERFACE_NAME);
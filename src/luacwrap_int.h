@@ -21,11 +21,143 @@
 // _M.$buftypes to store references
 extern const char* g_keyRefTable;
 
+// type name of anonymous array types
+extern const char* g_nameAnonArray;
+
+//
+// boxed object which references memory outside of its userdata
+// (e.g. memory allocated from an arena or external memory)
+//
+typedef struct luacwrap_IndirectObject luacwrap_IndirectObject;
+
+// releases the memory of an indirect object
+typedef void (*LUACWRAP_RELEASEMEM)(lua_State* L, luacwrap_IndirectObject* pobj);
+
+struct luacwrap_IndirectObject
+{
+  PBYTE                 ptr;          // pointer to object memory (NULL if released)
+  size_t                size;         // size of object memory
+  size_t                align;        // alignment of object memory
+  const unsigned int*   pgeneration;  // current generation of memory owner (or NULL)
+  unsigned int          generation;   // generation of memory owner at creation
+  LUACWRAP_RELEASEMEM   release;      // releases object memory (or NULL)
+  void*                 releasedata;  // data used by release function
+  int                   readonly;     // object memory must not be written
+};
+
+//
+// get/set environment of managed objects
+//
+int luacwrap_getenvironment     (lua_State *L, int ud);
+int luacwrap_setenvironment     (lua_State *L, int ud);
+
 //
 // access global module table
 //
 void getmoduletable(lua_State *L);
 
+//
+// access to type descriptors
+//
+luacwrap_Type* luacwrap_getdescriptor         (lua_State* L, int ud);
+luacwrap_Type* luacwrap_getdescriptor_byname  (lua_State* L, const char* name, int namelen);
+luacwrap_Type* luacwrap_getmembertype         (lua_State* L, luacwrap_RecordMember* member);
+luacwrap_Type* luacwrap_getelemtype           (lua_State* L, luacwrap_ArrayType* arrdesc);
+luacwrap_RecordMember* luacwrap_findmember    (luacwrap_RecordMember* members, const char* name, size_t namelen);
+
+//
+// size of a type in [bytes]
+//
+int luacwrap_type_size          (luacwrap_Type* desc);
+
+//
+// alignment guaranteed for the memory of lua userdata 
+// (boxed objects of types requiring more are allocated as indirect objects)
+//
+#define LUACWRAP_USERDATA_ALIGN  8
+
+//
+// maximal alignment of types in [bytes]
+//
+#define LUACWRAP_MAX_ALIGN       4096
+
+//
+// required alignment of boxed objects of a type in [bytes]
+//
+size_t luacwrap_type_align      (lua_State* L, luacwrap_Type* desc);
+
+//
+// index of the pointer reference store within the environment table 
+// of managed objects (absent if the object holds no references)
+//
+#define LUACWRAP_ENV_REFS        1
+
+//
+// index of the shared flag within environment tables which are shared 
+// by several objects (e.g. arena objects of the same type); shared
+// environments are copied before a reference store is added
+//
+#define LUACWRAP_ENV_SHARED      2
+
+//
+// get outer object and offset of a wrapped object (pushes outer object)
+//
+int luacwrap_getouter           (lua_State* L, int ud, int* offset);
+
+//
+// create an embedded object at the given offset of an outer object
+//
+int luacwrap_pushembedded       (lua_State* L, int ud, int offset, luacwrap_Type* desc);
+
+//
+// raise an error if the object is a read-only view
+//
+void luacwrap_checkwritable     (lua_State* L, int ud);
+
+//
+// get the type descriptor of a wrapped object, raise an error if there is none
+//
+luacwrap_Type* luacwrap_checkobject (lua_State* L, int ud);
+
+//
+// replace stack index 1 with the outer object of a wrapped object
+// (returns memory of the outer object)
+//
+void* luacwrap_replaceouter     (lua_State* L, int ud, int* offset);
+
+//
+// prepare creating an object from encoded data (e.g. fromjson()):
+// replace the type table at index 1 with a new object and push it
+//
+luacwrap_Type* luacwrap_beginnew  (lua_State* L, const char* fname);
+
+//
+// prepare setting the members of the writable object at index 1 from
+// encoded data (e.g. setjson()): replace it with its outer object
+//
+luacwrap_Type* luacwrap_beginset  (lua_State* L, int* offset);
+
+//
+// value of a basic type returned by its get wrapper
+//
+typedef struct luacwrap_BasicValue
+{
+  int           type;         // LUA_TNIL, LUA_TBOOLEAN, LUA_TNUMBER or LUA_TSTRING
+  double        number;       // boolean (0 or 1) or number
+  const char*   s;            // string (kept alive by the keep table)
+  size_t        len;          // string length
+} luacwrap_BasicValue;
+
+//
+// get (and pop) the value returned by the get wrapper of a basic type
+//
+void luacwrap_getbasicvalue     ( lua_State*            L
+                                , luacwrap_BasicType*   desc
+                                , PBYTE                 base
+                                , int                   offset
+                                , int                   keep
+                                , luacwrap_BasicValue*  value);
+
 //
 // used to register a basic type descriptor in the basic type table
 //
@@ -39,6 +171,20 @@ int luacwrap_registertype       ( lua_State*            L
                                 , int                   nsidx
                                 , luacwrap_Type*        desc);
 
+//
+// create the type table of an anonymous array type on the top of the Lua stack
+//
+luacwrap_ArrayType* luacwrap_pushanonarraytype  ( lua_State*            L
+                                                , luacwrap_Type*        elemdesc
+                                                , int                   elemcount);
+
+//
+// create a boxed object of an anonymous array type on the top of the Lua stack
+//
+void* luacwrap_pushnewarray     ( lua_State*            L
+                                , luacwrap_Type*        elemdesc
+                                , int                   elemcount);
+
 //
 // check a userdata type descriptor against a given type descriptor
 //
@@ -67,19 +213,64 @@ int luacwrap_mobj_set_reference     (lua_State *L, int ud, int value, int offset
 int luacwrap_mobj_get_reference     (lua_State *L, int ud, int offset);
 int luacwrap_mobj_remove_reference  (lua_State *L, int ud, int offset);
 int luacwrap_mobj_copy_references   (lua_State* L);
+int luacwrap_mobj_permute_references( lua_State*          L
+                                    , int                 ud
+                                    , int                 offset
+                                    , int                 elemsize
+                                    , int                 elemcount
+                                    , const unsigned int* newpos);
 
 //
 // get base pointer of given type
 //
 void* luacwrap_mobj_getbaseptr      (lua_State* L, int ud);
 
+//
+// get memory pointer of an outer object
+//
+void* luacwrap_getobjptr            (lua_State* L, int ud);
+
+//
+// get userdata at the given stack index if its metatable is stored
+// in the registry under the given key (otherwise NULL)
+//
+void* luacwrap_toudata              (lua_State* L, int idx, void* mtkey);
+
+//
+// create an indirect object header on the top of the lua stack
+//
+luacwrap_IndirectObject* luacwrap_pushindirectobj ( lua_State*          L
+                                                  , void*               ptr
+                                                  , size_t              size
+                                                  , size_t              align
+                                                  , const unsigned int* pgeneration
+                                                  , LUACWRAP_RELEASEMEM release
+                                                  , void*               releasedata);
+
+//
+// create a boxed object, optionally allocated from an allocator
+// (arena or external memory)
+//
+void* luacwrap_pushallocobj     ( lua_State*            L
+                                , luacwrap_Type*        desc
+                                , int                   initval
+                                , int                   allocidx);
+
 //
 // access to global reference table
 //
+int luacwrap_reftable_create    (lua_State* L, int weak);
 int luacwrap_createreference    (lua_State* L, int index);
 int luacwrap_pushreference      (lua_State* L, int tag);
 int luacwrap_release_reference  (lua_State *L);
 
+//
+// access to weak reference table
+//
+int  luacwrap_createweakreference  (lua_State* L, int index);
+int  luacwrap_getweakreference     (lua_State* L, int handle);
+void luacwrap_releaseweakreference (lua_State* L, int handle);
+
 //
 //  Registers a list of global constants maintained in an array or
 //  luacwrap_DefUIntConst structs. 
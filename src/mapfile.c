@@ -0,0 +1,527 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Memory mapped files as typed arrays.
+
+  luacwrap.mmap() maps a file of fixed size records into memory and
+  wraps it as an indirect object of an anonymous array type, so all
+  array operations work on the mapping without copying it. The file
+  is unmapped when the array is collected or explicitly via close().
+
+  Embedded objects address their memory with int offsets, so a single
+  mapping is limited to 2 GB. Larger files are processed by mapping
+  windows of records (offset parameter).
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include "luaaux.h"
+#include "mapfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char* const s_mapModes[] = { "r", "w", "c", NULL };
+
+// access pattern hints of advise()
+static const char* const s_mapAdvice[] = { "normal", "sequential", "random", "willneed", "dontneed", NULL };
+
+#ifdef _WIN32
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Maps a range of a file into memory (win32).
+
+  @param[in]     L       lua state
+  @param[in]     path    file name
+  @param[in]     mode    access mode
+  @param[in]     offset  byte offset of the range within the file
+  @param[in,out] size    size of the range in bytes (0 = up to the
+                         end of the file), receives the mapped size
+  @param[out]    delta   offset of the range within the mapping
+
+  @return start of the mapping
+
+*/////////////////////////////////////////////////////////////////////////
+static PBYTE mapfile_map(lua_State* L, const char* path, int mode, size_t offset, size_t* size, size_t* delta)
+{
+  static const DWORD protect[] = { PAGE_READONLY, PAGE_READWRITE, PAGE_WRITECOPY };
+  static const DWORD access[]  = { FILE_MAP_READ, FILE_MAP_WRITE, FILE_MAP_COPY };
+
+  HANDLE file;
+  HANDLE mapping;
+  LARGE_INTEGER filesize;
+  SYSTEM_INFO sysinfo;
+  unsigned __int64 start;
+  unsigned __int64 end;
+  void* base;
+
+  file = CreateFileA( path
+                    , (LUACWRAP_MAP_WRITE == mode) ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ
+                    , FILE_SHARE_READ | FILE_SHARE_WRITE
+                    , NULL
+                    , (LUACWRAP_MAP_WRITE == mode) ? OPEN_ALWAYS : OPEN_EXISTING
+                    , FILE_ATTRIBUTE_NORMAL
+                    , NULL);
+  if (INVALID_HANDLE_VALUE == file)
+  {
+    luaL_error(L, "luacwrap: cannot open file <%s> (error %d)", path, (int)GetLastError());
+  }
+  if (!GetFileSizeEx(file, &filesize))
+  {
+    CloseHandle(file);
+    luaL_error(L, "luacwrap: cannot get size of file <%s> (error %d)", path, (int)GetLastError());
+  }
+
+  // determine range (writable mappings grow the file)
+  if (0 == *size)
+  {
+    if ((unsigned __int64)filesize.QuadPart <= offset)
+    {
+      CloseHandle(file);
+      luaL_error(L, "luacwrap: file <%s> holds no data behind the given offset", path);
+    }
+    *size = (size_t)(filesize.QuadPart - offset);
+  }
+  else if (((unsigned __int64)filesize.QuadPart < (unsigned __int64)offset + *size) && (LUACWRAP_MAP_WRITE != mode))
+  {
+    CloseHandle(file);
+    luaL_error(L, "luacwrap: file <%s> too short", path);
+  }
+
+  GetSystemInfo(&sysinfo);
+  start  = offset & ~((unsigned __int64)sysinfo.dwAllocationGranularity - 1);
+  end    = (unsigned __int64)offset + *size;
+  *delta = (size_t)(offset - start);
+
+  mapping = CreateFileMappingA(file, NULL, protect[mode], (DWORD)(end >> 32), (DWORD)end, NULL);
+  CloseHandle(file);
+  if (NULL == mapping)
+  {
+    luaL_error(L, "luacwrap: cannot map file <%s> (error %d)", path, (int)GetLastError());
+  }
+
+  base = MapViewOfFile(mapping, access[mode], (DWORD)(start >> 32), (DWORD)start, *delta + *size);
+  CloseHandle(mapping);
+  if (NULL == base)
+  {
+    luaL_error(L, "luacwrap: cannot map file <%s> (error %d)", path, (int)GetLastError());
+  }
+  return (PBYTE)base;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Unmaps a mapping (win32).
+
+*/////////////////////////////////////////////////////////////////////////
+static void mapfile_unmap(PBYTE base, size_t length)
+{
+  UnmapViewOfFile(base);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Flushes modified pages of a mapping to the file (win32). Windows
+  always writes them asynchronously.
+
+*/////////////////////////////////////////////////////////////////////////
+static int mapfile_sync(PBYTE base, size_t length, int async)
+{
+  return FlushViewOfFile(base, length) ? 0 : -1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Advises the access pattern of a mapping (win32, ignored).
+
+*/////////////////////////////////////////////////////////////////////////
+static int mapfile_advise(PBYTE base, size_t length, int advice)
+{
+  return 0;
+}
+
+#else
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Maps a range of a file into memory (posix).
+
+  @param[in]     L       lua state
+  @param[in]     path    file name
+  @param[in]     mode    access mode
+  @param[in]     offset  byte offset of the range within the file
+  @param[in,out] size    size of the range in bytes (0 = up to the
+                         end of the file), receives the mapped size
+  @param[out]    delta   offset of the range within the mapping
+
+  @return start of the mapping
+
+*/////////////////////////////////////////////////////////////////////////
+static PBYTE mapfile_map(lua_State* L, const char* path, int mode, size_t offset, size_t* size, size_t* delta)
+{
+  static const int protect[] = { PROT_READ, PROT_READ | PROT_WRITE, PROT_READ | PROT_WRITE };
+  static const int flags[]   = { MAP_SHARED, MAP_SHARED, MAP_PRIVATE };
+
+  struct stat st;
+  size_t start;
+  void* base;
+  int fd;
+
+  fd = open(path, (LUACWRAP_MAP_WRITE == mode) ? (O_RDWR | O_CREAT) : O_RDONLY, 0666);
+  if (fd < 0)
+  {
+    luaL_error(L, "luacwrap: cannot open file <%s> (%s)", path, strerror(errno));
+  }
+  if (0 != fstat(fd, &st))
+  {
+    close(fd);
+    luaL_error(L, "luacwrap: cannot get size of file <%s> (%s)", path, strerror(errno));
+  }
+
+  // determine range (writable mappings grow the file)
+  if (0 == *size)
+  {
+    if ((size_t)st.st_size <= offset)
+    {
+      close(fd);
+      luaL_error(L, "luacwrap: file <%s> holds no data behind the given offset", path);
+    }
+    *size = (size_t)st.st_size - offset;
+  }
+  else if ((size_t)st.st_size < offset + *size)
+  {
+    if (LUACWRAP_MAP_WRITE != mode)
+    {
+      close(fd);
+      luaL_error(L, "luacwrap: file <%s> too short", path);
+    }
+    if (0 != ftruncate(fd, (off_t)(offset + *size)))
+    {
+      close(fd);
+      luaL_error(L, "luacwrap: cannot grow file <%s> (%s)", path, strerror(errno));
+    }
+  }
+
+  start  = offset & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+  *delta = offset - start;
+
+  base = mmap(NULL, *delta + *size, protect[mode], flags[mode], fd, (off_t)start);
+  close(fd);
+  if (MAP_FAILED == base)
+  {
+    luaL_error(L, "luacwrap: cannot map file <%s> (%s)", path, strerror(errno));
+  }
+  return (PBYTE)base;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Unmaps a mapping (posix).
+
+*/////////////////////////////////////////////////////////////////////////
+static void mapfile_unmap(PBYTE base, size_t length)
+{
+  munmap(base, length);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Flushes modified pages of a mapping to the file (posix).
+
+*/////////////////////////////////////////////////////////////////////////
+static int mapfile_sync(PBYTE base, size_t length, int async)
+{
+  return msync(base, length, async ? MS_ASYNC : MS_SYNC);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Advises the access pattern of a mapping (posix).
+
+*/////////////////////////////////////////////////////////////////////////
+static int mapfile_advise(PBYTE base, size_t length, int advice)
+{
+  static const int advices[] =
+  {
+    POSIX_MADV_NORMAL,
+    POSIX_MADV_SEQUENTIAL,
+    POSIX_MADV_RANDOM,
+    POSIX_MADV_WILLNEED,
+    POSIX_MADV_DONTNEED
+  };
+
+  return posix_madvise(base, length, advices[advice]);
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Releases the mapping of a memory mapped array. The start of the
+  mapping is stored as release data, the mapping ends with the
+  array memory.
+
+*/////////////////////////////////////////////////////////////////////////
+static void mapfile_release(lua_State* L, luacwrap_IndirectObject* pobj)
+{
+  PBYTE base = (PBYTE)pobj->releasedata;
+
+  mapfile_unmap(base, (size_t)(pobj->ptr - base) + pobj->size);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Checks for a memory mapped array which has not been closed.
+
+  @return indirect object header of the array
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_IndirectObject* mapfile_check(lua_State* L, int idx)
+{
+  luacwrap_IndirectObject* pobj;
+
+  pobj = (luacwrap_IndirectObject*)luacwrap_toudata(L, idx, (void*)g_mtMapped);
+  if (NULL == pobj)
+  {
+    luaL_argerror(L, idx, "memory mapped array expected");
+  }
+  if (NULL == pobj->ptr)
+  {
+    luaL_error(L, "access to released object (mapping has been closed)");
+  }
+  return pobj;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Maps records of a file into memory and pushes them as an array on
+  the lua stack.
+
+  @param[in]  L         lua state
+  @param[in]  path      file name
+  @param[in]  elemdesc  type descriptor of the records
+  @param[in]  count     number of records (0 = all complete records
+                        behind offset)
+  @param[in]  mode      access mode (LUACWRAP_MAP_xxx)
+  @param[in]  offset    byte offset of the first record within the file
+
+  @return pointer to the first record
+
+*/////////////////////////////////////////////////////////////////////////
+void* luacwrap_pushmappedarray( lua_State*      L
+                              , const char*     path
+                              , luacwrap_Type*  elemdesc
+                              , size_t          count
+                              , int             mode
+                              , size_t          offset)
+{
+  luacwrap_ArrayType* arrdesc;
+  luacwrap_IndirectObject* pobj;
+  size_t elemsize;
+  size_t size;
+  size_t delta;
+  PBYTE base;
+
+  LUASTACK_SET(L);
+
+  elemsize = luacwrap_type_size(elemdesc);
+
+  // create header first, so that the mapping is released on errors
+  pobj = luacwrap_pushindirectobj(L, NULL, 0, luacwrap_type_align(L, elemdesc), NULL, mapfile_release, NULL);
+  lua_pushlightuserdata(L, (void*)g_mtMapped);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  assert(!lua_isnil(L, -1));
+  lua_setmetatable(L, -2);
+
+  size = count * elemsize;
+  base = mapfile_map(L, path, mode, offset, &size, &delta);
+
+  pobj->ptr         = base + delta;
+  pobj->size        = size;
+  pobj->releasedata = base;
+  pobj->readonly    = (LUACWRAP_MAP_READ == mode);
+
+  // array of all complete records
+  if (0 == count)
+  {
+    count = size / elemsize;
+    if ((0 == count) || (size > INT_MAX))
+    {
+      luaL_error(L, "luacwrap: file <%s> holds no records or is too large to be mapped at once", path);
+    }
+  }
+
+  // set _ENV[$desc] and _ENV[$methods] (holds the array type descriptor)
+  arrdesc = luacwrap_pushanonarraytype(L, elemdesc, (int)count);
+  lua_createtable(L, 0, 2);
+  lua_pushvalue(L, -2);
+  lua_setfield(L, -2, "$methods");
+  lua_pushlightuserdata(L, arrdesc);
+  lua_setfield(L, -2, "$desc");
+  luacwrap_setenvironment(L, -3);
+  lua_pop(L, 1);
+
+  LUASTACK_CLEAN(L, 1);
+  return pobj->ptr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Maps a file of fixed size records into memory.
+
+  Parameters on lua stack:
+    - path    (file name)
+    - TYPE    (type table of the records)
+    - count   (optional number of records, default: all complete
+               records behind offset)
+    - mode    (optional access mode: "r" = read-only (default),
+               "w" = read-write shared, "c" = copy-on-write)
+    - offset  (optional zero based index of the first record)
+
+  Return values on lua stack
+    - memory mapped array
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_mapfile(lua_State* L)
+{
+  const char* path;
+  luacwrap_Type* elemdesc;
+  lua_Integer count;
+  lua_Integer first;
+  size_t elemsize;
+  int mode;
+
+  path = luaL_checkstring(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  count = luaL_optinteger(L, 3, 0);
+  mode  = luaL_checkoption(L, 4, "r", s_mapModes);
+  first = luaL_optinteger(L, 5, 0);
+
+  // get descriptor
+  lua_getfield(L, 2, "$desc");
+  if (lua_isnil(L, -1))
+  {
+    luaL_argerror(L, 2, "type expected");
+  }
+  elemdesc = (luacwrap_Type*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  elemsize = luacwrap_type_size(elemdesc);
+  luaL_argcheck(L, elemsize > 0, 2, "type without size");
+  luaL_argcheck(L, (count >= 0) && ((size_t)count <= (INT_MAX / elemsize)), 3, "number of records out of range");
+  luaL_argcheck(L, first >= 0, 5, "offset must not be negative");
+
+  luacwrap_pushmappedarray(L, path, elemdesc, (size_t)count, mode, (size_t)first * elemsize);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements array:close(). Unmaps the file before the array is
+  collected. Further accesses to the array raise an error.
+
+  Parameters on lua stack:
+    - self  (memory mapped array)
+
+*/////////////////////////////////////////////////////////////////////////
+static int mapfile_close(lua_State* L)
+{
+  luacwrap_IndirectObject* pobj;
+
+  pobj = (luacwrap_IndirectObject*)luacwrap_toudata(L, 1, (void*)g_mtMapped);
+  if (NULL == pobj)
+  {
+    luaL_argerror(L, 1, "memory mapped array expected");
+  }
+  if (NULL != pobj->ptr)
+  {
+    mapfile_release(L, pobj);
+    pobj->ptr = NULL;
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements array:sync([async]). Writes modified records of a
+  shared writable mapping to the file.
+
+  Parameters on lua stack:
+    - self  (memory mapped array)
+    - async (optional boolean, do not wait for completion)
+
+*/////////////////////////////////////////////////////////////////////////
+static int mapfile_syncmethod(lua_State* L)
+{
+  luacwrap_IndirectObject* pobj = mapfile_check(L, 1);
+  PBYTE base = (PBYTE)pobj->releasedata;
+
+  if (!pobj->readonly && (0 != mapfile_sync(base, (size_t)(pobj->ptr - base) + pobj->size, lua_toboolean(L, 2))))
+  {
+    luaL_error(L, "luacwrap: sync of memory mapped array failed");
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements array:advise(pattern). Tells the system how the records
+  will be accessed ("normal", "sequential", "random", "willneed" or
+  "dontneed").
+
+  Parameters on lua stack:
+    - self    (memory mapped array)
+    - pattern (access pattern)
+
+*/////////////////////////////////////////////////////////////////////////
+static int mapfile_advisemethod(lua_State* L)
+{
+  luacwrap_IndirectObject* pobj = mapfile_check(L, 1);
+  PBYTE base = (PBYTE)pobj->releasedata;
+  int advice = luaL_checkoption(L, 2, NULL, s_mapAdvice);
+
+  if (0 != mapfile_advise(base, (size_t)(pobj->ptr - base) + pobj->size, advice))
+  {
+    luaL_error(L, "luacwrap: advise of memory mapped array failed");
+  }
+  return 0;
+}
+
+// methods of memory mapped arrays
+luaL_Reg g_MappedMethods[ ] = {
+  { "close" , mapfile_close         },
+  { "sync"  , mapfile_syncmethod    },
+  { "advise", mapfile_advisemethod  },
+  { NULL, NULL }
+};
@@ -0,0 +1,41 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Memory mapped files as typed arrays
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+// access modes of memory mappings
+#define LUACWRAP_MAP_READ     0     // read-only
+#define LUACWRAP_MAP_WRITE    1     // read-write, changes are written to the file
+#define LUACWRAP_MAP_COPY     2     // copy-on-write, changes are private
+
+//
+// map records of a file into memory and push them as an array
+//
+void* luacwrap_pushmappedarray    ( lua_State*        L
+                                  , const char*       path
+                                  , luacwrap_Type*    elemdesc
+                                  , size_t            count
+                                  , int               mode
+                                  , size_t            offset);
+
+//
+// implements luacwrap.mmap(path, TYPE [, count [, mode [, offset]]])
+//
+int luacwrap_mapfile              ( lua_State*        L);
+
+// metatable of memory mapped arrays
+extern luaL_Reg g_mtMapped[];
+
+// methods of memory mapped arrays
+extern luaL_Reg g_MappedMethods[];
@@ -0,0 +1,1102 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  MessagePack encoding and decoding of wrapped objects.
+
+  The encoder walks the type descriptors and writes the object memory
+  directly into a luaL_Buffer:
+
+    - records are written as maps with the member names as keys, or
+      as arrays of the member values in declaration order
+    - arrays of $char are written as str (up to the first NUL
+      character), other arrays of 1 byte numbers and buffers as bin
+    - other numeric arrays are written as ext values holding the
+      elements in little endian byte order (ext type
+      LUACWRAP_MSGPACK_EXT + numeric kind), so the payload is a single
+      copy of the array memory on little endian platforms
+    - numbers are written with the smallest int encoding, $flt as
+      float 32 and $dbl as float 64
+    - other basic types (pointers, references) are written through
+      their get wrappers (nil, booleans, numbers and strings, other
+      values as nil)
+
+  The decoder writes the values directly into an object guided by its
+  type descriptors and converts numbers to the member types. Records
+  accept maps (unknown keys are skipped) and positional arrays, arrays
+  accept arrays, str/bin (1 byte elements) and numeric ext values of
+  any numeric kind, nil leaves a member unchanged.
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <string.h>
+
+#include "luaaux.h"
+#include "msgpack.h"
+#include "wrapnumeric.h"
+
+// maximal nesting depth of decoded values
+#define MSGPACK_MAX_DEPTH   128
+
+// value types of the decoder
+#define MSGPACK_NIL         0
+#define MSGPACK_BOOL        1
+#define MSGPACK_INT         2     // negative integer
+#define MSGPACK_UINT        3     // positive integer
+#define MSGPACK_FLOAT       4
+#define MSGPACK_STR         5
+#define MSGPACK_BIN         6
+#define MSGPACK_EXT         7
+#define MSGPACK_ARRAY       8
+#define MSGPACK_MAP         9
+
+// element size of the numeric kinds (index LUACWRAP_NK_xxx)
+static const size_t s_kindSize[] = { 0, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8 };
+
+//
+// state of the encoder
+//
+typedef struct msgpack_Out
+{
+  luaL_Buffer*        b;          // output
+  int                 maps;       // write records as maps (or arrays)
+  int                 typed;      // write numeric arrays as ext values
+  int                 keep;       // stack index of table keeping strings alive
+} msgpack_Out;
+
+//
+// state of the decoder
+//
+typedef struct msgpack_Reader
+{
+  lua_State*          L;
+  const BYTE*         start;      // start of the input
+  const BYTE*         p;          // next byte
+  const BYTE*         end;        // end of the input
+} msgpack_Reader;
+
+//
+// decoded value header (payload of str, bin and ext, count of arrays and maps)
+//
+typedef struct msgpack_Value
+{
+  int                 type;       // MSGPACK_xxx
+  int                 exttype;    // type of ext values
+  long long           i;          // MSGPACK_INT, MSGPACK_UINT, MSGPACK_BOOL
+  unsigned long long  u;          // MSGPACK_UINT
+  double              d;          // MSGPACK_FLOAT
+  const BYTE*         data;       // payload
+  size_t              len;        // length of payload or number of elements
+} msgpack_Value;
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Returns true on little endian platforms.
+
+*/////////////////////////////////////////////////////////////////////////
+static int msgpack_littleendian(void)
+{
+  const UINT16 one = 1;
+  return 1 == *(const BYTE*)&one;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a tag followed by a big endian value of n bytes.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putbe(luaL_Buffer* b, BYTE tag, unsigned long long value, int n)
+{
+  char tmp[9];
+  int i;
+
+  tmp[0] = (char)tag;
+  for (i = 0; i < n; i++)
+  {
+    tmp[1 + i] = (char)(value >> (8 * (n - 1 - i)));
+  }
+  luaL_addlstring(b, tmp, n + 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a header with a length (str, bin, array, map).
+
+  @param[in]  fix     tag of the fix format (0 = none)
+  @param[in]  fixmax  maximal length of the fix format
+  @param[in]  tag8    tag of the 8 bit length format (0 = none)
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putlen( luaL_Buffer*  b
+                          , size_t        len
+                          , BYTE          fix
+                          , size_t        fixmax
+                          , BYTE          tag8
+                          , BYTE          tag16
+                          , BYTE          tag32)
+{
+  if (fix && (len <= fixmax))
+    luaL_addchar(b, (char)(fix | len));
+  else if (tag8 && (len <= 0xFF))
+    msgpack_putbe(b, tag8, len, 1);
+  else if (len <= 0xFFFF)
+    msgpack_putbe(b, tag16, len, 2);
+  else
+    msgpack_putbe(b, tag32, len, 4);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends an unsigned integer in its smallest encoding.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putuint(luaL_Buffer* b, unsigned long long value)
+{
+  if (value < 0x80)
+    luaL_addchar(b, (char)value);
+  else if (value <= 0xFF)
+    msgpack_putbe(b, 0xCC, value, 1);
+  else if (value <= 0xFFFF)
+    msgpack_putbe(b, 0xCD, value, 2);
+  else if (value <= 0xFFFFFFFFu)
+    msgpack_putbe(b, 0xCE, value, 4);
+  else
+    msgpack_putbe(b, 0xCF, value, 8);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a signed integer in its smallest encoding.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putint(luaL_Buffer* b, long long value)
+{
+  if (value >= 0)
+    msgpack_putuint(b, (unsigned long long)value);
+  else if (value >= -32)
+    luaL_addchar(b, (char)value);
+  else if (value >= -128)
+    msgpack_putbe(b, 0xD0, (unsigned long long)value, 1);
+  else if (value >= -32768)
+    msgpack_putbe(b, 0xD1, (unsigned long long)value, 2);
+  else if (value >= INT32_MIN)
+    msgpack_putbe(b, 0xD2, (unsigned long long)value, 4);
+  else
+    msgpack_putbe(b, 0xD3, (unsigned long long)value, 8);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a float 64 value.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putdouble(luaL_Buffer* b, double value)
+{
+  uint64_t bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+  msgpack_putbe(b, 0xCB, bits, 8);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a str value.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putstr(luaL_Buffer* b, const char* s, size_t len)
+{
+  msgpack_putlen(b, len, 0xA0, 31, 0xD9, 0xDA, 0xDB);
+  luaL_addlstring(b, s, len);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a bin value.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putbin(luaL_Buffer* b, const BYTE* p, size_t len)
+{
+  msgpack_putlen(b, len, 0, 0, 0xC4, 0xC5, 0xC6);
+  luaL_addlstring(b, (const char*)p, len);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends a numeric member.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putnumber(luaL_Buffer* b, int kind, PBYTE p)
+{
+  switch (kind)
+  {
+    case LUACWRAP_NK_I8 : msgpack_putint (b, *(const int8_t*  )p); break;
+    case LUACWRAP_NK_U8 : msgpack_putuint(b, *(const uint8_t* )p); break;
+    case LUACWRAP_NK_I16: msgpack_putint (b, *(const int16_t* )p); break;
+    case LUACWRAP_NK_U16: msgpack_putuint(b, *(const uint16_t*)p); break;
+    case LUACWRAP_NK_I32: msgpack_putint (b, *(const int32_t* )p); break;
+    case LUACWRAP_NK_U32: msgpack_putuint(b, *(const uint32_t*)p); break;
+    case LUACWRAP_NK_I64: msgpack_putint (b, *(const int64_t* )p); break;
+    case LUACWRAP_NK_U64: msgpack_putuint(b, *(const uint64_t*)p); break;
+    case LUACWRAP_NK_FLT:
+      {
+        uint32_t bits;
+        memcpy(&bits, p, sizeof(bits));
+        msgpack_putbe(b, 0xCA, bits, 4);
+      }
+      break;
+    case LUACWRAP_NK_DBL: msgpack_putdouble(b, *(const double*)p); break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends the value of a basic type returned by its get wrapper.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putluavalue( lua_State*          L
+                               , msgpack_Out*        out
+                               , luacwrap_BasicType* desc
+                               , PBYTE               base
+                               , int                 offset)
+{
+  luacwrap_BasicValue value;
+
+  luacwrap_getbasicvalue(L, desc, base, offset, out->keep, &value);
+  switch (value.type)
+  {
+    case LUA_TBOOLEAN:
+      luaL_addchar(out->b, (char)(value.number ? 0xC3 : 0xC2));
+      break;
+    case LUA_TNUMBER:
+      // range check first, converting NaN or out of range doubles is undefined
+      if (  (value.number >= -9223372036854775808.0) && (value.number < 9223372036854775808.0)
+         && (value.number == (double)(long long)value.number))
+        msgpack_putint(out->b, (long long)value.number);
+      else
+        msgpack_putdouble(out->b, value.number);
+      break;
+    case LUA_TSTRING:
+      msgpack_putstr(out->b, value.s, value.len);
+      break;
+    default:
+      luaL_addchar(out->b, (char)0xC0);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Appends the MessagePack representation of an object.
+
+  @param[in]  base    memory of the outer object (at stack index 1)
+  @param[in]  offset  offset of the object within the outer object
+  @param[in]  desc    type of the object
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_putvalue( lua_State*      L
+                            , msgpack_Out*    out
+                            , PBYTE           base
+                            , int             offset
+                            , luacwrap_Type*  desc)
+{
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC:
+      {
+        int kind = luacwrap_numerickind(desc);
+        if (LUACWRAP_NK_NONE != kind)
+        {
+          msgpack_putnumber(out->b, kind, base + offset);
+        }
+        else
+        {
+          msgpack_putluavalue(L, out, (luacwrap_BasicType*)desc, base, offset);
+        }
+      }
+      break;
+
+    case LUACWRAP_TC_RECORD:
+      {
+        luacwrap_RecordMember* member = ((luacwrap_RecordType*)desc)->members;
+        size_t nmembers = 0;
+
+        while (member[nmembers].membername)
+        {
+          nmembers++;
+        }
+
+        if (out->maps)
+          msgpack_putlen(out->b, nmembers, 0x80, 15, 0, 0xDE, 0xDF);
+        else
+          msgpack_putlen(out->b, nmembers, 0x90, 15, 0, 0xDC, 0xDD);
+
+        for (; member->membername; member++)
+        {
+          if (out->maps)
+          {
+            msgpack_putstr(out->b, member->membername, strlen(member->membername));
+          }
+          msgpack_putvalue(L, out, base, offset + member->memberoffset, luacwrap_getmembertype(L, member));
+        }
+      }
+      break;
+
+    case LUACWRAP_TC_ARRAY:
+      {
+        luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+        luacwrap_Type* elemdesc = luacwrap_getelemtype(L, arrdesc);
+        int kind = luacwrap_numerickind(elemdesc);
+        PBYTE p = base + offset;
+        unsigned int n;
+
+        if (0 == strcmp(elemdesc->name, "$char"))
+        {
+          const BYTE* end = (const BYTE*)memchr(p, 0, arrdesc->elemcount);
+          msgpack_putstr(out->b, (const char*)p, end ? (size_t)(end - p) : arrdesc->elemcount);
+          break;
+        }
+
+        if (out->typed && (LUACWRAP_NK_NONE != kind) && (s_kindSize[kind] == arrdesc->elemsize))
+        {
+          size_t len = arrdesc->elemcount * arrdesc->elemsize;
+
+          if (1 == arrdesc->elemsize)
+          {
+            msgpack_putbin(out->b, p, len);
+            break;
+          }
+
+          // ext header
+          switch (len)
+          {
+            case 1 : luaL_addchar(out->b, (char)0xD4); break;
+            case 2 : luaL_addchar(out->b, (char)0xD5); break;
+            case 4 : luaL_addchar(out->b, (char)0xD6); break;
+            case 8 : luaL_addchar(out->b, (char)0xD7); break;
+            case 16: luaL_addchar(out->b, (char)0xD8); break;
+            default: msgpack_putlen(out->b, len, 0, 0, 0xC7, 0xC8, 0xC9);
+          }
+          luaL_addchar(out->b, (char)(LUACWRAP_MSGPACK_EXT + kind));
+
+          // payload in little endian byte order
+          if (msgpack_littleendian())
+          {
+            luaL_addlstring(out->b, (const char*)p, len);
+          }
+          else
+          {
+            size_t i;
+            for (i = 0; i < len; i += arrdesc->elemsize)
+            {
+              size_t k = arrdesc->elemsize;
+              while (k-- > 0)
+              {
+                luaL_addchar(out->b, (char)p[i + k]);
+              }
+            }
+          }
+          break;
+        }
+
+        msgpack_putlen(out->b, arrdesc->elemcount, 0x90, 15, 0, 0xDC, 0xDD);
+        for (n = 0; n < arrdesc->elemcount; n++)
+        {
+          msgpack_putvalue(L, out, base, offset + n * arrdesc->elemsize, elemdesc);
+        }
+      }
+      break;
+
+    case LUACWRAP_TC_BUFFER:
+      msgpack_putbin(out->b, base + offset, ((luacwrap_BufferType*)desc)->size);
+      break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Encodes a wrapped object as MessagePack string.
+
+  Parameters on lua stack:
+    - obj     (boxed or embedded object)
+    - opts    (optional table:
+                records = "map" (default) to write records as maps
+                          or "array" to write them positional,
+                typed   = false to write numeric arrays as arrays
+                          instead of bin/ext values)
+
+  Return values on lua stack
+    - MessagePack string
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_tomsgpack(lua_State* L)
+{
+  static const char* const s_recordForms[] = { "map", "array", NULL };
+
+  luaL_Buffer b;
+  luacwrap_Type* desc;
+  msgpack_Out out;
+  PBYTE base;
+  int offset;
+
+  lua_settop(L, 2);
+
+  desc = luacwrap_checkobject(L, 1);
+
+  // options
+  out.maps  = 1;
+  out.typed = 1;
+  if (lua_istable(L, 2))
+  {
+    lua_getfield(L, 2, "records");
+    if (!lua_isnil(L, -1))
+    {
+      const char* form = lua_tostring(L, -1);
+      out.maps = (form && (0 == strcmp(form, s_recordForms[0])));
+      if (!out.maps && !(form && (0 == strcmp(form, s_recordForms[1]))))
+      {
+        luaL_argerror(L, 2, "records must be \"map\" or \"array\"");
+      }
+    }
+    lua_getfield(L, 2, "typed");
+    if (!lua_isnil(L, -1))
+    {
+      out.typed = lua_toboolean(L, -1);
+    }
+    lua_pop(L, 2);
+  }
+
+  // get wrappers of pointer members expect the outer object at index 1
+  base = (PBYTE)luacwrap_replaceouter(L, 1, &offset);
+
+  lua_createtable(L, 1, 0);
+  out.keep = lua_gettop(L);
+
+  luaL_buffinit(L, &b);
+  out.b = &b;
+  msgpack_putvalue(L, &out, base, offset, desc);
+  luaL_pushresult(&b);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Raises a decoding error.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_error(msgpack_Reader* R, const char* msg)
+{
+  luaL_error(R->L, "luacwrap: MessagePack error at offset %d: %s", (int)(R->p - R->start), msg);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Reads a big endian value of n bytes.
+
+*/////////////////////////////////////////////////////////////////////////
+static unsigned long long msgpack_getbe(msgpack_Reader* R, int n)
+{
+  unsigned long long value = 0;
+
+  if (R->end - R->p < n)
+  {
+    msgpack_error(R, "unexpected end of data");
+  }
+  while (n-- > 0)
+  {
+    value = (value << 8) | *R->p++;
+  }
+  return value;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Reads the payload of a str, bin or ext value.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_getdata(msgpack_Reader* R, msgpack_Value* v, size_t len)
+{
+  if ((size_t)(R->end - R->p) < len)
+  {
+    msgpack_error(R, "unexpected end of data");
+  }
+  v->data = R->p;
+  v->len  = len;
+  R->p   += len;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Reads the next value. Payloads of str, bin and ext values are
+  consumed, elements of arrays and maps are not.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_get(msgpack_Reader* R, msgpack_Value* v)
+{
+  BYTE tag;
+
+  if (R->p >= R->end)
+  {
+    msgpack_error(R, "unexpected end of data");
+  }
+  tag = *R->p++;
+
+  memset(v, 0, sizeof(*v));
+  if (tag < 0x80)
+  {
+    v->type = MSGPACK_UINT;
+    v->u    = tag;
+  }
+  else if (tag < 0x90)
+  {
+    v->type = MSGPACK_MAP;
+    v->len  = tag & 0x0F;
+  }
+  else if (tag < 0xA0)
+  {
+    v->type = MSGPACK_ARRAY;
+    v->len  = tag & 0x0F;
+  }
+  else if (tag < 0xC0)
+  {
+    v->type = MSGPACK_STR;
+    msgpack_getdata(R, v, tag & 0x1F);
+  }
+  else if (tag >= 0xE0)
+  {
+    v->type = MSGPACK_INT;
+    v->i    = (signed char)tag;
+  }
+  else
+  {
+    switch (tag)
+    {
+      case 0xC0: v->type = MSGPACK_NIL; break;
+      case 0xC2: v->type = MSGPACK_BOOL; v->i = 0; break;
+      case 0xC3: v->type = MSGPACK_BOOL; v->i = 1; break;
+      case 0xC4: v->type = MSGPACK_BIN; msgpack_getdata(R, v, (size_t)msgpack_getbe(R, 1)); break;
+      case 0xC5: v->type = MSGPACK_BIN; msgpack_getdata(R, v, (size_t)msgpack_getbe(R, 2)); break;
+      case 0xC6: v->type = MSGPACK_BIN; msgpack_getdata(R, v, (size_t)msgpack_getbe(R, 4)); break;
+      case 0xC7:
+      case 0xC8:
+      case 0xC9:
+        {
+          size_t len = (size_t)msgpack_getbe(R, (0xC7 == tag) ? 1 : (0xC8 == tag) ? 2 : 4);
+          v->type    = MSGPACK_EXT;
+          v->exttype = (signed char)msgpack_getbe(R, 1);
+          msgpack_getdata(R, v, len);
+        }
+        break;
+      case 0xCA:
+        {
+          uint32_t bits = (uint32_t)msgpack_getbe(R, 4);
+          float value;
+          memcpy(&value, &bits, sizeof(value));
+          v->type = MSGPACK_FLOAT;
+          v->d    = value;
+        }
+        break;
+      case 0xCB:
+        {
+          uint64_t bits = msgpack_getbe(R, 8);
+          memcpy(&v->d, &bits, sizeof(v->d));
+          v->type = MSGPACK_FLOAT;
+        }
+        break;
+      case 0xCC: v->type = MSGPACK_UINT; v->u = msgpack_getbe(R, 1); break;
+      case 0xCD: v->type = MSGPACK_UINT; v->u = msgpack_getbe(R, 2); break;
+      case 0xCE: v->type = MSGPACK_UINT; v->u = msgpack_getbe(R, 4); break;
+      case 0xCF: v->type = MSGPACK_UINT; v->u = msgpack_getbe(R, 8); break;
+      case 0xD0: v->type = MSGPACK_INT; v->i = (int8_t )msgpack_getbe(R, 1); break;
+      case 0xD1: v->type = MSGPACK_INT; v->i = (int16_t)msgpack_getbe(R, 2); break;
+      case 0xD2: v->type = MSGPACK_INT; v->i = (int32_t)msgpack_getbe(R, 4); break;
+      case 0xD3: v->type = MSGPACK_INT; v->i = (int64_t)msgpack_getbe(R, 8); break;
+      case 0xD4:
+      case 0xD5:
+      case 0xD6:
+      case 0xD7:
+      case 0xD8:
+        v->type    = MSGPACK_EXT;
+        v->exttype = (signed char)msgpack_getbe(R, 1);
+        msgpack_getdata(R, v, (size_t)1 << (tag - 0xD4));
+        break;
+      case 0xD9: v->type = MSGPACK_STR; msgpack_getdata(R, v, (size_t)msgpack_getbe(R, 1)); break;
+      case 0xDA: v->type = MSGPACK_STR; msgpack_getdata(R, v, (size_t)msgpack_getbe(R, 2)); break;
+      case 0xDB: v->type = MSGPACK_STR; msgpack_getdata(R, v, (size_t)msgpack_getbe(R, 4)); break;
+      case 0xDC: v->type = MSGPACK_ARRAY; v->len = (size_t)msgpack_getbe(R, 2); break;
+      case 0xDD: v->type = MSGPACK_ARRAY; v->len = (size_t)msgpack_getbe(R, 4); break;
+      case 0xDE: v->type = MSGPACK_MAP; v->len = (size_t)msgpack_getbe(R, 2); break;
+      case 0xDF: v->type = MSGPACK_MAP; v->len = (size_t)msgpack_getbe(R, 4); break;
+      default:
+        R->p--;
+        msgpack_error(R, "invalid type tag");
+    }
+  }
+
+  // signed and unsigned view of integers
+  if (MSGPACK_UINT == v->type)
+    v->i = (long long)v->u;
+  else if ((MSGPACK_INT == v->type) || (MSGPACK_BOOL == v->type))
+    v->u = (unsigned long long)v->i;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Skips the elements of an array or map value.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_skip(msgpack_Reader* R, const msgpack_Value* v, int depth)
+{
+  size_t n;
+
+  if ((MSGPACK_ARRAY != v->type) && (MSGPACK_MAP != v->type))
+  {
+    return;
+  }
+  if (depth > MSGPACK_MAX_DEPTH)
+  {
+    msgpack_error(R, "nested too deep");
+  }
+
+  n = (MSGPACK_MAP == v->type) ? 2 * v->len : v->len;
+  while (n-- > 0)
+  {
+    msgpack_Value elem;
+    msgpack_get(R, &elem);
+    msgpack_skip(R, &elem, depth + 1);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Stores a decoded number into a numeric member.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_storenumber(msgpack_Reader* R, int kind, PBYTE p, const msgpack_Value* v)
+{
+  long long           ival = v->i;
+  unsigned long long  uval = v->u;
+  double              dval;
+
+  switch (v->type)
+  {
+    case MSGPACK_BOOL:
+    case MSGPACK_INT:   dval = (double)v->i; break;
+    case MSGPACK_UINT:  dval = (double)v->u; break;
+    case MSGPACK_FLOAT:
+      dval = v->d;
+      if ((LUACWRAP_NK_FLT == kind) || (LUACWRAP_NK_DBL == kind))
+      {
+        break;
+      }
+      // converting doubles out of the 64 bit range is undefined
+      if (!((dval >= -9223372036854775808.0) && (dval < 18446744073709551616.0)))
+      {
+        msgpack_error(R, "number out of range");
+      }
+      if (dval < 0)
+      {
+        ival = (long long)dval;
+        uval = (unsigned long long)ival;
+      }
+      else
+      {
+        uval = (unsigned long long)dval;
+        ival = (long long)uval;
+      }
+      break;
+    default:
+      msgpack_error(R, "number expected");
+      return;
+  }
+
+  switch (kind)
+  {
+    case LUACWRAP_NK_I8 : *(int8_t*  )p = (int8_t  )ival; break;
+    case LUACWRAP_NK_U8 : *(uint8_t* )p = (uint8_t )uval; break;
+    case LUACWRAP_NK_I16: *(int16_t* )p = (int16_t )ival; break;
+    case LUACWRAP_NK_U16: *(uint16_t*)p = (uint16_t)uval; break;
+    case LUACWRAP_NK_I32: *(int32_t* )p = (int32_t )ival; break;
+    case LUACWRAP_NK_U32: *(uint32_t*)p = (uint32_t)uval; break;
+    case LUACWRAP_NK_I64: *(int64_t* )p = (int64_t )ival; break;
+    case LUACWRAP_NK_U64: *(uint64_t*)p = (uint64_t)uval; break;
+    case LUACWRAP_NK_FLT: *(float*   )p = (float   )dval; break;
+    case LUACWRAP_NK_DBL: *(double*  )p = (double  )dval; break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Loads a little endian element of a numeric ext value.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_loadelem(int kind, const BYTE* p, msgpack_Value* v)
+{
+  unsigned long long bits = 0;
+  size_t size = s_kindSize[kind];
+  size_t n;
+
+  for (n = size; n-- > 0;)
+  {
+    bits = (bits << 8) | p[n];
+  }
+
+  memset(v, 0, sizeof(*v));
+  switch (kind)
+  {
+    case LUACWRAP_NK_I8 :
+    case LUACWRAP_NK_I16:
+    case LUACWRAP_NK_I32:
+    case LUACWRAP_NK_I64:
+      // sign extension
+      if ((size < 8) && (bits >> (8 * size - 1)))
+      {
+        bits |= ~0ull << (8 * size);
+      }
+      v->type = MSGPACK_INT;
+      v->i    = (long long)bits;
+      v->u    = bits;
+      break;
+    case LUACWRAP_NK_FLT:
+      {
+        uint32_t fbits = (uint32_t)bits;
+        float value;
+        memcpy(&value, &fbits, sizeof(value));
+        v->type = MSGPACK_FLOAT;
+        v->d    = value;
+      }
+      break;
+    case LUACWRAP_NK_DBL:
+      {
+        uint64_t dbits = bits;
+        v->type = MSGPACK_FLOAT;
+        memcpy(&v->d, &dbits, sizeof(v->d));
+      }
+      break;
+    default:
+      v->type = MSGPACK_UINT;
+      v->u    = bits;
+      v->i    = (long long)bits;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Copies a str or bin payload into fixed size memory. The rest of the
+  memory is filled with zeros, longer payloads are truncated.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_storebytes(PBYTE dst, size_t size, const msgpack_Value* v)
+{
+  size_t len = (v->len < size) ? v->len : size;
+
+  memcpy(dst, v->data, len);
+  memset(dst + len, 0, size - len);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Decodes the next value into an object of the given type.
+
+  @param[in]  base    memory of the outer object (at stack index 1)
+  @param[in]  offset  offset of the object within the outer object
+  @param[in]  desc    type of the object
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_parse( msgpack_Reader* R
+                         , PBYTE           base
+                         , int             offset
+                         , luacwrap_Type*  desc
+                         , int             depth)
+{
+  lua_State* L = R->L;
+  msgpack_Value v;
+  size_t n;
+
+  if (depth > MSGPACK_MAX_DEPTH)
+  {
+    msgpack_error(R, "nested too deep");
+  }
+
+  msgpack_get(R, &v);
+
+  // nil leaves the object unchanged
+  if (MSGPACK_NIL == v.type)
+  {
+    return;
+  }
+
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC:
+      {
+        int kind = luacwrap_numerickind(desc);
+        if (LUACWRAP_NK_NONE != kind)
+        {
+          msgpack_storenumber(R, kind, base + offset, &v);
+          break;
+        }
+
+        LUASTACK_SET(L);
+        switch (v.type)
+        {
+          case MSGPACK_BOOL : lua_pushboolean(L, (int)v.i); break;
+          case MSGPACK_INT  : lua_pushnumber(L, (lua_Number)v.i); break;
+          case MSGPACK_UINT : lua_pushnumber(L, (lua_Number)v.u); break;
+          case MSGPACK_FLOAT: lua_pushnumber(L, (lua_Number)v.d); break;
+          case MSGPACK_STR  :
+          case MSGPACK_BIN  : lua_pushlstring(L, (const char*)v.data, v.len); break;
+          default:
+            msgpack_error(R, "scalar value expected");
+        }
+        ((luacwrap_BasicType*)desc)->setWrapper((luacwrap_BasicType*)desc, L, base + offset, offset);
+        lua_pop(L, 1);
+        LUASTACK_CLEAN(L, 0);
+      }
+      break;
+
+    case LUACWRAP_TC_RECORD:
+      {
+        luacwrap_RecordMember* member = ((luacwrap_RecordType*)desc)->members;
+
+        if (MSGPACK_MAP == v.type)
+        {
+          for (n = 0; n < v.len; n++)
+          {
+            msgpack_Value key;
+            luacwrap_RecordMember* found = NULL;
+
+            msgpack_get(R, &key);
+            if ((MSGPACK_STR == key.type) && (NULL == memchr(key.data, 0, key.len)))
+            {
+              found = luacwrap_findmember(member, (const char*)key.data, key.len);
+            }
+            else
+            {
+              msgpack_skip(R, &key, depth + 1);
+            }
+
+            if (found)
+            {
+              msgpack_parse(R, base, offset + found->memberoffset, luacwrap_getmembertype(L, found), depth + 1);
+            }
+            else
+            {
+              // unknown member
+              msgpack_Value value;
+              msgpack_get(R, &value);
+              msgpack_skip(R, &value, depth + 1);
+            }
+          }
+        }
+        else if (MSGPACK_ARRAY == v.type)
+        {
+          // positional members, surplus values are skipped
+          for (n = 0; n < v.len; n++)
+          {
+            if (member->membername)
+            {
+              msgpack_parse(R, base, offset + member->memberoffset, luacwrap_getmembertype(L, member), depth + 1);
+              member++;
+            }
+            else
+            {
+              msgpack_Value value;
+              msgpack_get(R, &value);
+              msgpack_skip(R, &value, depth + 1);
+            }
+          }
+        }
+        else
+        {
+          msgpack_error(R, "map or array expected");
+        }
+      }
+      break;
+
+    case LUACWRAP_TC_ARRAY:
+      {
+        luacwrap_ArrayType* arrdesc = (luacwrap_ArrayType*)desc;
+        luacwrap_Type* elemdesc = luacwrap_getelemtype(L, arrdesc);
+        int kind = luacwrap_numerickind(elemdesc);
+        PBYTE p = base + offset;
+
+        if (((MSGPACK_STR == v.type) || (MSGPACK_BIN == v.type)) && (1 == arrdesc->elemsize))
+        {
+          msgpack_storebytes(p, arrdesc->elemcount, &v);
+        }
+        else if (MSGPACK_ARRAY == v.type)
+        {
+          if (v.len > arrdesc->elemcount)
+          {
+            msgpack_error(R, "too many array elements");
+          }
+          for (n = 0; n < v.len; n++)
+          {
+            msgpack_parse(R, base, offset + (int)(n * arrdesc->elemsize), elemdesc, depth + 1);
+          }
+        }
+        else if (  (MSGPACK_EXT == v.type) && (LUACWRAP_NK_NONE != kind)
+                && (v.exttype > LUACWRAP_MSGPACK_EXT) && (v.exttype <= LUACWRAP_MSGPACK_EXT + LUACWRAP_NK_DBL))
+        {
+          int srckind = v.exttype - LUACWRAP_MSGPACK_EXT;
+          size_t srcsize = s_kindSize[srckind];
+
+          if (0 != v.len % srcsize)
+          {
+            msgpack_error(R, "invalid numeric array");
+          }
+          if (v.len / srcsize > arrdesc->elemcount)
+          {
+            msgpack_error(R, "too many array elements");
+          }
+
+          if ((srckind == kind) && (srcsize == arrdesc->elemsize) && msgpack_littleendian())
+          {
+            // bulk copy
+            memcpy(p, v.data, v.len);
+          }
+          else
+          {
+            // convert element by element
+            for (n = 0; n < v.len / srcsize; n++)
+            {
+              msgpack_Value elem;
+              msgpack_loadelem(srckind, v.data + n * srcsize, &elem);
+              msgpack_storenumber(R, kind, p + n * arrdesc->elemsize, &elem);
+            }
+          }
+        }
+        else
+        {
+          msgpack_error(R, "array expected");
+        }
+      }
+      break;
+
+    case LUACWRAP_TC_BUFFER:
+      if ((MSGPACK_STR != v.type) && (MSGPACK_BIN != v.type))
+      {
+        msgpack_error(R, "str or bin expected");
+      }
+      msgpack_storebytes(base + offset, ((luacwrap_BufferType*)desc)->size, &v);
+      break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Decodes a MessagePack value at the given byte offset of the string at
+  stack index 2 into the object at stack index 1 (outer object) and
+  pushes the offset behind the value.
+
+*/////////////////////////////////////////////////////////////////////////
+static void msgpack_decode( lua_State*      L
+                          , lua_Integer     start
+                          , int             offset
+                          , luacwrap_Type*  desc)
+{
+  msgpack_Reader R;
+  size_t len;
+  const char* s = lua_tolstring(L, 2, &len);
+
+  luaL_argcheck(L, (start >= 0) && ((size_t)start < len), 3, "offset out of range");
+
+  R.L     = L;
+  R.start = (const BYTE*)s;
+  R.p     = (const BYTE*)s + start;
+  R.end   = (const BYTE*)s + len;
+
+  msgpack_parse(&R, (PBYTE)luacwrap_getobjptr(L, 1), offset, desc, 0);
+  lua_pushinteger(L, (lua_Integer)(R.p - R.start));
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements TYPE:frommsgpack(s [, offset]). Creates a new boxed object
+  from a MessagePack value, members absent in the value are zero.
+
+  Parameters on lua stack:
+    - self    (type descriptor)
+    - MessagePack string
+    - byte offset of the value (optional, default 0)
+
+  Return values on lua stack
+    - new object
+    - byte offset behind the value
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_type_frommsgpack(lua_State* L)
+{
+  luacwrap_Type* desc;
+  lua_Integer start;
+
+  luaL_checkstring(L, 2);
+  start = luaL_optinteger(L, 3, 0);
+  lua_settop(L, 3);
+
+  // set wrappers of pointer members expect the object at index 1
+  desc = luacwrap_beginnew(L, "frommsgpack");
+
+  msgpack_decode(L, start, 0, desc);
+  return 2;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements obj:setmsgpack(s [, offset]). Sets the members given in a
+  MessagePack value, other members are unchanged.
+
+  Parameters on lua stack:
+    - self    (boxed or embedded object)
+    - MessagePack string
+    - byte offset of the value (optional, default 0)
+
+  Return values on lua stack
+    - self
+    - byte offset behind the value
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_setmsgpack(lua_State* L)
+{
+  luacwrap_Type* desc;
+  lua_Integer start;
+  int offset = 0;
+
+  luaL_checkstring(L, 2);
+  start = luaL_optinteger(L, 3, 0);
+  lua_settop(L, 3);
+
+  // set wrappers of pointer members expect the outer object at index 1
+  desc = luacwrap_beginset(L, &offset);
+
+  msgpack_decode(L, start, offset, desc);
+  return 2;
+}
@@ -0,0 +1,36 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  MessagePack encoding and decoding of wrapped objects
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+//
+// first MessagePack extension type of numeric arrays
+// (ext type = LUACWRAP_MSGPACK_EXT + numeric kind LUACWRAP_NK_xxx)
+//
+#define LUACWRAP_MSGPACK_EXT    0x10
+
+//
+// implements luacwrap.tomsgpack(obj [, opts])
+//
+int luacwrap_tomsgpack            ( lua_State*        L);
+
+//
+// implements TYPE:frommsgpack(s [, offset])
+//
+int luacwrap_type_frommsgpack     ( lua_State*        L);
+
+//
+// implements obj:setmsgpack(s [, offset])
+//
+int luacwrap_setmsgpack           ( lua_State*        L);
@@ -0,0 +1,474 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Binary serialization of wrapped objects.
+
+  Objects are exported as Lua strings holding a copy of their raw
+  memory and imported by copying the string content into new boxed
+  objects. Pointer and reference members ($ptr, $ref, $wref) are only
+  meaningful within the current lua state, so they are either zeroed
+  or rejected according to a policy argument.
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "luaaux.h"
+#include "serialize.h"
+#include "wrappointer.h"
+#include "wrapreference.h"
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Get policy for pointer and reference members from an optional
+  string argument.
+
+  @param[in]  L       lua state
+  @param[in]  idx     stack index of the policy argument
+
+  @return LUACWRAP_REFS_ZERO or LUACWRAP_REFS_REJECT
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_checkrefpolicy(lua_State* L, int idx)
+{
+  static const char* policies[] = { "zero", "reject", NULL };
+
+  return luaL_checkoption(L, idx, "zero", policies);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  check if a basic type is a pointer or reference type
+
+*/////////////////////////////////////////////////////////////////////////
+static int serialize_isreftype(luacwrap_Type* desc)
+{
+  return (desc == &regType_Pointer.hdr)
+      || (desc == &regType_Reference.hdr)
+      || (desc == &regType_WeakReference.hdr);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Check if a type contains pointer or reference members.
+
+  @param[in]  L       lua state
+  @param[in]  desc    type descriptor
+
+  @return 1 if the type contains pointer or reference members
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_type_hasrefs(lua_State* L, luacwrap_Type* desc)
+{
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC:
+      return serialize_isreftype(desc);
+    case LUACWRAP_TC_RECORD:
+      {
+        luacwrap_RecordMember* member = ((luacwrap_RecordType*)desc)->members;
+        for (; member->membername; ++member)
+        {
+          if (luacwrap_type_hasrefs(L, luacwrap_getmembertype(L, member)))
+          {
+            return 1;
+          }
+        }
+      }
+      break;
+    case LUACWRAP_TC_ARRAY:
+      return luacwrap_type_hasrefs(L, luacwrap_getelemtype(L, (luacwrap_ArrayType*)desc));
+    default:
+      break;
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Apply policy to the pointer and reference members of an object
+  memory. With LUACWRAP_REFS_ZERO the members are cleared, with
+  LUACWRAP_REFS_REJECT an error is raised if a member is not zero.
+
+  @param[in]  L       lua state
+  @param[in]  desc    type descriptor
+  @param[in]  p       object memory
+  @param[in]  policy  LUACWRAP_REFS_ZERO or LUACWRAP_REFS_REJECT
+
+  @return number of non zero pointer and reference members
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_applyrefpolicy(lua_State* L, luacwrap_Type* desc, PBYTE p, int policy)
+{
+  int result = 0;
+
+  switch (desc->typeclass)
+  {
+    case LUACWRAP_TC_BASIC:
+      if (serialize_isreftype(desc))
+      {
+        unsigned int size = ((luacwrap_BasicType*)desc)->size;
+        unsigned int idx;
+
+        for (idx = 0; idx < size; ++idx)
+        {
+          if (p[idx])
+          {
+            if (LUACWRAP_REFS_REJECT == policy)
+            {
+              luaL_error(L, "luacwrap: %s member is set (policy 'reject')", desc->name);
+            }
+            memset(p, 0, size);
+            result = 1;
+            break;
+          }
+        }
+      }
+      break;
+    case LUACWRAP_TC_RECORD:
+      {
+        luacwrap_RecordMember* member = ((luacwrap_RecordType*)desc)->members;
+        for (; member->membername; ++member)
+        {
+          result += luacwrap_applyrefpolicy(L, luacwrap_getmembertype(L, member), p + member->memberoffset, policy);
+        }
+      }
+      break;
+    case LUACWRAP_TC_ARRAY:
+      {
+        luacwrap_ArrayType* arrdesc  = (luacwrap_ArrayType*)desc;
+        luacwrap_Type*      elemtype = luacwrap_getelemtype(L, arrdesc);
+        unsigned int        idx;
+
+        // don't walk arrays of plain elements
+        if (luacwrap_type_hasrefs(L, elemtype))
+        {
+          for (idx = 0; idx < arrdesc->elemcount; ++idx)
+          {
+            result += luacwrap_applyrefpolicy(L, elemtype, p + idx * arrdesc->elemsize, policy);
+          }
+        }
+      }
+      break;
+    default:
+      break;
+  }
+  return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  get type descriptor of the type table at stack index 1
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_Type* serialize_checktype(lua_State* L, const char* fname)
+{
+  luacwrap_Type* desc;
+
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  lua_getfield(L, 1, "$desc");
+  if (lua_isnil(L, -1))
+  {
+    luaL_error(L, "No descriptor found. Don't call %s() on instances.", fname);
+  }
+  desc = (luacwrap_Type*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  return desc;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Adds the memory of an object to a buffer. If the type contains
+  pointer or reference members the policy is applied to a copy
+  within the scratch memory.
+
+*/////////////////////////////////////////////////////////////////////////
+static void serialize_addobj( lua_State*      L
+                            , luaL_Buffer*    b
+                            , luacwrap_Type*  desc
+                            , PBYTE           p
+                            , size_t          size
+                            , int             hasrefs
+                            , PBYTE           scratch
+                            , int             policy)
+{
+  if (hasrefs)
+  {
+    if (LUACWRAP_REFS_ZERO == policy)
+    {
+      memcpy(scratch, p, size);
+      luacwrap_applyrefpolicy(L, desc, scratch, policy);
+      p = scratch;
+    }
+    else
+    {
+      luacwrap_applyrefpolicy(L, desc, p, policy);
+    }
+  }
+  luaL_addlstring(b, (const char*)p, size);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements obj:tobytes([policy]). Returns the raw memory of a boxed
+  or embedded object as a lua string.
+
+  Parameters on lua stack:
+    - self    (boxed or embedded object)
+    - policy  (optional, "zero" or "reject")
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_tobytes(lua_State* L)
+{
+  luacwrap_Type* desc;
+  PBYTE          p;
+  size_t         size;
+  int            policy;
+
+  LUASTACK_SET(L);
+
+  desc = luacwrap_getdescriptor(L, 1);
+  if (NULL == desc)
+  {
+    return luaL_argerror(L, 1, "wrapped object expected");
+  }
+  policy = luacwrap_checkrefpolicy(L, 2);
+
+  p    = (PBYTE)luacwrap_mobj_getbaseptr(L, 1);
+  size = luacwrap_type_size(desc);
+
+  if (luacwrap_type_hasrefs(L, desc))
+  {
+    if (LUACWRAP_REFS_ZERO == policy)
+    {
+      // clear members within a copy
+      PBYTE scratch = (PBYTE)lua_newuserdata(L, size);
+      memcpy(scratch, p, size);
+      luacwrap_applyrefpolicy(L, desc, scratch, policy);
+      lua_pushlstring(L, (const char*)scratch, size);
+      lua_remove(L, -2);
+
+      LUASTACK_CLEAN(L, 1);
+      return 1;
+    }
+    luacwrap_applyrefpolicy(L, desc, p, policy);
+  }
+
+  lua_pushlstring(L, (const char*)p, size);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Check that a string holds count objects of the given size starting
+  at the byte offset given at stack index offsetidx.
+
+  @return pointer to the first object within the string
+
+*/////////////////////////////////////////////////////////////////////////
+static const char* serialize_checkbytes( lua_State*   L
+                                       , int          offsetidx
+                                       , size_t       size
+                                       , lua_Integer* count)
+{
+  size_t      len;
+  const char* s      = luaL_checklstring(L, 2, &len);
+  lua_Integer offset = luaL_optinteger(L, offsetidx, 0);
+
+  luaL_argcheck(L, (offset >= 0) && ((size_t)offset <= len), offsetidx, "offset out of range");
+
+  if (0 == size)
+  {
+    luaL_error(L, "luacwrap: type has no size");
+  }
+
+  // determine number of complete objects if not given
+  if (*count < 0)
+  {
+    *count = (lua_Integer)((len - (size_t)offset) / size);
+  }
+
+  if (((size_t)*count > (len - (size_t)offset) / size))
+  {
+    luaL_error( L
+              , "luacwrap: string too short (%d bytes needed at offset %d, got %d)"
+              , (int)(*count * size)
+              , (int)offset
+              , (int)(len - (size_t)offset));
+  }
+  return s + offset;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements TYPE:frombytes(s [, offset [, policy]]). Creates a new
+  boxed object from the raw memory stored within a string.
+
+  Parameters on lua stack:
+    - self    (type descriptor)
+    - string
+    - byte offset within string (optional, default 0)
+    - policy  (optional, "zero" or "reject")
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_type_frombytes(lua_State* L)
+{
+  luacwrap_Type* desc;
+  const char*    src;
+  size_t         size;
+  lua_Integer    count = 1;
+  int            policy;
+  PBYTE          p;
+
+  LUASTACK_SET(L);
+
+  desc   = serialize_checktype(L, "frombytes");
+  size   = luacwrap_type_size(desc);
+  src    = serialize_checkbytes(L, 3, size, &count);
+  policy = luacwrap_checkrefpolicy(L, 4);
+
+  p = (PBYTE)luacwrap_pushallocobj(L, desc, LUACWRAP_NOINIT, 0);
+  memcpy(p, src, size);
+
+  if (luacwrap_type_hasrefs(L, desc))
+  {
+    luacwrap_applyrefpolicy(L, desc, p, policy);
+  }
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements TYPE:tobytesmany(objs [, policy]). Concatenates the raw
+  memory of an array of objects of the type into a single string.
+
+  Parameters on lua stack:
+    - self    (type descriptor)
+    - array of objects
+    - policy  (optional, "zero" or "reject")
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_type_tobytesmany(lua_State* L)
+{
+  luacwrap_Type* desc;
+  size_t         size;
+  int            policy;
+  int            hasrefs;
+  int            count;
+  int            idx;
+  PBYTE          scratch;
+  luaL_Buffer    b;
+
+  LUASTACK_SET(L);
+
+  desc   = serialize_checktype(L, "tobytesmany");
+  size   = luacwrap_type_size(desc);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  policy = luacwrap_checkrefpolicy(L, 3);
+
+#if (LUA_VERSION_NUM > 501)
+  count = (int)lua_rawlen(L, 2);
+#else
+  count = (int)lua_objlen(L, 2);
+#endif
+
+  hasrefs = luacwrap_type_hasrefs(L, desc);
+  scratch = (PBYTE)lua_newuserdata(L, hasrefs ? size : 1);
+
+  luaL_buffinit(L, &b);
+  for (idx = 1; idx <= count; ++idx)
+  {
+    PBYTE p;
+
+    lua_rawgeti(L, 2, idx);
+    if (desc != luacwrap_getdescriptor(L, -1))
+    {
+      luaL_error(L, "luacwrap: element %d is not of type %s", idx, desc->name);
+    }
+    p = (PBYTE)luacwrap_mobj_getbaseptr(L, -1);
+    lua_pop(L, 1);
+
+    // object is still referenced by the array
+    serialize_addobj(L, &b, desc, p, size, hasrefs, scratch, policy);
+  }
+  luaL_pushresult(&b);
+
+  // drop scratch memory
+  lua_remove(L, -2);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements TYPE:frombytesmany(s [, offset [, count [, policy]]]).
+  Creates an array of boxed objects from consecutive objects stored
+  within a string.
+
+  Parameters on lua stack:
+    - self    (type descriptor)
+    - string
+    - byte offset within string (optional, default 0)
+    - number of objects (optional, default all complete objects)
+    - policy  (optional, "zero" or "reject")
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_type_frombytesmany(lua_State* L)
+{
+  luacwrap_Type* desc;
+  const char*    src;
+  size_t         size;
+  lua_Integer    count;
+  lua_Integer    idx;
+  int            policy;
+  int            hasrefs;
+
+  LUASTACK_SET(L);
+
+  desc  = serialize_checktype(L, "frombytesmany");
+  size  = luacwrap_type_size(desc);
+  count = luaL_optinteger(L, 4, -1);
+  luaL_argcheck(L, lua_isnoneornil(L, 4) || (count >= 0), 4, "number of objects must not be negative");
+  src    = serialize_checkbytes(L, 3, size, &count);
+  policy = luacwrap_checkrefpolicy(L, 5);
+
+  hasrefs = luacwrap_type_hasrefs(L, desc);
+
+  lua_createtable(L, (int)count, 0);
+  for (idx = 0; idx < count; ++idx)
+  {
+    PBYTE p = (PBYTE)luacwrap_pushallocobj(L, desc, LUACWRAP_NOINIT, 0);
+    memcpy(p, src + idx * size, size);
+    if (hasrefs)
+    {
+      luacwrap_applyrefpolicy(L, desc, p, policy);
+    }
+    lua_rawseti(L, -2, (int)(idx + 1));
+  }
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Binary serialization of wrapped objects
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+//
+// policies for pointer and reference members ($ptr, $ref, $wref) 
+// which are meaningless outside of the current lua state
+//
+#define LUACWRAP_REFS_ZERO    0     // zero pointer/reference members
+#define LUACWRAP_REFS_REJECT  1     // raise an error if they are set
+
+//
+// get policy for pointer and reference members from an optional
+// string argument ("zero" or "reject", default is "zero")
+//
+int luacwrap_checkrefpolicy   ( lua_State*        L
+                              , int               idx);
+
+//
+// check if a type contains pointer or reference members
+//
+int luacwrap_type_hasrefs     ( lua_State*        L
+                              , luacwrap_Type*    desc);
+
+//
+// apply policy to the pointer and reference members of an object
+// memory (returns the number of non zero members)
+//
+int luacwrap_applyrefpolicy   ( lua_State*        L
+                              , luacwrap_Type*    desc
+                              , PBYTE             p
+                              , int               policy);
+
+//
+// implements obj:tobytes([policy])
+//
+int luacwrap_tobytes          ( lua_State*        L);
+
+//
+// implements TYPE:frombytes(s [, offset [, policy]])
+//
+int luacwrap_type_frombytes   ( lua_State*        L);
+
+//
+// implements TYPE:tobytesmany(objs [, policy])
+//
+int luacwrap_type_tobytesmany ( lua_State*        L);
+
+//
+// implements TYPE:frombytesmany(s [, offset [, count [, policy]]])
+//
+int luacwrap_type_frombytesmany(lua_State*        L);
@@ -0,0 +1,290 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Per type object and memory statistics.
+
+  Counters are kept in a process wide hash table keyed by the
+  address of the type descriptor. The last looked up entry is cached,
+  so consecutive updates of the same type are cheap. The counters are
+  not synchronized, when lua states are used from different threads
+  the numbers are only approximations.
+
+  Anonymous array types are created on the fly (e.g. by select() or
+  mmap()) and their descriptors are collected with them, so they share
+  a single entry instead of adding an entry per descriptor.
+
+  Statistics are reported per type name (e.g. all anonymous arrays
+  are reported as "$array").
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "luaaux.h"
+#include "stats.h"
+
+#ifdef LUACWRAP_STATS
+
+// initial number of slots of the statistics table
+#define LUACWRAP_STATS_INITIALSLOTS   64
+
+typedef struct luacwrap_StatsEntry
+{
+  const luacwrap_Type*  desc;       // type descriptor (NULL = empty slot)
+  const char*           name;       // copy of type name (descriptor 
+                                    // and its name may be freed)
+  luacwrap_TypeStats    stats;      // counters
+} luacwrap_StatsEntry;
+
+static luacwrap_StatsEntry* s_slots    = NULL;
+static size_t               s_capacity = 0;
+static size_t               s_count    = 0;
+static luacwrap_StatsEntry* s_last     = NULL;
+
+// used for objects without descriptor or if the statistics
+// table could not be allocated
+static luacwrap_StatsEntry  s_overflow;
+
+// shared by all anonymous array types
+static luacwrap_StatsEntry  s_anonarrays;
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  hash of a type descriptor address
+
+*/////////////////////////////////////////////////////////////////////////
+static size_t stats_hash(const luacwrap_Type* desc)
+{
+  return (size_t)(((size_t)desc >> 3) * 2654435761u);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  find slot of a type descriptor (or the empty slot to insert it)
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_StatsEntry* stats_findslot( luacwrap_StatsEntry*  slots
+                                          , size_t                capacity
+                                          , const luacwrap_Type*  desc)
+{
+  size_t mask = capacity - 1;
+  size_t pos  = stats_hash(desc) & mask;
+
+  while ((NULL != slots[pos].desc) && (desc != slots[pos].desc))
+  {
+    pos = (pos + 1) & mask;
+  }
+  return &slots[pos];
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  copy a type name (kept until the process ends)
+
+*/////////////////////////////////////////////////////////////////////////
+static const char* stats_copyname(const char* name)
+{
+  char* result = (char*)malloc(strlen(name) + 1);
+  if (NULL == result)
+  {
+    return "?";
+  }
+  strcpy(result, name);
+  return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  doubles the size of the statistics table
+
+  @return 0 if allocation failed
+
+*/////////////////////////////////////////////////////////////////////////
+static int stats_grow(void)
+{
+  luacwrap_StatsEntry* slots;
+  size_t capacity;
+  size_t idx;
+
+  capacity = s_capacity ? (s_capacity * 2) : LUACWRAP_STATS_INITIALSLOTS;
+  slots = (luacwrap_StatsEntry*)calloc(capacity, sizeof(luacwrap_StatsEntry));
+  if (NULL == slots)
+  {
+    return 0;
+  }
+
+  // rehash entries
+  for (idx = 0; idx < s_capacity; ++idx)
+  {
+    if (NULL != s_slots[idx].desc)
+    {
+      *stats_findslot(slots, capacity, s_slots[idx].desc) = s_slots[idx];
+    }
+  }
+
+  free(s_slots);
+  s_slots    = slots;
+  s_capacity = capacity;
+  s_last     = NULL;
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Get the statistics entry of a type. Creates the entry on first use.
+
+  @param[in]  desc  type descriptor
+
+  @return counters of the type
+
+*/////////////////////////////////////////////////////////////////////////
+luacwrap_TypeStats* luacwrap_stats_get(const luacwrap_Type* desc)
+{
+  luacwrap_StatsEntry* entry;
+
+  if ((NULL != s_last) && (desc == s_last->desc))
+  {
+    return &s_last->stats;
+  }
+
+  // objects without descriptor
+  if (NULL == desc)
+  {
+    return &s_overflow.stats;
+  }
+
+  // anonymous arrays
+  if (g_nameAnonArray == desc->name)
+  {
+    s_anonarrays.name = g_nameAnonArray;
+    return &s_anonarrays.stats;
+  }
+
+  // keep load factor below 1/2
+  if ((2 * (s_count + 1) > s_capacity) && !stats_grow())
+  {
+    return &s_overflow.stats;
+  }
+
+  entry = stats_findslot(s_slots, s_capacity, desc);
+  if (NULL == entry->desc)
+  {
+    entry->desc = desc;
+    entry->name = stats_copyname(desc->name);
+    ++s_count;
+  }
+
+  s_last = entry;
+  return &entry->stats;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  adds a counter value to field of the table on top of the stack
+
+*/////////////////////////////////////////////////////////////////////////
+static void stats_addfield(lua_State* L, const char* name, size_t value)
+{
+  lua_Number n;
+
+  lua_getfield(L, -1, name);
+  n = lua_tonumber(L, -1);
+  lua_pop(L, 1);
+
+  lua_pushnumber(L, n + (lua_Number)value);
+  lua_setfield(L, -2, name);
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Get statistics of a type.
+
+  @param[in]  desc    type descriptor
+  @param[out] stats   receives the counters
+
+  @return 1 if statistics are collected, otherwise 0
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_getstats(luacwrap_Type* desc, luacwrap_TypeStats* stats)
+{
+#ifdef LUACWRAP_STATS
+  *stats = *luacwrap_stats_get(desc);
+  return 1;
+#else
+  memset(stats, 0, sizeof(luacwrap_TypeStats));
+  return 0;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements luacwrap.stats().
+
+  Return values on lua stack
+    - table indexed by type name with tables of counters
+      (created, alive, bytes, embedded, envtables, refs, unrefs, 
+      references) or nil if not compiled with LUACWRAP_STATS
+    - error message (if statistics are not available)
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_stats(lua_State* L)
+{
+#ifdef LUACWRAP_STATS
+  size_t idx;
+
+  LUASTACK_SET(L);
+
+  lua_newtable(L);
+  for (idx = 0; idx <= s_capacity; ++idx)
+  {
+    // the entry of anonymous arrays follows the table entries
+    const luacwrap_StatsEntry* entry = (idx < s_capacity) ? &s_slots[idx] : &s_anonarrays;
+
+    if ((NULL != entry->desc) || (NULL != entry->name))
+    {
+      // get/create counters of type name
+      lua_getfield(L, -1, entry->name);
+      if (lua_isnil(L, -1))
+      {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, entry->name);
+      }
+
+      stats_addfield(L, "created"   , entry->stats.created);
+      stats_addfield(L, "alive"     , entry->stats.alive);
+      stats_addfield(L, "bytes"     , entry->stats.bytes);
+      stats_addfield(L, "embedded"  , entry->stats.embedded);
+      stats_addfield(L, "envtables" , entry->stats.envtables);
+      stats_addfield(L, "refs"      , entry->stats.refs);
+      stats_addfield(L, "unrefs"    , entry->stats.unrefs);
+      stats_addfield(L, "references", entry->stats.references);
+      lua_pop(L, 1);
+    }
+  }
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+#else
+  lua_pushnil(L);
+  lua_pushstring(L, "statistics not available (compile with LUACWRAP_STATS)");
+  return 2;
+#endif
+}
@@ -0,0 +1,50 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Per type object and memory statistics.
+
+  Statistics are only collected if compiled with LUACWRAP_STATS
+  defined. Otherwise the LUACWRAP_STAT_* macros expand to nothing.
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+#ifdef LUACWRAP_STATS
+
+//
+// get the statistics entry of a type (creates it on first use)
+//
+luacwrap_TypeStats* luacwrap_stats_get  (const luacwrap_Type* desc);
+
+#define LUACWRAP_STAT_ADD(desc, counter, n)   (luacwrap_stats_get(desc)->counter += (n))
+#define LUACWRAP_STAT_SUB(desc, counter, n)   (luacwrap_stats_get(desc)->counter -= (n))
+#define LUACWRAP_STAT_INC(desc, counter)      (++luacwrap_stats_get(desc)->counter)
+#define LUACWRAP_STAT_DEC(desc, counter)      (--luacwrap_stats_get(desc)->counter)
+
+#else
+
+#define LUACWRAP_STAT_ADD(desc, counter, n)
+#define LUACWRAP_STAT_SUB(desc, counter, n)
+#define LUACWRAP_STAT_INC(desc, counter)
+#define LUACWRAP_STAT_DEC(desc, counter)
+
+#endif
+
+//
+// get statistics of a type (C interface)
+//
+int luacwrap_getstats           ( luacwrap_Type*        desc
+                                , luacwrap_TypeStats*   stats);
+
+//
+// implements luacwrap.stats()
+//
+int luacwrap_stats              (lua_State* L);
@@ -0,0 +1,858 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Streaming of fixed size records from/to files.
+
+  A reader refills one reusable buffer with large read() calls and
+  returns the records through a single cursor object, which is
+  re-pointed to the next record on each step. So reading a file does
+  not create garbage proportional to its size. The cursor is only
+  valid until the next step, use cursor:__dup() to keep a record.
+
+  The buffer is an object of an anonymous array type allocated from
+  luacwrap.external, the cursor is an embedded object within it.
+
+  A writer copies small objects into its buffer and writes it in large
+  blocks. Large objects are not copied but gathered together with the
+  buffered data and written with a single writev() call. Pointer and
+  reference members are written as zero (same as obj:tobytes()).
+
+*/////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include "luaaux.h"
+#include "external.h"
+#include "serialize.h"
+#include "stream.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#define stream_open(path)           _open(path, _O_RDONLY | _O_BINARY)
+#define stream_create(path, flag)   _open(path, _O_WRONLY | _O_CREAT | _O_BINARY | (flag ? _O_APPEND : _O_TRUNC), _S_IREAD | _S_IWRITE)
+#define stream_read(fd, buf, size)  _read(fd, buf, (unsigned int)(size))
+#define stream_close(fd)            _close(fd)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#define stream_open(path)           open(path, O_RDONLY)
+#define stream_create(path, flag)   open(path, O_WRONLY | O_CREAT | (flag ? O_APPEND : O_TRUNC), 0666)
+#define stream_read(fd, buf, size)  read(fd, buf, size)
+#define stream_close(fd)            close(fd)
+#endif
+
+// default number of records per buffer
+#define STREAM_DEFAULT_BATCH    1024
+
+// default buffer size of writers
+#define STREAM_DEFAULT_BUFSIZE  65536
+
+// alignment of stream buffers
+#define STREAM_BUFFER_ALIGN     LUACWRAP_MAX_ALIGN
+
+// environment slots of reader objects
+#define STREAM_ENV_BUFFER       1
+#define STREAM_ENV_CURSOR       2
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Checks for a reader object which has not been closed.
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_Reader* reader_check(lua_State* L, int idx)
+{
+  luacwrap_Reader* rd;
+
+  rd = (luacwrap_Reader*)luacwrap_toudata(L, idx, (void*)g_mtReader);
+  if (NULL == rd)
+  {
+    luaL_argerror(L, idx, "reader expected");
+  }
+  if (rd->fd < 0)
+  {
+    luaL_error(L, "luacwrap: reader has been closed");
+  }
+  return rd;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Refills the buffer of a reader. The incomplete record at the end of
+  the buffer is moved to the front, then the buffer is filled up to
+  its capacity or the end of the file.
+
+  @return 0 at the end of the file, otherwise 1
+
+*/////////////////////////////////////////////////////////////////////////
+static int reader_fill(lua_State* L, luacwrap_Reader* rd)
+{
+  size_t tail = rd->filled - rd->pos;
+
+  memmove(rd->buffer, rd->buffer + rd->pos, tail);
+  rd->filled = tail;
+  rd->pos    = 0;
+
+  while (rd->filled < rd->capacity)
+  {
+    int n = (int)stream_read(rd->fd, rd->buffer + rd->filled, rd->capacity - rd->filled);
+    if (n < 0)
+    {
+      if (EINTR == errno)
+      {
+        continue;
+      }
+      luaL_error(L, "luacwrap: read failed (%s)", strerror(errno));
+    }
+    if (0 == n)
+    {
+      break;
+    }
+    rd->filled += n;
+  }
+
+  if (rd->filled < rd->elemsize)
+  {
+    if (0 != rd->filled)
+    {
+      luaL_error(L, "luacwrap: file ends with an incomplete record");
+    }
+    return 0;
+  }
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Creates a reader for fixed size records.
+
+  Parameters on lua stack:
+    - path or file descriptor (string or number)
+    - TYPE  (type table of the records)
+    - batch (optional number of records per read, default 1024)
+
+  Return values on lua stack
+    - reader object
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_reader_new(lua_State* L)
+{
+  luacwrap_Type* elemdesc;
+  luacwrap_ArrayType* arrdesc;
+  luacwrap_Allocator* allocator;
+  luacwrap_Reader* rd;
+  lua_Integer batch;
+  size_t elemsize;
+
+  LUASTACK_SET(L);
+
+  if (LUA_TNUMBER != lua_type(L, 1))
+  {
+    luaL_checkstring(L, 1);
+  }
+  luaL_checktype(L, 2, LUA_TTABLE);
+  batch = luaL_optinteger(L, 3, STREAM_DEFAULT_BATCH);
+
+  // get descriptor
+  lua_getfield(L, 2, "$desc");
+  if (lua_isnil(L, -1))
+  {
+    luaL_argerror(L, 2, "type expected");
+  }
+  elemdesc = (luacwrap_Type*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  elemsize = luacwrap_type_size(elemdesc);
+  luaL_argcheck(L, elemsize > 0, 2, "type without size");
+  luaL_argcheck(L, (batch > 0) && ((size_t)batch <= (INT_MAX / elemsize)), 3, "batch size out of range");
+
+  // create reader (closed until the file has been opened)
+  rd = (luacwrap_Reader*)lua_newuserdata(L, sizeof(luacwrap_Reader));
+  rd->fd       = -1;
+  rd->ownsfd   = 0;
+  rd->elemsize = elemsize;
+  rd->capacity = (size_t)batch * elemsize;
+  rd->filled   = 0;
+  rd->pos      = 0;
+  rd->buffer   = NULL;
+  rd->cursor   = NULL;
+
+  lua_pushlightuserdata(L, (void*)g_mtReader);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  assert(lua_istable(L, -1));
+  lua_setmetatable(L, -2);
+
+  lua_createtable(L, 2, 0);
+
+  // create buffer object from external memory
+  getmoduletable(L);
+  lua_getfield(L, -1, "external");
+  allocator = luacwrap_toallocator(L, -1);
+  if (NULL == allocator)
+  {
+    luaL_error(L, "luacwrap: luacwrap.external is not an allocator");
+  }
+  rd->buffer = (PBYTE)luacwrap_allocator_pushobj(L, allocator, rd->capacity, STREAM_BUFFER_ALIGN);
+  lua_replace(L, -3);
+  lua_pop(L, 1);
+
+  // set _ENV[$desc] and _ENV[$methods] of buffer object
+  arrdesc = luacwrap_pushanonarraytype(L, elemdesc, (int)batch);
+  lua_createtable(L, 0, 2);
+  lua_pushvalue(L, -2);
+  lua_setfield(L, -2, "$methods");
+  lua_pushlightuserdata(L, arrdesc);
+  lua_setfield(L, -2, "$desc");
+  luacwrap_setenvironment(L, -3);
+  lua_pop(L, 1);
+
+  // create cursor on the buffer object
+  luacwrap_pushembedded(L, -1, 0, elemdesc);
+  rd->cursor = (luacwrap_EmbeddedObject*)lua_touserdata(L, -1);
+  lua_rawseti(L, -3, STREAM_ENV_CURSOR);
+  lua_rawseti(L, -2, STREAM_ENV_BUFFER);
+  luacwrap_setenvironment(L, -2);
+
+  // open the file
+  if (LUA_TNUMBER == lua_type(L, 1))
+  {
+    rd->fd = (int)lua_tointeger(L, 1);
+  }
+  else
+  {
+    const char* path = lua_tostring(L, 1);
+
+    rd->fd = stream_open(path);
+    if (rd->fd < 0)
+    {
+      luaL_error(L, "luacwrap: cannot open file <%s> (%s)", path, strerror(errno));
+    }
+    rd->ownsfd = 1;
+  }
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements reader:next(). Re-points the cursor to the next record.
+
+  Parameters on lua stack:
+    - self  (reader)
+
+  Return values on lua stack
+    - cursor (or nil at the end of the file)
+
+*/////////////////////////////////////////////////////////////////////////
+static int reader_next(lua_State* L)
+{
+  luacwrap_Reader* rd = reader_check(L, 1);
+
+  if ((rd->pos + rd->elemsize > rd->filled) && !reader_fill(L, rd))
+  {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  rd->cursor->offset = (unsigned int)rd->pos;
+  rd->pos += rd->elemsize;
+
+  luacwrap_getenvironment(L, 1);
+  lua_rawgeti(L, -1, STREAM_ENV_CURSOR);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements reader:records(). Returns an iterator over the remaining
+  records for use in a generic for loop:
+
+    for rec in reader:records() do ... end
+
+*/////////////////////////////////////////////////////////////////////////
+static int reader_records(lua_State* L)
+{
+  reader_check(L, 1);
+
+  lua_pushcfunction(L, reader_next);
+  lua_pushvalue(L, 1);
+  return 2;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements reader:close() and the __gc metamethod. Closes the file
+  if it has been opened by the reader.
+
+*/////////////////////////////////////////////////////////////////////////
+static int reader_close(lua_State* L)
+{
+  luacwrap_Reader* rd;
+
+  rd = (luacwrap_Reader*)luacwrap_toudata(L, 1, (void*)g_mtReader);
+  if (NULL == rd)
+  {
+    luaL_argerror(L, 1, "reader expected");
+  }
+  if (rd->ownsfd && (rd->fd >= 0))
+  {
+    stream_close(rd->fd);
+  }
+  rd->fd = -1;
+  return 0;
+}
+
+// metatable of reader objects
+luaL_Reg g_mtReader[ ] = {
+  { "next"    , reader_next     },
+  { "records" , reader_records  },
+  { "close"   , reader_close    },
+  { "__gc"    , reader_close    },
+  { NULL, NULL }
+};
+
+// open modes of writers
+static const char* const s_writerModes[] = { "w", "a", NULL };
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Drops gather entries left behind by an aborted write() call. They 
+  may point to objects which have been collected meanwhile. Data 
+  copied into the buffer is kept.
+
+*/////////////////////////////////////////////////////////////////////////
+static void writer_dropgathered(luacwrap_Writer* wr)
+{
+  // buffer segments of the gather list are the start of the buffer
+  wr->niov    = 0;
+  wr->segment = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Checks for a writer object which has not been closed.
+
+*/////////////////////////////////////////////////////////////////////////
+static luacwrap_Writer* writer_check(lua_State* L, int idx)
+{
+  luacwrap_Writer* wr;
+
+  wr = (luacwrap_Writer*)luacwrap_toudata(L, idx, (void*)g_mtWriter);
+  if (NULL == wr)
+  {
+    luaL_argerror(L, idx, "writer expected");
+  }
+  if (wr->fd < 0)
+  {
+    luaL_error(L, "luacwrap: writer has been closed");
+  }
+  writer_dropgathered(wr);
+  return wr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Writes the pending gather entries of a writer (one writev() call 
+  for all entries, one write() call per entry on win32).
+
+  @return 0 or error number
+
+*/////////////////////////////////////////////////////////////////////////
+static int writer_writeiov(luacwrap_Writer* wr)
+{
+  luacwrap_IoVec* iov = wr->iov;
+  int n = wr->niov;
+
+  while (n > 0)
+  {
+#ifdef _WIN32
+    int written = _write(wr->fd, iov->base, (unsigned int)iov->len);
+#else
+    struct iovec vec[LUACWRAP_WRITER_MAXIOV];
+    ssize_t written;
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+      vec[i].iov_base = iov[i].base;
+      vec[i].iov_len  = iov[i].len;
+    }
+    written = writev(wr->fd, vec, n);
+#endif
+    ++wr->syscalls;
+
+    if (written < 0)
+    {
+      if (EINTR == errno)
+      {
+        continue;
+      }
+      return errno;
+    }
+    wr->bytes += (size_t)written;
+
+    // skip written entries, adjust partially written one
+    while ((n > 0) && ((size_t)written >= iov->len))
+    {
+      written -= iov->len;
+      ++iov;
+      --n;
+    }
+    if (n > 0)
+    {
+      iov->base += written;
+      iov->len  -= (size_t)written;
+    }
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Writes buffered data and pending gather entries of a writer. The 
+  buffer is empty afterwards, also if writing failed.
+
+  @return 0 or error number
+
+*/////////////////////////////////////////////////////////////////////////
+static int writer_flush(luacwrap_Writer* wr)
+{
+  int err;
+
+  if (wr->used > wr->segment)
+  {
+    wr->iov[wr->niov].base = wr->buffer + wr->segment;
+    wr->iov[wr->niov].len  = wr->used - wr->segment;
+    ++wr->niov;
+  }
+  err = writer_writeiov(wr);
+
+  wr->niov    = 0;
+  wr->used    = 0;
+  wr->segment = 0;
+  return err;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Same as writer_flush() but raises an error if writing failed.
+
+*/////////////////////////////////////////////////////////////////////////
+static void writer_checkflush(lua_State* L, luacwrap_Writer* wr)
+{
+  int err = writer_flush(wr);
+  if (0 != err)
+  {
+    luaL_error(L, "luacwrap: write failed (%s)", strerror(err));
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Adds memory to the data written by a writer. Large blocks are 
+  gathered, the others are copied into the buffer. 
+
+  @param[in]  L       lua state
+  @param[in]  wr      writer
+  @param[in]  p       memory to write (has to stay valid until the
+                      end of the current write() call)
+  @param[in]  size    number of bytes
+  @param[in]  refdesc type descriptor if pointer and reference 
+                      members have to be cleared (or NULL)
+
+*/////////////////////////////////////////////////////////////////////////
+static void writer_add(lua_State* L, luacwrap_Writer* wr, PBYTE p, size_t size, luacwrap_Type* refdesc)
+{
+  if (0 == size)
+  {
+    return;
+  }
+
+  if ((NULL == refdesc) && (size >= wr->capacity / 2))
+  {
+    // keep room for the buffer segments in front of and behind p
+    if (wr->niov + 3 > LUACWRAP_WRITER_MAXIOV)
+    {
+      writer_checkflush(L, wr);
+    }
+    if (wr->used > wr->segment)
+    {
+      wr->iov[wr->niov].base = wr->buffer + wr->segment;
+      wr->iov[wr->niov].len  = wr->used - wr->segment;
+      ++wr->niov;
+      wr->segment = wr->used;
+    }
+    wr->iov[wr->niov].base = p;
+    wr->iov[wr->niov].len  = size;
+    ++wr->niov;
+  }
+  else
+  {
+    if (size > wr->capacity - wr->used)
+    {
+      writer_checkflush(L, wr);
+    }
+    if (size > wr->capacity)
+    {
+      luaL_error(L, "luacwrap: object with pointer or reference members exceeds the writer buffer");
+    }
+    memcpy(wr->buffer + wr->used, p, size);
+    if (NULL != refdesc)
+    {
+      luacwrap_applyrefpolicy(L, refdesc, wr->buffer + wr->used, LUACWRAP_REFS_ZERO);
+    }
+    wr->used += size;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Checks that a value can be written by a writer. write() checks all 
+  values before adding any of them, so that no gathered memory is 
+  left behind by an argument error.
+
+*/////////////////////////////////////////////////////////////////////////
+static void writer_checkvalue(lua_State* L, int idx, int argidx)
+{
+  switch (lua_type(L, idx))
+  {
+    case LUA_TSTRING:
+      break;
+    case LUA_TUSERDATA:
+      if (NULL == luacwrap_getdescriptor(L, idx))
+      {
+        luaL_argerror(L, argidx, "wrapped object expected");
+      }
+      break;
+    default:
+      luaL_argerror(L, argidx, "wrapped object, string or table expected");
+      break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Adds a wrapped object or a string to the data written by a writer.
+
+*/////////////////////////////////////////////////////////////////////////
+static void writer_addvalue(lua_State* L, luacwrap_Writer* wr, int idx, int argidx)
+{
+  switch (lua_type(L, idx))
+  {
+    case LUA_TSTRING:
+      {
+        size_t len;
+        const char* s = lua_tolstring(L, idx, &len);
+
+        writer_add(L, wr, (PBYTE)s, len, NULL);
+      }
+      break;
+    case LUA_TUSERDATA:
+      {
+        luacwrap_Type* desc = luacwrap_getdescriptor(L, idx);
+        if (NULL == desc)
+        {
+          luaL_argerror(L, argidx, "wrapped object expected");
+        }
+        if (desc != wr->lastdesc)
+        {
+          wr->lastdesc = desc;
+          wr->lastrefs = luacwrap_type_hasrefs(L, desc);
+        }
+        writer_add( L
+                  , wr
+                  , (PBYTE)luacwrap_mobj_getbaseptr(L, idx)
+                  , (size_t)luacwrap_type_size(desc)
+                  , wr->lastrefs ? desc : NULL);
+      }
+      break;
+    default:
+      {
+        luaL_argerror(L, argidx, "wrapped object, string or table expected");
+      }
+      break;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Creates a writer.
+
+  Parameters on lua stack:
+    - path or file descriptor (string or number)
+    - bufsize (optional buffer size in bytes, default 64 KB)
+    - mode    (optional "w" = truncate (default) or "a" = append)
+
+  Return values on lua stack
+    - writer object
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_writer_new(lua_State* L)
+{
+  luacwrap_Writer* wr;
+  lua_Integer bufsize;
+  int append;
+
+  LUASTACK_SET(L);
+
+  if (LUA_TNUMBER != lua_type(L, 1))
+  {
+    luaL_checkstring(L, 1);
+  }
+  bufsize = luaL_optinteger(L, 2, STREAM_DEFAULT_BUFSIZE);
+  append  = luaL_checkoption(L, 3, "w", s_writerModes);
+  luaL_argcheck(L, (bufsize > 0) && (bufsize <= INT_MAX), 2, "buffer size out of range");
+
+  // create writer with aligned buffer behind it (closed until the file has been opened)
+  wr = (luacwrap_Writer*)lua_newuserdata(L, sizeof(luacwrap_Writer) + (size_t)bufsize + STREAM_BUFFER_ALIGN - 1);
+  wr->fd        = -1;
+  wr->ownsfd    = 0;
+  wr->capacity  = (size_t)bufsize;
+  wr->used      = 0;
+  wr->segment   = 0;
+  wr->niov      = 0;
+  wr->bytes     = 0;
+  wr->syscalls  = 0;
+  wr->lastdesc  = NULL;
+  wr->lastrefs  = 0;
+  wr->buffer    = (PBYTE)(((size_t)(wr + 1) + STREAM_BUFFER_ALIGN - 1) & ~(size_t)(STREAM_BUFFER_ALIGN - 1));
+
+  lua_pushlightuserdata(L, (void*)g_mtWriter);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  assert(lua_istable(L, -1));
+  lua_setmetatable(L, -2);
+
+  // open the file
+  if (LUA_TNUMBER == lua_type(L, 1))
+  {
+    wr->fd = (int)lua_tointeger(L, 1);
+  }
+  else
+  {
+    const char* path = lua_tostring(L, 1);
+
+    wr->fd = stream_create(path, append);
+    if (wr->fd < 0)
+    {
+      luaL_error(L, "luacwrap: cannot open file <%s> (%s)", path, strerror(errno));
+    }
+    wr->ownsfd = 1;
+  }
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements writer:write(...). Writes the memory of wrapped objects
+  (boxed or embedded records, arrays and buffers), strings and tables
+  (sequences) of them.
+
+  Parameters on lua stack:
+    - self  (writer)
+    - objects to write
+
+  Return values on lua stack
+    - self  (writer)
+
+*/////////////////////////////////////////////////////////////////////////
+static int writer_write(lua_State* L)
+{
+  luacwrap_Writer* wr = writer_check(L, 1);
+  int top = lua_gettop(L);
+  int idx;
+
+  // descriptors are cached only during a call
+  wr->lastdesc = NULL;
+
+  // check all values before anything is gathered
+  for (idx = 2; idx <= top; ++idx)
+  {
+    if (lua_istable(L, idx))
+    {
+#if (LUA_VERSION_NUM > 501)
+      int n = (int)lua_rawlen(L, idx);
+#else
+      int n = (int)lua_objlen(L, idx);
+#endif
+      int elem;
+
+      for (elem = 1; elem <= n; ++elem)
+      {
+        lua_rawgeti(L, idx, elem);
+        writer_checkvalue(L, -1, idx);
+        lua_pop(L, 1);
+      }
+    }
+    else
+    {
+      writer_checkvalue(L, idx, idx);
+    }
+  }
+
+  for (idx = 2; idx <= top; ++idx)
+  {
+    if (lua_istable(L, idx))
+    {
+#if (LUA_VERSION_NUM > 501)
+      int n = (int)lua_rawlen(L, idx);
+#else
+      int n = (int)lua_objlen(L, idx);
+#endif
+      int elem;
+
+      // elements are kept alive by the table until the gathered memory is written
+      for (elem = 1; elem <= n; ++elem)
+      {
+        lua_rawgeti(L, idx, elem);
+        writer_addvalue(L, wr, -1, idx);
+        lua_pop(L, 1);
+      }
+    }
+    else
+    {
+      writer_addvalue(L, wr, idx, idx);
+    }
+  }
+
+  // gathered memory is only valid during this call
+  if (wr->niov > 0)
+  {
+    writer_checkflush(L, wr);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements writer:flush(). Writes the buffered data.
+
+*/////////////////////////////////////////////////////////////////////////
+static int writer_flushmethod(lua_State* L)
+{
+  writer_checkflush(L, writer_check(L, 1));
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements writer:stats().
+
+  Return values on lua stack
+    - number of written bytes
+    - number of write system calls
+
+*/////////////////////////////////////////////////////////////////////////
+static int writer_stats(lua_State* L)
+{
+  luacwrap_Writer* wr;
+
+  wr = (luacwrap_Writer*)luacwrap_toudata(L, 1, (void*)g_mtWriter);
+  if (NULL == wr)
+  {
+    luaL_argerror(L, 1, "writer expected");
+  }
+
+  lua_pushinteger(L, (lua_Integer)wr->bytes);
+  lua_pushinteger(L, (lua_Integer)wr->syscalls);
+  return 2;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements writer:close(). Writes the buffered data and closes the
+  file if it has been opened by the writer.
+
+*/////////////////////////////////////////////////////////////////////////
+static int writer_close(lua_State* L)
+{
+  luacwrap_Writer* wr;
+  int err = 0;
+
+  wr = (luacwrap_Writer*)luacwrap_toudata(L, 1, (void*)g_mtWriter);
+  if (NULL == wr)
+  {
+    luaL_argerror(L, 1, "writer expected");
+  }
+  if (wr->fd >= 0)
+  {
+    writer_dropgathered(wr);
+    err = writer_flush(wr);
+    if (wr->ownsfd)
+    {
+      stream_close(wr->fd);
+    }
+    wr->fd = -1;
+  }
+  if (0 != err)
+  {
+    luaL_error(L, "luacwrap: write failed (%s)", strerror(err));
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements the __gc metamethod of writers. Same as close() but 
+  ignores write errors.
+
+*/////////////////////////////////////////////////////////////////////////
+static int writer_gc(lua_State* L)
+{
+  luacwrap_Writer* wr = (luacwrap_Writer*)lua_touserdata(L, 1);
+
+  if (wr->fd >= 0)
+  {
+    writer_dropgathered(wr);
+    writer_flush(wr);
+    if (wr->ownsfd)
+    {
+      stream_close(wr->fd);
+    }
+    wr->fd = -1;
+  }
+  return 0;
+}
+
+// metatable of writer objects
+luaL_Reg g_mtWriter[ ] = {
+  { "write"   , writer_write        },
+  { "flush"   , writer_flushmethod  },
+  { "stats"   , writer_stats        },
+  { "close"   , writer_close        },
+  { "__gc"    , writer_gc           },
+  { NULL, NULL }
+};
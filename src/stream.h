@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// LuaCwrap - Lua <-> C 
+// Copyright (C) 2011-2021 Klaus Oberhofer. See Copyright Notice in luacwrap.h
+//
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Streaming of fixed size records from/to files
+
+*/////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "luacwrap_int.h"
+
+//
+// record reader
+//
+typedef struct luacwrap_Reader
+{
+  int                       fd;         // file descriptor (-1 if closed)
+  int                       ownsfd;     // close file descriptor on close()
+  size_t                    elemsize;   // size of a record
+  size_t                    capacity;   // size of the buffer
+  size_t                    filled;     // number of valid bytes within the buffer
+  size_t                    pos;        // buffer position of the next record
+  PBYTE                     buffer;     // buffer memory (held by buffer object)
+  luacwrap_EmbeddedObject*  cursor;     // cursor object (re-pointed on each step)
+} luacwrap_Reader;
+
+// maximum number of gather entries of a writer
+#define LUACWRAP_WRITER_MAXIOV  16
+
+//
+// gather entry of a writer
+//
+typedef struct luacwrap_IoVec
+{
+  PBYTE                     base;       // start of memory
+  size_t                    len;        // number of bytes
+} luacwrap_IoVec;
+
+//
+// record writer
+//
+typedef struct luacwrap_Writer
+{
+  int                       fd;         // file descriptor (-1 if closed)
+  int                       ownsfd;     // close file descriptor on close()
+  size_t                    capacity;   // size of the buffer
+  size_t                    used;       // number of valid bytes within the buffer
+  size_t                    segment;    // start of the buffer part not yet gathered
+  int                       niov;       // number of pending gather entries
+  size_t                    bytes;      // number of written bytes
+  size_t                    syscalls;   // number of write system calls
+  luacwrap_Type*            lastdesc;   // type of the last written object
+  int                       lastrefs;   // lastdesc has pointer/reference members
+  PBYTE                     buffer;     // buffer memory (behind the writer)
+  luacwrap_IoVec            iov[LUACWRAP_WRITER_MAXIOV];
+} luacwrap_Writer;
+
+//
+// implements luacwrap.reader(path_or_fd, TYPE [, batch])
+//
+int luacwrap_reader_new           ( lua_State*        L);
+
+//
+// implements luacwrap.writer(path_or_fd [, bufsize [, mode]])
+//
+int luacwrap_writer_new           ( lua_State*        L);
+
+// metatable of reader objects
+extern luaL_Reg g_mtReader[];
+
+// metatable of writer objects
+extern luaL_Reg g_mtWriter[];
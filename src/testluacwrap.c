@@ -99,6 +99,40 @@ luacwrap_ArrayType regType_INT32_4 =
   "$i32"
 };
 
+typedef struct 
+{
+  float    x;
+  float    y;
+  float    z;
+  float    w;
+  float    reserved[12];
+} VEC4C;
+
+// member descriptor for VEC4C
+static luacwrap_RecordMember s_memberVEC4C[] =
+{
+  { "x",  offsetof(VEC4C, x),  "$flt" },
+  { "y",  offsetof(VEC4C, y),  "$flt" },
+  { "z",  offsetof(VEC4C, z),  "$flt" },
+  { "w",  offsetof(VEC4C, w),  "$flt" },
+  { NULL, 0 }
+};
+
+// type descriptor for VEC4C, boxed objects are 64 byte aligned
+LUACWRAP_DEFINESTRUCT_ALIGNED(VEC4C, 64)
+
+// array of VEC4C, inherits the alignment of its elements
+luacwrap_ArrayType regType_VEC4C_4 =
+{
+  {
+    LUACWRAP_TC_ARRAY,
+    "VEC4C_4"
+  },
+  4,
+  sizeof(VEC4C),
+  "VEC4C"
+};
+
 
 //////////////////////////////////////////////////////////////////////////
 /**
@@ -328,6 +362,84 @@ int checkInnerStructAccess(lua_State* L)
   return 1;
 }
 
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Returns the alignment of the memory of a given object, means the
+  largest power of two (up to 4096) dividing its base address
+
+  @param[in]  L  pointer lua state
+  
+  @result alignment in bytes
+
+*/////////////////////////////////////////////////////////////////////////
+int getAlignment(lua_State* L)
+{
+  size_t addr;
+  int    align;
+
+  LUASTACK_SET(L);
+
+  addr = (size_t)g_luacwrapiface->mobjgetbaseptr(L, 1);
+
+  align = 1;
+  while ((align < 4096) && (0 == (addr & align)))
+  {
+    align <<= 1;
+  }
+
+  lua_pushinteger(L, align);
+  
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  allocator hooks for external memory used by setAllocator() 
+  (supports the default alignment only)
+
+*/////////////////////////////////////////////////////////////////////////
+static void* testAlloc(void* ud, size_t size, size_t align)
+{
+  ++*(int*)ud;
+  return (align <= 8) ? malloc(size) : NULL;
+}
+
+static void testFree(void* ud, void* ptr, size_t size, size_t align)
+{
+  --*(int*)ud;
+  free(ptr);
+}
+
+static int s_testAllocations;
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Sets the allocator hooks of luacwrap.external
+
+  @param[in]  L  pointer lua state
+
+  Parameters on lua stack:
+    - true to pass the allocation hook (otherwise NULL)
+    - true to pass the release hook (otherwise NULL)
+
+  @result returns number of allocations not released by the hooks
+
+*/////////////////////////////////////////////////////////////////////////
+int setAllocator(lua_State* L)
+{
+  g_luacwrapiface->setallocator( L
+                               , lua_toboolean(L, 1) ? testAlloc : NULL
+                               , lua_toboolean(L, 2) ? testFree  : NULL
+                               , &s_testAllocations);
+
+  lua_pushinteger(L, s_testAllocations);
+  return 1;
+}
+
 static const luaL_Reg testluacwrap_functions[ ] = {
   { "printTESTSTRUCT"   , printTESTSTRUCT },
   { "callwithTESTSTRUCT", callwithTESTSTRUCT },
@@ -335,6 +447,8 @@ static const luaL_Reg testluacwrap_functions[ ] = {
   { "callwithwrappedTESTSTRUCT", callwithwrappedTESTSTRUCT },
   { "callwithRefType", callwithRefType },
   { "checkInnerStructAccess", checkInnerStructAccess },
+  { "getAlignment", getAlignment },
+  { "setAllocator", setAllocator },
   { NULL, NULL }
 };
 
@@ -394,6 +508,8 @@ int luaopen_testluacwrap(lua_State *L)
   g_luacwrapiface->registertype(L, -1, &regType_INNERSTRUCT.hdr);
   g_luacwrapiface->registertype(L, -1, &regType_INT32_4.hdr);
   g_luacwrapiface->registertype(L, -1, &regType_TESTSTRUCT.hdr);
+  g_luacwrapiface->registertype(L, -1, &regType_VEC4C.hdr);
+  g_luacwrapiface->registertype(L, -1, &regType_VEC4C_4.hdr);
   lua_pop(L, 1);
 
   LUASTACK_CLEAN(L, 1);
@@ -53,7 +53,9 @@ function TestTESTSTRUCT:testCreateTESTSTRUCT()
 
     -- check metatable
     assert(nil ~= getmetatable(struct))
-    assert(getTable(getmetatable(struct)) == [[function __index, function __len, function __newindex, function __tostring, userdata getouter]])
+    -- (__gc is only present if compiled with LUACWRAP_STATS)
+    local boxedmt = getTable(getmetatable(struct)):gsub("^function __gc, ", "")
+    assert(boxedmt == [[function __index, function __len, function __newindex, function __tostring, userdata getouter]])
 
     -- check inner struct access
     assert(nil ~= getmetatable(struct.inner))
@@ -435,5 +437,1151 @@ function TestTESTSTRUCT:testRegisterStructType()
     assert(mystruct.member2 == 22)
 end
 
+--
+-- test sorting of arrays
+--
+function TestTESTSTRUCT:testSortArray()
+    -- array of records
+    local type_teststruct6 = luacwrap.registerarray("TESTSTRUCT_6", 6, "TESTSTRUCT")
+    local arr = type_teststruct6:new()
+
+    local u8s  = { 3, 1, 2, 3, 1, 2 }
+    local i32s = { 5, 6, 7, 8, 9, 10 }
+    for idx=1, 6 do
+      arr[idx].u8  = u8s[idx]
+      arr[idx].i32 = i32s[idx]
+      arr[idx].ptr = "ptr" .. i32s[idx]
+    end
+
+    -- sort by multiple keys
+    assert(arr == arr:sort("u8", "-i32"))
+
+    local expected = { {1, 9}, {1, 6}, {2, 10}, {2, 7}, {3, 8}, {3, 5} }
+    for idx=1, 6 do
+      assert(arr[idx].u8  == expected[idx][1])
+      assert(arr[idx].i32 == expected[idx][2])
+      -- pointer references follow their elements
+      assert(arr[idx].ptr == "ptr" .. expected[idx][2])
+    end
+
+    -- stable sort keeps order of equal keys
+    arr:sort("-u8", { stable = true })
+
+    expected = { {3, 8}, {3, 5}, {2, 10}, {2, 7}, {1, 9}, {1, 6} }
+    for idx=1, 6 do
+      assert(arr[idx].u8  == expected[idx][1])
+      assert(arr[idx].i32 == expected[idx][2])
+      assert(arr[idx].ptr == "ptr" .. expected[idx][2])
+    end
+
+    -- sort by char array member
+    local names = { "delta", "alpha", "charlie", "bravo", "echo", "al" }
+    for idx=1, 6 do
+      arr[idx].chararray = names[idx]
+    end
+    arr:sort("chararray")
+    local sorted = { "al", "alpha", "bravo", "charlie", "delta", "echo" }
+    for idx=1, 6 do
+      local str = tostring(arr[idx].chararray)
+      assert(str:sub(1, str:find("\0", 1, true) - 1) == sorted[idx])
+    end
+
+    -- array of basic types is sorted by value
+    local type_double5 = luacwrap.registerarray("double5", 5, "$dbl")
+    local dbls = type_double5:new()
+    local values = { 5, 3, 4, 1, 2 }
+    for idx=1, 5 do
+      dbls[idx] = values[idx]
+    end
+    dbls:sort()
+    for idx=1, 5 do
+      assert(dbls[idx] == idx)
+    end
+    dbls:sort("-")
+    for idx=1, 5 do
+      assert(dbls[idx] == 6 - idx)
+    end
+
+    -- unknown members are rejected
+    lu.assertError(arr.sort, arr, "unknown")
+end
+--
+-- test binary search on sorted arrays
+--
+function TestTESTSTRUCT:testSearchArray()
+    local type_teststruct8 = luacwrap.registerarray("TESTSTRUCT_8", 8, "TESTSTRUCT")
+    local arr = type_teststruct8:new()
+
+    local u32s = { 10, 20, 20, 20, 30, 40, 40, 50 }
+    for idx=1, 8 do
+      arr[idx].u32 = u32s[idx]
+      arr[idx].i16 = -idx
+    end
+
+    lu.assertEquals(arr:lowerbound("u32", 20), 2)
+    lu.assertEquals(arr:upperbound("u32", 20), 5)
+    lu.assertEquals(arr:lowerbound("u32", 25), 5)
+    lu.assertEquals(arr:lowerbound("u32", 5),  1)
+    lu.assertEquals(arr:lowerbound("u32", 60), 9)
+    lu.assertEquals(arr:upperbound("u32", 50), 9)
+    lu.assertEquals(arr:find("u32", 40), 6)
+    lu.assertEquals(arr:find("u32", 35), nil)
+
+    -- descending order
+    lu.assertEquals(arr:lowerbound("-i16", -3), 3)
+    lu.assertEquals(arr:find("-i16", -8), 8)
+
+    -- array of basic types
+    local type_double6 = luacwrap.registerarray("double6", 6, "$dbl")
+    local dbls = type_double6:new()
+    for idx=1, 6 do
+      dbls[idx] = idx * 1.5
+    end
+    lu.assertEquals(dbls:lowerbound(3), 2)
+    lu.assertEquals(dbls:upperbound(3), 3)
+    lu.assertEquals(dbls:find(4.5), 3)
+    lu.assertEquals(dbls:find(4), nil)
+end
+--
+-- test hash index on arrays
+--
+function TestTESTSTRUCT:testIndexArray()
+    local type_teststruct8 = luacwrap.registerarray("TESTSTRUCT_8", 8, "TESTSTRUCT")
+    local arr = type_teststruct8:new()
+
+    for idx=1, 8 do
+      arr[idx].i32 = 1000 - idx * 100
+      arr[idx].chararray = "key" .. idx
+    end
+
+    local byi32 = arr:index("i32")
+    lu.assertEquals(byi32:lookup(900), 1)
+    lu.assertEquals(byi32:lookup(200), 8)
+    lu.assertEquals(byi32:lookup(250), nil)
+    lu.assertEquals(byi32:lookup(200.5), nil)
+
+    local bytes, count, slots = byi32:memory()
+    lu.assertEquals(count, 8)
+    lu.assertEquals(slots, 16)
+    lu.assertTrue(bytes >= slots * 4)
+
+    -- modified elements are not found until inserted
+    arr[3].i32 = -5
+    lu.assertEquals(byi32:lookup(-5), nil)
+    lu.assertEquals(byi32:lookup(700), nil)
+    byi32:insert(3)
+    lu.assertEquals(byi32:lookup(-5), 3)
+
+    -- duplicate keys map to the first element after rebuild
+    arr[5].i32 = -5
+    byi32:rebuild()
+    lu.assertEquals(byi32:lookup(-5), 3)
+    lu.assertEquals(select(2, byi32:memory()), 7)
+
+    -- inserted duplicates stay indexed when the index grows
+    byi32:insert(5)
+    lu.assertEquals(byi32:lookup(-5), 5)
+    for k=1, 6 do
+      arr[1].i32 = 1000 + k
+      byi32:insert(1)
+    end
+    lu.assertEquals(select(3, byi32:memory()), 32)
+    lu.assertEquals(byi32:lookup(-5), 5)
+    lu.assertEquals(byi32:lookup(1006), 1)
+    lu.assertEquals(byi32:lookup(1005), nil)
+    lu.assertEquals(select(2, byi32:memory()), 7)
+
+    -- char array keys
+    local bychars = arr:index("chararray")
+    lu.assertEquals(bychars:lookup("key6"), 6)
+    lu.assertEquals(bychars:lookup("key"), nil)
+    lu.assertEquals(bychars:lookup(string.rep("x", 40)), nil)
+
+    -- arrays of basic types
+    local type_u16_5 = luacwrap.registerarray("u16_5", 5, "$u16")
+    local u16s = type_u16_5:new()
+    for idx=1, 5 do
+      u16s[idx] = idx * 3
+    end
+    lu.assertEquals(u16s:index():lookup(12), 4)
+
+    -- floating point keys are not supported
+    local type_double2 = luacwrap.registerarray("double2", 2, "$dbl")
+    lu.assertErrorMsgContains("hash key", function() type_double2:new():index() end)
+end
+--
+-- test filtering of arrays
+--
+function TestTESTSTRUCT:testSelectArray()
+    local type_teststruct8 = luacwrap.registerarray("TESTSTRUCT_8", 8, "TESTSTRUCT")
+    local arr = type_teststruct8:new()
+
+    for idx=1, 8 do
+      arr[idx].u8  = idx
+      arr[idx].i16 = (idx % 2 == 0) and -idx or idx
+      arr[idx].chararray = (idx > 4) and "high" or "low"
+    end
+
+    local result = arr:select{ {"u8", ">", 2}, {"i16", "<", 0} }
+    lu.assertEquals(#result, 3)
+    lu.assertEquals(result[1], 4)
+    lu.assertEquals(result[2], 6)
+    lu.assertEquals(result[3], 8)
+
+    lu.assertEquals(arr:select({ {"chararray", "==", "low"}, {"u8", "~=", 2} }, { astable = true }), { 1, 3, 4 })
+    lu.assertEquals(arr:select({ {"chararray", "!=", "low"}, {"u8", "<=", 5} }, { astable = true }), { 5 })
+    lu.assertEquals(arr:select({ {"u8", ">=", 7} }, { astable = true }), { 7, 8 })
+    lu.assertEquals(arr:select({ }, { astable = true }), { 1, 2, 3, 4, 5, 6, 7, 8 })
+    lu.assertEquals(#arr:select{ {"u8", ">", 100} }, 0)
+
+    -- arrays of basic types
+    local type_double5 = luacwrap.registerarray("double5", 5, "$dbl")
+    local dbls = type_double5:new()
+    for idx=1, 5 do
+      dbls[idx] = idx / 2
+    end
+    lu.assertEquals(dbls:select({ {"", "<", 1.5} }, { astable = true }), { 1, 2 })
+
+    -- NaN is unordered and satisfies only ~=
+    dbls[3] = 0/0
+    lu.assertEquals(dbls:select({ {"", "<=", 10} }, { astable = true }), { 1, 2, 4, 5 })
+    lu.assertEquals(dbls:select({ {"", ">=", 0} }, { astable = true }), { 1, 2, 4, 5 })
+    lu.assertEquals(dbls:select({ {"", "~=", 1} }, { astable = true }), { 1, 3, 4, 5 })
+    lu.assertEquals(dbls:select({ {"", "==", 0/0} }, { astable = true }), { })
+    lu.assertEquals(dbls:select({ {"", "~=", 0/0} }, { astable = true }), { 1, 2, 3, 4, 5 })
+
+    lu.assertErrorMsgContains("unknown operator", function() arr:select{ {"u8", "=", 1} } end)
+    lu.assertErrorMsgContains("unknown member", function() arr:select{ {"xyz", "==", 1} } end)
+end
+--
+-- test aggregation over arrays
+--
+function TestTESTSTRUCT:testAggregateArray()
+    local type_teststruct8 = luacwrap.registerarray("TESTSTRUCT_8", 8, "TESTSTRUCT")
+    local arr = type_teststruct8:new()
+
+    for idx=1, 8 do
+      arr[idx].u8  = idx % 3
+      arr[idx].i16 = idx * 10
+      arr[idx].i32 = -idx
+      arr[idx].chararray = (idx > 2) and "many" or "few"
+    end
+
+    local result = arr:aggregate("u8", { count = true, sum = "i16", min = "i32", max = "i16", avg = "i16" })
+    lu.assertEquals(result[0], { count = 2, sum =  90, min = -6, max = 60, avg = 45 })
+    lu.assertEquals(result[1], { count = 3, sum = 120, min = -7, max = 70, avg = 40 })
+    lu.assertEquals(result[2], { count = 3, sum = 150, min = -8, max = 80, avg = 50 })
+
+    result = arr:aggregate("chararray", { count = true })
+    lu.assertEquals(result, { few = { count = 2 }, many = { count = 6 } })
+
+    lu.assertErrorMsgContains("unknown aggregate function", function() arr:aggregate("u8", { median = "i16" }) end)
+    lu.assertErrorMsgContains("not numeric", function() arr:aggregate("u8", { sum = "chararray" }) end)
+end
+--
+-- test allocation of objects from an arena
+--
+function TestTESTSTRUCT:testArena()
+    local arena = luacwrap.arena(1024)
+    local used, size = arena:usage()
+    lu.assertEquals(used, 0)
+    lu.assertEquals(size, 1024)
+
+    local s1 = TESTSTRUCT:new(nil, arena)
+    local s2 = arena:new(TESTSTRUCT, { u8 = 7, ptr = "hello", inner = { pszText = "inner" } })
+    lu.assertEquals(s1.u8, 0)
+    lu.assertEquals(s2.u8, 7)
+    lu.assertEquals(s2.ptr, "hello")
+    lu.assertEquals(s2.inner.pszText, "inner")
+    lu.assertTrue(arena:usage() > 0)
+
+    s1.intarray[2] = 42
+    lu.assertEquals(s1.intarray[2], 42)
+    lu.assertEquals(TESTSTRUCT:new(s1).intarray[2], 42)
+    assert(1 == testluacwrap.checkInnerStructAccess(s1, s1.inner))
+
+    -- arena objects share their environment until they store references
+    lu.assertNil(s1.ptr)
+    s1.ptr = "first"
+    lu.assertEquals(s1.ptr, "first")
+    lu.assertEquals(s2.ptr, "hello")
+    lu.assertNil(TESTSTRUCT:new(nil, arena).ptr)
+
+    -- exhausted arena
+    lu.assertErrorMsgContains("arena exhausted", function()
+      for i=1, 100 do
+        TESTSTRUCT:new(nil, arena)
+      end
+    end)
+
+    -- stale objects
+    local inner = s2.inner
+    arena:reset()
+    lu.assertEquals(arena:usage(), 0)
+    lu.assertErrorMsgContains("released", function() return s1.u8 end)
+    lu.assertErrorMsgContains("released", function() s2.u8 = 1 end)
+    lu.assertErrorMsgContains("released", function() return inner.pszText end)
+
+    -- arena could be reused after reset
+    local s3 = TESTSTRUCT:new(0, arena)
+    lu.assertEquals(s3.u32, 0)
+
+    lu.assertErrorMsgContains("arena or allocator expected", function() TESTSTRUCT:new(nil, {}) end)
+end
+
+function TestTESTSTRUCT:testExternal()
+    local used, count = luacwrap.external:usage()
+
+    local s1 = TESTSTRUCT:new(nil, luacwrap.external)
+    local s2 = luacwrap.external:new(TESTSTRUCT, { u8 = 7, ptr = "hello" })
+    lu.assertEquals(s1.u8, 0)
+    lu.assertEquals(s2.u8, 7)
+    lu.assertEquals(s2.ptr, "hello")
+    s1.intarray[2] = 42
+    lu.assertEquals(s1.intarray[2], 42)
+    assert(1 == testluacwrap.checkInnerStructAccess(s1, s1.inner))
+
+    local used1, count1 = luacwrap.external:usage()
+    lu.assertEquals(count1, count + 2)
+    lu.assertTrue(used1 > used)
+
+    -- explicit release
+    local inner = s1.inner
+    s1:free()
+    s1:free()
+    lu.assertEquals(select(2, luacwrap.external:usage()), count + 1)
+    lu.assertErrorMsgContains("released", function() return s1.u8 end)
+    lu.assertErrorMsgContains("released", function() s1.u8 = 1 end)
+    lu.assertErrorMsgContains("released", function() return inner.pszText end)
+
+    -- release on collection
+    s2 = nil
+    collectgarbage()
+    collectgarbage()
+    lu.assertEquals(select(2, luacwrap.external:usage()), count)
+
+    -- custom hooks have to be given together
+    lu.assertErrorMsgContains("given together", function() testluacwrap.setAllocator(true, false) end)
+    lu.assertErrorMsgContains("given together", function() testluacwrap.setAllocator(false, true) end)
+    lu.assertEquals(testluacwrap.setAllocator(true, true), 0)
+    local s3 = TESTSTRUCT:new({ u8 = 3 }, luacwrap.external)
+    lu.assertEquals(s3.u8, 3)
+    s3:free()
+    lu.assertEquals(testluacwrap.setAllocator(false, false), 0)
+end
+
+function TestTESTSTRUCT:testAlignment()
+    local VEC4 = luacwrap.registerstruct("VEC4_ALIGNED", 64,
+      {
+        { "x", 0, "$flt" },
+        { "y", 4, "$flt" },
+        { "z", 8, "$flt" },
+        { "w", 12, "$flt" },
+      }, 64)
+    luacwrap.types.VEC4_ALIGNED = VEC4
+    local VEC4_8 = luacwrap.registerarray("VEC4_ALIGNED_8", 8, "VEC4_ALIGNED")
+
+    local objs = {}
+    for i=1, 16 do
+      local v = VEC4:new({ x = i, w = 2 })
+      lu.assertTrue(testluacwrap.getAlignment(v) >= 64)
+      lu.assertEquals(v.x, i)
+      lu.assertEquals(v.w, 2)
+      objs[i] = v
+    end
+    lu.assertEquals(VEC4:new(objs[3]).x, 3)
+    lu.assertTrue(testluacwrap.getAlignment(objs[3]:__dup()) >= 64)
+
+    -- arrays inherit the alignment of their elements
+    local arr = VEC4_8:new()
+    lu.assertTrue(testluacwrap.getAlignment(arr) >= 64)
+    lu.assertTrue(testluacwrap.getAlignment(arr[2]) >= 64)
+    arr[2].y = 5
+    lu.assertEquals(arr[2].y, 5)
+
+    -- static C array descriptors resolve their element type on first use
+    local carr = VEC4C_4:new()
+    lu.assertTrue(testluacwrap.getAlignment(carr) >= 64)
+    lu.assertTrue(testluacwrap.getAlignment(carr[2]) >= 64)
+
+    -- buffers
+    for i=1, 8 do
+      lu.assertTrue(testluacwrap.getAlignment(luacwrap.createbuffer(24, 32)) >= 32)
+    end
+    lu.assertEquals(#luacwrap.createbuffer(24, 32), 24)
+
+    -- arena and external memory
+    local arena = luacwrap.arena(1024)
+    TESTSTRUCT:new(nil, arena)
+    lu.assertTrue(testluacwrap.getAlignment(VEC4:new(nil, arena)) >= 64)
+    lu.assertTrue(testluacwrap.getAlignment(VEC4:new(nil, luacwrap.external)) >= 64)
+
+    lu.assertErrorMsgContains("power of two", function() luacwrap.createbuffer(24, 24) end)
+    lu.assertErrorMsgContains("multiple of the alignment", function()
+      luacwrap.registerstruct("VEC4_UNPADDED", 16, { { "x", 0, "$flt" } }, 64) end)
+    luacwrap.types.VEC4_ALIGNED = nil
+end
+
+function TestTESTSTRUCT:testStats()
+    local stats, msg = luacwrap.stats()
+    if not stats then
+      -- compiled without LUACWRAP_STATS
+      lu.assertStrContains(msg, "LUACWRAP_STATS")
+      return
+    end
+    local before = stats.TESTSTRUCT or { created = 0, embedded = 0 }
+    local beforeinner = stats.INNERSTRUCT or { embedded = 0, refs = 0 }
+
+    local s = TESTSTRUCT:new()
+    local inner = s.inner
+    s.ptr = "hello"
+
+    stats = luacwrap.stats()
+    lu.assertEquals(stats.TESTSTRUCT.created, before.created + 1)
+    lu.assertTrue(stats.TESTSTRUCT.alive >= 1)
+    lu.assertTrue(stats.TESTSTRUCT.bytes >= #s)
+    lu.assertTrue(stats.TESTSTRUCT.references >= 1)
+    lu.assertEquals(stats.INNERSTRUCT.embedded, beforeinner.embedded + 1)
+    lu.assertEquals(stats.INNERSTRUCT.refs, beforeinner.refs + 1)
+
+    local alive = stats.TESTSTRUCT.alive
+    s, inner = nil, nil
+    collectgarbage()
+    collectgarbage()
+    stats = luacwrap.stats()
+    lu.assertTrue(stats.TESTSTRUCT.alive < alive)
+    lu.assertTrue(stats.INNERSTRUCT.unrefs >= 1)
+end
+
+function TestTESTSTRUCT:testSingleInit()
+    luacwrap.types.BIG_U32_8 = luacwrap.registerarray("BIG_U32_8", 8, "$u32")
+    local BIG = luacwrap.registerstruct("BIGSTRUCT", 512,
+      {
+        { "a",   0,   "$u32" },
+        { "b",   8,   "$dbl" },
+        { "arr", 256, "BIG_U32_8" },
+        { "c",   508, "$u32" },
+      })
+    local U32_128 = luacwrap.registerarray("U32_128", 128, "$u32")
+
+    -- fill arena memory, so that the following objects reuse dirty memory
+    local arena = luacwrap.arena(4096)
+    BIG:new(255, arena)
+    U32_128:new(255, arena)
+    arena:reset()
+
+    -- gaps are cleared
+    local o = BIG:new({ a = 1, c = 3, arr = { 7 } }, arena)
+    lu.assertEquals(o.a, 1)
+    lu.assertEquals(o.b, 0)
+    lu.assertEquals(o.c, 3)
+    lu.assertEquals(o.arr[1], 7)
+    lu.assertEquals(o.arr[2], 0)
+    lu.assertEquals(o.arr[8], 0)
+
+    local arr = U32_128:new({ 1, 2, 3 }, arena)
+    lu.assertEquals(arr[3], 3)
+    lu.assertEquals(arr[4], 0)
+    lu.assertEquals(arr[128], 0)
+
+    -- copy construction
+    local o2 = BIG:new(o)
+    lu.assertEquals(o2.a, 1)
+    lu.assertEquals(o2.arr[1], 7)
+    lu.assertEquals(o2.c, 3)
+    local o3 = o:__dup()
+    lu.assertEquals(o3.c, 3)
+    local o4 = o.arr:__dup()
+    lu.assertEquals(o4[1], 7)
+
+    -- references are copied
+    local s = TESTSTRUCT:new({ ptr = "hello" })
+    lu.assertEquals(s:__dup().ptr, "hello")
+    lu.assertEquals(TESTSTRUCT:new(s).ptr, "hello")
+    lu.assertErrorMsgContains("incompatible", function() BIG:new(s) end)
+
+    -- uninitialized objects
+    local u = BIG:new_uninit()
+    lu.assertEquals(#u, 512)
+    u.c = 3
+    lu.assertEquals(u.c, 3)
+    lu.assertEquals(U32_128:new_uninit(arena)[1] ~= nil, true)
+
+    luacwrap.types.BIG_U32_8 = nil
+end
+
+function TestTESTSTRUCT:testNewMany()
+    local objs = TESTSTRUCT:newmany(100)
+    lu.assertEquals(#objs, 100)
+    lu.assertEquals(objs[1].u8, 0)
+    lu.assertEquals(objs[100].i32, 0)
+    objs[1].u8 = 5
+    lu.assertEquals(objs[2].u8, 0)
+
+    local inits = {}
+    for i=1, 10 do
+      inits[i] = { u8 = i, ptr = "ptr" .. i }
+    end
+    inits[5] = objs[1]
+    local objs2 = TESTSTRUCT:newmany(12, inits)
+    lu.assertEquals(#objs2, 12)
+    lu.assertEquals(objs2[3].u8, 3)
+    lu.assertEquals(objs2[3].ptr, "ptr3")
+    lu.assertEquals(objs2[5].u8, 5)
+    lu.assertEquals(objs2[10].ptr, "ptr10")
+    lu.assertEquals(objs2[12].u8, 0)
+    assert(1 == testluacwrap.checkInnerStructAccess(objs2[4], objs2[4].inner))
+
+    local arena = luacwrap.arena(4096)
+    local objs3 = TESTSTRUCT:newmany(3, nil, arena)
+    lu.assertEquals(objs3[3].u8, 0)
+    lu.assertTrue(arena:usage() > 0)
+
+    lu.assertEquals(#TESTSTRUCT:newmany(0), 0)
+    lu.assertErrorMsgContains("negative", function() TESTSTRUCT:newmany(-1) end)
+end
+
+function TestTESTSTRUCT:testReferenceStore()
+    local struct = TESTSTRUCT:new()
+    lu.assertEquals(struct.ptr, nil)
+
+    -- insert references out of offset order
+    struct.inner.pszText = "inner"
+    struct.ptr = "outer"
+    lu.assertEquals(struct.ptr, "outer")
+    lu.assertEquals(struct.inner.pszText, "inner")
+
+    -- replace and remove
+    struct.ptr = "outer2"
+    lu.assertEquals(struct.ptr, "outer2")
+    struct.inner.pszText = nil
+    lu.assertEquals(struct.inner.pszText, nil)
+    lu.assertEquals(struct.ptr, "outer2")
+
+    -- copies keep references
+    struct.inner.pszText = "inner2"
+    local copy = struct:__dup()
+    lu.assertEquals(copy.ptr, "outer2")
+    lu.assertEquals(copy.inner.pszText, "inner2")
+    local copy2 = TESTSTRUCT:new(struct)
+    lu.assertEquals(copy2.ptr, "outer2")
+    lu.assertEquals(copy2.inner.pszText, "inner2")
+
+    -- drop all references and add again
+    struct.ptr = nil
+    struct.inner.pszText = 0
+    lu.assertEquals(struct.ptr, nil)
+    lu.assertEquals(struct.inner.pszText, nil)
+    struct.ptr = "again"
+    lu.assertEquals(struct.ptr, "again")
+    lu.assertEquals(copy.ptr, "outer2")
+end
+
+function TestTESTSTRUCT:testCopyReferenceRange()
+    local a = TESTSTRUCT:new{ ptr = "a", inner = { pszText = "a.inner" } }
+    local b = TESTSTRUCT:new{ ptr = "b", inner = { pszText = "b.inner" } }
+
+    -- copy nested object between outer objects
+    a.inner = b.inner
+    lu.assertEquals(a.inner.pszText, "b.inner")
+    lu.assertEquals(a.ptr, "a")
+
+    -- copy nested object into standalone object and back
+    local inner = INNERSTRUCT:new(b.inner)
+    lu.assertEquals(inner.pszText, "b.inner")
+    inner.pszText = "standalone"
+    b.inner = inner
+    lu.assertEquals(b.inner.pszText, "standalone")
+    lu.assertEquals(b.ptr, "b")
+
+    -- references of the destination range are replaced
+    local c = TESTSTRUCT:new{ u8 = 3 }
+    TESTSTRUCT.set(a, c)
+    lu.assertEquals(a.u8, 3)
+    lu.assertEquals(a.ptr, nil)
+    lu.assertEquals(a.inner.pszText, nil)
+    a.inner = b.inner
+    lu.assertEquals(a.inner.pszText, "standalone")
+    lu.assertEquals(a.ptr, nil)
+end
+
+function TestTESTSTRUCT:testReferenceHandles()
+    local function countrefs()
+      local n = 0
+      for _ in pairs(luacwrap.reftable) do n = n + 1 end
+      return n
+    end
+
+    local struct = TESTSTRUCT:new()
+    struct.ref = "first"
+    local ref = struct.ref
+    lu.assertEquals(ref.value, "first")
+    local handle = ref.ref
+    ref:release()
+    lu.assertErrorMsgContains("released", function() return ref.value end)
+    lu.assertErrorMsgContains("stale", function() ref:release() end)
+
+    -- slot is reused with a new generation
+    local other = TESTSTRUCT:new()
+    other.ref = "second"
+    lu.assertNotEquals(other.ref.ref, handle)
+    lu.assertEquals(other.ref.value, "second")
+    lu.assertErrorMsgContains("released", function() return struct.ref.value end)
+    luacwrap.releasereference(other.ref)
+
+    -- released slots are reused
+    local before = countrefs()
+    for i=1, 1000 do
+      other.ref = i
+      other.ref:release()
+    end
+    lu.assertEquals(countrefs(), before)
+
+    -- nil is stored as handle 0
+    struct.ref = nil
+    lu.assertEquals(struct.ref.ref, 0)
+    lu.assertEquals(struct.ref.value, nil)
+end
+
+function TestTESTSTRUCT:testWeakReference()
+    local CACHEENTRY = luacwrap.registerstruct("CACHEENTRY", 8,
+      {
+        { "key",    0, "$i32"  },
+        { "target", 4, "$wref" },
+      })
+
+    local entry = CACHEENTRY:new()
+    lu.assertEquals(entry.target.ref, 0)
+    lu.assertEquals(entry.target.value, nil)
+
+    local target = { name = "target" }
+    entry.target = target
+    lu.assertEquals(entry.target.value, target)
+
+    -- weak references do not keep their value alive
+    target = nil
+    collectgarbage()
+    collectgarbage()
+    lu.assertEquals(entry.target.value, nil)
+    entry.target:release()
+    entry.target:release()
+
+    -- slots of collected values are reused
+    for i=1, 1000 do
+      entry.target = {}
+    end
+    collectgarbage()
+    lu.assertEquals(entry.target.value, nil)
+end
+
+function TestTESTSTRUCT:testBytes()
+    local struct = TESTSTRUCT:new{ u8 = 8, i16 = -16, u32 = 32, chararray = "bytes", intarray = { 1, 2, 3, 4 } }
+    local bytes = struct:tobytes()
+    lu.assertEquals(#bytes, #TESTSTRUCT:new():tobytes())
+
+    local copy = TESTSTRUCT:frombytes(bytes)
+    lu.assertEquals(copy.u8, 8)
+    lu.assertEquals(copy.i16, -16)
+    lu.assertEquals(copy.u32, 32)
+    lu.assertEquals(copy.chararray:tobytes():sub(1, 6), "bytes\0")
+    lu.assertEquals(copy.intarray[4], 4)
+
+    -- embedded objects and arrays
+    local intbytes = struct.intarray:tobytes()
+    lu.assertEquals(#intbytes, 16)
+    lu.assertEquals(INT32_4:frombytes(intbytes)[3], 3)
+
+    -- offset and length validation
+    lu.assertEquals(TESTSTRUCT:frombytes("xyz" .. bytes, 3).u32, 32)
+    lu.assertErrorMsgContains("too short", function() TESTSTRUCT:frombytes(bytes, 1) end)
+    lu.assertErrorMsgContains("too short", function() INT32_4:frombytes("abc") end)
+
+    -- pointer and reference members are zeroed or rejected
+    struct.ptr = "pointer"
+    lu.assertEquals(TESTSTRUCT:frombytes(struct:tobytes()).ptr, nil)
+    lu.assertEquals(TESTSTRUCT:frombytes(struct:tobytes()).u8, 8)
+    lu.assertErrorMsgContains("reject", function() struct:tobytes("reject") end)
+    struct.ptr = nil
+    lu.assertEquals(#struct:tobytes("reject"), #bytes)
+
+    -- batch variants
+    local objs = TESTSTRUCT:newmany(3, { { u8 = 1 }, { u8 = 2 }, { u8 = 3 } })
+    local all = TESTSTRUCT:tobytesmany(objs)
+    lu.assertEquals(#all, 3 * #bytes)
+    local objs2 = TESTSTRUCT:frombytesmany(all)
+    lu.assertEquals(#objs2, 3)
+    lu.assertEquals(objs2[3].u8, 3)
+    lu.assertEquals(#TESTSTRUCT:frombytesmany(all, #bytes, 1), 1)
+    lu.assertEquals(TESTSTRUCT:frombytesmany(all, #bytes)[1].u8, 2)
+    lu.assertErrorMsgContains("too short", function() TESTSTRUCT:frombytesmany(all, 0, 4) end)
+    lu.assertErrorMsgContains("not of type", function() TESTSTRUCT:tobytesmany({ copy, intbytes }) end)
+end
+
+function TestTESTSTRUCT:testView()
+    local struct = TESTSTRUCT:new{ u8 = 8, u32 = 32, chararray = "view", intarray = { 4, 3, 2, 1 } }
+    local bytes = struct:tobytes()
+
+    local view = TESTSTRUCT:view(bytes)
+    lu.assertEquals(view.u8, 8)
+    lu.assertEquals(view.u32, 32)
+    lu.assertEquals(view.chararray:tobytes():sub(1, 5), "view\0")
+    lu.assertEquals(view.intarray[2], 3)
+    lu.assertEquals(TESTSTRUCT:view("xyz" .. bytes, 3).u32, 32)
+    lu.assertEquals(INT32_4:view(struct.intarray:tobytes())[4], 1)
+
+    -- string conversion of views
+    local s = tostring(view)
+    lu.assertStrContains(s, "\nu32 = " .. tostring(view.u32) .. ",\n")
+    lu.assertStrContains(s, "\nchararray = [[view\\0")
+    lu.assertEquals(tostring(view.intarray), tostring(struct.intarray))
+
+    -- views are read-only, also for nested objects
+    lu.assertErrorMsgContains("read-only", function() view.u8 = 1 end)
+    lu.assertErrorMsgContains("read-only", function() view.intarray[1] = 1 end)
+    lu.assertErrorMsgContains("read-only", function() view.intarray:sort() end)
+    lu.assertErrorMsgContains("read-only", function() TESTSTRUCT.set(view, { u8 = 1 }) end)
+    lu.assertEquals(view.u8, 8)
+
+    -- copies are writable
+    local copy = view:__dup()
+    copy.u8 = 1
+    lu.assertEquals(copy.u8, 1)
+    lu.assertEquals(view.u8, 8)
+
+    -- offset and length validation
+    lu.assertErrorMsgContains("too short", function() TESTSTRUCT:view(bytes, 1) end)
+    lu.assertErrorMsgContains("out of range", function() TESTSTRUCT:view(bytes, -1) end)
+end
+
+function TestTESTSTRUCT:testMmap()
+    local MAPREC = luacwrap.registerstruct("MAPREC", 8,
+      {
+        { "id",    0, "$i32" },
+        { "value", 4, "$i32" },
+      })
+    local path = os.tmpname()
+
+    -- writable mappings grow the file
+    local recs = luacwrap.mmap(path, MAPREC, 100, "w")
+    lu.assertEquals(#recs, 100)
+    for i=1, #recs do
+      recs[i].id = 101 - i
+      recs[i].value = i
+    end
+    recs:sync()
+    recs:close()
+    lu.assertErrorMsgContains("closed", function() recs:sync() end)
+    lu.assertErrorMsgContains("released", function() return recs[1].id end)
+
+    -- read-only mapping of all records
+    local ro = luacwrap.mmap(path, MAPREC)
+    lu.assertEquals(#ro, 100)
+    lu.assertEquals(ro[1].id, 100)
+    lu.assertEquals(ro:lowerbound("value", 50), 50)
+    lu.assertEquals(#ro:tobytes(), 800)
+    ro:advise("sequential")
+    lu.assertErrorMsgContains("read-only", function() ro[1].id = 1 end)
+    lu.assertErrorMsgContains("read-only", function() ro:sort("id") end)
+
+    -- copy-on-write changes are private
+    local cow = luacwrap.mmap(path, MAPREC, nil, "c")
+    cow:sort("id")
+    lu.assertEquals(cow[1].id, 1)
+    lu.assertEquals(ro[1].id, 100)
+    cow:close()
+
+    -- windows of records
+    local window = luacwrap.mmap(path, MAPREC, 10, "r", 90)
+    lu.assertEquals(#window, 10)
+    lu.assertEquals(window[1].value, 91)
+    lu.assertEquals(#luacwrap.mmap(path, MAPREC, nil, "r", 95), 5)
+    lu.assertErrorMsgContains("too short", function() luacwrap.mmap(path, MAPREC, 20, "r", 90) end)
+    lu.assertErrorMsgContains("cannot open", function() luacwrap.mmap(path .. ".missing", MAPREC) end)
+    window:close()
+    ro:close()
+    os.remove(path)
+end
+
+function TestTESTSTRUCT:testReader()
+    local READREC = luacwrap.registerstruct("READREC", 8,
+      {
+        { "id",    0, "$i32" },
+        { "value", 4, "$i32" },
+      })
+    local inits = {}
+    for i=1, 100 do
+      inits[i] = { id = i, value = 2 * i }
+    end
+    local path = os.tmpname()
+    local f = io.open(path, "wb")
+    f:write(READREC:tobytesmany(READREC:newmany(100, inits)))
+    f:close()
+
+    -- all records are returned through a single cursor
+    local rd = luacwrap.reader(path, READREC, 7)
+    local n, sum, cursor = 0, 0, nil
+    for rec in rd:records() do
+      n = n + 1
+      sum = sum + rec.value
+      lu.assertEquals(rec.id, n)
+      cursor = cursor or rec
+      lu.assertTrue(rawequal(cursor, rec))
+    end
+    lu.assertEquals(n, 100)
+    lu.assertEquals(sum, 10100)
+    lu.assertEquals(rd:next(), nil)
+    rd:close()
+    lu.assertErrorMsgContains("closed", function() rd:next() end)
+
+    -- records are kept by copying them
+    rd = luacwrap.reader(path, READREC)
+    local first = rd:next():__dup()
+    lu.assertEquals(rd:next().id, 2)
+    lu.assertEquals(first.id, 1)
+    rd:close()
+
+    -- files with incomplete records
+    f = io.open(path, "ab")
+    f:write("xyz")
+    f:close()
+    rd = luacwrap.reader(path, READREC, 16)
+    lu.assertErrorMsgContains("incomplete", function() for rec in rd:records() do end end)
+    rd:close()
+    lu.assertErrorMsgContains("cannot open", function() luacwrap.reader(path .. ".missing", READREC) end)
+    os.remove(path)
+end
+
+function TestTESTSTRUCT:testWriter()
+    local WRITEREC = luacwrap.registerstruct("WRITEREC", 8,
+      {
+        { "id",    0, "$i32" },
+        { "value", 4, "$i32" },
+      })
+    local recs = WRITEREC:newmany(100)
+    for i=1, #recs do
+      recs[i].id = i
+      recs[i].value = -i
+    end
+    local path = os.tmpname()
+    local function readfile()
+      local f = io.open(path, "rb")
+      local data = f:read("*a")
+      f:close()
+      return data
+    end
+
+    -- small objects are buffered
+    local wr = luacwrap.writer(path, 4096)
+    for i=1, #recs do
+      wr:write(recs[i])
+    end
+    lu.assertEquals(select(2, wr:stats()), 0)
+    wr:write(recs, "tail")
+    wr:close()
+    lu.assertEquals(wr:stats(), 1604)
+    lu.assertEquals(select(2, wr:stats()), 1)
+    lu.assertErrorMsgContains("closed", function() wr:write(recs[1]) end)
+
+    local data = readfile()
+    lu.assertEquals(#data, 1604)
+    lu.assertEquals(WRITEREC:frombytes(data, 8 * 99).id, 100)
+    lu.assertEquals(WRITEREC:frombytes(data, 800).value, -1)
+    lu.assertEquals(data:sub(-4), "tail")
+
+    -- large objects are gathered in order with buffered data
+    wr = luacwrap.writer(path, 16)
+    wr:write("ab", recs, "cd")
+    wr:flush()
+    lu.assertTrue(select(2, wr:stats()) < 20)
+    wr:write(recs[2])
+    wr:close()
+    data = readfile()
+    lu.assertEquals(#data, 812)
+    lu.assertEquals(data:sub(1, 2), "ab")
+    lu.assertEquals(WRITEREC:frombytes(data, 2 + 8 * 99).id, 100)
+    lu.assertEquals(data:sub(803, 804), "cd")
+    lu.assertEquals(WRITEREC:frombytes(data, 804).id, 2)
+
+    -- a failed call writes nothing, later calls still work
+    wr = luacwrap.writer(path, 16)
+    lu.assertErrorMsgContains("expected", function() wr:write("ab", recs, true) end)
+    lu.assertErrorMsgContains("expected", function() wr:write(recs, { "ab", recs, 1 }) end)
+    collectgarbage()
+    wr:write("cd", recs[3])
+    wr:close()
+    data = readfile()
+    lu.assertEquals(#data, 10)
+    lu.assertEquals(data:sub(1, 2), "cd")
+    lu.assertEquals(WRITEREC:frombytes(data, 2).id, 3)
+
+    -- append mode, pointer members are written as zero
+    local struct = TESTSTRUCT:new{ u32 = 32 }
+    struct.ptr = "pointer"
+    wr = luacwrap.writer(path, nil, "a")
+    wr:write(struct)
+    wr:close()
+    data = readfile()
+    lu.assertEquals(data:sub(11), struct:tobytes())
+    lu.assertErrorMsgContains("expected", function() luacwrap.writer(path):write(true) end)
+    os.remove(path)
+end
+
+function TestTESTSTRUCT:testArchive()
+    luacwrap.registerarray("ARCNAME", 8, "$u8")
+    local ARCREC = luacwrap.registerstruct("ARCREC", 16,
+      {
+        { "id",    0, "$i32" },
+        { "value", 4, "$i32" },
+        { "name",  8, "ARCNAME" },
+      })
+    local recs = ARCREC:newmany(100)
+    for i=1, #recs do
+      recs[i].id = i
+      recs[i].value = -i
+      recs[i].name[1] = i
+    end
+    local path = os.tmpname()
+
+    -- identical layouts are mapped
+    lu.assertEquals(luacwrap.savearchive(path, ARCREC, recs, { blockrecords = 16 }), 100)
+    local loaded, mapped = luacwrap.loadarchive(path, ARCREC)
+    lu.assertTrue(mapped)
+    lu.assertEquals(#loaded, 100)
+    lu.assertEquals(loaded[100].value, -100)
+    lu.assertErrorMsgContains("read-only", function() loaded[1].id = 0 end)
+    loaded:close()
+    loaded, mapped = luacwrap.loadarchive(path, ARCREC, { copy = true })
+    lu.assertFalse(mapped)
+    lu.assertEquals(loaded[50].id, 50)
+
+    -- changed layouts are converted by member name
+    local ARCREC2 = luacwrap.registerstruct("ARCREC2", 16,
+      {
+        { "value", 0, "$dbl" },
+        { "extra", 8, "$u32" },
+        { "id",   12, "$i32" },
+      })
+    loaded, mapped = luacwrap.loadarchive(path, ARCREC2)
+    lu.assertFalse(mapped)
+    lu.assertEquals(#loaded, 100)
+    lu.assertEquals(loaded[7].id, 7)
+    lu.assertEquals(loaded[7].value, -7)
+    lu.assertEquals(loaded[7].extra, 0)
+
+    -- padding is part of identical layouts
+    local ARCPAD = luacwrap.registerstruct("ARCPAD", 8,
+      {
+        { "id",   0, "$i32" },
+        { "flag", 4, "$u8" },
+      })
+    local pads = ARCPAD:newmany(10)
+    pads[10].id, pads[10].flag = 10, 1
+    luacwrap.savearchive(path, ARCPAD, pads)
+    loaded, mapped = luacwrap.loadarchive(path, ARCPAD)
+    lu.assertTrue(mapped)
+    lu.assertEquals(loaded[10].id, 10)
+    lu.assertEquals(loaded[10].flag, 1)
+    loaded:close()
+
+    -- tables of objects, pointer members are stored as zero
+    local struct = TESTSTRUCT:new{ u32 = 32 }
+    struct.ptr = "pointer"
+    luacwrap.savearchive(path, TESTSTRUCT, { struct, TESTSTRUCT:new() }, { checksum = false })
+    loaded, mapped = luacwrap.loadarchive(path, TESTSTRUCT)
+    lu.assertTrue(mapped)
+    lu.assertEquals(loaded[1].u32, 32)
+    lu.assertEquals(loaded[1]:tobytes(), struct:tobytes())
+    loaded:close()
+
+    -- corrupted records are detected
+    luacwrap.savearchive(path, ARCREC, recs)
+    local f = io.open(path, "r+b")
+    f:seek("end", -4)
+    f:write("xxxx")
+    f:close()
+    lu.assertErrorMsgContains("checksum", function() luacwrap.loadarchive(path, ARCREC) end)
+    lu.assertErrorMsgContains("checksum", function() luacwrap.loadarchive(path, ARCREC2) end)
+    lu.assertEquals(luacwrap.loadarchive(path, ARCREC, { verify = false })[1].id, 1)
+
+    lu.assertErrorMsgContains("not of type", function() luacwrap.savearchive(path, ARCREC, { struct }) end)
+    f = io.open(path, "wb")
+    f:write("no archive at all, just some text")
+    f:close()
+    lu.assertErrorMsgContains("not a luacwrap archive", function() luacwrap.loadarchive(path, ARCREC) end)
+    os.remove(path)
+end
+
+function TestTESTSTRUCT:testToJson()
+    local struct = TESTSTRUCT:new{ u8 = 8, i8 = -8, u32 = 4000000000, chararray = "say \"hi\"\n" }
+    struct.intarray[2] = 42
+    struct.ptr = "pointer"
+    local json = luacwrap.tojson(struct)
+    lu.assertStrContains(json, '{"u8":8,"i8":-8,')
+    lu.assertStrContains(json, '"u32":4000000000,')
+    lu.assertStrContains(json, '"ptr":"pointer",')
+    lu.assertStrContains(json, '"chararray":"say \\"hi\\"\\n",')
+    lu.assertStrContains(json, '"intarray":[0,42,0,0],')
+    lu.assertStrContains(json, '"inner":{"pszText":null}}')
+
+    -- embedded objects and options
+    lu.assertEquals(luacwrap.tojson(struct.intarray), "[0,42,0,0]")
+    lu.assertEquals(luacwrap.tojson(struct.intarray, { indent = 2 }), "[\n  0,\n  42,\n  0,\n  0\n]")
+    lu.assertStrContains(luacwrap.tojson(struct, { chararrays = false }), '"chararray":[115,97,121,32,')
+    local doubles = luacwrap.registerarray("double3", 3, "$dbl"):new()
+    doubles[1], doubles[2], doubles[3] = 0.5, 1/0, -2
+    lu.assertEquals(luacwrap.tojson(doubles), "[0.5,null,-2]")
+    lu.assertErrorMsgContains("wrapped object expected", function() luacwrap.tojson({}) end)
+
+    -- streaming to files
+    local path = os.tmpname()
+    local f = io.open(path, "wb")
+    local recs = TESTSTRUCT:newmany(1000)
+    lu.assertEquals(luacwrap.writejson(f, recs), f)
+    f:close()
+    f = io.open(path, "rb")
+    local data = f:read("*a")
+    f:close()
+    lu.assertEquals(data, luacwrap.tojson(recs))
+    lu.assertErrorMsgContains("closed file", function() luacwrap.writejson(f, recs) end)
+    os.remove(path)
+end
+
+function TestTESTSTRUCT:testFromJson()
+    local struct = TESTSTRUCT:fromjson([[
+      { "u8": 8, "i8": -8, "u32": 4000000000, "unknown": { "a": [1, 2, {"b": "\u00e4"}] },
+        "chararray": "line\nfeed", "intarray": [1, 2.5, true],
+        "ptr": "pointer", "inner": { "pszText": null } } ]])
+    lu.assertEquals(struct.u8, 8)
+    lu.assertEquals(struct.i8, -8)
+    lu.assertEquals(struct.u32, 4000000000)
+    lu.assertEquals(struct.chararray:sub(1, 10), "line\nfeed")
+    lu.assertEquals(struct.chararray:byte(11), 0)
+    lu.assertEquals(struct.intarray[2], 2)
+    lu.assertEquals(struct.intarray[3], 1)
+    lu.assertEquals(struct.intarray[4], 0)
+    lu.assertEquals(struct.ptr, "pointer")
+
+    -- setjson() changes only the given members
+    struct:setjson('{"i16": -16, "chararray": "\u20ac"}')
+    lu.assertEquals(struct.i16, -16)
+    lu.assertEquals(struct.u8, 8)
+    lu.assertEquals(struct.chararray:sub(1, 3), "\226\130\172")
+    struct.intarray:setjson("[7]")
+    lu.assertEquals(struct.intarray[1], 7)
+    lu.assertEquals(struct.intarray[2], 2)
+
+    -- round trip
+    local copy = TESTSTRUCT:fromjson(luacwrap.tojson(struct))
+    lu.assertEquals(luacwrap.tojson(copy), luacwrap.tojson(struct))
+
+    -- errors report the path
+    lu.assertErrorMsgContains("at $.intarray[4] (offset 26): too many array elements", function()
+      struct:setjson('{"intarray": [1, 2, 3, 4, 5]}') end)
+    lu.assertErrorMsgContains("at $.inner (offset 10): object expected", function()
+      struct:setjson('{"inner": 1}') end)
+    lu.assertErrorMsgContains("at $.u8 (offset 7): number expected", function()
+      struct:setjson('{"u8": "x"}') end)
+    lu.assertErrorMsgContains("at $.i32 (offset 8): number out of range", function()
+      struct:setjson('{"i32": 1e300}') end)
+    lu.assertErrorMsgContains("number out of range", function()
+      struct:setjson('{"u32": -1e19}') end)
+    struct:setjson('{"i32": -2.5}')
+    lu.assertEquals(struct.i32, -2)
+    lu.assertErrorMsgContains("unexpected data", function() struct:setjson('{} {}') end)
+    lu.assertErrorMsgContains("unterminated string", function() struct:setjson('{"u8') end)
+    lu.assertErrorMsgContains("read-only", function()
+      TESTSTRUCT:view(struct:tobytes()):setjson('{}') end)
+end
+
+function TestTESTSTRUCT:testMsgPack()
+    local struct = TESTSTRUCT:new{ u8 = 200, i8 = -100, u32 = 4000000000, chararray = "text",
+                                   intarray = { 1, 2, 70000 } }
+    struct.ptr = "pointer"
+
+    -- round trip with records as maps and as positional arrays
+    local s = luacwrap.tomsgpack(struct)
+    local copy, nextoffset = TESTSTRUCT:frommsgpack(s)
+    lu.assertEquals(nextoffset, #s)
+    lu.assertEquals(copy.u8, 200)
+    lu.assertEquals(copy.i8, -100)
+    lu.assertEquals(copy.u32, 4000000000)
+    lu.assertEquals(copy.chararray:sub(1, 5), "text\0")
+    lu.assertEquals(copy.intarray[1], 1)
+    lu.assertEquals(copy.intarray[3], 70000)
+    lu.assertEquals(copy.ptr, "pointer")
+    lu.assertEquals(luacwrap.tomsgpack(copy), s)
+    local positional = luacwrap.tomsgpack(struct, { records = "array", typed = false })
+    lu.assertTrue(#positional < #s)
+    lu.assertEquals(luacwrap.tomsgpack((TESTSTRUCT:frommsgpack(positional))), s)
+
+    -- numeric arrays are ext values with little endian payload
+    lu.assertEquals(luacwrap.tomsgpack(struct.intarray),
+      "\216\022\001\000\000\000\002\000\000\000\112\017\001\000\000\000\000\000")
+    lu.assertEquals(luacwrap.tomsgpack(struct.intarray, { typed = false }),
+      "\148\001\002\206\000\001\017\112\000")
+
+    -- setmsgpack() changes only the given members and converts numbers
+    struct:setmsgpack("\130\162u8\203\064\069\000\000\000\000\000\000\161x\192")
+    lu.assertEquals(struct.u8, 42)
+    lu.assertEquals(struct.i8, -100)
+    struct.intarray:setmsgpack("\146\007\192")
+    lu.assertEquals(struct.intarray[1], 7)
+    lu.assertEquals(struct.intarray[2], 2)
+
+    -- consecutive values
+    local _, offset = struct:setmsgpack("\129\162u8\001\129\162u8\002")
+    lu.assertEquals(struct.u8, 1)
+    struct:setmsgpack("\129\162u8\001\129\162u8\002", offset)
+    lu.assertEquals(struct.u8, 2)
+
+    lu.assertErrorMsgContains("at offset 1: too many array elements", function()
+      struct.intarray:setmsgpack("\149\001\002\003\004\005") end)
+    lu.assertErrorMsgContains("number expected", function() struct:setmsgpack("\129\162u8\161x") end)
+    lu.assertErrorMsgContains("number out of range", function()
+      struct:setmsgpack("\129\162u8\203\127\240\000\000\000\000\000\000") end)
+    lu.assertErrorMsgContains("unexpected end of data", function() struct:setmsgpack("\129\162u8") end)
+    lu.assertErrorMsgContains("read-only", function()
+      TESTSTRUCT:view(struct:tobytes()):setmsgpack("\128") end)
+end
+
+function TestTESTSTRUCT:testToString()
+    local struct = TESTSTRUCT:new{ u8 = 8, i16 = -16, chararray = "abc", intarray = { 1, 2, 3, 4 } }
+    local v = {}
+    for i = 1, 4 do v[i] = tostring(struct.intarray[i]) end
+
+    -- records
+    local s = tostring(struct)
+    lu.assertEquals(s:sub(1, 10), "{ __ptr = ")
+    lu.assertEquals(s:sub(-3), ",\n}")
+    lu.assertStrContains(s, ",\nu8 = " .. tostring(struct.u8) .. ",\n")
+    lu.assertStrContains(s, "\ni16 = " .. tostring(struct.i16) .. ",\n")
+    lu.assertStrContains(s, "\nchararray = [[abc\\0\\0")
+    lu.assertStrContains(s, "\nintarray = [[ = {\n  1 = " .. v[1] .. ",\n")
+    lu.assertStrContains(s, "\ninner = [[{ __ptr = ")
+
+    -- embedded records print the strings of their pointer members
+    struct.inner.pszText = "inner text"
+    lu.assertStrContains(tostring(struct.inner), "\npszText = [[inner text]],\n")
+    lu.assertEquals(luacwrap.tostring(struct), s)
+
+    -- arrays
+    lu.assertEquals(tostring(struct.intarray),
+      " = {\n  1 = " .. v[1] .. ",\n  2 = " .. v[2] .. ",\n  3 = " .. v[3] .. ",\n  4 = " .. v[4] .. ",\n}")
+    lu.assertEquals(luacwrap.tostring(struct.intarray, { maxelements = 1 }), " = {\n  1 = " .. v[1] .. ",\n  ...\n}")
+
+    -- compact output
+    lu.assertEquals(luacwrap.tostring(struct.intarray, { compact = true }),
+      "{ " .. v[1] .. ", " .. v[2] .. ", " .. v[3] .. ", " .. v[4] .. " }")
+    lu.assertEquals(luacwrap.tostring(struct.intarray, { compact = true, maxelements = 2 }),
+      "{ " .. v[1] .. ", " .. v[2] .. ", ... }")
+    local c = luacwrap.tostring(struct, { compact = true, maxelements = 2 })
+    lu.assertNil(c:find("\n"))
+    lu.assertStrContains(c, ", u8 = " .. tostring(struct.u8) .. ", ")
+    lu.assertStrContains(c, ", intarray = [[{ " .. v[1] .. ", " .. v[2] .. ", ... }]], ")
+    lu.assertEquals(c:sub(-2), " }")
+
+    -- 1 byte arrays are returned as raw string
+    lu.assertEquals(luacwrap.tostring(struct.chararray), tostring(struct.chararray))
+end
 
 os.exit(lu.run())
@@ -101,3 +101,45 @@ int luacwrap_registerNumericTypes(lua_State* L)
   LUASTACK_CLEAN(L, 0);
   return 0;
 }
+
+// numeric kind of an integer type determined from size and signedness
+#define INTKIND(TYPE)   ( (((TYPE)-1) < 0)                                        \
+                        ? ( (1 == sizeof(TYPE)) ? LUACWRAP_NK_I8  :               \
+                            (2 == sizeof(TYPE)) ? LUACWRAP_NK_I16 :               \
+                            (4 == sizeof(TYPE)) ? LUACWRAP_NK_I32 : LUACWRAP_NK_I64 ) \
+                        : ( (1 == sizeof(TYPE)) ? LUACWRAP_NK_U8  :               \
+                            (2 == sizeof(TYPE)) ? LUACWRAP_NK_U16 :               \
+                            (4 == sizeof(TYPE)) ? LUACWRAP_NK_U32 : LUACWRAP_NK_U64 ) )
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  returns the numeric kind (LUACWRAP_NK_xxx) of a basic type descriptor
+  or LUACWRAP_NK_NONE if the type is not one of the numeric types above
+
+*/////////////////////////////////////////////////////////////////////////
+int luacwrap_numerickind(luacwrap_Type* desc)
+{
+  luacwrap_BasicType* basdesc = (luacwrap_BasicType*)desc;
+
+  if (LUACWRAP_TC_BASIC != desc->typeclass)
+    return LUACWRAP_NK_NONE;
+
+  if (basdesc == &regType_INT8)     return LUACWRAP_NK_I8;
+  if (basdesc == &regType_UINT8)    return LUACWRAP_NK_U8;
+  if (basdesc == &regType_INT16)    return LUACWRAP_NK_I16;
+  if (basdesc == &regType_UINT16)   return LUACWRAP_NK_U16;
+  if (basdesc == &regType_INT32)    return LUACWRAP_NK_I32;
+  if (basdesc == &regType_UINT32)   return LUACWRAP_NK_U32;
+  if (basdesc == &regType_int64_t)  return LUACWRAP_NK_I64;
+  if (basdesc == &regType_uint64_t) return LUACWRAP_NK_U64;
+  if (basdesc == &regType_INT)      return INTKIND(int);
+  if (basdesc == &regType_UINT)     return INTKIND(unsigned int);
+  if (basdesc == &regType_LONG)     return INTKIND(long);
+  if (basdesc == &regType_ULONG)    return INTKIND(unsigned long);
+  if (basdesc == &regType_FLOAT)    return LUACWRAP_NK_FLT;
+  if (basdesc == &regType_DOUBLE)   return LUACWRAP_NK_DBL;
+  if (basdesc == &regType_char)     return INTKIND(char);
+
+  return LUACWRAP_NK_NONE;
+}
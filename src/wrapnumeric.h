@@ -17,3 +17,21 @@
 
 
 extern int luacwrap_registerNumericTypes(lua_State* L);
+
+//
+// numeric kinds, used to access numeric members directly from C
+// (e.g. for typed comparisons)
+//
+#define LUACWRAP_NK_NONE    0
+#define LUACWRAP_NK_I8      1
+#define LUACWRAP_NK_U8      2
+#define LUACWRAP_NK_I16     3
+#define LUACWRAP_NK_U16     4
+#define LUACWRAP_NK_I32     5
+#define LUACWRAP_NK_U32     6
+#define LUACWRAP_NK_I64     7
+#define LUACWRAP_NK_U64     8
+#define LUACWRAP_NK_FLT     9
+#define LUACWRAP_NK_DBL     10
+
+extern int luacwrap_numerickind(luacwrap_Type* desc);
@@ -81,19 +81,18 @@ static int luacwrap_pointer_set(luacwrap_BasicType* self, lua_State *L, PBYTE pD
 *////////////////////////////////////////////////////////////////////////
 static int luacwrap_pointer_get(luacwrap_BasicType* self, lua_State *L, PBYTE pData, int offset)
 {
+  PBYTE* v = (PBYTE*)pData;
+
+  // NULL pointers never hold a reference
+  if (NULL == *v)
+  {
+    lua_pushnil(L);
+  }
   // try to get referenced lua value from outer struct
-  if (!luacwrap_mobj_get_reference(L, 1, offset))
+  else if (!luacwrap_mobj_get_reference(L, 1, offset))
   {
     // otherwise return raw pointer as light userdata
-    PBYTE* v = (PBYTE*)pData;
-    if (*v)
-    {
-      lua_pushlightuserdata(L, *v);
-    }
-    else
-    {
-      lua_pushnil(L);
-    }
+    lua_pushlightuserdata(L, *v);
   }
 
   return 1;
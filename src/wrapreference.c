@@ -11,9 +11,23 @@
 
 */////////////////////////////////////////////////////////////////////////
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "wrapreference.h"
 #include "luaaux.h"
-#include "string.h"
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  reference object returned when reading $ref/$wref members
+
+*////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+  int handle;                         // reference handle
+  int weak;                           // set for weak references ($wref)
+} luacwrap_RefObject;
 
 //////////////////////////////////////////////////////////////////////////
 /**
@@ -24,11 +38,11 @@
   @param[in]  index   stack index
 
 *////////////////////////////////////////////////////////////////////////
-static int* luacwrap_toreference(lua_State* L, int index)
+static luacwrap_RefObject* luacwrap_toreference(lua_State* L, int index)
 {
   const char *msg;
 
-  int* p = (int*)lua_touserdata(L, index);
+  luacwrap_RefObject* p = (luacwrap_RefObject*)lua_touserdata(L, index);
   if (p != NULL)
   {
     if (lua_getmetatable(L, index))
@@ -53,32 +67,409 @@ static int* luacwrap_toreference(lua_State* L, int index)
 //////////////////////////////////////////////////////////////////////////
 /**
 
-  creates a reference in the reference table
+  Reference handles.
+
+  The values of $ref members are kept in a values table (_M.reftable),
+  the values of $wref members in a second values table with weak values.
+  The slots of these tables are managed by handle tables with a free
+  list, so released slots are reused and the tables do not grow
+  beyond the peak number of live references.
+  A handle combines the slot index with the generation of the slot
+  which is incremented on each release, so stale handles are detected
+  instead of aliasing the next value stored in the same slot.
+  Handle 0 denotes "no reference".
+
+*////////////////////////////////////////////////////////////////////////
+
+// marks slots in use (instead of a next free slot)
+#define LUACWRAP_REF_INUSE  0xFFFFFFFFu
+
+// initial number of slots
+#define LUACWRAP_REF_MINCAPACITY  64
+
+typedef struct
+{
+  unsigned int generation;            // generation of the slot
+  unsigned int nextfree;              // next free slot or LUACWRAP_REF_INUSE
+} luacwrap_RefSlot;
+
+typedef struct
+{
+  luacwrap_RefSlot* slots;            // slot array (slots[0] is unused)
+  unsigned int      capacity;         // allocated number of slots
+  unsigned int      top;              // highest slot used so far
+  unsigned int      freehead;         // first free slot or 0
+} luacwrap_RefTable;
+
+// addresses of these variables are used as keys to register the handle tables
+static const char* s_keyRefHandles     = "refhandles";
+static const char* s_keyWeakRefHandles = "weakrefhandles";
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements __gc metamethod of the handle tables.
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_reftable_gc(lua_State* L)
+{
+  luacwrap_RefTable* tbl = (luacwrap_RefTable*)lua_touserdata(L, 1);
+
+  free(tbl->slots);
+  tbl->slots    = NULL;
+  tbl->capacity = 0;
+
+  return 0;
+}
+
+// metatable for the handle tables
+static luaL_Reg g_mtRefTable[ ] = {
+  { "__gc", luacwrap_reftable_gc },
+  { NULL, NULL }
+};
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Creates a handle table, stores it in the registry and pushes its
+  values table.
+
+  @param[in]  L       lua state
+  @param[in]  weak    create the table for weak references
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_reftable_create(lua_State* L, int weak)
+{
+  luacwrap_RefTable* tbl;
+
+  LUASTACK_SET(L);
+
+  lua_pushlightuserdata(L, weak ? (void*)&s_keyWeakRefHandles : (void*)&s_keyRefHandles);
+
+  tbl = (luacwrap_RefTable*)lua_newuserdata(L, sizeof(luacwrap_RefTable));
+  memset(tbl, 0, sizeof(luacwrap_RefTable));
+
+  lua_newtable(L);
+#if (LUA_VERSION_NUM > 501)
+  luaL_setfuncs(L, g_mtRefTable, 0);
+#else
+  luaL_openlib(L, NULL, g_mtRefTable, 0);
+#endif
+  lua_setmetatable(L, -2);
+
+  // values are kept in the environment of the handle table
+  lua_newtable(L);
+  if (weak)
+  {
+    lua_newtable(L);
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+  }
+  lua_pushvalue(L, -1);
+  luacwrap_setenvironment(L, -3);
+
+  // registry[key] = handle table
+  lua_insert(L, -3);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+
+  LUASTACK_CLEAN(L, 1);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  pushes the values table and returns the handle table
+
+*////////////////////////////////////////////////////////////////////////
+static luacwrap_RefTable* luacwrap_reftable_push(lua_State* L, int weak)
+{
+  luacwrap_RefTable* tbl;
+
+  lua_pushlightuserdata(L, weak ? (void*)&s_keyWeakRefHandles : (void*)&s_keyRefHandles);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  tbl = (luacwrap_RefTable*)lua_touserdata(L, -1);
+  assert(NULL != tbl);
+
+  luacwrap_getenvironment(L, -1);
+  lua_replace(L, -2);
+
+  return tbl;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  get slot of a handle
+
+  @return slot index or 0 if the handle is stale or invalid
+
+*////////////////////////////////////////////////////////////////////////
+static unsigned int luacwrap_reftable_slot(luacwrap_RefTable* tbl, int handle)
+{
+  unsigned int slot = (unsigned int)handle & LUACWRAP_REF_SLOTMASK;
+  unsigned int gen  = ((unsigned int)handle >> LUACWRAP_REF_SLOTBITS) & LUACWRAP_REF_GENMASK;
+
+  if (  (handle > 0)
+     && (slot > 0)
+     && (slot <= tbl->top)
+     && (LUACWRAP_REF_INUSE == tbl->slots[slot].nextfree)
+     && (gen == tbl->slots[slot].generation))
+  {
+    return slot;
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Put slot into the free list and start a new generation.
+
+*////////////////////////////////////////////////////////////////////////
+static void luacwrap_reftable_free(luacwrap_RefTable* tbl, unsigned int slot)
+{
+  tbl->slots[slot].generation = (tbl->slots[slot].generation + 1) & LUACWRAP_REF_GENMASK;
+  tbl->slots[slot].nextfree   = tbl->freehead;
+  tbl->freehead               = slot;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Frees all slots whose values have been collected (only happens
+  within the weak values table).
+
+  @param[in]  L       lua state
+  @param[in]  tbl     handle table
+  @param[in]  values  stack index of values table
+
+*////////////////////////////////////////////////////////////////////////
+static void luacwrap_reftable_sweep(lua_State* L, luacwrap_RefTable* tbl, int values)
+{
+  unsigned int slot;
+
+  for (slot = 1; slot <= tbl->top; ++slot)
+  {
+    if (LUACWRAP_REF_INUSE == tbl->slots[slot].nextfree)
+    {
+      lua_rawgeti(L, values, slot);
+      if (lua_isnil(L, -1))
+      {
+        luacwrap_reftable_free(tbl, slot);
+      }
+      lua_pop(L, 1);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  creates a handle for the value at the given stack index
 
   @param[in]  L       lua state
   @param[in]  index   stack index
+  @param[in]  weak    use the weak values table
+
+  @return handle of the reference (0 for nil)
 
 *////////////////////////////////////////////////////////////////////////
-int luacwrap_createreference(lua_State* L, int index)
+static int luacwrap_reftable_create_handle(lua_State* L, int index, int weak)
 {
-  int ref;
+  luacwrap_RefTable* tbl;
+  unsigned int slot;
   int validx = abs_index(L, index);
 
   LUASTACK_SET(L);
 
-  // get access to _M.reftable
-  getmoduletable(L);
-  lua_getfield(L, -1, g_keyRefTable);
-  assert(lua_istable(L, -1));
+  if (lua_isnil(L, validx))
+  {
+    return 0;
+  }
+
+  tbl = luacwrap_reftable_push(L, weak);
 
+  // reclaim slots of collected values before growing
+  if (weak && !tbl->freehead && (tbl->top + 1 >= tbl->capacity))
+  {
+    luacwrap_reftable_sweep(L, tbl, lua_gettop(L));
+  }
+
+  if (tbl->freehead)
+  {
+    slot = tbl->freehead;
+  }
+  else
+  {
+    if (tbl->top >= LUACWRAP_REF_SLOTMASK)
+    {
+      luaL_error(L, "luacwrap: too many references");
+    }
+
+    // grow slot array
+    if (tbl->top + 1 >= tbl->capacity)
+    {
+      unsigned int capacity = tbl->capacity ? 2 * tbl->capacity : LUACWRAP_REF_MINCAPACITY;
+      luacwrap_RefSlot* slots;
+
+      if (capacity > LUACWRAP_REF_SLOTMASK + 1)
+      {
+        capacity = LUACWRAP_REF_SLOTMASK + 1;
+      }
+
+      slots = (luacwrap_RefSlot*)realloc(tbl->slots, capacity * sizeof(luacwrap_RefSlot));
+      if (NULL == slots)
+      {
+        luaL_error(L, "luacwrap: not enough memory for references");
+      }
+      tbl->slots    = slots;
+      tbl->capacity = capacity;
+    }
+
+    slot = tbl->top + 1;
+    tbl->slots[slot].generation = 0;
+    tbl->slots[slot].nextfree   = 0;
+  }
+
+  // values[slot] = value
   lua_pushvalue(L, validx);
-  ref = luaL_ref(L, -2);
+  lua_rawseti(L, -2, slot);
+
+  // take slot
+  if (slot == tbl->freehead)
+  {
+    tbl->freehead = tbl->slots[slot].nextfree;
+  }
+  else
+  {
+    tbl->top = slot;
+  }
+  tbl->slots[slot].nextfree = LUACWRAP_REF_INUSE;
 
-  // pop _M and _M.reftable
-  lua_pop(L, 2);
+  // pop values table
+  lua_pop(L, 1);
 
   LUASTACK_CLEAN(L, 0);
-  return ref;
+  return (int)((tbl->slots[slot].generation << LUACWRAP_REF_SLOTBITS) | slot);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  pushes the value of a handle
+
+  @return 1 if the handle is valid, 0 if it is stale (nil is pushed)
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_reftable_get(lua_State* L, int handle, int weak)
+{
+  luacwrap_RefTable* tbl  = luacwrap_reftable_push(L, weak);
+  unsigned int       slot = luacwrap_reftable_slot(tbl, handle);
+
+  if (slot)
+  {
+    // replace values table by value
+    lua_rawgeti(L, -1, slot);
+    lua_replace(L, -2);
+    return 1;
+  }
+
+  lua_pop(L, 1);
+  lua_pushnil(L);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  releases a handle
+
+  @return 1 if the handle has been released, 0 if it is stale
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_reftable_release(lua_State* L, int handle, int weak)
+{
+  luacwrap_RefTable* tbl  = luacwrap_reftable_push(L, weak);
+  unsigned int       slot = luacwrap_reftable_slot(tbl, handle);
+
+  if (slot)
+  {
+    // values[slot] = nil
+    lua_pushnil(L);
+    lua_rawseti(L, -2, slot);
+
+    luacwrap_reftable_free(tbl, slot);
+  }
+
+  // pop values table
+  lua_pop(L, 1);
+
+  return (0 != slot);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  creates a reference in the reference table
+
+  @param[in]  L       lua state
+  @param[in]  index   stack index
+
+  @return handle of the reference (0 for nil)
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_createreference(lua_State* L, int index)
+{
+  return luacwrap_reftable_create_handle(L, index, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  creates a weak reference which does not keep the value alive
+
+  @param[in]  L       lua state
+  @param[in]  index   stack index
+
+  @return handle of the weak reference (0 for nil)
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_createweakreference(lua_State* L, int index)
+{
+  return luacwrap_reftable_create_handle(L, index, 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  pushes the value of a weak reference
+
+  @param[in]  L       lua state
+  @param[in]  handle  handle of the weak reference
+
+  @return 1 if the value is still alive, otherwise 0 (nil is pushed)
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_getweakreference(lua_State* L, int handle)
+{
+  luacwrap_reftable_get(L, handle, 1);
+  return !lua_isnil(L, -1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  releases a weak reference (stale handles are ignored)
+
+  @param[in]  L       lua state
+  @param[in]  handle  handle of the weak reference
+
+*////////////////////////////////////////////////////////////////////////
+void luacwrap_releaseweakreference(lua_State* L, int handle)
+{
+  luacwrap_reftable_release(L, handle, 1);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -91,22 +482,17 @@ int luacwrap_createreference(lua_State* L, int index)
 *////////////////////////////////////////////////////////////////////////
 int luacwrap_release_reference(lua_State *L)
 {
-  int* pref = luacwrap_toreference(L, 1);
+  luacwrap_RefObject* pref = luacwrap_toreference(L, 1);
 
   LUASTACK_SET(L);
 
-  if (pref && (*pref))
+  if (pref && pref->handle)
   {
-    // get access to _M.reftable
-    getmoduletable(L);
-    lua_getfield(L, -1, g_keyRefTable);
-    assert(lua_istable(L, -1));
-
-    lua_pushnil(L);
-    lua_rawseti(L, -2, *pref);
-
-    // remove _M and _M.reftable
-    lua_pop(L, 2);
+    // releasing a collected weak reference is fine
+    if (!luacwrap_reftable_release(L, pref->handle, pref->weak) && !pref->weak)
+    {
+      luaL_error(L, "luacwrap: release of stale reference");
+    }
   }
 
   LUASTACK_CLEAN(L, 0);
@@ -123,7 +509,7 @@ int luacwrap_release_reference(lua_State *L)
 *////////////////////////////////////////////////////////////////////////
 int luacwrap_reference_index(lua_State *L)
 {
-  int* pref = luacwrap_toreference(L, 1);
+  luacwrap_RefObject* pref = luacwrap_toreference(L, 1);
 
   LUASTACK_SET(L);
 
@@ -132,16 +518,18 @@ int luacwrap_reference_index(lua_State *L)
     const char* stridx = lua_tostring(L, 2);
     if (0 == strcmp(stridx, "value"))
     {
-      // get access to _M.reftable
-      getmoduletable(L);
-      lua_getfield(L, -1, g_keyRefTable);
-      assert(lua_istable(L, -1));
-
-      lua_rawgeti(L, -1, *pref);
-
-      // remove _M and _M.reftable
-      lua_replace(L, -3);
-      lua_pop(L, 1);
+      if (pref->handle)
+      {
+        // weak references to collected values return nil
+        if (!luacwrap_reftable_get(L, pref->handle, pref->weak) && !pref->weak)
+        {
+          luaL_error(L, "luacwrap: access to released reference");
+        }
+      }
+      else
+      {
+        lua_pushnil(L);
+      }
     }
     else if (0 == strcmp(stridx, "release"))
     {
@@ -150,7 +538,7 @@ int luacwrap_reference_index(lua_State *L)
     }
     else if (0 == strcmp(stridx, "ref"))
     {
-      lua_pushinteger(L, *pref);
+      lua_pushinteger(L, pref->handle);
     }
     else
     {
@@ -177,17 +565,19 @@ luaL_Reg g_mtReferences[ ] = {
   pushes a reference object onto the stack
 
   @param[in]  L         lua state
-  @param[in]  reference reference index
+  @param[in]  reference reference handle
+  @param[in]  weak      handle of a weak reference
 
 *////////////////////////////////////////////////////////////////////////
-int luacwrap_pushreference(lua_State* L, int reference)
+static int luacwrap_pushrefobject(lua_State* L, int reference, int weak)
 {
-  int* ud;
+  luacwrap_RefObject* ud;
 
   LUASTACK_SET(L);
 
-  ud = lua_newuserdata(L, sizeof(int*));
-  *ud = reference;
+  ud = (luacwrap_RefObject*)lua_newuserdata(L, sizeof(luacwrap_RefObject));
+  ud->handle = reference;
+  ud->weak   = weak;
   lua_pushlightuserdata(L, g_mtReferences);
   lua_rawget(L, LUA_REGISTRYINDEX);
   lua_setmetatable(L, -2);
@@ -196,6 +586,20 @@ int luacwrap_pushreference(lua_State* L, int reference)
   return 1;
 }
 
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  pushes a reference object onto the stack
+
+  @param[in]  L         lua state
+  @param[in]  reference reference handle
+
+*////////////////////////////////////////////////////////////////////////
+int luacwrap_pushreference(lua_State* L, int reference)
+{
+  return luacwrap_pushrefobject(L, reference, 0);
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 /**
@@ -248,3 +652,54 @@ luacwrap_BasicType regType_Reference =
   luacwrap_reference_get,
   luacwrap_reference_set
 };
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements set method for weak references.
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_weakreference_set(luacwrap_BasicType* self, lua_State *L, PBYTE pData, int offset)
+{
+  int* v = (int*)pData;
+
+  LUASTACK_SET(L);
+
+  *v = luacwrap_createweakreference(L, -1);
+
+  LUASTACK_CLEAN(L, 0);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Implements get method for weak references.
+
+*////////////////////////////////////////////////////////////////////////
+static int luacwrap_weakreference_get(luacwrap_BasicType* self, lua_State *L, PBYTE pData, int offset)
+{
+  int* v = (int*)pData;
+  return luacwrap_pushrefobject(L, *v, 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/**
+
+  Weak references do not keep the referenced lua object alive. Once
+  the object has been collected the value of the reference is nil.
+  Only collectable objects (tables, userdata, functions, threads) are
+  removed from the weak values table, strings and numbers stay alive
+  until the reference is released.
+
+*////////////////////////////////////////////////////////////////////////
+luacwrap_BasicType regType_WeakReference =
+{
+  {
+    LUACWRAP_TC_BASIC,
+    "$wref"
+  },
+  sizeof(int),
+  luacwrap_weakreference_get,
+  luacwrap_weakreference_set
+};
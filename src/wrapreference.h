@@ -16,6 +16,15 @@
 #include "luacwrap_int.h"
 
 
+//
+// layout of reference handles: the lower bits hold the slot index,
+// the upper bits of a positive 32 bit integer the generation of the slot
+//
+#define LUACWRAP_REF_SLOTBITS   22
+#define LUACWRAP_REF_SLOTMASK   ((1u << LUACWRAP_REF_SLOTBITS) - 1)
+#define LUACWRAP_REF_GENMASK    ((1u << (31 - LUACWRAP_REF_SLOTBITS)) - 1)
+
 extern luaL_Reg g_mtReferences[];
 
 extern luacwrap_BasicType regType_Reference;
+extern luacwrap_BasicType regType_WeakReference;